@@ -0,0 +1,366 @@
+#pragma once
+#include "Task.h"
+#include "mpmcqueue.h"
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * C++20 coroutines on top of Timo::Context, so that pipelines like read -> decode -> upload can be written
+ * as straight-line code:
+ *
+ *	Timo::Async<Image> LoadImage(std::wstring path)
+ *	{
+ *		ByteArray bytes = co_await Utility::ReadFileAsync(path);	// suspends, the read runs on the I/O thread
+ *		co_return Decode(bytes);									// resumed on a worker of g_TaskContext
+ *	}
+ *
+ * Async<T> is lazy, it starts when it is awaited, and resumes its awaiter when it finishes. Blocking calls
+ * go through RunIO(), which parks the coroutine instead of a worker while the I/O thread does the call.
+ * SyncWait() drives a coroutine from ordinary code, helping the context while it waits.
+ */
+
+namespace Timo
+{
+	template <typename T = void>
+	class Async;
+
+	namespace Detail
+	{
+		// Hands the thread over to the awaiting coroutine (symmetric transfer), so chains don't grow the stack
+		struct FinalAwaiter
+		{
+			bool await_ready() const noexcept { return false; }
+
+			template <typename Promise>
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+			{
+				if (auto continuation = handle.promise().continuation)
+					return continuation;
+				return std::noop_coroutine();
+			}
+
+			void await_resume() const noexcept { }
+		};
+
+		struct PromiseBase
+		{
+			std::coroutine_handle<> continuation;
+			std::exception_ptr exception;
+
+			std::suspend_always initial_suspend() const noexcept { return {}; }
+			FinalAwaiter final_suspend() const noexcept { return {}; }
+			void unhandled_exception() { exception = std::current_exception(); }
+		};
+
+		template <typename T>
+		struct Promise : PromiseBase
+		{
+			std::optional<T> value;
+
+			Async<T> get_return_object();
+
+			template <typename U>
+			void return_value(U&& result) { value.emplace(std::forward<U>(result)); }
+
+			T Result()
+			{
+				if (exception)
+					std::rethrow_exception(exception);
+				return std::move(*value);
+			}
+		};
+
+		template <>
+		struct Promise<void> : PromiseBase
+		{
+			Async<void> get_return_object();
+
+			void return_void() { }
+
+			void Result()
+			{
+				if (exception)
+					std::rethrow_exception(exception);
+			}
+		};
+
+		// Fire and forget coroutine, starts immediately and frees itself when done
+		struct Detached
+		{
+			struct promise_type
+			{
+				Detached get_return_object() { return {}; }
+				std::suspend_never initial_suspend() const noexcept { return {}; }
+				std::suspend_never final_suspend() const noexcept { return {}; }
+				void return_void() { }
+				void unhandled_exception() { std::terminate(); }
+			};
+		};
+	}
+
+	/**
+	 * Coroutine returning T. Move-only, owns the coroutine frame.
+	 * co_await on it starts it and returns its result (or rethrows its exception).
+	 */
+	template <typename T>
+	class Async
+	{
+	public:
+		using promise_type = Detail::Promise<T>;
+		using Handle = std::coroutine_handle<promise_type>;
+
+		Async() = default;
+		explicit Async(Handle handle) : m_Handle(handle) { }
+		Async(Async&& other) noexcept : m_Handle(std::exchange(other.m_Handle, {})) { }
+		Async& operator=(Async&& other) noexcept
+		{
+			if (this != &other)
+			{
+				Reset();
+				m_Handle = std::exchange(other.m_Handle, {});
+			}
+			return *this;
+		}
+		~Async() { Reset(); }
+
+		Async(const Async&) = delete;
+		Async& operator=(const Async&) = delete;
+
+		bool IsValid() const { return (bool)m_Handle; }
+		bool IsDone() const { return m_Handle && m_Handle.done(); }
+
+		// Only once IsDone()
+		T Result() { return m_Handle.promise().Result(); }
+
+		auto operator co_await() noexcept
+		{
+			struct Awaiter
+			{
+				Handle handle;
+
+				bool await_ready() const noexcept { return handle.done(); }
+				std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+				{
+					handle.promise().continuation = awaiting;
+					return handle;
+				}
+				T await_resume() { return handle.promise().Result(); }
+			};
+			return Awaiter{ m_Handle };
+		}
+
+		// Same as co_await, without taking the result
+		auto WhenReady() noexcept
+		{
+			struct Awaiter
+			{
+				Handle handle;
+
+				bool await_ready() const noexcept { return handle.done(); }
+				std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+				{
+					handle.promise().continuation = awaiting;
+					return handle;
+				}
+				void await_resume() const noexcept { }
+			};
+			return Awaiter{ m_Handle };
+		}
+
+	private:
+		void Reset()
+		{
+			if (m_Handle)
+				m_Handle.destroy();
+			m_Handle = {};
+		}
+
+		Handle m_Handle;
+	};
+
+	namespace Detail
+	{
+		template <typename T>
+		Async<T> Promise<T>::get_return_object() { return Async<T>(std::coroutine_handle<Promise<T>>::from_promise(*this)); }
+
+		inline Async<void> Promise<void>::get_return_object() { return Async<void>(std::coroutine_handle<Promise<void>>::from_promise(*this)); }
+	}
+
+	// co_await Schedule(context) continues the coroutine as a task of the context
+	inline auto Schedule(Context& context)
+	{
+		struct Awaiter
+		{
+			Context& context;
+
+			bool await_ready() const noexcept { return false; }
+			void await_suspend(std::coroutine_handle<> handle) { context.Execute([handle](TaskParams) { handle.resume(); }); }
+			void await_resume() const noexcept { }
+		};
+		return Awaiter{ context };
+	}
+
+	/**
+	 * Thread for blocking calls, file reads mostly, so that they don't occupy the workers of a Context.
+	 * Requests are queued in a MpmcQueue and run in order. The thread starts with the first request.
+	 */
+	class IOService
+	{
+	public:
+		IOService() = default;
+		~IOService()
+		{
+			if (m_Thread.joinable())
+			{
+				m_Requests.Push(nullptr);
+				m_Thread.join();
+			}
+		}
+
+		IOService(const IOService&) = delete;
+		IOService& operator=(const IOService&) = delete;
+
+		void Submit(std::function<void()> request)
+		{
+			std::call_once(m_StartFlag, [this]{ m_Thread = std::thread(&IOService::ThreadEntry, this); });
+			m_Requests.Push(std::move(request));
+		}
+
+	private:
+		void ThreadEntry()
+		{
+			// An empty request stops the thread
+			while (auto request = m_Requests.Pop())
+				request();
+		}
+
+		MpmcQueue<std::function<void()>> m_Requests{ 256 };
+		std::once_flag m_StartFlag;
+		std::thread m_Thread;
+	};
+
+	inline IOService g_IOService;
+
+	/**
+	 * co_await RunIO(context, func) suspends the coroutine, calls func() on the I/O thread and resumes the
+	 * coroutine as a task of the context with the value func() returned.
+	 */
+	template <typename Func>
+	auto RunIO(Context& context, Func func)
+	{
+		using Result = std::invoke_result_t<Func&>;
+		static_assert(!std::is_void_v<Result>, "RunIO() needs a function returning a value");
+
+		struct Awaiter
+		{
+			Context& context;
+			Func func;
+			std::optional<Result> result;
+			std::exception_ptr exception;
+
+			bool await_ready() const noexcept { return false; }
+			void await_suspend(std::coroutine_handle<> handle)
+			{
+				// The awaiter lives in the coroutine frame, which stays put while the coroutine is suspended
+				g_IOService.Submit([this, handle]
+					{
+						try
+						{
+							result.emplace(func());
+						}
+						catch (...)
+						{
+							exception = std::current_exception();
+						}
+						context.Execute([handle](TaskParams) { handle.resume(); });
+					});
+			}
+			Result await_resume()
+			{
+				if (exception)
+					std::rethrow_exception(exception);
+				return std::move(*result);
+			}
+		};
+		return Awaiter{ context, std::move(func), std::nullopt, nullptr };
+	}
+
+	/**
+	 * Awaits all tasks and returns their results in order. They are started one after another on the awaiting
+	 * thread and run concurrently from their first suspension on (Schedule(), RunIO(), ...).
+	 */
+	template <typename T>
+	Async<std::vector<T>> WhenAll(std::vector<Async<T>> tasks)
+	{
+		struct Counter
+		{
+			std::atomic_uint32_t count;
+			std::coroutine_handle<> continuation;
+		};
+
+		struct Awaiter
+		{
+			Counter& counter;
+
+			bool await_ready() const noexcept { return false; }
+			bool await_suspend(std::coroutine_handle<> handle) noexcept
+			{
+				// The extra count is released here, whoever brings it to zero resumes the awaiter
+				counter.continuation = handle;
+				return counter.count.fetch_sub(1, std::memory_order_acq_rel) != 1;
+			}
+			void await_resume() const noexcept { }
+		};
+
+		auto start = [](Async<T>& task, Counter& counter) -> Detail::Detached
+		{
+			co_await task.WhenReady();
+			if (counter.count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				counter.continuation.resume();
+		};
+
+		Counter counter{ (uint32_t)tasks.size() + 1, nullptr };
+		for (auto& task : tasks)
+			start(task, counter);
+		co_await Awaiter{ counter };
+
+		std::vector<T> results;
+		results.reserve(tasks.size());
+		for (auto& task : tasks)
+			results.push_back(task.Result());
+		co_return results;
+	}
+
+	/**
+	 * Runs the task to completion and returns its result, for code outside of coroutines. The calling thread
+	 * runs queued tasks of the context while it waits, so it can also be used on a worker.
+	 */
+	template <typename T>
+	T SyncWait(Context& context, Async<T> task)
+	{
+		std::atomic_bool bDone{ false };
+
+		auto start = [](Async<T>& task, std::atomic_bool& bDone) -> Detail::Detached
+		{
+			co_await task.WhenReady();
+			// Last access to this frame's arguments, the waiting thread may return right after
+			bDone.store(true, std::memory_order_release);
+		};
+		start(task, bDone);
+
+		while (!bDone.load(std::memory_order_acquire))
+		{
+			if (!context.RunPendingTask())
+				std::this_thread::yield();
+		}
+		return task.Result();
+	}
+}
@@ -1,8 +1,14 @@
 #include "CommandListManager.h"
 #include "Graphics.h"
+#include "Telemetry.h"
+#include <chrono>
 
 using namespace MyDirectX;
 
+// CPU blocked on the GPU, by any queue
+static StatCounter s_FenceWaits("CommandQueue.FenceWaits");
+static StatCounter s_FenceWaitMicroseconds("CommandQueue.FenceWaitMicroseconds");
+
 CommandQueue::CommandQueue(D3D12_COMMAND_LIST_TYPE type)
 	: m_Type(type), 
 	m_CommandQueue(nullptr), 
@@ -105,11 +111,16 @@ void CommandQueue::WaitForFence(uint64_t fenceValue)
 	// the fence can only have one event set on completion, then thread B has to wait for 
 	// 100 before it knows 99 is ready.  Maybe insert sequential events?
 	{
+		const auto start = std::chrono::steady_clock::now();
+
 		std::lock_guard<std::mutex> lockGuard(m_EventMutex);
 
 		m_pFence->SetEventOnCompletion(fenceValue, m_FenceEventHandle);
 		WaitForSingleObject(m_FenceEventHandle, INFINITE);
 		m_LastCompletedFenceValue = fenceValue;
+
+		s_FenceWaits.Add();
+		s_FenceWaitMicroseconds.Add(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
 	}
 }
 
@@ -0,0 +1,315 @@
+#include "CpuProfiler.h"
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+#include <ostream>
+#include <string_view>
+#include <unordered_map>
+
+using namespace Timo;
+
+CpuProfiler Timo::g_CpuProfiler{};
+
+static void WriteJsonString(std::ostream& out, std::string_view str)
+{
+	out << '"';
+	for (char c : str)
+	{
+		if (c == '"' || c == '\\')
+			out << '\\' << c;
+		else if ((unsigned char)c < 0x20)
+			out << ' ';
+		else
+			out << c;
+	}
+	out << '"';
+}
+
+// Chrome traces are in us, keep the ns as decimals
+static void WriteMicroseconds(std::ostream& out, uint64_t ns)
+{
+	char buffer[32];
+	std::snprintf(buffer, sizeof(buffer), "%" PRIu64 ".%03u", ns / 1000, (uint32_t)(ns % 1000));
+	out << buffer;
+}
+
+CpuProfiler::CpuProfiler()
+{
+	m_FrameBegins[0] = Now();
+}
+
+uint64_t CpuProfiler::Now()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+CpuProfiler::ThreadBuffer& CpuProfiler::GetThreadBuffer()
+{
+	// Hands the buffer back when the thread exits
+	struct ThreadSlot
+	{
+		CpuProfiler* owner = nullptr;
+		ThreadBuffer* buffer = nullptr;
+
+		~ThreadSlot()
+		{
+			if (buffer != nullptr)
+				ReleaseThreadBuffer(buffer);
+		}
+	};
+	static thread_local ThreadSlot t_Slot;
+
+	if (t_Slot.owner == this && t_Slot.buffer->state.load(std::memory_order_acquire) == kInUse)
+		return *t_Slot.buffer;
+	if (t_Slot.buffer != nullptr)
+		ReleaseThreadBuffer(t_Slot.buffer);
+
+	// First marker of this thread, a buffer of an exited thread keeps its index but not its events
+	ThreadBuffer* buffer = nullptr;
+	{
+		std::lock_guard lock(m_Mutex);
+		for (ThreadBuffer* freeBuffer : m_Threads)
+		{
+			// Only claimed under the lock, exiting threads move buffers from kInUse to kFree without it
+			uint32_t state = kFree;
+			if (freeBuffer->state.compare_exchange_strong(state, kInUse, std::memory_order_acq_rel))
+			{
+				buffer = freeBuffer;
+				buffer->firstEvent.store(buffer->count.load(std::memory_order_relaxed), std::memory_order_release);
+				break;
+			}
+		}
+		if (buffer == nullptr)
+		{
+			buffer = new ThreadBuffer();
+			buffer->threadIndex = (uint32_t)m_Threads.size();
+			m_Threads.push_back(buffer);
+		}
+		buffer->name = "Thread " + std::to_string(buffer->threadIndex);
+	}
+	t_Slot.owner = this;
+	t_Slot.buffer = buffer;
+	return *buffer;
+}
+
+void CpuProfiler::ReleaseThreadBuffer(ThreadBuffer* buffer)
+{
+	uint32_t state = kInUse;
+	if (!buffer->state.compare_exchange_strong(state, kFree, std::memory_order_acq_rel))
+	{
+		// Detached, the profiler no longer knows it
+		delete buffer;
+	}
+}
+
+void CpuProfiler::Shutdown()
+{
+	std::lock_guard lock(m_Mutex);
+	for (ThreadBuffer* buffer : m_Threads)
+	{
+		// A live thread may still write to its buffer, it frees it itself
+		uint32_t state = kInUse;
+		if (!buffer->state.compare_exchange_strong(state, kDetached, std::memory_order_acq_rel))
+			delete buffer;
+	}
+	m_Threads.clear();
+}
+
+void CpuProfiler::SetThreadName(const std::string& name)
+{
+	ThreadBuffer& buffer = GetThreadBuffer();
+
+	std::lock_guard lock(m_Mutex);
+	buffer.name = name;
+}
+
+void CpuProfiler::MarkFrame()
+{
+	const uint64_t now = Now();
+
+	std::lock_guard lock(m_Mutex);
+	++m_FrameIndex;
+	m_FrameBegins[m_FrameIndex % kFrameCapacity] = now;
+}
+
+uint64_t CpuProfiler::GetFrameIndex() const
+{
+	std::lock_guard lock(m_Mutex);
+	return m_FrameIndex;
+}
+
+void CpuProfiler::Record(const char* name, uint64_t beginNs, uint64_t endNs, uint32_t depth)
+{
+	ThreadBuffer& buffer = GetThreadBuffer();
+	const uint64_t index = buffer.count.load(std::memory_order_relaxed);
+	Event& event = buffer.events[index & (kEventCapacity - 1)];
+
+	// Seqlock style: a reader that sees any of the new fields also sees a count telling it the slot was reused
+	std::atomic_thread_fence(std::memory_order_release);
+	event.name.store(name, std::memory_order_relaxed);
+	event.beginNs.store(beginNs, std::memory_order_relaxed);
+	event.endNs.store(endNs, std::memory_order_relaxed);
+	event.depth.store(depth, std::memory_order_relaxed);
+	buffer.count.store(index + 1, std::memory_order_release);
+}
+
+void CpuProfiler::CollectEvents(uint64_t beginNs, uint64_t endNs, std::vector<EventCopy>& events) const
+{
+	std::vector<ThreadBuffer*> threads;
+	{
+		std::lock_guard lock(m_Mutex);
+		threads = m_Threads;
+	}
+
+	for (const ThreadBuffer* buffer : threads)
+	{
+		const uint64_t count = buffer->count.load(std::memory_order_acquire);
+		const uint64_t first = std::max(count > kEventCapacity ? count - kEventCapacity : 0,
+			buffer->firstEvent.load(std::memory_order_acquire));
+
+		const size_t copyBegin = events.size();
+		for (uint64_t i = first; i < count; ++i)
+		{
+			const Event& event = buffer->events[i & (kEventCapacity - 1)];
+			EventCopy copy;
+			copy.name = event.name.load(std::memory_order_relaxed);
+			copy.beginNs = event.beginNs.load(std::memory_order_relaxed);
+			copy.endNs = event.endNs.load(std::memory_order_relaxed);
+			copy.depth = event.depth.load(std::memory_order_relaxed);
+			copy.threadIndex = buffer->threadIndex;
+			events.push_back(copy);
+		}
+
+		// Slots the writer got to while they were copied are torn, drop them
+		std::atomic_thread_fence(std::memory_order_acquire);
+		const uint64_t countAfter = buffer->count.load(std::memory_order_relaxed);
+		const uint64_t valid = countAfter > kEventCapacity ? countAfter - kEventCapacity + 1 : 0;
+		const size_t torn = (size_t)std::min(count, std::max(valid, first)) - (size_t)first;
+
+		auto it = std::remove_if(events.begin() + copyBegin + torn, events.end(), [=](const EventCopy& event)
+			{
+				return event.beginNs < beginNs || event.beginNs >= endNs;
+			});
+		events.erase(it, events.end());
+		events.erase(events.begin() + copyBegin, events.begin() + copyBegin + torn);
+	}
+}
+
+bool CpuProfiler::GetFrameSpan(uint64_t& firstFrame, uint64_t& lastFrame, uint64_t& beginNs, uint64_t& endNs) const
+{
+	std::lock_guard lock(m_Mutex);
+
+	// Frame i ends where frame i + 1 begins, the one in progress ends now
+	const uint64_t oldest = m_FrameIndex >= kFrameCapacity - 1 ? m_FrameIndex - (kFrameCapacity - 1) : 0;
+	firstFrame = std::max(firstFrame, oldest);
+	lastFrame = std::min(lastFrame, m_FrameIndex);
+	if (firstFrame > lastFrame)
+		return false;
+
+	beginNs = m_FrameBegins[firstFrame % kFrameCapacity];
+	endNs = lastFrame < m_FrameIndex ? m_FrameBegins[(lastFrame + 1) % kFrameCapacity] : Now();
+	return true;
+}
+
+bool CpuProfiler::GetFrameStats(uint64_t frameIndex, CpuFrameStats& stats) const
+{
+	if (frameIndex >= GetFrameIndex())
+		return false;
+
+	uint64_t firstFrame = frameIndex, lastFrame = frameIndex;
+	if (!GetFrameSpan(firstFrame, lastFrame, stats.beginNs, stats.endNs) || firstFrame != frameIndex)
+		return false;
+	stats.frameIndex = frameIndex;
+
+	std::vector<EventCopy> events;
+	CollectEvents(stats.beginNs, stats.endNs, events);
+
+	// The same name may be different literals in different translation units, group by content
+	std::unordered_map<std::string_view, CpuMarkerStats> byName;
+	for (const EventCopy& event : events)
+	{
+		CpuMarkerStats& marker = byName[event.name];
+		const uint64_t duration = event.endNs - event.beginNs;
+		marker.name = event.name;
+		++marker.count;
+		marker.totalNs += duration;
+		marker.maxNs = std::max(marker.maxNs, duration);
+	}
+
+	stats.markers.clear();
+	stats.markers.reserve(byName.size());
+	for (const auto& [name, marker] : byName)
+		stats.markers.push_back(marker);
+	std::sort(stats.markers.begin(), stats.markers.end(), [](const CpuMarkerStats& a, const CpuMarkerStats& b) { return a.totalNs > b.totalNs; });
+	return true;
+}
+
+void CpuProfiler::WriteChromeTrace(std::ostream& out, uint64_t firstFrame, uint64_t lastFrame) const
+{
+	out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+
+	uint64_t beginNs = 0, endNs = 0;
+	if (!GetFrameSpan(firstFrame, lastFrame, beginNs, endNs))
+	{
+		out << "]}\n";
+		return;
+	}
+
+	std::vector<EventCopy> events;
+	CollectEvents(beginNs, endNs, events);
+
+	std::vector<std::string> threadNames;
+	uint64_t frameBegins[kFrameCapacity + 1];
+	{
+		std::lock_guard lock(m_Mutex);
+		for (const ThreadBuffer* buffer : m_Threads)
+			threadNames.push_back(buffer->name);
+		for (uint64_t frame = firstFrame; frame <= lastFrame; ++frame)
+			frameBegins[frame - firstFrame] = m_FrameBegins[frame % kFrameCapacity];
+	}
+	frameBegins[lastFrame - firstFrame + 1] = endNs;
+
+	// Frames get their own track (tid 0), threads follow
+	out << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"Frames\"}}";
+	for (size_t i = 0; i < threadNames.size(); ++i)
+	{
+		out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << i + 1 << ",\"args\":{\"name\":";
+		WriteJsonString(out, threadNames[i]);
+		out << "}}";
+	}
+
+	for (uint64_t frame = firstFrame; frame <= lastFrame; ++frame)
+	{
+		const uint64_t frameBegin = frameBegins[frame - firstFrame];
+		const uint64_t frameEnd = frameBegins[frame - firstFrame + 1];
+		out << ",\n{\"name\":\"Frame " << frame << "\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":";
+		WriteMicroseconds(out, frameBegin - beginNs);
+		out << ",\"dur\":";
+		WriteMicroseconds(out, frameEnd - frameBegin);
+		out << "}";
+	}
+
+	for (const EventCopy& event : events)
+	{
+		out << ",\n{\"name\":";
+		WriteJsonString(out, event.name);
+		out << ",\"ph\":\"X\",\"pid\":0,\"tid\":" << event.threadIndex + 1 << ",\"ts\":";
+		WriteMicroseconds(out, event.beginNs - beginNs);
+		out << ",\"dur\":";
+		WriteMicroseconds(out, event.endNs - event.beginNs);
+		out << ",\"args\":{\"depth\":" << event.depth << "}}";
+	}
+	out << "\n]}\n";
+}
+
+bool CpuProfiler::ExportChromeTrace(const std::string& filePath, uint64_t firstFrame, uint64_t lastFrame) const
+{
+	std::ofstream file(filePath, std::ios::out | std::ios::trunc);
+	if (!file)
+		return false;
+
+	WriteChromeTrace(file, firstFrame, lastFrame);
+	return (bool)file;
+}
@@ -0,0 +1,176 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Compile the CPU markers out with TIMO_CPU_PROFILER=0, they cost two clock reads and one ring write otherwise
+#ifndef TIMO_CPU_PROFILER
+#define TIMO_CPU_PROFILER 1
+#endif
+
+#define TIMO_PROFILE_CONCAT_IMPL(a, b) a##b
+#define TIMO_PROFILE_CONCAT(a, b) TIMO_PROFILE_CONCAT_IMPL(a, b)
+
+#if TIMO_CPU_PROFILER
+// Times the enclosing scope. name has to outlive the profiler, a string literal mostly
+#define CPU_PROFILE_SCOPE(name) Timo::CpuProfileScope TIMO_PROFILE_CONCAT(_cpuProfileScope, __LINE__)(name)
+#else
+#define CPU_PROFILE_SCOPE(name) ((void)0)
+#endif
+
+namespace Timo
+{
+	// Totals of one marker name over a frame, nested calls of the same name are counted each
+	struct CpuMarkerStats
+	{
+		const char* name = nullptr;
+		uint32_t count = 0;
+		uint64_t totalNs = 0;
+		uint64_t maxNs = 0;
+	};
+
+	struct CpuFrameStats
+	{
+		uint64_t frameIndex = 0;
+		uint64_t beginNs = 0;
+		uint64_t endNs = 0;
+		std::vector<CpuMarkerStats> markers;	// by descending totalNs
+	};
+
+	/**
+	 * CPU timeline of scoped markers.
+	 * Each thread records into its own ring buffer (single writer, no locks, the oldest events are overwritten),
+	 * readers copy the rings and drop the events that were overwritten while they read. Frames are delimited by
+	 * MarkFrame() on the main loop; stats and chrome://tracing (Perfetto) JSON are built on demand for any of the
+	 * last kFrameCapacity frames whose events are still in the rings.
+	 */
+	class CpuProfiler
+	{
+	public:
+		static constexpr uint32_t kEventCapacity = 1u << 14;	// per thread
+		static constexpr uint32_t kFrameCapacity = 256;
+
+		CpuProfiler();
+
+		CpuProfiler(const CpuProfiler&) = delete;
+		CpuProfiler& operator=(const CpuProfiler&) = delete;
+
+		// Steady clock, in ns
+		static uint64_t Now();
+
+		void SetEnabled(bool bEnabled) { m_bEnabled.store(bEnabled, std::memory_order_relaxed); }
+		bool IsEnabled() const { return m_bEnabled.load(std::memory_order_relaxed); }
+
+		// Frees the buffers of exited threads and detaches those of live threads, which free their own once they record
+		// again (and get a new one) or exit. No stats or trace may be built while it runs
+		void Shutdown();
+
+		// Names the calling thread in the traces
+		void SetThreadName(const std::string& name);
+
+		// Ends the current frame and begins the next one
+		void MarkFrame();
+		// Index of the frame in progress, the frames before it are complete
+		uint64_t GetFrameIndex() const;
+
+		void Record(const char* name, uint64_t beginNs, uint64_t endNs, uint32_t depth);
+
+		// False if the frame is not complete or was dropped from the history
+		bool GetFrameStats(uint64_t frameIndex, CpuFrameStats& stats) const;
+		// Frames [firstFrame, lastFrame]; everything recorded so far with the default range
+		void WriteChromeTrace(std::ostream& out, uint64_t firstFrame = 0, uint64_t lastFrame = UINT64_MAX) const;
+		bool ExportChromeTrace(const std::string& filePath, uint64_t firstFrame = 0, uint64_t lastFrame = UINT64_MAX) const;
+
+	private:
+		struct Event
+		{
+			std::atomic<const char*> name{ nullptr };
+			std::atomic_uint64_t beginNs{ 0 };
+			std::atomic_uint64_t endNs{ 0 };
+			std::atomic_uint32_t depth{ 0 };
+		};
+
+		enum ThreadBufferState : uint32_t
+		{
+			kInUse,
+			kFree,		// its thread exited, goes to the next new thread
+			kDetached,	// dropped by Shutdown() while its thread lived, the thread frees it
+		};
+
+		struct ThreadBuffer
+		{
+			std::unique_ptr<Event[]> events{ new Event[kEventCapacity] };
+			std::atomic_uint64_t count{ 0 };	// events ever written, only the last kEventCapacity are kept
+			std::atomic_uint64_t firstEvent{ 0 };	// the events before it are of an exited thread that had the buffer
+			std::atomic_uint32_t state{ kInUse };
+			uint32_t threadIndex = 0;
+			std::string name;	// guarded by m_Mutex
+		};
+
+		struct EventCopy
+		{
+			const char* name;
+			uint64_t beginNs, endNs;
+			uint32_t depth;
+			uint32_t threadIndex;
+		};
+
+		ThreadBuffer& GetThreadBuffer();
+		// At thread exit, the buffer goes to the next new thread, or is freed if Shutdown() detached it. Doesn't touch
+		// the profiler, which may be gone by then
+		static void ReleaseThreadBuffer(ThreadBuffer* buffer);
+		// Events of all threads that began in [beginNs, endNs)
+		void CollectEvents(uint64_t beginNs, uint64_t endNs, std::vector<EventCopy>& events) const;
+		// Time span of frames [firstFrame, lastFrame] that are still in the history, false if there is none
+		bool GetFrameSpan(uint64_t& firstFrame, uint64_t& lastFrame, uint64_t& beginNs, uint64_t& endNs) const;
+
+		std::atomic_bool m_bEnabled{ true };
+
+		// Thread registration and frames are rare, they take the lock
+		mutable std::mutex m_Mutex;
+		// One per live thread, buffers of exited threads are reused. Only Shutdown() frees them, threads may still
+		// record during static destruction
+		std::vector<ThreadBuffer*> m_Threads;
+		uint64_t m_FrameBegins[kFrameCapacity] = {};	// of frame i at i % kFrameCapacity
+		uint64_t m_FrameIndex = 0;
+	};
+
+	extern CpuProfiler g_CpuProfiler;
+
+	class CpuProfileScope
+	{
+	public:
+		explicit CpuProfileScope(const char* name) : m_Name(name)
+		{
+			if (g_CpuProfiler.IsEnabled())
+			{
+				m_Depth = s_Depth++;
+				m_BeginNs = CpuProfiler::Now();
+			}
+			else
+				m_Name = nullptr;
+		}
+		~CpuProfileScope()
+		{
+			if (m_Name != nullptr)
+			{
+				g_CpuProfiler.Record(m_Name, m_BeginNs, CpuProfiler::Now(), m_Depth);
+				--s_Depth;
+			}
+		}
+
+		CpuProfileScope(const CpuProfileScope&) = delete;
+		CpuProfileScope& operator=(const CpuProfileScope&) = delete;
+
+	private:
+		static inline thread_local uint32_t s_Depth = 0;
+
+		const char* m_Name;
+		uint64_t m_BeginNs = 0;
+		uint32_t m_Depth = 0;
+	};
+}
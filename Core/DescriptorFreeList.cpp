@@ -0,0 +1,274 @@
+#include "DescriptorFreeList.h"
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <ostream>
+#include <utility>
+
+namespace MyDirectX
+{
+	void DescriptorFragmentationReport::Write(std::ostream& out) const
+	{
+		out << "heaps " << heaps << ", descriptors " << descriptors
+			<< ", allocated " << allocatedDescriptors << " in " << allocations << " ranges"
+			<< ", pending " << pendingDescriptors
+			<< ", free " << freeDescriptors << " in " << freeBlocks << " blocks (largest " << largestFreeBlock << ")"
+			<< ", fragmentation " << GetFragmentation() << "\n";
+
+		out << "free blocks by size:";
+		for (uint32_t i = 0; i < kNumSizeClasses; ++i)
+		{
+			if (freeBlocksPerClass[i] != 0)
+				out << " [" << (1u << i) << ", " << (2u << i) << "): " << freeBlocksPerClass[i];
+		}
+		out << "\n";
+	}
+
+	DescriptorFreeList::Stats::Stats(const std::string& prefix)
+		: descriptors(prefix + "Descriptors")
+		, heaps(prefix + "Heaps")
+		, pendingDescriptors(prefix + "PendingFreeDescriptors")
+	{
+	}
+
+	DescriptorFreeList::DescriptorFreeList(DescriptorHeapSource& source, const std::string& statPrefix, uint32_t descriptorsPerHeap)
+		: m_Source(source), m_DescriptorsPerHeap(descriptorsPerHeap), m_Stats(statPrefix)
+	{
+	}
+
+	uint32_t DescriptorFreeList::GetSizeClass(uint32_t count)
+	{
+		return std::min((uint32_t)std::bit_width(count) - 1, kNumSizeClasses - 1);
+	}
+
+	size_t DescriptorFreeList::Allocate(uint32_t count)
+	{
+		assert(count > 0);
+
+		std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+		ProcessPendingFreesLocked();
+
+		// first fit in the own class, its blocks may be too small
+		const uint32_t sizeClass = GetSizeClass(count);
+		uint32_t heapIndex = ~0u, offset = 0, blockCount = 0;
+		for (const auto& [blockHeap, blockOffset] : m_SizeClasses[sizeClass])
+		{
+			const uint32_t freeCount = m_Heaps[blockHeap].freeBlocks.at(blockOffset);
+			if (freeCount >= count)
+			{
+				heapIndex = blockHeap;
+				offset = blockOffset;
+				blockCount = freeCount;
+				break;
+			}
+		}
+
+		// any block of a larger class fits
+		const uint32_t largerClasses = sizeClass + 1 < kNumSizeClasses ? m_NonEmptyClasses & (~0u << (sizeClass + 1)) : 0;
+		if (heapIndex == ~0u && largerClasses != 0)
+		{
+			const auto& block = *m_SizeClasses[std::countr_zero(largerClasses)].begin();
+			heapIndex = block.first;
+			offset = block.second;
+			blockCount = m_Heaps[heapIndex].freeBlocks.at(offset);
+		}
+
+		if (heapIndex == ~0u)
+		{
+			Heap heap;
+			heap.numDescriptors = std::max(count, m_DescriptorsPerHeap);
+			heap.basePtr = m_Source.CreateHeap(heap.numDescriptors);
+			heap.descriptorSize = m_Source.GetDescriptorSize();
+
+			heapIndex = (uint32_t)m_Heaps.size();
+			offset = 0;
+			blockCount = heap.numDescriptors;
+			m_HeapByPtr.emplace(heap.basePtr, heapIndex);
+			m_Heaps.push_back(std::move(heap));
+			InsertFreeBlock(heapIndex, offset, blockCount);
+			m_Stats.heaps.Add();
+		}
+
+		// the front of the block is handed out, the rest stays free
+		RemoveFreeBlock(heapIndex, offset, blockCount);
+		if (blockCount > count)
+			InsertFreeBlock(heapIndex, offset + count, blockCount - count);
+
+		Heap& heap = m_Heaps[heapIndex];
+		heap.allocations.emplace(offset, Allocation{ count, false });
+		m_Stats.descriptors.Add(count);
+
+		return heap.basePtr + (size_t)offset * heap.descriptorSize;
+	}
+
+	void DescriptorFreeList::Free(size_t ptr, uint64_t fenceValue)
+	{
+		std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+		uint32_t heapIndex, offset;
+		auto allocation = FindAllocation(ptr, heapIndex, offset);
+		if (allocation == nullptr)
+		{
+			assert(!"DescriptorFreeList::Free: not an allocated descriptor range, or freed twice");
+			return;
+		}
+
+		if (fenceValue == 0)
+		{
+			Release(heapIndex, offset);
+			return;
+		}
+
+		allocation->pending = true;
+		m_PendingFrees.emplace(fenceValue, heapIndex, offset);
+		m_PendingDescriptors += allocation->count;
+		m_Stats.pendingDescriptors.Add(allocation->count);
+	}
+
+	void DescriptorFreeList::ProcessPendingFrees()
+	{
+		std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+		ProcessPendingFreesLocked();
+	}
+
+	bool DescriptorFreeList::IsAllocated(size_t ptr) const
+	{
+		std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+		uint32_t heapIndex, offset;
+		return FindAllocation(ptr, heapIndex, offset) != nullptr;
+	}
+
+	DescriptorFragmentationReport DescriptorFreeList::GetReport() const
+	{
+		std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+		DescriptorFragmentationReport report;
+		report.heaps = (uint32_t)m_Heaps.size();
+		report.pendingDescriptors = m_PendingDescriptors;
+		for (const Heap& heap : m_Heaps)
+		{
+			report.descriptors += heap.numDescriptors;
+			report.allocations += heap.allocations.size();
+			for (const auto& [offset, allocation] : heap.allocations)
+				report.allocatedDescriptors += allocation.count;
+			for (const auto& [offset, count] : heap.freeBlocks)
+			{
+				report.freeDescriptors += count;
+				report.largestFreeBlock = std::max(report.largestFreeBlock, count);
+				++report.freeBlocksPerClass[GetSizeClass(count)];
+			}
+			report.freeBlocks += heap.freeBlocks.size();
+		}
+		// pending ranges are still in allocations
+		report.allocations -= m_PendingFrees.size();
+		report.allocatedDescriptors -= m_PendingDescriptors;
+		return report;
+	}
+
+	void DescriptorFreeList::Reset()
+	{
+		std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+		m_Heaps.clear();
+		m_HeapByPtr.clear();
+		for (auto& sizeClass : m_SizeClasses)
+			sizeClass.clear();
+		m_NonEmptyClasses = 0;
+		m_PendingFrees = {};
+		m_PendingDescriptors = 0;
+
+		m_Stats.descriptors.Set(0);
+		m_Stats.heaps.Set(0);
+		m_Stats.pendingDescriptors.Set(0);
+	}
+
+	const DescriptorFreeList::Allocation* DescriptorFreeList::FindAllocation(size_t ptr, uint32_t& heapIndex, uint32_t& offset) const
+	{
+		auto iter = m_HeapByPtr.upper_bound(ptr);
+		if (iter == m_HeapByPtr.begin())
+			return nullptr;
+		--iter;
+
+		const Heap& heap = m_Heaps[iter->second];
+		const size_t byteOffset = ptr - heap.basePtr;
+		if (byteOffset % heap.descriptorSize != 0 || byteOffset / heap.descriptorSize >= heap.numDescriptors)
+			return nullptr;
+
+		heapIndex = iter->second;
+		offset = (uint32_t)(byteOffset / heap.descriptorSize);
+		auto allocation = heap.allocations.find(offset);
+		return allocation != heap.allocations.end() && !allocation->second.pending ? &allocation->second : nullptr;
+	}
+
+	DescriptorFreeList::Allocation* DescriptorFreeList::FindAllocation(size_t ptr, uint32_t& heapIndex, uint32_t& offset)
+	{
+		return const_cast<Allocation*>(std::as_const(*this).FindAllocation(ptr, heapIndex, offset));
+	}
+
+	void DescriptorFreeList::InsertFreeBlock(uint32_t heapIndex, uint32_t offset, uint32_t count)
+	{
+		const uint32_t sizeClass = GetSizeClass(count);
+		m_Heaps[heapIndex].freeBlocks.emplace(offset, count);
+		m_SizeClasses[sizeClass].emplace(heapIndex, offset);
+		m_NonEmptyClasses |= 1u << sizeClass;
+	}
+
+	void DescriptorFreeList::RemoveFreeBlock(uint32_t heapIndex, uint32_t offset, uint32_t count)
+	{
+		const uint32_t sizeClass = GetSizeClass(count);
+		m_Heaps[heapIndex].freeBlocks.erase(offset);
+		m_SizeClasses[sizeClass].erase({ heapIndex, offset });
+		if (m_SizeClasses[sizeClass].empty())
+			m_NonEmptyClasses &= ~(1u << sizeClass);
+	}
+
+	void DescriptorFreeList::Release(uint32_t heapIndex, uint32_t offset)
+	{
+		Heap& heap = m_Heaps[heapIndex];
+		auto allocation = heap.allocations.find(offset);
+		uint32_t count = allocation->second.count;
+		heap.allocations.erase(allocation);
+		m_Stats.descriptors.Sub(count);
+
+		// merge with the free neighbours
+		auto next = heap.freeBlocks.lower_bound(offset);
+		if (next != heap.freeBlocks.begin())
+		{
+			auto prev = std::prev(next);
+			if (prev->first + prev->second == offset)
+			{
+				const uint32_t prevOffset = prev->first, prevCount = prev->second;
+				RemoveFreeBlock(heapIndex, prevOffset, prevCount);
+				offset = prevOffset;
+				count += prevCount;
+			}
+		}
+		next = heap.freeBlocks.lower_bound(offset);
+		if (next != heap.freeBlocks.end() && offset + count == next->first)
+		{
+			const uint32_t nextOffset = next->first, nextCount = next->second;
+			RemoveFreeBlock(heapIndex, nextOffset, nextCount);
+			count += nextCount;
+		}
+
+		InsertFreeBlock(heapIndex, offset, count);
+		s_RecycleEpoch.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void DescriptorFreeList::ProcessPendingFreesLocked()
+	{
+		while (!m_PendingFrees.empty() && m_Source.IsFenceComplete(std::get<0>(m_PendingFrees.front())))
+		{
+			const auto [fenceValue, heapIndex, offset] = m_PendingFrees.front();
+			m_PendingFrees.pop();
+
+			const uint32_t count = m_Heaps[heapIndex].allocations.at(offset).count;
+			m_PendingDescriptors -= count;
+			m_Stats.pendingDescriptors.Sub(count);
+			Release(heapIndex, offset);
+		}
+	}
+}
@@ -0,0 +1,134 @@
+#pragma once
+#include "Telemetry.h"
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <set>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace MyDirectX
+{
+	/**
+		Recycling allocator of CPU descriptor ranges, without D3D12. Descriptors live in fixed heaps created by a
+	DescriptorHeapSource, a range is handed out as the CPU handle of its first descriptor and never moves until it
+	is freed. Freed ranges wait for their fence, then go back to the free blocks of their heap, merged with free
+	neighbours.
+		Free blocks are kept in power of 2 size classes (segregated fit, as in TLSF): a request looks for the first
+	block that fits in its own class, otherwise takes any block of the next non-empty class and splits it. Blocks of
+	lower heaps come first, so that the last heaps tend to drain.
+	*/
+	class DescriptorHeapSource
+	{
+	public:
+		virtual ~DescriptorHeapSource() = default;
+
+		// CPU handle (ptr) of the first descriptor of a new heap
+		virtual size_t CreateHeap(uint32_t numDescriptors) = 0;
+		virtual uint32_t GetDescriptorSize() = 0;
+		virtual bool IsFenceComplete(uint64_t fenceValue) = 0;
+	};
+
+	struct DescriptorFragmentationReport
+	{
+		static constexpr uint32_t kNumSizeClasses = 16;
+
+		uint32_t heaps = 0;
+		uint64_t descriptors = 0;			// in all heaps
+		uint64_t allocations = 0;
+		uint64_t allocatedDescriptors = 0;
+		uint64_t pendingDescriptors = 0;	// freed, waiting for their fence
+		uint64_t freeDescriptors = 0;
+		uint64_t freeBlocks = 0;
+		uint32_t largestFreeBlock = 0;
+		uint32_t freeBlocksPerClass[kNumSizeClasses] = {};	// class i holds blocks of [2^i, 2^(i+1)) descriptors
+
+		// 0 when the free descriptors are one block, towards 1 as they get scattered
+		float GetFragmentation() const { return freeDescriptors > 0 ? 1.0f - (float)largestFreeBlock / (float)freeDescriptors : 0.0f; }
+
+		void Write(std::ostream& out) const;
+	};
+
+	class DescriptorFreeList
+	{
+	public:
+		static constexpr uint32_t kNumSizeClasses = DescriptorFragmentationReport::kNumSizeClasses;
+
+		// statPrefix names the telemetry counters, e.g. "DescriptorAllocator.CBV_SRV_UAV."
+		DescriptorFreeList(DescriptorHeapSource& source, const std::string& statPrefix, uint32_t descriptorsPerHeap);
+
+		DescriptorFreeList(const DescriptorFreeList&) = delete;
+		DescriptorFreeList& operator=(const DescriptorFreeList&) = delete;
+
+		// CPU handle (ptr) of count contiguous descriptors, requests larger than a heap get a heap of their own
+		size_t Allocate(uint32_t count);
+		// the range is reused once fenceValue has completed, right away for fence 0
+		void Free(size_t ptr, uint64_t fenceValue);
+		// moves freed ranges whose fence has completed back to the free blocks, Allocate() does it as well
+		void ProcessPendingFrees();
+
+		bool IsAllocated(size_t ptr) const;
+
+		// changes whenever freed descriptors of any free list become reusable, caches of descriptor contents compare it
+		static uint64_t GetRecycleEpoch() { return s_RecycleEpoch.load(std::memory_order_relaxed); }
+
+		DescriptorFragmentationReport GetReport() const;
+
+		// forgets every heap, once the source has released them
+		void Reset();
+
+	private:
+		struct Allocation
+		{
+			uint32_t count;
+			bool pending;	// freed, waiting for its fence
+		};
+
+		struct Heap
+		{
+			size_t basePtr;
+			uint32_t descriptorSize;
+			uint32_t numDescriptors;
+			std::map<uint32_t, uint32_t> freeBlocks;			// offset -> count
+			std::unordered_map<uint32_t, Allocation> allocations;	// offset -> range
+		};
+
+		// "<prefix>*", e.g. "DescriptorAllocator.CBV_SRV_UAV.Descriptors"
+		struct Stats
+		{
+			explicit Stats(const std::string& prefix);
+
+			StatCounter descriptors;		// allocated, pending frees included
+			StatCounter heaps;
+			StatCounter pendingDescriptors;	// freed, waiting for their fence
+		};
+
+		static uint32_t GetSizeClass(uint32_t count);
+
+		// nullptr unless ptr is the first descriptor of a range that is allocated and not freed yet
+		const Allocation* FindAllocation(size_t ptr, uint32_t& heapIndex, uint32_t& offset) const;
+		Allocation* FindAllocation(size_t ptr, uint32_t& heapIndex, uint32_t& offset);
+		void InsertFreeBlock(uint32_t heapIndex, uint32_t offset, uint32_t count);
+		void RemoveFreeBlock(uint32_t heapIndex, uint32_t offset, uint32_t count);
+		void Release(uint32_t heapIndex, uint32_t offset);
+		void ProcessPendingFreesLocked();
+
+		DescriptorHeapSource& m_Source;
+		const uint32_t m_DescriptorsPerHeap;
+		Stats m_Stats;
+		std::vector<Heap> m_Heaps;
+		std::map<size_t, uint32_t> m_HeapByPtr;			// base ptr -> heap index
+		std::set<std::pair<uint32_t, uint32_t>> m_SizeClasses[kNumSizeClasses];	// (heap index, offset)
+		uint32_t m_NonEmptyClasses = 0;
+		std::queue<std::tuple<uint64_t, uint32_t, uint32_t>> m_PendingFrees;	// (fence, heap index, offset)
+		uint64_t m_PendingDescriptors = 0;
+		mutable std::mutex m_Mutex;
+
+		inline static std::atomic_uint64_t s_RecycleEpoch{ 0 };
+	};
+}
@@ -1,4 +1,5 @@
 #include "DescriptorHeap.h"
+#include "Graphics.h"
 // #include "MyApp.h"		// GetDescriptorIncrementSize
 
 namespace MyDirectX
@@ -8,33 +9,93 @@ namespace MyDirectX
 	std::mutex DescriptorAllocator::s_AllocationMutex;
 	std::vector<ComPtr<ID3D12DescriptorHeap>> DescriptorAllocator::s_DescriptorHeapPool;
 
-	D3D12_CPU_DESCRIPTOR_HANDLE DescriptorAllocator::Allocate(ID3D12Device* pDevice, uint32_t count)
+	static std::string GetStatPrefix(D3D12_DESCRIPTOR_HEAP_TYPE type)
 	{
-		if (m_CurrentHeap == nullptr || m_RemainingFreeHandles < count)
+		switch (type)
 		{
-			ASSERT(pDevice != nullptr);
+		case D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV:	return "DescriptorAllocator.CBV_SRV_UAV.";
+		case D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER:		return "DescriptorAllocator.Sampler.";
+		case D3D12_DESCRIPTOR_HEAP_TYPE_RTV:			return "DescriptorAllocator.RTV.";
+		case D3D12_DESCRIPTOR_HEAP_TYPE_DSV:			return "DescriptorAllocator.DSV.";
+		default:										return "DescriptorAllocator.Unknown.";
+		}
+	}
 
-			m_CurrentHeap = RequestNewHeap(pDevice, m_Type);
-			m_CurrentHandle = m_CurrentHeap->GetCPUDescriptorHandleForHeapStart();
-			m_RemainingFreeHandles = s_NumDescriptorsPerHeap;
+	// every allocator, for DestroyAll(). Function local, allocators are static objects of other translation units
+	static std::vector<DescriptorAllocator*>& GetAllocators()
+	{
+		static std::vector<DescriptorAllocator*> s_Allocators;
+		return s_Allocators;
+	}
 
-			if (m_DescriptorSize == 0)
-				m_DescriptorSize = pDevice->GetDescriptorHandleIncrementSize(m_Type);
-		}
+	DescriptorAllocator::DescriptorAllocator(D3D12_DESCRIPTOR_HEAP_TYPE type)
+		: m_Type(type), m_FreeList(*this, GetStatPrefix(type), s_NumDescriptorsPerHeap)
+	{
+		std::lock_guard<std::mutex> lockGuard(s_AllocationMutex);
+		GetAllocators().push_back(this);
+	}
 
-		D3D12_CPU_DESCRIPTOR_HANDLE ret = m_CurrentHandle;
-		m_CurrentHandle.ptr += count * m_DescriptorSize;
-		m_RemainingFreeHandles -= count;
+	DescriptorAllocator::~DescriptorAllocator()
+	{
+		std::lock_guard<std::mutex> lockGuard(s_AllocationMutex);
+		auto& allocators = GetAllocators();
+		allocators.erase(std::find(allocators.begin(), allocators.end(), this));
+	}
 
+	D3D12_CPU_DESCRIPTOR_HANDLE DescriptorAllocator::Allocate(ID3D12Device* pDevice, uint32_t count)
+	{
+		ASSERT(pDevice != nullptr);
+
+		// the device only changes after DestroyAll()
+		ID3D12Device* pCurDevice = nullptr;
+		m_pDevice.compare_exchange_strong(pCurDevice, pDevice, std::memory_order_acq_rel);
+		ASSERT(pCurDevice == nullptr || pCurDevice == pDevice);
+
+		D3D12_CPU_DESCRIPTOR_HANDLE ret;
+		ret.ptr = m_FreeList.Allocate(count);
 		return ret;
 	}
 
+	void DescriptorAllocator::Free(D3D12_CPU_DESCRIPTOR_HANDLE handle, uint64_t fenceValue)
+	{
+		m_FreeList.Free(handle.ptr, fenceValue);
+	}
+
+	size_t DescriptorAllocator::CreateHeap(uint32_t numDescriptors)
+	{
+		return RequestNewHeap(m_pDevice.load(std::memory_order_acquire), m_Type, numDescriptors)->GetCPUDescriptorHandleForHeapStart().ptr;
+	}
+
+	uint32_t DescriptorAllocator::GetDescriptorSize()
+	{
+		// only asked when a heap is created, no need to keep it next to the device
+		return m_pDevice.load(std::memory_order_acquire)->GetDescriptorHandleIncrementSize(m_Type);
+	}
+
+	bool DescriptorAllocator::IsFenceComplete(uint64_t fenceValue)
+	{
+		return Graphics::s_CommandManager.IsFenceComplete(fenceValue);
+	}
+
 	void DescriptorAllocator::DestroyAll()
 	{
+		// not under s_AllocationMutex, the free lists take their own lock before RequestNewHeap() takes it
+		std::vector<DescriptorAllocator*> allocators;
+		{
+			std::lock_guard<std::mutex> lockGuard(s_AllocationMutex);
+			allocators = GetAllocators();
+		}
+		for (DescriptorAllocator* allocator : allocators)
+		{
+			allocator->m_FreeList.Reset();
+			allocator->m_pDevice.store(nullptr, std::memory_order_release);
+		}
+
+		std::lock_guard<std::mutex> lockGuard(s_AllocationMutex);
 		s_DescriptorHeapPool.clear();
 	}
 
-	ID3D12DescriptorHeap* DescriptorAllocator::RequestNewHeap(ID3D12Device* pDevice, D3D12_DESCRIPTOR_HEAP_TYPE type)
+	ID3D12DescriptorHeap* DescriptorAllocator::RequestNewHeap(ID3D12Device* pDevice, D3D12_DESCRIPTOR_HEAP_TYPE type, uint32_t numDescriptors)
 	{
 		ASSERT(pDevice != nullptr);
 
@@ -42,7 +103,7 @@ namespace MyDirectX
 
 		D3D12_DESCRIPTOR_HEAP_DESC heapDesc;
 		heapDesc.Type = type;
-		heapDesc.NumDescriptors = s_NumDescriptorsPerHeap;
+		heapDesc.NumDescriptors = numDescriptors;
 		heapDesc.NodeMask = 1;
 		heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
 
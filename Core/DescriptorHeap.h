@@ -1,5 +1,6 @@
 #pragma once
 #include "pch.h"
+#include "DescriptorFreeList.h"
 #include <queue>
 #include <mutex>
 
@@ -9,30 +10,38 @@ namespace MyDirectX
 		This is an unbounded resource descriptor allocator. It is intended to provide space for CPU-visible
 	resource descriptors as resources are created. For those that need to be made shader-visible, they will
 	need to be copied to a UserDescriptorHeap or a DynamicDescriptorHeap.
+		Freed descriptors are recycled through a DescriptorFreeList, once the fence passed to Free() has completed.
+	This allocator is its D3D12 heap source.
 	*/
-	class DescriptorAllocator
+	class DescriptorAllocator : public DescriptorHeapSource
 	{
 	public:
-		DescriptorAllocator(D3D12_DESCRIPTOR_HEAP_TYPE type) : m_Type(type), m_CurrentHeap(nullptr)
-		{ 
-			m_CurrentHandle.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
-		}
+		DescriptorAllocator(D3D12_DESCRIPTOR_HEAP_TYPE type);
+		~DescriptorAllocator();
 
 		D3D12_CPU_DESCRIPTOR_HANDLE Allocate(ID3D12Device *pDevice, uint32_t count);
+		// fenceValue of Graphics::s_CommandManager after which the descriptors are no longer read, 0 - right away
+		void Free(D3D12_CPU_DESCRIPTOR_HANDLE handle, uint64_t fenceValue);
+
+		DescriptorFragmentationReport GetFragmentationReport() const { return m_FreeList.GetReport(); }
 
 		static void DestroyAll();
 
+		// DescriptorHeapSource
+		size_t CreateHeap(uint32_t numDescriptors) override;
+		uint32_t GetDescriptorSize() override;
+		bool IsFenceComplete(uint64_t fenceValue) override;
+
 	protected:
 		static const uint32_t s_NumDescriptorsPerHeap = 256;
 		static std::mutex s_AllocationMutex;
 		static std::vector<Microsoft::WRL::ComPtr<ID3D12DescriptorHeap>> s_DescriptorHeapPool;
-		static ID3D12DescriptorHeap* RequestNewHeap(ID3D12Device *pDevice, D3D12_DESCRIPTOR_HEAP_TYPE type);
+		static ID3D12DescriptorHeap* RequestNewHeap(ID3D12Device *pDevice, D3D12_DESCRIPTOR_HEAP_TYPE type, uint32_t numDescriptors);
 
 		D3D12_DESCRIPTOR_HEAP_TYPE m_Type;
-		ID3D12DescriptorHeap* m_CurrentHeap;
-		D3D12_CPU_DESCRIPTOR_HANDLE m_CurrentHandle;
-		uint32_t m_DescriptorSize = 0;
-		uint32_t m_RemainingFreeHandles = 0;
+		// set by the first Allocate() after DestroyAll(), read by the DescriptorHeapSource callbacks under the free list's lock
+		std::atomic<ID3D12Device*> m_pDevice{ nullptr };
+		DescriptorFreeList m_FreeList;
 	};
 
 	// This handle refers to a descriptor or a descriptor table (contiguous descriptors) that is shader visible
@@ -0,0 +1,81 @@
+#include "DescriptorTableHashCache.h"
+#include "Hash.h"
+#include <bit>
+
+namespace MyDirectX
+{
+	size_t DescriptorTableHashCache::HashTable(const size_t* tableHandles, uint32_t assignedBitMap)
+	{
+		static_assert(sizeof(size_t) % sizeof(uint32_t) == 0, "Handles are hashed as 32-bit words");
+
+		size_t hash = Utility::HashState(&assignedBitMap);
+
+		// one range per run of assigned slots
+		uint64_t slots = assignedBitMap;
+		while (slots != 0)
+		{
+			const int first = std::countr_zero(slots);
+			const int count = std::countr_one(slots >> first);
+			hash = Utility::HashRange((const uint32_t*)(tableHandles + first), (const uint32_t*)(tableHandles + first + count), hash);
+			slots &= ~(((1ull << count) - 1) << first);
+		}
+		return hash;
+	}
+
+	uint64_t DescriptorTableHashCache::Find(size_t hash, const size_t* tableHandles, uint32_t assignedBitMap) const
+	{
+		for (uint32_t i = (uint32_t)hash & (kCapacity - 1); m_Entries[i].gpuPtr != 0; i = (i + 1) & (kCapacity - 1))
+		{
+			const Entry& entry = m_Entries[i];
+			if (entry.hash == hash && IsEqual(entry, tableHandles, assignedBitMap))
+				return entry.gpuPtr;
+		}
+		return 0;
+	}
+
+	void DescriptorTableHashCache::Insert(size_t hash, const size_t* tableHandles, uint32_t assignedBitMap, uint64_t gpuPtr)
+	{
+		// keep the probes short
+		if (m_Size >= kCapacity * 3 / 4)
+			Clear();
+
+		uint32_t i = (uint32_t)hash & (kCapacity - 1);
+		while (m_Entries[i].gpuPtr != 0)
+			i = (i + 1) & (kCapacity - 1);
+
+		Entry& entry = m_Entries[i];
+		entry.hash = hash;
+		entry.gpuPtr = gpuPtr;
+		entry.assignedBitMap = assignedBitMap;
+		entry.firstHandle = (uint32_t)m_Handles.size();
+		for (uint64_t slots = assignedBitMap; slots != 0; slots &= slots - 1)
+			m_Handles.push_back(tableHandles[std::countr_zero(slots)]);
+		++m_Size;
+	}
+
+	void DescriptorTableHashCache::Clear()
+	{
+		if (m_Size == 0)
+			return;
+
+		for (Entry& entry : m_Entries)
+			entry.gpuPtr = 0;
+		m_Handles.clear();
+		m_Size = 0;
+		++m_Generation;
+	}
+
+	bool DescriptorTableHashCache::IsEqual(const Entry& entry, const size_t* tableHandles, uint32_t assignedBitMap) const
+	{
+		if (entry.assignedBitMap != assignedBitMap)
+			return false;
+
+		const size_t* handles = m_Handles.data() + entry.firstHandle;
+		for (uint64_t slots = assignedBitMap; slots != 0; slots &= slots - 1)
+		{
+			if (*handles++ != tableHandles[std::countr_zero(slots)])
+				return false;
+		}
+		return true;
+	}
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace MyDirectX
+{
+	/**
+		The descriptor tables a DynamicDescriptorHeap has copied to its current shader-visible heap, so that a table
+	staged again with the same CPU handles is bound to the earlier copy instead of being copied once more.
+		A table is identified by its assigned slots (the bit map) and the CPU handles in them, hashed with
+	Utility::HashRange. Entries point into the current heap only, the owner clears the cache when it moves to another
+	heap or its command list is done. When the cache fills up it starts over.
+		Handles are the D3D12_CPU_DESCRIPTOR_HANDLE / D3D12_GPU_DESCRIPTOR_HANDLE ptr values, nothing here needs a device.
+	*/
+	class DescriptorTableHashCache
+	{
+	public:
+		static constexpr uint32_t kCapacity = 256;
+
+		// tableHandles are slots [0, 32) of a table, only the ones in assignedBitMap are read
+		static size_t HashTable(const size_t* tableHandles, uint32_t assignedBitMap);
+
+		// GPU handle of an identical table copied before, 0 if there is none
+		uint64_t Find(size_t hash, const size_t* tableHandles, uint32_t assignedBitMap) const;
+		void Insert(size_t hash, const size_t* tableHandles, uint32_t assignedBitMap, uint64_t gpuPtr);
+		void Clear();
+
+		uint32_t GetSize() const { return m_Size; }
+		// changes whenever the entries are dropped, a table bound in the same generation can be bound again as it is
+		uint64_t GetGeneration() const { return m_Generation; }
+
+	private:
+		struct Entry
+		{
+			size_t hash;
+			uint64_t gpuPtr;			// 0 - empty
+			uint32_t assignedBitMap;
+			uint32_t firstHandle;		// into m_Handles, one per assigned slot
+		};
+
+		bool IsEqual(const Entry& entry, const size_t* tableHandles, uint32_t assignedBitMap) const;
+
+		Entry m_Entries[kCapacity] = {};
+		std::vector<size_t> m_Handles;
+		uint32_t m_Size = 0;
+		uint64_t m_Generation = 1;
+	};
+}
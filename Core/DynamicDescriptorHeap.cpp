@@ -3,6 +3,7 @@
 #include "CommandListManager.h"
 #include "CommandContext.h"
 #include "RootSignature.h"
+#include "Telemetry.h"
 
 namespace MyDirectX
 {
@@ -10,6 +11,40 @@ namespace MyDirectX
 	std::vector<Microsoft::WRL::ComPtr<ID3D12DescriptorHeap>> DynamicDescriptorHeap::s_DescriptorHeapPool[2];
 	std::queue<std::pair<uint64_t, ID3D12DescriptorHeap*>> DynamicDescriptorHeap::s_RetiredDescriptorHeaps[2];
 	std::queue<ID3D12DescriptorHeap*> DynamicDescriptorHeap::s_AvailableDescriptorHeaps[2];
+	bool DynamicDescriptorHeap::s_bEnableTableCache = false;
+
+	namespace
+	{
+		// "DynamicDescriptorHeap.CBV_SRV_UAV.*", "DynamicDescriptorHeap.Sampler.*", indexed like the pools
+		struct HeapStats
+		{
+			explicit HeapStats(const std::string& prefix)
+				: heaps(prefix + "Heaps")
+				, availableHeaps(prefix + "AvailableHeaps")
+				, retiredHeaps(prefix + "RetiredHeaps")
+				, heapRequests(prefix + "HeapRequests")
+				, fenceBlocked(prefix + "FenceBlocked")
+				, descriptorsCopied(prefix + "DescriptorsCopied")
+				, descriptorsReused(prefix + "DescriptorsReused")
+			{
+			}
+
+			StatCounter heaps;
+			StatCounter availableHeaps;
+			StatCounter retiredHeaps;		// waiting for their fence
+			StatCounter heapRequests;
+			StatCounter fenceBlocked;		// heaps created while retired heaps were still in flight
+			StatCounter descriptorsCopied;	// into the shader-visible heaps
+			StatCounter descriptorsReused;	// tables bound to an earlier copy instead
+		};
+
+		HeapStats s_HeapStats[2] = { HeapStats("DynamicDescriptorHeap.CBV_SRV_UAV."), HeapStats("DynamicDescriptorHeap.Sampler.") };
+
+		HeapStats& GetHeapStats(D3D12_DESCRIPTOR_HEAP_TYPE type)
+		{
+			return s_HeapStats[type == D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER ? 1 : 0];
+		}
+	}
 
 	ID3D12DescriptorHeap* DynamicDescriptorHeap::RequestDescriptorHeap(D3D12_DESCRIPTOR_HEAP_TYPE type)
 	{
@@ -23,14 +58,24 @@ namespace MyDirectX
 			s_RetiredDescriptorHeaps[idx].pop();
 		}
 
+		HeapStats& stats = s_HeapStats[idx];
+		stats.heapRequests.Add();
+
 		if (!s_AvailableDescriptorHeaps[idx].empty())
 		{
 			ID3D12DescriptorHeap* pHeap = s_AvailableDescriptorHeaps[idx].front();
 			s_AvailableDescriptorHeaps[idx].pop();
+			stats.availableHeaps.Set((int64_t)s_AvailableDescriptorHeaps[idx].size());
+			stats.retiredHeaps.Set((int64_t)s_RetiredDescriptorHeaps[idx].size());
 			return pHeap;
 		}
 		else
 		{
+			if (!s_RetiredDescriptorHeaps[idx].empty())
+				stats.fenceBlocked.Add();
+			stats.heaps.Add();
+			stats.retiredHeaps.Set((int64_t)s_RetiredDescriptorHeaps[idx].size());
+
 			D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
 			heapDesc.Type = type;
 			heapDesc.NumDescriptors = s_kNumDescriptorsPerHeap;
@@ -54,6 +99,7 @@ namespace MyDirectX
 		{
 			s_RetiredDescriptorHeaps[idx].push(std::make_pair(fenceValueForReset, *iter));
 		}
+		s_HeapStats[idx].retiredHeaps.Set((int64_t)s_RetiredDescriptorHeaps[idx].size());
 	}
 
 	DynamicDescriptorHeap::DynamicDescriptorHeap(CommandContext& context, D3D12_DESCRIPTOR_HEAP_TYPE type)
@@ -86,6 +132,7 @@ namespace MyDirectX
 		m_CurOffset += 1;
 
 		Graphics::s_Device->CopyDescriptorsSimple(1, destHandle.GetCpuHandle(), handle, m_DescriptorType);
+		GetHeapStats(m_DescriptorType).descriptorsCopied.Add();
 
 		return destHandle.GetGpuHandle();
 	}
@@ -103,6 +150,7 @@ namespace MyDirectX
 		m_RetiredHeaps.push_back(m_CurHeap);
 		m_CurHeap = nullptr;
 		m_CurOffset = 0;
+		m_TableCache.Clear();
 	}
 
 	void DynamicDescriptorHeap::RetireUsedHeaps(uint64_t fenceValue)
@@ -129,6 +177,25 @@ namespace MyDirectX
 		ID3D12GraphicsCommandList* pCmdList, 
 		void(STDMETHODCALLTYPE ID3D12GraphicsCommandList::* SetFunc)(UINT, D3D12_GPU_DESCRIPTOR_HANDLE))
 	{
+		HeapStats& stats = GetHeapStats(m_DescriptorType);
+
+		// recycled CPU descriptors may hold other views than when their tables were copied
+		const uint64_t recycleEpoch = DescriptorFreeList::GetRecycleEpoch();
+		if (s_bEnableTableCache && m_TableCacheEpoch != recycleEpoch)
+		{
+			m_TableCache.Clear();
+			m_TableCacheEpoch = recycleEpoch;
+		}
+
+		// tables already copied to the current heap are bound as they are
+		if (s_bEnableTableCache && m_TableCache.GetSize() != 0)
+		{
+			m_Context.SetDescriptorHeap(m_DescriptorType, m_CurHeap);
+			stats.descriptorsReused.Add(handleCache.BindCachedTables(m_TableCache, pCmdList, SetFunc));
+			if (handleCache.m_StaleRootParamsBitMap == 0)
+				return;
+		}
+
 		uint32_t neededSize = handleCache.ComputeStagedSize();
 		if (!HasSpace(neededSize))
 		{
@@ -140,7 +207,8 @@ namespace MyDirectX
 		// this can trigger the creation of a new heap
 		m_Context.SetDescriptorHeap(m_DescriptorType, GetHeapPointer());
 		handleCache.CopyAndBindStaleTables(m_DescriptorType, m_DescriptorSize, Allocate(neededSize),
-			pCmdList, SetFunc);
+			s_bEnableTableCache ? &m_TableCache : nullptr, pCmdList, SetFunc);
+		stats.descriptorsCopied.Add(neededSize);
 	}
 
 	void DynamicDescriptorHeap::UnbindAllValid()
@@ -149,6 +217,17 @@ namespace MyDirectX
 		m_ComputeHandleCache.UnbindAllValid();
 	}
 
+	// DescriptorTableCache
+	size_t DynamicDescriptorHeap::DescriptorTableCache::GetHash()
+	{
+		if (bHashStale)
+		{
+			hash = DescriptorTableHashCache::HashTable(&tableStart->ptr, assignedHandlesBitMap);
+			bHashStale = false;
+		}
+		return hash;
+	}
+
 	// DescriptorHandleCache
 	uint32_t DynamicDescriptorHeap::DescriptorHandleCache::ComputeStagedSize()
 	{
@@ -171,8 +250,43 @@ namespace MyDirectX
 		return neededSpace;
 	}
 
+	uint32_t DynamicDescriptorHeap::DescriptorHandleCache::BindCachedTables(const DescriptorTableHashCache& tableCache,
+		ID3D12GraphicsCommandList* pCmdList, void(STDMETHODCALLTYPE ID3D12GraphicsCommandList::* SetFunc)(UINT, D3D12_GPU_DESCRIPTOR_HANDLE))
+	{
+		uint32_t reusedDescriptors = 0;
+		uint32_t rootIndex;
+		uint32_t staleParams = m_StaleRootParamsBitMap;
+
+		while (_BitScanForward((unsigned long*)&rootIndex, staleParams))
+		{
+			staleParams ^= (1 << rootIndex);
+
+			DescriptorTableCache& rootDescTable = m_RootDescriptorTable[rootIndex];
+			const SIZE_T* tableHandles = &rootDescTable.tableStart->ptr;
+			const uint32_t assignedHandles = rootDescTable.assignedHandlesBitMap;
+
+			// staged again with the handles it is bound with, no lookup
+			D3D12_GPU_DESCRIPTOR_HANDLE gpuHandle;
+			gpuHandle.ptr = rootDescTable.boundGeneration == tableCache.GetGeneration() ? rootDescTable.boundGpuPtr :
+				tableCache.Find(rootDescTable.GetHash(), tableHandles, assignedHandles);
+			if (gpuHandle.ptr == 0)
+				continue;
+
+			(pCmdList->*SetFunc)(rootIndex, gpuHandle);
+			rootDescTable.boundGpuPtr = gpuHandle.ptr;
+			rootDescTable.boundGeneration = tableCache.GetGeneration();
+			m_StaleRootParamsBitMap ^= (1 << rootIndex);
+
+			uint32_t maxSetHandle;
+			_BitScanReverse((unsigned long*)&maxSetHandle, assignedHandles);
+			reusedDescriptors += maxSetHandle + 1;
+		}
+
+		return reusedDescriptors;
+	}
+
 	void DynamicDescriptorHeap::DescriptorHandleCache::CopyAndBindStaleTables(D3D12_DESCRIPTOR_HEAP_TYPE type,
-		uint32_t descriptorSize, DescriptorHandle destHandle, ID3D12GraphicsCommandList* pCmdList,
+		uint32_t descriptorSize, DescriptorHandle destHandle, DescriptorTableHashCache* pTableCache, ID3D12GraphicsCommandList* pCmdList,
 		void(STDMETHODCALLTYPE ID3D12GraphicsCommandList::* SetFunc)(UINT, D3D12_GPU_DESCRIPTOR_HANDLE))
 	{
 		uint32_t staleParamCount = 0;
@@ -219,6 +333,14 @@ namespace MyDirectX
 
 			DescriptorTableCache& rootDescTable = m_RootDescriptorTable[rootIndex];
 
+			if (pTableCache != nullptr)
+			{
+				pTableCache->Insert(rootDescTable.GetHash(), &rootDescTable.tableStart->ptr, rootDescTable.assignedHandlesBitMap,
+					destHandle.GetGpuPtr());
+				rootDescTable.boundGpuPtr = destHandle.GetGpuPtr();
+				rootDescTable.boundGeneration = pTableCache->GetGeneration();
+			}
+
 			D3D12_CPU_DESCRIPTOR_HANDLE* srcHandles = rootDescTable.tableStart;
 			uint64_t setHandles = (uint64_t)rootDescTable.assignedHandlesBitMap;
 			D3D12_CPU_DESCRIPTOR_HANDLE curDest = destHandle.GetCpuHandle();
@@ -295,9 +417,19 @@ namespace MyDirectX
 
 		DescriptorTableCache& tableCache = m_RootDescriptorTable[rootIndex];
 		D3D12_CPU_DESCRIPTOR_HANDLE* copyDest = tableCache.tableStart + offset;
+		const uint32_t assignedHandles = tableCache.assignedHandlesBitMap | (((1 << numHandles) - 1) << offset);
+		bool bChanged = assignedHandles != tableCache.assignedHandlesBitMap;
 		for (UINT i = 0; i < numHandles; ++i)
+		{
+			bChanged |= copyDest[i].ptr != handles[i].ptr;
 			copyDest[i] = handles[i];
-		tableCache.assignedHandlesBitMap |= ((1 << numHandles) - 1) << offset;
+		}
+		tableCache.assignedHandlesBitMap = assignedHandles;
+		if (bChanged)
+		{
+			tableCache.bHashStale = true;
+			tableCache.boundGeneration = 0;
+		}
 		m_StaleRootParamsBitMap |= (1 << rootIndex);
 	}
 
@@ -325,6 +457,8 @@ namespace MyDirectX
 			rootDescriptorTable.assignedHandlesBitMap = 0;
 			rootDescriptorTable.tableStart = m_HandleCache + curOffset;
 			rootDescriptorTable.tableSize = tableSize;
+			rootDescriptorTable.bHashStale = true;
+			rootDescriptorTable.boundGeneration = 0;
 
 			curOffset += tableSize;
 		}
@@ -1,6 +1,7 @@
 #pragma once
 #include "pch.h"
 #include "DescriptorHeap.h"
+#include "DescriptorTableHashCache.h"
 #include <queue>
 #include <mutex>
 
@@ -18,6 +19,10 @@ namespace MyDirectX
 		DynamicDescriptorHeap(CommandContext& context, D3D12_DESCRIPTOR_HEAP_TYPE type);
 		~DynamicDescriptorHeap() = default;
 
+		// bind tables staged again with the same CPU handles to their earlier copy (DescriptorTableHashCache). Off by
+		// default, the lookups cost more CPU than the copies they save unless draws are sorted by material
+		static bool s_bEnableTableCache;
+
 		static void DestroyAll()
 		{
 			s_DescriptorHeapPool[0].clear();
@@ -88,6 +93,10 @@ namespace MyDirectX
 		DescriptorHandle m_FirstDescriptor;
 		std::vector<ID3D12DescriptorHeap*> m_RetiredHeaps;
 
+		// tables copied to m_CurHeap, for both handle caches
+		DescriptorTableHashCache m_TableCache;
+		uint64_t m_TableCacheEpoch = 0;
+
 		// describes a descriptor table entry: a region of the handle cache and which handles have been set
 		struct DescriptorTableCache
 		{
@@ -96,6 +105,14 @@ namespace MyDirectX
 			uint32_t assignedHandlesBitMap = 0;
 			D3D12_CPU_DESCRIPTOR_HANDLE* tableStart = nullptr;
 			uint32_t tableSize = 0;
+
+			// DescriptorTableHashCache::HashTable of the handles, recomputed only after they change
+			size_t GetHash();
+			size_t hash = 0;
+			bool bHashStale = true;
+			// where the handles were last bound, valid while the table cache is in the same generation
+			uint64_t boundGpuPtr = 0;
+			uint64_t boundGeneration = 0;
 		};
 
 		struct DescriptorHandleCache
@@ -119,8 +136,13 @@ namespace MyDirectX
 			static constexpr uint32_t kMaxNumDescriptorTables = 16;
 
 			uint32_t ComputeStagedSize();
+			// binds the stale tables found in tableCache and clears their stale bits, returns the descriptors not copied
+			uint32_t BindCachedTables(const DescriptorTableHashCache& tableCache, ID3D12GraphicsCommandList* pCmdList,
+				void (STDMETHODCALLTYPE ID3D12GraphicsCommandList::*SetFunc)(UINT, D3D12_GPU_DESCRIPTOR_HANDLE));
+			// pTableCache - nullptr when the cache is off
 			void CopyAndBindStaleTables(D3D12_DESCRIPTOR_HEAP_TYPE type, uint32_t descriptorSize, DescriptorHandle destHandle,
-				ID3D12GraphicsCommandList* pCmdList, void (STDMETHODCALLTYPE ID3D12GraphicsCommandList::*SetFunc)(UINT, D3D12_GPU_DESCRIPTOR_HANDLE));
+				DescriptorTableHashCache* pTableCache, ID3D12GraphicsCommandList* pCmdList,
+				void (STDMETHODCALLTYPE ID3D12GraphicsCommandList::*SetFunc)(UINT, D3D12_GPU_DESCRIPTOR_HANDLE));
 
 			DescriptorTableCache m_RootDescriptorTable[kMaxNumDescriptorTables];
 			D3D12_CPU_DESCRIPTOR_HANDLE m_HandleCache[kMaxNumDescriptors];
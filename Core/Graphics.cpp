@@ -255,7 +255,6 @@ namespace MyDirectX
         
         PSO::DestroyAll();
         RootSignature::DestroyAll();
-        DescriptorAllocator::DestroyAll();
 
         // Resources
         s_CommonStates.DestroyCommonStates();
@@ -269,6 +268,9 @@ namespace MyDirectX
         }
         m_PreDisplayBuffer.Destroy();
 
+        // after the resources, textures give their descriptors back
+        DescriptorAllocator::DestroyAll();
+
 #if defined(_DEBUG)
         ID3D12DebugDevice* debugInterface;
         if (SUCCEEDED(m_Device->QueryInterface(&debugInterface)))
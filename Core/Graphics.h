@@ -84,6 +84,12 @@ namespace MyDirectX
 			return s_DescriptorAllocator[type].Allocate(s_Device, count);
 		}
 
+		// recycled once the graphics queue has finished the work submitted so far, and the next submission
+		inline static void FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE type, D3D12_CPU_DESCRIPTOR_HANDLE handle)
+		{
+			s_DescriptorAllocator[type].Free(handle, s_CommandManager.GetGraphicsQueue().GetNextFenceValue());
+		}
+
 		void CreateDeviceResources();
 		void CreateWindowSizeDependentResources();
 
@@ -12,7 +12,8 @@
 
 #pragma once
 
-#include "Math/Common.h"
+#include <cstddef>
+#include <cstdint>
 
 // This requires SSE4.2 which is present on Intel Nehalem (Nov. 2008)
 // and AMD Bulldozer (Oct. 2011) processors.  I could put a runtime
@@ -25,6 +26,7 @@
 #endif
 
 #if ENABLE_SSE_CRC32
+#include <intrin.h>
 #pragma intrinsic(_mm_crc32_u32)
 #pragma intrinsic(_mm_crc32_u64)
 #endif
@@ -34,8 +36,8 @@ namespace Utility
     inline size_t HashRange(const uint32_t* const Begin, const uint32_t* const End, size_t Hash)
     {
 #if ENABLE_SSE_CRC32
-        const uint64_t* Iter64 = (const uint64_t*)Math::AlignUp(Begin, 8);
-        const uint64_t* const End64 = (const uint64_t* const)Math::AlignDown(End, 8);
+        const uint64_t* Iter64 = (const uint64_t*)(((size_t)Begin + 7) & ~(size_t)7);
+        const uint64_t* const End64 = (const uint64_t* const)((size_t)End & ~(size_t)7);
 
         // If not 64-bit aligned, start with a single u32
         if ((uint32_t*)Iter64 > Begin)
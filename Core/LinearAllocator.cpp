@@ -9,37 +9,16 @@ namespace MyDirectX
 
 	LinearAllocatorPageManager LinearAllocator::s_PageManager[2];
 
-	LinearAllocatorPageManager::LinearAllocatorPageManager()
+	static std::string GetStatPrefix(LinearAllocatorType type)
 	{
-		m_AllocationType = s_AutoType;
-		s_AutoType = (LinearAllocatorType)((int)s_AutoType + 1);
-		ASSERT(s_AutoType <= LinearAllocatorType::kNumAllocatorTypes);
+		return type == LinearAllocatorType::kGpuExclusive ? "LinearAllocator.GpuExclusive." : "LinearAllocator.CpuWritable.";
 	}
 
-	LinearAllocationPage* LinearAllocatorPageManager::RequestPage()
+	LinearAllocatorPageManager::LinearAllocatorPageManager()
+		: m_AllocationType(s_AutoType), m_PagePool(*this, GetStatPrefix(s_AutoType))
 	{
-		std::lock_guard<std::mutex> lockGuard(m_Mutex);
-
-		while (!m_RetiredPages.empty() && Graphics::s_CommandManager.IsFenceComplete(m_RetiredPages.front().first))
-		{
-			m_AvailablePages.push(m_RetiredPages.front().second);
-			m_RetiredPages.pop();
-		}
-
-		LinearAllocationPage* pagePtr = nullptr;
-
-		if (!m_AvailablePages.empty())
-		{
-			pagePtr = m_AvailablePages.front();
-			m_AvailablePages.pop();
-		}
-		else
-		{
-			pagePtr = CreateNewPage();
-			m_PagePool.emplace_back(pagePtr);
-		}
-
-		return pagePtr;
+		s_AutoType = (LinearAllocatorType)((int)s_AutoType + 1);
+		ASSERT(s_AutoType <= LinearAllocatorType::kNumAllocatorTypes);
 	}
 
 	LinearAllocationPage* LinearAllocatorPageManager::CreateNewPage(size_t pageSize)
@@ -87,31 +66,14 @@ namespace MyDirectX
 		return new LinearAllocationPage(pBuffer, defaultUsage);
 	}
 
-	void LinearAllocatorPageManager::DiscardPages(uint64_t fenceID, const std::vector<LinearAllocationPage*>& pages)
+	size_t LinearAllocatorPageManager::GetPageSize(LinearAllocationPage& page)
 	{
-		std::lock_guard<std::mutex> lockGuard(m_Mutex);
-
-		for (auto iter = pages.begin(); iter != pages.end(); ++iter)
-		{
-			m_RetiredPages.push(std::make_pair(fenceID, *iter));
-		}
+		return (size_t)page.GetResource()->GetDesc().Width;
 	}
 
-	void LinearAllocatorPageManager::FreeLargePages(uint64_t fenceID, const std::vector<LinearAllocationPage*>& pages)
+	bool LinearAllocatorPageManager::IsFenceComplete(uint64_t fenceValue)
 	{
-		std::lock_guard<std::mutex> lockGuard(m_Mutex);
-
-		while (!m_DeletionQueue.empty() && Graphics::s_CommandManager.IsFenceComplete(m_DeletionQueue.front().first))
-		{
-			delete m_DeletionQueue.front().second;
-			m_DeletionQueue.pop();
-		}
-
-		for (auto iter = pages.begin(); iter != pages.end(); ++iter)
-		{
-			(*iter)->Unmap();
-			m_DeletionQueue.push(std::make_pair(fenceID, *iter));
-		}
+		return Graphics::s_CommandManager.IsFenceComplete(fenceValue);
 	}
 
 	// LinearAllocator
@@ -176,7 +138,7 @@ namespace MyDirectX
 
 	DynAlloc LinearAllocator::AllocateLargePage(size_t sizeInBytes)
 	{
-		LinearAllocationPage* oneOff = s_PageManager[(int)m_AllocationType].CreateNewPage(sizeInBytes);
+		LinearAllocationPage* oneOff = s_PageManager[(int)m_AllocationType].CreateLargePage(sizeInBytes);
 		m_LargePageList.push_back(oneOff);
 
 		DynAlloc ret(*oneOff, 0, sizeInBytes);
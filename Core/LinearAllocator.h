@@ -1,5 +1,6 @@
 #pragma once
 #include "GpuResource.h"
+#include "LinearAllocatorPagePool.h"
 #include <queue>
 #include <mutex>
 
@@ -85,43 +86,31 @@ namespace MyDirectX
 		kCpuAllocatorPageSize = 0x200000    // 2MB
 	};
 
-	// Page allocator, manages the life of pages
-	class LinearAllocatorPageManager
+	// Page allocator, manages the life of pages. The D3D12 page source of a LinearPagePool
+	class LinearAllocatorPageManager : public LinearPageSource<LinearAllocationPage>
 	{
 	public:
 		LinearAllocatorPageManager();
-		LinearAllocationPage* RequestPage();
-		LinearAllocationPage* CreateNewPage(size_t pageSize = 0);
+		LinearAllocationPage* RequestPage() { return m_PagePool.RequestPage(); }
+		LinearAllocationPage* CreateNewPage(size_t pageSize = 0) override;
+		LinearAllocationPage* CreateLargePage(size_t pageSize) { return m_PagePool.CreateLargePage(pageSize); }
 
-		// discard pages will get recycled. This is for fixed size pages
-		void DiscardPages(uint64_t fenceID, const std::vector<LinearAllocationPage*>& pages);
+		size_t GetPageSize(LinearAllocationPage& page) override;
+		bool IsFenceComplete(uint64_t fenceValue) override;
 
-		// freed pages will be destroyed once their fence has passed. This is for single-use, "large" pages
-		void FreeLargePages(uint64_t fenceID, const std::vector<LinearAllocationPage*>& pages);
+		void DiscardPages(uint64_t fenceID, const std::vector<LinearAllocationPage*>& pages) { m_PagePool.DiscardPages(fenceID, pages); }
+		void FreeLargePages(uint64_t fenceID, const std::vector<LinearAllocationPage*>& pages) { m_PagePool.FreeLargePages(fenceID, pages); }
 
 		// -2020-3-28 Note:
 		//	m_DeletionQueue is not in m_PagePool, get deleted once used
 		//	But if only run once (e.g. CommonCompute), m_DeletionQueue does not get deleted
-		void Destroy() 
-		{ 
-			m_PagePool.clear(); 
-
-			while (!m_DeletionQueue.empty())
-			{
-				delete m_DeletionQueue.front().second;
-				m_DeletionQueue.pop();
-			}
-		}
+		void Destroy() { m_PagePool.Destroy(); }
 
 	private:
 		static LinearAllocatorType s_AutoType;
 
 		LinearAllocatorType m_AllocationType;
-		std::vector<std::unique_ptr<LinearAllocationPage>> m_PagePool;
-		std::queue<std::pair<uint64_t, LinearAllocationPage*>> m_RetiredPages;
-		std::queue<std::pair<uint64_t, LinearAllocationPage*>> m_DeletionQueue;
-		std::queue<LinearAllocationPage*> m_AvailablePages;
-		std::mutex m_Mutex;
+		LinearPagePool<LinearAllocationPage> m_PagePool;
 	};
 
 	// Multi threads, multi allocators
@@ -0,0 +1,326 @@
+#pragma once
+#include "Telemetry.h"
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace MyDirectX
+{
+	/**
+		Page recycling of the LinearAllocator, without D3D12. The pool hands out pages, gets them back together with
+	the fence of the work that used them, and reuses them once that fence has completed. Creating pages and reading
+	fences is left to a LinearPageSource, so that CPU memory and a simulated fence can stand in for the GPU heap.
+		Every thread keeps a few pages of its own: the last pages it discarded, still in flight, and pages ready for reuse.
+	RequestPage() and DiscardPages() only take the pool lock when that cache runs empty or overflows, pages then move
+	between the cache and the shared queues in batches. A thread that stops requesting pages keeps its cache until
+	FlushThreadCache() or Destroy().
+	*/
+	template <typename Page>
+	class LinearPageSource
+	{
+	public:
+		virtual ~LinearPageSource() = default;
+
+		// pageSize 0 is the default page size of the source
+		virtual Page* CreateNewPage(size_t pageSize) = 0;
+		virtual size_t GetPageSize(Page& page) = 0;
+		virtual bool IsFenceComplete(uint64_t fenceValue) = 0;
+	};
+
+	template <typename Page>
+	class LinearPagePool
+	{
+	public:
+		static constexpr size_t kDefaultThreadCachePages = 4;
+
+		// statPrefix names the telemetry counters, threadCachePages 0 sends every call through the lock
+		LinearPagePool(LinearPageSource<Page>& source, const std::string& statPrefix, size_t threadCachePages = kDefaultThreadCachePages)
+			: m_Source(source), m_ThreadCachePages(threadCachePages), m_PoolId(NewPoolId()), m_Stats(statPrefix)
+		{
+		}
+		~LinearPagePool() { Destroy(); }
+
+		LinearPagePool(const LinearPagePool&) = delete;
+		LinearPagePool& operator=(const LinearPagePool&) = delete;
+
+		Page* RequestPage();
+
+		// discarded pages get recycled. This is for fixed size pages
+		void DiscardPages(uint64_t fenceID, const std::vector<Page*>& pages);
+
+		// single-use page of pageSize bytes, to be handed back to FreeLargePages()
+		Page* CreateLargePage(size_t pageSize);
+		// freed pages will be destroyed once their fence has passed. This is for single-use, "large" pages
+		void FreeLargePages(uint64_t fenceID, const std::vector<Page*>& pages);
+
+		// gives the pages cached by the calling thread back to the shared queues
+		void FlushThreadCache();
+
+		// not thread safe, destroys every page, including the ones cached by threads
+		void Destroy();
+
+	private:
+		// only touched by its thread, and by Destroy()
+		struct ThreadCache
+		{
+			std::vector<Page*> availablePages;
+			std::deque<std::pair<uint64_t, Page*>> retiredPages;
+			// published with the next locked call
+			int64_t requests = 0;
+			int64_t hits = 0;
+		};
+
+		// "<prefix>*", e.g. "LinearAllocator.GpuExclusive.Pages"
+		struct Stats
+		{
+			explicit Stats(const std::string& prefix)
+				: pages(prefix + "Pages")
+				, availablePages(prefix + "AvailablePages")
+				, retiredPages(prefix + "RetiredPages")
+				, pageRequests(prefix + "PageRequests")
+				, threadCacheHits(prefix + "ThreadCacheHits")
+				, fenceBlocked(prefix + "FenceBlocked")
+				, largePages(prefix + "LargePages")
+				, largePageBytes(prefix + "LargePageBytes")
+				, deletionQueue(prefix + "DeletionQueue")
+			{
+			}
+
+			StatCounter pages;				// pooled pages, they live until Destroy()
+			StatCounter availablePages;		// shared queues only, thread caches are not included
+			StatCounter retiredPages;		// waiting for their fence
+			StatCounter pageRequests;
+			StatCounter threadCacheHits;	// requests served without the lock
+			StatCounter fenceBlocked;		// pages created while retired pages were still in flight
+			StatCounter largePages;			// one-off pages, until their fence has passed
+			StatCounter largePageBytes;
+			StatCounter deletionQueue;
+		};
+
+		static uint64_t NewPoolId()
+		{
+			static std::atomic_uint64_t s_NextId{ 1 };
+			return s_NextId.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		ThreadCache& GetThreadCache();
+		void CollectCompletedPages(ThreadCache& cache);
+		// moves the oldest retired pages out of the cache until at most maxPages are left
+		void ReleaseCachedPages(ThreadCache& cache, size_t maxPages);
+		void PublishStats(ThreadCache& cache);
+
+		LinearPageSource<Page>& m_Source;
+		const size_t m_ThreadCachePages;
+		const uint64_t m_PoolId;
+		Stats m_Stats;
+		std::vector<std::unique_ptr<Page>> m_PagePool;
+		std::queue<std::pair<uint64_t, Page*>> m_RetiredPages;
+		std::queue<std::tuple<uint64_t, Page*, size_t>> m_DeletionQueue;
+		std::queue<Page*> m_AvailablePages;
+		std::vector<std::unique_ptr<ThreadCache>> m_ThreadCaches;
+		std::mutex m_Mutex;
+	};
+
+	template <typename Page>
+	Page* LinearPagePool<Page>::RequestPage()
+	{
+		ThreadCache& cache = GetThreadCache();
+		++cache.requests;
+
+		CollectCompletedPages(cache);
+		if (!cache.availablePages.empty())
+		{
+			Page* pagePtr = cache.availablePages.back();
+			cache.availablePages.pop_back();
+			++cache.hits;
+			return pagePtr;
+		}
+
+		std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+		while (!m_RetiredPages.empty() && m_Source.IsFenceComplete(m_RetiredPages.front().first))
+		{
+			m_AvailablePages.push(m_RetiredPages.front().second);
+			m_RetiredPages.pop();
+		}
+
+		Page* pagePtr = nullptr;
+
+		if (!m_AvailablePages.empty())
+		{
+			pagePtr = m_AvailablePages.front();
+			m_AvailablePages.pop();
+
+			// take some more along, so that the next requests don't need the lock
+			while (!m_AvailablePages.empty() && cache.availablePages.size() < m_ThreadCachePages)
+			{
+				cache.availablePages.push_back(m_AvailablePages.front());
+				m_AvailablePages.pop();
+			}
+		}
+		else
+		{
+			if (!m_RetiredPages.empty() || !cache.retiredPages.empty())
+				m_Stats.fenceBlocked.Add();
+
+			pagePtr = m_Source.CreateNewPage(0);
+			m_PagePool.emplace_back(pagePtr);
+			m_Stats.pages.Add();
+		}
+
+		PublishStats(cache);
+
+		return pagePtr;
+	}
+
+	template <typename Page>
+	void LinearPagePool<Page>::DiscardPages(uint64_t fenceID, const std::vector<Page*>& pages)
+	{
+		ThreadCache& cache = GetThreadCache();
+
+		for (auto iter = pages.begin(); iter != pages.end(); ++iter)
+		{
+			cache.retiredPages.emplace_back(fenceID, *iter);
+		}
+
+		if (cache.retiredPages.size() <= m_ThreadCachePages)
+			return;
+
+		std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+		ReleaseCachedPages(cache, m_ThreadCachePages);
+		PublishStats(cache);
+	}
+
+	template <typename Page>
+	Page* LinearPagePool<Page>::CreateLargePage(size_t pageSize)
+	{
+		Page* pagePtr = m_Source.CreateNewPage(pageSize);
+
+		m_Stats.largePages.Add();
+		m_Stats.largePageBytes.Add((int64_t)pageSize);
+		return pagePtr;
+	}
+
+	template <typename Page>
+	void LinearPagePool<Page>::FreeLargePages(uint64_t fenceID, const std::vector<Page*>& pages)
+	{
+		std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+		while (!m_DeletionQueue.empty() && m_Source.IsFenceComplete(std::get<0>(m_DeletionQueue.front())))
+		{
+			m_Stats.largePages.Sub();
+			m_Stats.largePageBytes.Sub((int64_t)std::get<2>(m_DeletionQueue.front()));
+			delete std::get<1>(m_DeletionQueue.front());
+			m_DeletionQueue.pop();
+		}
+
+		for (auto iter = pages.begin(); iter != pages.end(); ++iter)
+		{
+			m_DeletionQueue.emplace(fenceID, *iter, m_Source.GetPageSize(**iter));
+		}
+		m_Stats.deletionQueue.Set((int64_t)m_DeletionQueue.size());
+	}
+
+	template <typename Page>
+	void LinearPagePool<Page>::FlushThreadCache()
+	{
+		ThreadCache& cache = GetThreadCache();
+
+		std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+		ReleaseCachedPages(cache, 0);
+		for (Page* pagePtr : cache.availablePages)
+			m_AvailablePages.push(pagePtr);
+		cache.availablePages.clear();
+		PublishStats(cache);
+	}
+
+	template <typename Page>
+	void LinearPagePool<Page>::Destroy()
+	{
+		std::lock_guard<std::mutex> lockGuard(m_Mutex);
+
+		// the caches stay registered, their threads may still hold pointers to them
+		for (auto& cache : m_ThreadCaches)
+		{
+			cache->availablePages.clear();
+			cache->retiredPages.clear();
+		}
+		m_AvailablePages = {};
+		m_RetiredPages = {};
+		m_PagePool.clear();
+
+		while (!m_DeletionQueue.empty())
+		{
+			delete std::get<1>(m_DeletionQueue.front());
+			m_DeletionQueue.pop();
+		}
+
+		m_Stats.pages.Set(0);
+		m_Stats.availablePages.Set(0);
+		m_Stats.retiredPages.Set(0);
+		m_Stats.largePages.Set(0);
+		m_Stats.largePageBytes.Set(0);
+		m_Stats.deletionQueue.Set(0);
+	}
+
+	template <typename Page>
+	typename LinearPagePool<Page>::ThreadCache& LinearPagePool<Page>::GetThreadCache()
+	{
+		// pool ids are never reused, entries of destroyed pools just stop matching
+		static thread_local std::vector<std::pair<uint64_t, ThreadCache*>> t_Caches;
+		for (const auto& entry : t_Caches)
+		{
+			if (entry.first == m_PoolId)
+				return *entry.second;
+		}
+
+		// first call of this thread
+		ThreadCache* cache = new ThreadCache();
+		{
+			std::lock_guard<std::mutex> lockGuard(m_Mutex);
+			m_ThreadCaches.emplace_back(cache);
+		}
+		t_Caches.emplace_back(m_PoolId, cache);
+		return *cache;
+	}
+
+	template <typename Page>
+	void LinearPagePool<Page>::CollectCompletedPages(ThreadCache& cache)
+	{
+		while (!cache.retiredPages.empty() && m_Source.IsFenceComplete(cache.retiredPages.front().first))
+		{
+			cache.availablePages.push_back(cache.retiredPages.front().second);
+			cache.retiredPages.pop_front();
+		}
+	}
+
+	template <typename Page>
+	void LinearPagePool<Page>::ReleaseCachedPages(ThreadCache& cache, size_t maxPages)
+	{
+		while (cache.retiredPages.size() > maxPages)
+		{
+			m_RetiredPages.push(cache.retiredPages.front());
+			cache.retiredPages.pop_front();
+		}
+	}
+
+	template <typename Page>
+	void LinearPagePool<Page>::PublishStats(ThreadCache& cache)
+	{
+		m_Stats.pageRequests.Add(cache.requests);
+		m_Stats.threadCacheHits.Add(cache.hits);
+		cache.requests = 0;
+		cache.hits = 0;
+
+		m_Stats.availablePages.Set((int64_t)m_AvailablePages.size());
+		m_Stats.retiredPages.Set((int64_t)m_RetiredPages.size());
+	}
+}
@@ -1,10 +1,34 @@
 #include "Task.h"
-#include "Utility.h"
+#include "CpuProfiler.h"
+#include <algorithm>
+#include <string>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#endif
 
 using namespace Timo;
 
 Context Timo::g_TaskContext{};
 
+// Worker identity of the calling thread, external threads have t_Context == nullptr
+static thread_local Context* t_Context = nullptr;
+static thread_local uint32_t t_WorkerIndex = 0;
+
+static uint32_t NextRandom(uint32_t& state)
+{
+	// Xorshift32
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
 Context::~Context() 
 {
 	Destroy();
@@ -19,12 +43,19 @@ void Context::Init(uint32_t numThreads)
 	// Retrieve the number of hardware threads in this sytem
 	uint32_t numHardwareThreads = std::thread::hardware_concurrency();
 
-	// -1 (main threads)
-	numThreads = std::min(numThreads, numHardwareThreads-1);
+	// -1 (main threads), keep one worker on single core machines, hardware_concurrency() is 0 when unknown
+	numThreads = std::min(numThreads, std::max(numHardwareThreads, 2u) - 1);
+
+	m_bStop = false;
+	for (uint32_t i = 0; i < numThreads; i++)
+	{
+		auto& worker = m_Workers.emplace_back(new Worker());
+		worker->rngState = 0x9E3779B9u * (i + 1);
+	}
 
 	for (uint32_t i = 0; i < numThreads; i++) 
 	{
-		auto &thread = m_Threads.emplace_back( &Context::WorkerEntry, this );
+		auto &thread = m_Threads.emplace_back( &Context::WorkerEntry, this, i );
 
 #ifdef _WIN32
 		// Do Windows-specific thread setup
@@ -38,6 +69,8 @@ void Context::Init(uint32_t numThreads)
 
 		std::wstring threadName = L"Task::Thread_" + std::to_wstring(i);
 		SetThreadDescription(handle, threadName.c_str());
+#else
+		(void)thread;
 #endif
 	}
 }
@@ -47,73 +80,297 @@ void Context::Destroy()
 	if (m_Threads.empty())
 		return;
 
-	uint32_t numThreads = static_cast<uint32_t>(m_Threads.size());
-	for (uint32_t i = 0; i < numThreads; i++)
+	Wait();
 	{
-		m_TaskQueue.Push( { .params = { .id = kInvalidTaskId }});
+		std::lock_guard lock(m_ParkMutex);
+		m_bStop = true;
 	}
-	Wait();
+	m_ParkCV.notify_all();
+
 	m_Threads.clear();
+	m_Workers.clear();
+}
+
+void Context::WorkerEntry(uint32_t workerIndex) 
+{
+	t_Context = this;
+	t_WorkerIndex = workerIndex;
+	g_CpuProfiler.SetThreadName("Task::Thread_" + std::to_string(workerIndex));
+
+	// One marker per run of tasks rather than per task, the clock reads would cost as much as small tasks
+	uint64_t busyBeginNs = 0;
+
+	uint32_t idleRounds = 0;
+	while (!m_bStop.load(std::memory_order_relaxed))
+	{
+		if (TaskRange* range = FindWork(workerIndex))
+		{
+			if (busyBeginNs == 0 && TIMO_CPU_PROFILER && g_CpuProfiler.IsEnabled())
+				busyBeginNs = CpuProfiler::Now();
+			RunRange(range, workerIndex);
+			idleRounds = 0;
+			continue;
+		}
+
+		if (busyBeginNs != 0)
+		{
+			g_CpuProfiler.Record("Tasks", busyBeginNs, CpuProfiler::Now(), 0);
+			busyBeginNs = 0;
+		}
+
+		if (++idleRounds < kSpinCount)
+		{
+			std::this_thread::yield();
+		}
+		else
+		{
+			Park();
+			idleRounds = 0;
+		}
+	}
+
+	if (busyBeginNs != 0)
+		g_CpuProfiler.Record("Tasks", busyBeginNs, CpuProfiler::Now(), 0);
+	t_Context = nullptr;
+}
+
+TaskHandle Context::Execute(const std::function<void(TaskParams)>& taskImpl, const std::vector<TaskHandle>& dependencies)
+{
+	return CreateJob(taskImpl, 1, 1, dependencies);
+}
+
+TaskHandle Context::Dispatch(const std::function<void(TaskParams)>& taskImpl, uint32_t dispatchSize, uint32_t groupSize, const std::vector<TaskHandle>& dependencies) 
+{
+	uint32_t groupCount = (dispatchSize + groupSize - 1) / groupSize;
+	return CreateJob(taskImpl, groupCount, groupSize, dependencies);
+}
+
+TaskHandle Context::CreateJob(const std::function<void(TaskParams)>& taskImpl, uint32_t groupCount, uint32_t groupSize, const std::vector<TaskHandle>& dependencies)
+{
+	auto job = std::make_shared<TaskJob>();
+	job->func = taskImpl;
+	job->invoke = [](void* data, TaskParams params) { (*static_cast<std::function<void(TaskParams)>*>(data))(params); };
+	job->data = &job->func;
+	job->id = m_Counter.fetch_add(groupCount);
+	job->groupSize = groupSize;
+	job->groupCount = groupCount;
+	job->pending.store(groupCount, std::memory_order_relaxed);
+	job->self = job;
+
+	// Register with the dependencies that are still running, they release the job when they complete
+	for (const TaskHandle& dependency : dependencies)
+	{
+		TaskJob* before = dependency.m_Job.get();
+		if (before == nullptr)
+			continue;
+
+		std::lock_guard lock(before->mutex);
+		if (!before->bDone.load(std::memory_order_relaxed))
+		{
+			job->blockers.fetch_add(1, std::memory_order_relaxed);
+			before->successors.push_back(job.get());
+		}
+	}
+
+	TaskHandle handle(job);
+	Release(job.get());
+	return handle;
+}
+
+void Context::RunInline(TaskJob& job, uint32_t groupCount, uint32_t groupSize)
+{
+	job.id = m_Counter.fetch_add(groupCount);
+	job.groupSize = groupSize;
+	job.groupCount = groupCount;
+	job.pending.store(groupCount, std::memory_order_relaxed);
+
+	// Start on the whole range here, which pushes the halves for the other workers
+	const uint32_t workerIndex = t_Context == this ? t_WorkerIndex : kExternalThread;
+	TaskRange* range = &job.ranges[0];
+	*range = { &job, 0, groupCount };
+	RunRange(range, workerIndex);
+
+	// No handle, completion is the last group coming back
+	while (job.pending.load(std::memory_order_acquire) != 0)
+	{
+		if (!RunPendingTask())
+			std::this_thread::yield();
+	}
 }
 
-void Context::WorkerEntry() 
+void Context::Release(TaskJob* job)
 {
-	static thread_local uint32_t ThreadId = m_ThreadId++;
+	if (job->blockers.fetch_sub(1, std::memory_order_acq_rel) != 1)
+		return;
+
+	// Empty dispatches only join their dependencies
+	if (job->groupCount == 0)
+		Complete(job);
+	else
+		Push(new TaskRange{ job, 0, job->groupCount });
+}
 
-	while (true)
+void Context::Complete(TaskJob* job)
+{
+	std::vector<TaskJob*> successors;
 	{
-		auto task = m_TaskQueue.Pop();
-		if (task.params.id == kInvalidTaskId)
-			break;
+		std::lock_guard lock(job->mutex);
+		job->bDone.store(true, std::memory_order_release);
+		successors.swap(job->successors);
+	}
+	for (TaskJob* successor : successors)
+		Release(successor);
 
-		task.func(task.params);
+	// The last reference may be a handle, or nothing
+	job->self.reset();
+}
 
-		TaskResult result{};
-		m_ResponseQueue.Push(result);
+void Context::Push(TaskRange* range)
+{
+	if (t_Context == this)
+	{
+		// Nested submission from a worker, stays local until stolen
+		m_Workers[t_WorkerIndex]->deque.Push(range);
 	}
+	else if (!m_InjectQueue.TryPush(range))
+	{
+		// Back pressure, the submitting thread helps instead of blocking on the workers
+		RunRange(range, kExternalThread);
+		return;
+	}
+	WakeOne();
 }
 
-void Context::Execute(const std::function<void(TaskParams)>& taskImpl)
+TaskRange* Context::FindWork(uint32_t workerIndex)
 {
-	uint32_t taskId = m_Counter.fetch_add(1);
-	Task task =
+	TaskRange* range = nullptr;
+	if (workerIndex != kExternalThread && m_Workers[workerIndex]->deque.Pop(range))
+		return range;
+
+	if (auto injected = m_InjectQueue.TryPop())
+		return *injected;
+
+	// One pass over the other workers, from a random victim on
+	const uint32_t workerCount = static_cast<uint32_t>(m_Workers.size());
+	if (workerCount == 0)
+		return nullptr;
+
+	static thread_local uint32_t t_ExternalRngState = 0x2545F491u;
+	uint32_t& rngState = workerIndex != kExternalThread ? m_Workers[workerIndex]->rngState : t_ExternalRngState;
+	const uint32_t first = NextRandom(rngState) % workerCount;
+	for (uint32_t i = 0; i < workerCount; ++i)
 	{
-		.params = { .id = taskId },
-		.func = taskImpl
-	};
-	m_TaskQueue.Push(task);
+		const uint32_t victim = (first + i) % workerCount;
+		if (victim != workerIndex && m_Workers[victim]->deque.Steal(range))
+			return range;
+	}
+	return nullptr;
 }
 
-void Context::Dispatch(const std::function<void(TaskParams)>& taskImpl, uint32_t dispatchSize, uint32_t groupSize) 
+void Context::RunRange(TaskRange* range, uint32_t workerIndex)
 {
-	uint32_t groupCount = Math::DivideByMultiple(dispatchSize, groupSize);
-	uint32_t taskId = m_Counter.fetch_add( groupCount );
-	for (uint32_t groupId = 0; groupId < groupCount; ++groupId)
+	TaskJob* job = range->job;
+	// Read before the group completes, a pre-sized job may be gone right after
+	const bool bPreSized = job->ranges != nullptr;
+
+	// Split off the upper half until one group is left, thieves take the largest halves from the top.
+	// A worker pushes straight to its own deque, threads outside the pool have none and go through Push()
+	// to the injection queue.
+	while (range->end - range->begin > 1)
 	{
-		Task task =
+		const uint32_t mid = range->begin + (range->end - range->begin) / 2;
+		TaskRange* upper = bPreSized ? &job->ranges[mid] : new TaskRange;
+		*upper = { job, mid, range->end };
+		if (workerIndex != kExternalThread)
 		{
-			.params = { .id = taskId, .groupId = groupId, .groupSize = groupSize },
-			.func = taskImpl
-		};
-		m_TaskQueue.Push(task);
+			m_Workers[workerIndex]->deque.Push(upper);
+			WakeOne();
+		}
+		else
+			Push(upper);
+		range->end = mid;
 	}
-	
+
+	job->invoke(job->data, { .id = job->id, .groupId = range->begin, .groupSize = job->groupSize });
+	if (!bPreSized)
+		delete range;
+
+	// Pre-sized jobs are waited on through pending alone
+	if (job->pending.fetch_sub(1, std::memory_order_acq_rel) == 1 && !bPreSized)
+		Complete(job);
+	m_Counter.fetch_sub(1, std::memory_order_release);
+}
+
+bool Context::RunPendingTask()
+{
+	const uint32_t workerIndex = t_Context == this ? t_WorkerIndex : kExternalThread;
+	TaskRange* range = FindWork(workerIndex);
+	if (range == nullptr)
+		return false;
+
+	RunRange(range, workerIndex);
+	return true;
+}
+
+bool Context::HasWork() const
+{
+	if (!m_InjectQueue.Empty())
+		return true;
+	for (const auto& worker : m_Workers)
+	{
+		if (!worker->deque.Empty())
+			return true;
+	}
+	return false;
+}
+
+void Context::Park()
+{
+	std::unique_lock lock(m_ParkMutex);
+	const uint64_t epoch = m_WakeEpoch;
+
+	// Announce first, then look again: a producer either sees the sleeper or its work is seen here
+	m_Sleepers.fetch_add(1);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (!HasWork() && !m_bStop)
+		m_ParkCV.wait(lock, [&]{ return m_WakeEpoch != epoch || m_bStop; });
+	m_Sleepers.fetch_sub(1);
+}
+
+void Context::WakeOne()
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (m_Sleepers.load(std::memory_order_relaxed) == 0)
+		return;
+
+	{
+		std::lock_guard lock(m_ParkMutex);
+		++m_WakeEpoch;
+	}
+	m_ParkCV.notify_one();
 }
 
 void Context::Wait()
 {
-	while (m_Counter > 0) {
-		auto response = m_ResponseQueue.TryPop();
-		if (response) {
-			--m_Counter;
-		}
-		// _mm_pause();
-		/**
-		* std::this_thead::yield
-		* Provides a hint to implementation to reschedule the execution of threads, allowing other threads to run.
-		* Notes: The exact behavior of this function depends on the implementation, in particular on the mechanism of
-		* the OS scheduler in use and the state of the system.
-		*/
-		std::this_thread::yield();
+	while (m_Counter > 0)
+	{
+		// Help instead of spinning, this also makes progress when there are no workers at all
+		if (!RunPendingTask())
+			std::this_thread::yield();
 	}
 }
+
+void Context::Wait(const TaskHandle& handle)
+{
+	while (!handle.IsDone())
+	{
+		if (!RunPendingTask())
+			std::this_thread::yield();
+	}
+}
+
+void Context::Wait(const std::vector<TaskHandle>& handles)
+{
+	for (const TaskHandle& handle : handles)
+		Wait(handle);
+}
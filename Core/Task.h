@@ -1,6 +1,16 @@
 #pragma once
-#include "mtqueue.h"
+#include "mpmcqueue.h"
+#include "wsdeque.h"
+#include <algorithm>
 #include <functional>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
 
 namespace Timo 
 {
@@ -13,22 +23,83 @@ namespace Timo
 		// TODO...	
 	};
 
-	struct TaskResult
+	struct TaskJob;
+
+	// Groups [begin, end) of a job
+	struct TaskRange
 	{
-		// TODO...
+		TaskJob* job;
+		uint32_t begin, end;
 	};
 
-	struct Task 
+	// One Execute(), Dispatch() or ParallelFor() call, shared by all of its groups and by the handles to it
+	struct TaskJob
 	{
-		TaskParams params;
+		// Type-erased callable, points to func for Execute() and Dispatch(), to the caller's stack for ParallelFor()
+		void (*invoke)(void* data, TaskParams params) = nullptr;
+		void* data = nullptr;
 		std::function<void(TaskParams)> func;
+
+		// Pre-sized jobs own one range per group: a range is only pushed once its first group is split off,
+		// so ranges[begin] is free for it. Otherwise ranges are allocated as they are split.
+		TaskRange* ranges = nullptr;
+
+		uint32_t id = 0;
+		uint32_t groupSize = 1;
+		uint32_t groupCount = 0;
+		std::atomic_uint32_t pending{ 0 };	// groups not finished yet
+		std::atomic_uint32_t blockers{ 1 };	// unfinished dependencies, +1 until the submission is complete
+		std::atomic_bool bDone{ false };
+
+		// Jobs waiting for this one, guarded by mutex together with the transition to bDone
+		std::mutex mutex;
+		std::vector<TaskJob*> successors;
+
+		// Keeps the job alive while it is queued, dropped once it completes
+		std::shared_ptr<TaskJob> self;
+	};
+
+	/**
+	 * Handle to a submitted Execute() or Dispatch(). It can be waited on, or passed as a dependency of later
+	 * submissions, which then only start once it completed. An empty handle counts as done.
+	 */
+	class TaskHandle
+	{
+	public:
+		TaskHandle() = default;
+
+		bool IsValid() const { return m_Job != nullptr; }
+		bool IsDone() const { return m_Job == nullptr || m_Job->bDone.load(std::memory_order_acquire); }
+
+	private:
+		friend class Context;
+		explicit TaskHandle(std::shared_ptr<TaskJob> job) : m_Job(std::move(job)) { }
+
+		std::shared_ptr<TaskJob> m_Job;
 	};
 
+	/**
+	 * Work-stealing task system. Every worker owns a Chase-Lev deque (WsDeque); a dispatch is submitted
+	 * as one range of groups, which the worker running it keeps splitting in half, pushing the upper half
+	 * to its deque. Idle workers steal from randomly chosen victims, so the work spreads without a shared
+	 * queue. Threads outside the pool submit through a lock-free injection queue (MpmcQueue); when it is
+	 * full, the submitting thread runs the work itself.
+	 * Workers that find nothing to do for a while park on a condition variable until new work is pushed.
+	 *
+	 * Submissions return a TaskHandle and can depend on earlier handles, which builds a task graph as it is
+	 * submitted: e.g. BLAS builds as independent tasks, and the TLAS build as their continuation. A job is
+	 * queued when its last dependency completes. Waiting threads run pending tasks instead of yielding, so
+	 * Wait(handle) is also safe inside a task; Wait() for everything is not, it would wait for itself.
+	 */
 	class Context 
 	{
 	public:
 		static constexpr uint32_t kDefaultGroupSize = 64;
 		static constexpr uint32_t kInvalidTaskId = std::numeric_limits<uint32_t>::max();
+		// Failed steal rounds before a worker parks
+		static constexpr uint32_t kSpinCount = 64;
+		// Most groups of a ParallelFor() or ParallelReduce(), larger loops get larger groups
+		static constexpr uint32_t kMaxInlineGroups = 256;
 
 		Context() = default;
 		~Context();
@@ -36,24 +107,127 @@ namespace Timo
 		void Init(uint32_t numThreads);
 		void Destroy();
 
-		void Execute(const std::function<void(TaskParams)>& taskImpl);
-		void Dispatch(const std::function<void(TaskParams)>& taskImpl, uint32_t dispatchSize, uint32_t groupSize = kDefaultGroupSize);
+		TaskHandle Execute(const std::function<void(TaskParams)>& taskImpl, const std::vector<TaskHandle>& dependencies = {});
+		TaskHandle Dispatch(const std::function<void(TaskParams)>& taskImpl, uint32_t dispatchSize, uint32_t groupSize = kDefaultGroupSize,
+			const std::vector<TaskHandle>& dependencies = {});
+		// Continuation, runs taskImpl once dependency completed
+		TaskHandle Then(const TaskHandle& dependency, const std::function<void(TaskParams)>& taskImpl) { return Execute(taskImpl, { dependency }); }
+
+		/**
+		 * Runs func(i) for i in [0, count) and returns when all are done, inline when there are no workers.
+		 * The job, the callable and the ranges live on the caller's stack, so nothing is allocated per call.
+		 */
+		template <typename Func>
+		void ParallelFor(uint32_t count, uint32_t groupSize, const Func& func);
+
+		/**
+		 * Folds func(accumulator, i) over [0, count). Every group starts from identity and keeps its own partial,
+		 * the partials are then combined with reduce(a, b) in group order, so the result doesn't depend on which
+		 * worker ran what. Partials are kept on the stack, T should be small.
+		 */
+		template <typename T, typename Func, typename Reduce>
+		T ParallelReduce(uint32_t count, uint32_t groupSize, const T& identity, const Func& func, const Reduce& reduce);
+
+		uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_Threads.size()); }
 
 		void ResetCounter() { m_Counter = 0; }
 		bool IsBusy() const { return m_Counter > 0; }
+		// Waits for all submitted tasks, from outside of the tasks only
 		void Wait();
+		void Wait(const TaskHandle& handle);
+		void Wait(const std::vector<TaskHandle>& handles);
+		// Runs one queued task on the calling thread, false if there was none. For custom waits (SyncWait)
+		bool RunPendingTask();
 
 	private:
-		void WorkerEntry();
+		struct alignas(64) Worker
+		{
+			WsDeque<TaskRange*> deque;
+			uint32_t rngState = 1;
+		};
+
+		// Worker index of threads outside the pool
+		static constexpr uint32_t kExternalThread = std::numeric_limits<uint32_t>::max();
+		// Ranges submitted from outside the pool that can be queued at once
+		static constexpr uint32_t kInjectCapacity = 1024;
+
+		void WorkerEntry(uint32_t workerIndex);
+		void RunInline(TaskJob& job, uint32_t groupCount, uint32_t groupSize);
+		TaskHandle CreateJob(const std::function<void(TaskParams)>& taskImpl, uint32_t groupCount, uint32_t groupSize, const std::vector<TaskHandle>& dependencies);
+		void Release(TaskJob* job);
+		void Complete(TaskJob* job);
+		void Push(TaskRange* range);
+		TaskRange* FindWork(uint32_t workerIndex);
+		void RunRange(TaskRange* range, uint32_t workerIndex);
+		bool HasWork() const;
+		void Park();
+		void WakeOne();
 
-		MtQueue<Task> m_TaskQueue;
-		MtQueue<TaskResult> m_ResponseQueue;
+		std::vector<std::unique_ptr<Worker>> m_Workers;
+		MpmcQueue<TaskRange*> m_InjectQueue{ kInjectCapacity };
 
 		std::vector<std::jthread> m_Threads;
 
+		// Parking, m_WakeEpoch is guarded by m_ParkMutex
+		std::mutex m_ParkMutex;
+		std::condition_variable m_ParkCV;
+		uint64_t m_WakeEpoch = 0;
+		std::atomic_uint32_t m_Sleepers{ 0 };
+		std::atomic_bool m_bStop{ false };
+
 		std::atomic_uint32_t m_Counter{ 0 };
-		std::atomic_uint32_t m_ThreadId{ 0 };
 	};
 
 	extern Context g_TaskContext;
+
+	template <typename Func>
+	void Context::ParallelFor(uint32_t count, uint32_t groupSize, const Func& func)
+	{
+		groupSize = std::max(groupSize, 1u);
+		if (GetThreadCount() == 0 || count <= groupSize)
+		{
+			for (uint32_t i = 0; i < count; ++i)
+				func(i);
+			return;
+		}
+
+		groupSize = std::max(groupSize, (count + kMaxInlineGroups - 1) / kMaxInlineGroups);
+		auto body = [&](TaskParams params)
+		{
+			uint32_t i = params.groupId * params.groupSize;
+			uint32_t imax = std::min(i + params.groupSize, count);
+			for (; i < imax; ++i)
+				func(i);
+		};
+
+		TaskRange ranges[kMaxInlineGroups];
+		TaskJob job;
+		job.invoke = [](void* data, TaskParams params) { (*static_cast<decltype(body)*>(data))(params); };
+		job.data = &body;
+		job.ranges = ranges;
+		RunInline(job, (count + groupSize - 1) / groupSize, groupSize);
+	}
+
+	template <typename T, typename Func, typename Reduce>
+	T Context::ParallelReduce(uint32_t count, uint32_t groupSize, const T& identity, const Func& func, const Reduce& reduce)
+	{
+		groupSize = std::max({ groupSize, 1u, (count + kMaxInlineGroups - 1) / kMaxInlineGroups });
+		const uint32_t groupCount = (count + groupSize - 1) / groupSize;
+
+		T partials[kMaxInlineGroups];
+		ParallelFor(groupCount, 1, [&](uint32_t groupId)
+			{
+				T& partial = partials[groupId];
+				partial = identity;
+				uint32_t i = groupId * groupSize;
+				uint32_t imax = std::min(i + groupSize, count);
+				for (; i < imax; ++i)
+					func(partial, i);
+			});
+
+		T result = identity;
+		for (uint32_t groupId = 0; groupId < groupCount; ++groupId)
+			result = reduce(result, partials[groupId]);
+		return result;
+	}
 }
@@ -0,0 +1,120 @@
+#include "Telemetry.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <ostream>
+
+namespace MyDirectX
+{
+	namespace
+	{
+		// Function local, so that counters of any translation unit can register during static initialization
+		struct Registry
+		{
+			std::mutex mutex;
+			std::vector<StatCounter*> counters;
+			uint64_t frameCount = 0;
+		};
+
+		Registry& GetRegistry()
+		{
+			static Registry s_Registry;
+			return s_Registry;
+		}
+	}
+
+	StatCounter::StatCounter(std::string name)
+		: m_Name(std::move(name))
+	{
+		Telemetry::Register(this);
+	}
+
+	StatCounter::~StatCounter()
+	{
+		Telemetry::Unregister(this);
+	}
+
+	void Telemetry::Register(StatCounter* counter)
+	{
+		Registry& registry = GetRegistry();
+		std::lock_guard<std::mutex> lockGuard(registry.mutex);
+		registry.counters.push_back(counter);
+	}
+
+	void Telemetry::Unregister(StatCounter* counter)
+	{
+		Registry& registry = GetRegistry();
+		std::lock_guard<std::mutex> lockGuard(registry.mutex);
+		auto iter = std::find(registry.counters.begin(), registry.counters.end(), counter);
+		if (iter != registry.counters.end())
+			registry.counters.erase(iter);
+	}
+
+	void Telemetry::EndFrame()
+	{
+		Registry& registry = GetRegistry();
+		std::lock_guard<std::mutex> lockGuard(registry.mutex);
+		for (StatCounter* counter : registry.counters)
+			counter->m_LastFrame.store(counter->m_Frame.exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+		++registry.frameCount;
+	}
+
+	uint64_t Telemetry::GetFrameCount()
+	{
+		Registry& registry = GetRegistry();
+		std::lock_guard<std::mutex> lockGuard(registry.mutex);
+		return registry.frameCount;
+	}
+
+	std::vector<Telemetry::Snapshot> Telemetry::GetSnapshot()
+	{
+		std::vector<Snapshot> snapshot;
+		{
+			Registry& registry = GetRegistry();
+			std::lock_guard<std::mutex> lockGuard(registry.mutex);
+			snapshot.reserve(registry.counters.size());
+			for (const StatCounter* counter : registry.counters)
+				snapshot.push_back({ counter->GetName(), counter->GetValue(), counter->GetPeak(), counter->GetTotal(), counter->GetLastFrame() });
+		}
+		std::sort(snapshot.begin(), snapshot.end(), [](const Snapshot& a, const Snapshot& b) { return a.name < b.name; });
+		return snapshot;
+	}
+
+	const StatCounter* Telemetry::Find(const std::string& name)
+	{
+		Registry& registry = GetRegistry();
+		std::lock_guard<std::mutex> lockGuard(registry.mutex);
+		for (const StatCounter* counter : registry.counters)
+		{
+			if (counter->GetName() == name)
+				return counter;
+		}
+		return nullptr;
+	}
+
+	void Telemetry::WriteJson(std::ostream& out)
+	{
+		const std::vector<Snapshot> snapshot = GetSnapshot();
+
+		// Counter names are plain identifiers with dots, no escaping needed
+		out << "{\n\t\"frame\": " << GetFrameCount() << ",\n\t\"counters\": {";
+		for (size_t i = 0; i < snapshot.size(); ++i)
+		{
+			const Snapshot& counter = snapshot[i];
+			out << (i == 0 ? "\n" : ",\n") << "\t\t\"" << counter.name << "\": { \"value\": " << counter.value
+				<< ", \"peak\": " << counter.peak << ", \"total\": " << counter.total << ", \"lastFrame\": " << counter.lastFrame << " }";
+		}
+		out << "\n\t}\n}\n";
+	}
+
+	bool Telemetry::DumpJson(const std::wstring& filePath)
+	{
+		std::ofstream file(std::filesystem::path(filePath), std::ios::out | std::ios::trunc);
+		if (!file)
+			return false;
+
+		WriteJson(file);
+		return (bool)file;
+	}
+}
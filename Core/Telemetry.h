@@ -0,0 +1,94 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace MyDirectX
+{
+	/**
+		Named counter for the allocators and heaps, readable at runtime and dumped by Telemetry.
+		value is a gauge (Add / Sub / Set) with its high-water mark in peak, every Add() also counts towards
+	total and towards the current frame, which Telemetry::EndFrame() moves to lastFrame.
+		Updates are relaxed atomics, counters may be touched from any thread.
+	*/
+	class StatCounter
+	{
+	public:
+		explicit StatCounter(std::string name);
+		~StatCounter();
+
+		StatCounter(const StatCounter&) = delete;
+		StatCounter& operator=(const StatCounter&) = delete;
+
+		void Add(int64_t count = 1)
+		{
+			const int64_t value = m_Value.fetch_add(count, std::memory_order_relaxed) + count;
+			UpdatePeak(value);
+			m_Total.fetch_add(count, std::memory_order_relaxed);
+			m_Frame.fetch_add(count, std::memory_order_relaxed);
+		}
+
+		void Sub(int64_t count = 1) { m_Value.fetch_sub(count, std::memory_order_relaxed); }
+
+		void Set(int64_t value)
+		{
+			m_Value.store(value, std::memory_order_relaxed);
+			UpdatePeak(value);
+		}
+
+		const std::string& GetName() const { return m_Name; }
+		int64_t GetValue() const { return m_Value.load(std::memory_order_relaxed); }
+		int64_t GetPeak() const { return m_Peak.load(std::memory_order_relaxed); }
+		int64_t GetTotal() const { return m_Total.load(std::memory_order_relaxed); }
+		// Adds during the last completed frame
+		int64_t GetLastFrame() const { return m_LastFrame.load(std::memory_order_relaxed); }
+
+	private:
+		friend class Telemetry;
+
+		void UpdatePeak(int64_t value)
+		{
+			int64_t peak = m_Peak.load(std::memory_order_relaxed);
+			while (value > peak && !m_Peak.compare_exchange_weak(peak, value, std::memory_order_relaxed))
+				;
+		}
+
+		std::string m_Name;
+		std::atomic_int64_t m_Value{ 0 };
+		std::atomic_int64_t m_Peak{ 0 };
+		std::atomic_int64_t m_Total{ 0 };
+		std::atomic_int64_t m_Frame{ 0 };
+		std::atomic_int64_t m_LastFrame{ 0 };
+	};
+
+	// Registry of all StatCounters
+	class Telemetry
+	{
+	public:
+		// Once per frame, closes the per-frame counts
+		static void EndFrame();
+		static uint64_t GetFrameCount();
+
+		struct Snapshot
+		{
+			std::string name;
+			int64_t value, peak, total, lastFrame;
+		};
+		// Sorted by name
+		static std::vector<Snapshot> GetSnapshot();
+		// nullptr if there is no counter of that name
+		static const StatCounter* Find(const std::string& name);
+
+		// { "frame": N, "counters": { "<name>": { "value", "peak", "total", "lastFrame" }, ... } }
+		static void WriteJson(std::ostream& out);
+		static bool DumpJson(const std::wstring& filePath);
+
+	private:
+		friend class StatCounter;
+
+		static void Register(StatCounter* counter);
+		static void Unregister(StatCounter* counter);
+	};
+}
@@ -3,6 +3,7 @@
 #include "Graphics.h"
 #include "CommandContext.h"
 #include "Utilities/FileUtility.h"
+#include "Telemetry.h"
 #include <thread>
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -10,6 +11,9 @@
 
 namespace MyDirectX
 {
+	static StatCounter s_TextureCount("TextureManager.Textures");
+	static StatCounter s_TextureCacheHits("TextureManager.CacheHits");
+	static StatCounter s_TextureLoadFailures("TextureManager.LoadFailures");
 
 	Texture TextureManager::s_DefaultTexture[(int)EDefaultTexture::kNumDefaultTextures];
 
@@ -59,8 +63,7 @@ namespace MyDirectX
 
 		CommandContext::InitializeTexture(*this, 1, &texResource);
 
-		if (m_hCpuDescriptorHandle.ptr == D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN)
-			m_hCpuDescriptorHandle = Graphics::AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+		AllocateDescriptor();
 
 		//-mf
 		//D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
@@ -127,8 +130,7 @@ namespace MyDirectX
 
 		CommandContext::InitializeTexture(*this, 1, &texResource);
 
-		if (m_hCpuDescriptorHandle.ptr == D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN)
-			m_hCpuDescriptorHandle = Graphics::AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+		AllocateDescriptor();
 
 		D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
 		srvDesc.Format = format;
@@ -200,8 +202,7 @@ namespace MyDirectX
 
 	bool Texture::CreateDDSFromMemory(ID3D12Device* pDevice, const void* memBuffer, size_t fileSize, bool sRGB)
 	{
-		if (m_hCpuDescriptorHandle.ptr == D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN)
-			m_hCpuDescriptorHandle = Graphics::AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+		AllocateDescriptor();
 
 		bool valid = SUCCEEDED(CreateDDSTextureFromMemory(pDevice,
 			(const uint8_t*)memBuffer, fileSize, 0, sRGB, &m_pResource, m_hCpuDescriptorHandle));
@@ -260,6 +261,33 @@ namespace MyDirectX
 		stbi_image_free(data);
 	}
 
+	void Texture::Destroy()
+	{
+		GpuResource::Destroy();
+		ReleaseDescriptor();
+		m_hCpuDescriptorHandle.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
+	}
+
+	void Texture::AllocateDescriptor()
+	{
+		if (m_hCpuDescriptorHandle.ptr != D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN)
+			return;
+
+		m_hCpuDescriptorHandle = Graphics::AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+		m_OwnsDescriptor = true;
+	}
+
+	// default textures share their SRV with managed textures, only the owner gives it back
+	void Texture::ReleaseDescriptor()
+	{
+		if (!m_OwnsDescriptor)
+			return;
+
+		Graphics::FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, m_hCpuDescriptorHandle);
+		m_hCpuDescriptorHandle.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
+		m_OwnsDescriptor = false;
+	}
+
 	/// ManagedTexture
 	void ManagedTexture::WaitForLoad() const
 	{
@@ -273,7 +301,30 @@ namespace MyDirectX
 		// while (volHandle.ptr == D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN && volValid) std::this_thread::yield();
 
 		//  -2021-3-8
-		while ((volatile bool&)m_IsLoading) std::this_thread::yield();
+		m_IsLoading.wait(true, std::memory_order_acquire);
+	}
+
+	bool ManagedTexture::LoadAwaiter::await_suspend(std::coroutine_handle<> handle)
+	{
+		std::lock_guard<std::mutex> lock(tex.m_WaiterMutex);
+		if (!tex.m_IsLoading.load(std::memory_order_acquire))
+			return false;
+		tex.m_Waiters.push_back(handle);
+		return true;
+	}
+
+	void ManagedTexture::FinishLoad()
+	{
+		std::vector<std::coroutine_handle<>> waiters;
+		{
+			std::lock_guard<std::mutex> lock(m_WaiterMutex);
+			m_IsLoading.store(false, std::memory_order_release);
+			waiters.swap(m_Waiters);
+		}
+		m_IsLoading.notify_all();
+
+		for (std::coroutine_handle<> handle : waiters)
+			Timo::g_TaskContext.Execute([handle](Timo::TaskParams) { handle.resume(); });
 	}
 
 	void ManagedTexture::Unload()
@@ -283,14 +334,17 @@ namespace MyDirectX
 
 	void ManagedTexture::SetDefault(EDefaultTexture detaultTex)
 	{
+		ReleaseDescriptor();
 		m_hCpuDescriptorHandle = TextureManager::GetDefaultTexture(detaultTex);
 	}
 
 	// Default to 'Invalid'
 	void ManagedTexture::SetToInvalidTexture()
 	{
+		ReleaseDescriptor();
 		m_hCpuDescriptorHandle = TextureManager::GetMagentaTex2D().GetSRV();
 		m_IsValid = false;
+		s_TextureLoadFailures.Add();
 	}
 
 	// TextureManager
@@ -322,6 +376,7 @@ namespace MyDirectX
 		DestroyDefaultTextures();
 
 		m_TextureCache.clear();
+		s_TextureCount.Set(0);
 	}
 
 	// <ManagedTexture*, bRequestLoad : bool>
@@ -339,11 +394,13 @@ namespace MyDirectX
 		// if it's found, it has already been loaded or the load process has begun
 		if (iter != m_TextureCache.end())
 		{
+			s_TextureCacheHits.Add();
 			return std::make_pair(iter->second.get(), false);
 		}
 
 		ManagedTexture* newTexture = new ManagedTexture(key);
 		m_TextureCache[key].reset(newTexture);
+		s_TextureCount.Add();
 
 		// this was the first time it was request, so indicate that the caller must read the file
 		return std::make_pair(newTexture, true);
@@ -367,6 +424,7 @@ namespace MyDirectX
 			{
 				// If a texture was already created make sure it has finished loading before
 				// returning a point to it
+				s_TextureCacheHits.Add();
 				tex = iter->second.get();
 				tex->WaitForLoad();
 				return tex;
@@ -376,6 +434,7 @@ namespace MyDirectX
 				// If it's not found, create a new managed texture and start loading it
 				tex = new ManagedTexture(key);
 				m_TextureCache[key].reset(tex);
+				s_TextureCount.Add();
 			}
 		}
 
@@ -390,7 +449,7 @@ namespace MyDirectX
 		{
 			tex->SetDefault(fallback);
 		}
-		tex->m_IsLoading = false;
+		tex->FinishLoad();
 
 		return nullptr;
 	}
@@ -429,7 +488,7 @@ namespace MyDirectX
 			tex->GetResource()->SetName(fileName.c_str());
 			tex->m_IsValid = true;
 		}
-		tex->m_IsLoading = false;
+		tex->FinishLoad();
 
 		return tex;
 	}
@@ -456,11 +515,82 @@ namespace MyDirectX
 		}
 		else
 			tex->SetToInvalidTexture();
-		tex->m_IsLoading = false;
+		tex->FinishLoad();
 
 		return tex;
 	}
 
+	Timo::Async<const ManagedTexture*> TextureManager::LoadFromFileAsync(ID3D12Device* pDevice, std::wstring fileName, bool sRGB)
+	{
+		const ManagedTexture* tex = co_await LoadDDSFromFileAsync(pDevice, fileName + L".dds", sRGB);
+		if (!tex->IsValid())
+			tex = co_await LoadTGAFromFileAsync(pDevice, fileName + L".tga", sRGB);
+
+		co_return tex;
+	}
+
+	Timo::Async<const ManagedTexture*> TextureManager::LoadDDSFromFileAsync(ID3D12Device* pDevice, std::wstring fileName, bool sRGB)
+	{
+		auto managedTex = FindOrLoadTexture(fileName);
+
+		ManagedTexture* tex = managedTex.first;
+		const bool requestsLoad = managedTex.second;
+
+		if (!requestsLoad)
+		{
+			// Loaded by someone else, resumed when it is done
+			co_await tex->WhenLoaded();
+			co_return tex;
+		}
+
+		Utility::ByteArray ba = co_await Utility::ReadFileAsync(m_RootPath + fileName);
+		{
+			std::lock_guard<std::mutex> lock(m_CreateMutex);
+			if (ba->size() == 0 || !tex->CreateDDSFromMemory(pDevice, ba->data(), ba->size(), sRGB))
+			{
+				tex->SetToInvalidTexture();
+			}
+			else
+			{
+				tex->GetResource()->SetName(fileName.c_str());
+				tex->m_IsValid = true;
+			}
+		}
+		tex->FinishLoad();
+
+		co_return tex;
+	}
+
+	Timo::Async<const ManagedTexture*> TextureManager::LoadTGAFromFileAsync(ID3D12Device* pDevice, std::wstring fileName, bool sRGB)
+	{
+		auto managedTex = FindOrLoadTexture(fileName);
+
+		ManagedTexture* tex = managedTex.first;
+		const bool requestsLoad = managedTex.second;
+
+		if (!requestsLoad)
+		{
+			co_await tex->WhenLoaded();
+			co_return tex;
+		}
+
+		Utility::ByteArray ba = co_await Utility::ReadFileAsync(m_RootPath + fileName);
+		{
+			std::lock_guard<std::mutex> lock(m_CreateMutex);
+			if (ba->size() > 0)
+			{
+				tex->CreateTGAFromMemory(pDevice, ba->data(), ba->size(), sRGB);
+				tex->GetResource()->SetName(fileName.c_str());
+				tex->m_IsValid = true;
+			}
+			else
+				tex->SetToInvalidTexture();
+		}
+		tex->FinishLoad();
+
+		co_return tex;
+	}
+
 	const ManagedTexture* TextureManager::LoadPIXImageFromFile(ID3D12Device* pDevice, const std::wstring& fileName)
 	{
 		auto managedTex = FindOrLoadTexture(fileName);
@@ -483,7 +613,7 @@ namespace MyDirectX
 		}
 		else
 			tex->SetToInvalidTexture();
-		tex->m_IsLoading = false;
+		tex->FinishLoad();
 
 		return tex;
 	}
@@ -543,7 +673,7 @@ namespace MyDirectX
 		}
 		else
 			tex->SetToInvalidTexture();
-		tex->m_IsLoading = false;
+		tex->FinishLoad();
 
 		return tex;
 	}
@@ -565,6 +695,7 @@ namespace MyDirectX
 				pTex.release();
 
 				m_TextureCache.erase(fileName[i]);
+				s_TextureCount.Sub();
 			}
 		}		
 	}
@@ -586,7 +717,7 @@ namespace MyDirectX
 
 		uint32_t blackPixel = 0;
 		tex->Create2D(Graphics::s_Device, 1, 1, DXGI_FORMAT_R8G8B8A8_UNORM, &blackPixel);
-		tex->m_IsLoading = false;
+		tex->FinishLoad();
 
 		return *tex;
 	}
@@ -606,7 +737,7 @@ namespace MyDirectX
 
 		uint32_t whitePixel = 0xFFFFFFFFul;
 		tex->Create2D(Graphics::s_Device, 1, 1, DXGI_FORMAT_R8G8B8A8_UNORM, &whitePixel);
-		tex->m_IsLoading = false;
+		tex->FinishLoad();
 
 		return *tex;
 	}
@@ -626,7 +757,7 @@ namespace MyDirectX
 
 		uint32_t magentaPixel = 0x00FF00FF;
 		tex->Create2D(Graphics::s_Device, 1, 1, DXGI_FORMAT_R8G8B8A8_UNORM, &magentaPixel);
-		tex->m_IsLoading = false;
+		tex->FinishLoad();
 
 		return *tex;
 	}
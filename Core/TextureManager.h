@@ -1,7 +1,11 @@
 #pragma once
 #include "pch.h"
 #include "GpuResource.h"
+#include "AsyncTask.h"
+#include <atomic>
+#include <coroutine>
 #include <mutex>
+#include <vector>
 
 namespace MyDirectX
 {
@@ -37,12 +41,7 @@ namespace MyDirectX
 		void CreatePIXImageFromMemory(ID3D12Device* pDevice, const void* memBuffer, size_t fileSize);
 		void CreateTexBySTB_IMAGE(ID3D12Device* pDevice, const void* memBuffer, size_t fileSize, bool sRGB);
 
-		virtual void Destroy() override
-		{
-			GpuResource::Destroy();
-			// this leaks descriptor handles. We should really give it back to be reused
-			m_hCpuDescriptorHandle.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
-		}
+		virtual void Destroy() override;
 
 		const D3D12_CPU_DESCRIPTOR_HANDLE& GetSRV() const { return m_hCpuDescriptorHandle; }
 
@@ -57,7 +56,13 @@ namespace MyDirectX
 		uint32_t m_Height = 0;
 		uint32_t m_Depth = 0;
 
+		// allocates the SRV if there is none yet
+		void AllocateDescriptor();
+		// frees the SRV if it was allocated by AllocateDescriptor()
+		void ReleaseDescriptor();
+
 		D3D12_CPU_DESCRIPTOR_HANDLE m_hCpuDescriptorHandle;
+		bool m_OwnsDescriptor = false;
 	};
 
 	class ManagedTexture : public Texture
@@ -68,6 +73,8 @@ namespace MyDirectX
 		ManagedTexture(const std::wstring& fileName) : m_MapKey(fileName), m_IsValid(false), m_IsLoading(true), m_ReferenceCount(0) {  }
 
 		void WaitForLoad() const;
+		// co_await WhenLoaded() suspends until the texture has loaded, the coroutine continues on Timo::g_TaskContext
+		auto WhenLoaded() const { return LoadAwaiter{ const_cast<ManagedTexture&>(*this) }; }
 		void Unload();
 
 		void SetDefault(EDefaultTexture detaultTex = EDefaultTexture::kMagenta2D);
@@ -75,9 +82,23 @@ namespace MyDirectX
 		bool IsValid() const { return m_IsValid; }
 
 	private:
+		struct LoadAwaiter
+		{
+			ManagedTexture& tex;
+
+			bool await_ready() const noexcept { return !tex.m_IsLoading.load(std::memory_order_acquire); }
+			bool await_suspend(std::coroutine_handle<> handle);
+			void await_resume() const noexcept { }
+		};
+
+		// ends the load, wakes the threads and resumes the coroutines waiting for it
+		void FinishLoad();
+
 		std::wstring m_MapKey;	// for deleting from the map later
 		bool m_IsValid;
-		bool m_IsLoading;
+		std::atomic<bool> m_IsLoading;
+		std::mutex m_WaiterMutex;
+		std::vector<std::coroutine_handle<>> m_Waiters;
 		size_t m_ReferenceCount = 0;
 	};
 
@@ -133,11 +154,22 @@ namespace MyDirectX
 		const ManagedTexture* LoadPIXImageFromFile(ID3D12Device* pDevice, const std::wstring& fileName);
 		const ManagedTexture* LoadBySTB_IMAGE(ID3D12Device* pDevice, const std::wstring& fileName, bool sRGB = false);
 
+		// Coroutine versions, the file is read on Timo::g_IOService and the texture created on Timo::g_TaskContext.
+		// Start many of them at once (Timo::WhenAll) so that the reads overlap with the decodes
+		Timo::Async<const ManagedTexture*> LoadFromFileAsync(ID3D12Device* pDevice, std::wstring fileName, bool sRGB = false);
+		Timo::Async<const ManagedTexture*> LoadDDSFromFileAsync(ID3D12Device* pDevice, std::wstring fileName, bool sRGB = false);
+		Timo::Async<const ManagedTexture*> LoadTGAFromFileAsync(ID3D12Device* pDevice, std::wstring fileName, bool sRGB = false);
+
 		const ManagedTexture* LoadFromFile(ID3D12Device* pDevice, const std::string& fileName, bool sRGB = false)
 		{
 			return LoadFromFile(pDevice, MakeWStr(fileName), sRGB);
 		}
 
+		Timo::Async<const ManagedTexture*> LoadFromFileAsync(ID3D12Device* pDevice, const std::string& fileName, bool sRGB = false)
+		{
+			return LoadFromFileAsync(pDevice, MakeWStr(fileName), sRGB);
+		}
+
 		const ManagedTexture* LoadBySTB_IMAGE(ID3D12Device* pDevice, const std::string& fileName, bool sRGB = false)
 		{
 			return LoadBySTB_IMAGE(pDevice, MakeWStr(fileName), sRGB);
@@ -175,5 +207,7 @@ namespace MyDirectX
 		std::wstring m_RootPath;
 		std::map<std::wstring, std::unique_ptr<ManagedTexture>> m_TextureCache;
 		std::mutex m_TexMutex;
+		// the async loads create their textures one at a time: descriptor allocation and the upload are shared
+		std::mutex m_CreateMutex;
 	};
 }
@@ -0,0 +1,103 @@
+#include "VertexConversion.h"
+#include <array>
+#include <utility>
+
+namespace MyDirectX
+{
+	namespace
+	{
+		using namespace VertexKernels;
+
+		constexpr uint32_t kNumComponents = (uint32_t)VertexComponent::Count;
+		constexpr uint32_t kMaxCount = 4;
+		constexpr uint32_t kMaxCopySize = 16;
+
+		// [component][source count][normalized][destination count], float destinations
+		constexpr size_t GetFloatIndex(uint32_t component, uint32_t srcCount, bool normalized, uint32_t dstCount)
+		{
+			return ((component * kMaxCount + srcCount - 1) * 2 + (normalized ? 1 : 0)) * kMaxCount + dstCount - 1;
+		}
+
+		template <size_t Index>
+		constexpr VertexConverter GetFloatKernel()
+		{
+			constexpr VertexComponent component = (VertexComponent)(Index / (kMaxCount * 2 * kMaxCount));
+			constexpr uint32_t srcCount = (uint32_t)(Index / (2 * kMaxCount) % kMaxCount + 1);
+			constexpr bool normalized = Index / kMaxCount % 2 != 0;
+			constexpr uint32_t dstCount = (uint32_t)(Index % kMaxCount + 1);
+			return &Convert<component, srcCount, normalized, VertexComponent::Float, dstCount>;
+		}
+
+		template <size_t... Index>
+		constexpr std::array<VertexConverter, sizeof...(Index)> MakeFloatKernels(std::index_sequence<Index...>)
+		{
+			return { GetFloatKernel<Index>()... };
+		}
+
+		template <size_t... Index>
+		constexpr std::array<VertexConverter, sizeof...(Index)> MakeCopyKernels(std::index_sequence<Index...>)
+		{
+			return { &Copy<Index + 1>... };
+		}
+
+		constexpr auto s_FloatKernels = MakeFloatKernels(std::make_index_sequence<kNumComponents * kMaxCount * 2 * kMaxCount>());
+		constexpr auto s_CopyKernels = MakeCopyKernels(std::make_index_sequence<kMaxCopySize>());
+
+		template <VertexComponent Dst>
+		VertexConverter GetIndexKernel(VertexComponent src)
+		{
+			switch (src)
+			{
+			case VertexComponent::UInt8: return &Convert<VertexComponent::UInt8, 1, false, Dst, 1>;
+			case VertexComponent::UInt16: return &Convert<VertexComponent::UInt16, 1, false, Dst, 1>;
+			case VertexComponent::UInt32: return &Convert<VertexComponent::UInt32, 1, false, Dst, 1>;
+			default: return nullptr;
+			}
+		}
+	}
+
+	uint32_t VertexFormat::GetSize() const
+	{
+		switch (component)
+		{
+		case VertexComponent::Int8:
+		case VertexComponent::UInt8:
+			return count;
+		case VertexComponent::Int16:
+		case VertexComponent::UInt16:
+			return 2 * count;
+		default:
+			return 4 * count;
+		}
+	}
+
+	VertexConverter GetVertexConverter(const VertexFormat& src, const VertexFormat& dst)
+	{
+		if (src.component >= VertexComponent::Count || src.count < 1 || src.count > kMaxCount
+			|| dst.component >= VertexComponent::Count || dst.count < 1 || dst.count > kMaxCount)
+			return nullptr;
+
+		if (src == dst)
+			return s_CopyKernels[src.GetSize() - 1];
+
+		if (dst.component == VertexComponent::Float)
+		{
+			const bool normalized = src.normalized && src.component != VertexComponent::Float;
+			return s_FloatKernels[GetFloatIndex((uint32_t)src.component, src.count, normalized, dst.count)];
+		}
+
+		if (src.count == 1 && dst.count == 1 && !src.normalized && !dst.normalized)
+		{
+			if (dst.component == VertexComponent::UInt16)
+				return GetIndexKernel<VertexComponent::UInt16>(src.component);
+			if (dst.component == VertexComponent::UInt32)
+				return GetIndexKernel<VertexComponent::UInt32>(src.component);
+		}
+		return nullptr;
+	}
+
+	VertexConverter GetVertexCopier(uint32_t size)
+	{
+		return size >= 1 && size <= kMaxCopySize ? s_CopyKernels[size - 1] : nullptr;
+	}
+}
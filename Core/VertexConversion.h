@@ -0,0 +1,168 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <immintrin.h>
+
+namespace MyDirectX
+{
+	/**
+		Vertex stream conversion for the importers. A kernel converts count elements of a strided source stream into a
+	strided destination, e.g. one attribute of an accessor into the interleaved vertices. Kernels are templates
+	specialized on the source component type and count, normalization and the destination component type and count,
+	so that the loop has no per-element switch. float3, float2, float4, unorm8x4 and unorm16x2 streams have SSE bodies.
+		GetVertexConverter() picks the kernel once per stream. Destinations are floats (missing components are 0), the
+	source format itself (a copy), or UInt16/UInt32 scalars from integer scalars (indices).
+	*/
+	enum class VertexComponent : uint8_t
+	{
+		Int8,
+		UInt8,
+		Int16,
+		UInt16,
+		UInt32,
+		Float,
+		Count
+	};
+
+	struct VertexFormat
+	{
+		VertexComponent component = VertexComponent::Float;
+		uint32_t count = 1;			// 1 - 4
+		bool normalized = false;	// integers map to [0, 1], or [-1, 1] if signed
+
+		uint32_t GetSize() const;
+
+		bool operator==(const VertexFormat& other) const
+		{
+			return component == other.component && count == other.count && (normalized == other.normalized || component == VertexComponent::Float);
+		}
+	};
+
+	using VertexConverter = void (*)(const uint8_t* src, size_t srcStride, uint8_t* dst, size_t dstStride, size_t count);
+
+	// nullptr if there is no kernel from src to dst
+	VertexConverter GetVertexConverter(const VertexFormat& src, const VertexFormat& dst);
+	// copies the first size bytes of each element as they are, for formats without a kernel. nullptr unless size is 1 - 16
+	VertexConverter GetVertexCopier(uint32_t size);
+
+	namespace VertexKernels
+	{
+		template <VertexComponent C> struct ComponentType;
+		template <> struct ComponentType<VertexComponent::Int8> { using Type = int8_t; };
+		template <> struct ComponentType<VertexComponent::UInt8> { using Type = uint8_t; };
+		template <> struct ComponentType<VertexComponent::Int16> { using Type = int16_t; };
+		template <> struct ComponentType<VertexComponent::UInt16> { using Type = uint16_t; };
+		template <> struct ComponentType<VertexComponent::UInt32> { using Type = uint32_t; };
+		template <> struct ComponentType<VertexComponent::Float> { using Type = float; };
+
+		template <typename D, bool Normalized, typename S>
+		inline D ConvertComponent(S value)
+		{
+			if constexpr (std::is_same_v<D, float> && Normalized && !std::is_same_v<S, float>)
+			{
+				// glTF: signed values clamp at -1, so that -128 and -127 both give -1
+				constexpr float kScale = 1.0f / (float)std::numeric_limits<S>::max();
+				if constexpr (std::is_signed_v<S>)
+					return std::max((float)value * kScale, -1.0f);
+				else
+					return (float)value * kScale;
+			}
+			else
+				return static_cast<D>(value);
+		}
+
+		template <VertexComponent Src, uint32_t SrcN, bool Normalized, VertexComponent Dst, uint32_t DstN>
+		void Convert(const uint8_t* src, size_t srcStride, uint8_t* dst, size_t dstStride, size_t count)
+		{
+			using S = typename ComponentType<Src>::Type;
+			using D = typename ComponentType<Dst>::Type;
+
+			for (size_t i = 0; i < count; ++i, src += srcStride, dst += dstStride)
+			{
+				S in[SrcN];
+				std::memcpy(in, src, sizeof(in));
+
+				D out[DstN];
+				for (uint32_t c = 0; c < DstN; ++c)
+					out[c] = c < SrcN ? ConvertComponent<D, Normalized>(in[c]) : D(0);
+				std::memcpy(dst, out, sizeof(out));
+			}
+		}
+
+		// unorm8x4 -> float4
+		template <>
+		inline void Convert<VertexComponent::UInt8, 4, true, VertexComponent::Float, 4>(const uint8_t* src, size_t srcStride,
+			uint8_t* dst, size_t dstStride, size_t count)
+		{
+			const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+			for (size_t i = 0; i < count; ++i, src += srcStride, dst += dstStride)
+			{
+				int packed;
+				std::memcpy(&packed, src, sizeof(packed));
+				const __m128i ints = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed));
+				_mm_storeu_ps((float*)dst, _mm_mul_ps(_mm_cvtepi32_ps(ints), scale));
+			}
+		}
+
+		// unorm16x2 -> float2
+		template <>
+		inline void Convert<VertexComponent::UInt16, 2, true, VertexComponent::Float, 2>(const uint8_t* src, size_t srcStride,
+			uint8_t* dst, size_t dstStride, size_t count)
+		{
+			const __m128 scale = _mm_set1_ps(1.0f / 65535.0f);
+			for (size_t i = 0; i < count; ++i, src += srcStride, dst += dstStride)
+			{
+				int packed;
+				std::memcpy(&packed, src, sizeof(packed));
+				const __m128i ints = _mm_cvtepu16_epi32(_mm_cvtsi32_si128(packed));
+				_mm_storel_pi((__m64*)dst, _mm_mul_ps(_mm_cvtepi32_ps(ints), scale));
+			}
+		}
+
+		// float3 -> float2, e.g. Assimp texture coordinates
+		template <>
+		inline void Convert<VertexComponent::Float, 3, false, VertexComponent::Float, 2>(const uint8_t* src, size_t srcStride,
+			uint8_t* dst, size_t dstStride, size_t count)
+		{
+			for (size_t i = 0; i < count; ++i, src += srcStride, dst += dstStride)
+				_mm_storel_epi64((__m128i*)dst, _mm_loadl_epi64((const __m128i*)src));
+		}
+
+		// elements of Size bytes, in one block when both streams are packed
+		template <size_t Size>
+		void Copy(const uint8_t* src, size_t srcStride, uint8_t* dst, size_t dstStride, size_t count)
+		{
+			if (srcStride == Size && dstStride == Size)
+			{
+				std::memcpy(dst, src, Size * count);
+				return;
+			}
+
+			for (size_t i = 0; i < count; ++i, src += srcStride, dst += dstStride)
+			{
+				if constexpr (Size == 16)
+					_mm_storeu_ps((float*)dst, _mm_loadu_ps((const float*)src));
+				else if constexpr (Size == 12)
+				{
+					// float3: the 4th float of a 16-byte load is only read up to the last element, the store is 8 + 4 bytes
+					if (i + 1 < count)
+					{
+						const __m128 value = _mm_loadu_ps((const float*)src);
+						_mm_storel_pi((__m64*)dst, value);
+						_mm_store_ss((float*)dst + 2, _mm_movehl_ps(value, value));
+					}
+					else
+						std::memcpy(dst, src, Size);
+				}
+				else if constexpr (Size == 8)
+					_mm_storel_epi64((__m128i*)dst, _mm_loadl_epi64((const __m128i*)src));
+				else
+					std::memcpy(dst, src, Size);
+			}
+		}
+	}
+}
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <thread>
+
+// Ref: Dmitry Vyukov. Bounded MPMC queue
+// https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+
+namespace Timo
+{
+    /**
+     * Lock-free bounded multi-producer multi-consumer queue, same surface as MtQueue.
+     * Every cell carries a sequence number telling whether it is ready for the producer or the consumer
+     * of a given lap, producers and consumers only contend on their own position counter.
+     * Blocking Push() / Pop() sleep on an eventcount (std::atomic::wait), the timed variants poll with
+     * yield() until the deadline.
+     */
+    template <typename T>
+    class MpmcQueue
+    {
+        struct Cell
+        {
+            std::atomic<std::size_t> sequence;
+            T value;
+        };
+
+        std::unique_ptr<Cell[]> m_Cells;
+        std::size_t m_Mask{};
+
+        alignas(64) std::atomic<std::size_t> m_EnqueuePos{ 0 };
+        alignas(64) std::atomic<std::size_t> m_DequeuePos{ 0 };
+
+        // Eventcounts for the blocking calls, consumers sleep on m_PushEpoch and producers on m_PopEpoch.
+        // Bit 0 is set by a thread about to sleep; the other side only bumps the counter and wakes the
+        // sleepers when it is set, which also clears it, so a busy queue doesn't make a syscall per item.
+        alignas(64) std::atomic_uint32_t m_PushEpoch{ 0 };
+        alignas(64) std::atomic_uint32_t m_PopEpoch{ 0 };
+
+        static void Notify(std::atomic_uint32_t& epoch)
+        {
+            // Pairs with the fetch_or() in Await(): either the sleeper sees the new item, or this sees the bit
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (epoch.load(std::memory_order_relaxed) & 1)
+            {
+                epoch.fetch_add(1);
+                epoch.notify_all();
+            }
+        }
+
+        template <typename TryFunc>
+        static void Await(std::atomic_uint32_t& epoch, const TryFunc& tryFunc)
+        {
+            while (!tryFunc())
+            {
+                const uint32_t waiting = epoch.fetch_or(1) | 1;
+                if (tryFunc())
+                    return;
+                epoch.wait(waiting);
+            }
+        }
+
+        template <typename TryFunc>
+        static bool PollUntil(std::chrono::steady_clock::time_point timepoint, const TryFunc& tryFunc)
+        {
+            while (!tryFunc())
+            {
+                if (std::chrono::steady_clock::now() >= timepoint)
+                    return false;
+                std::this_thread::yield();
+            }
+            return true;
+        }
+
+    public:
+        constexpr static std::size_t s_DefaultCapacity = 1024;
+
+        // capacity is rounded up to a power of 2
+        explicit MpmcQueue(std::size_t capacity = s_DefaultCapacity)
+        {
+            std::size_t size = 2;
+            while (size < capacity)
+                size *= 2;
+
+            m_Cells.reset(new Cell[size]);
+            m_Mask = size - 1;
+            for (std::size_t i = 0; i < size; ++i)
+                m_Cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        MpmcQueue(const MpmcQueue&) = delete;
+        MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+        std::size_t Capacity() const { return m_Mask + 1; }
+
+        // Snapshot, may be stale by the time it returns
+        std::size_t Size() const
+        {
+            const std::size_t dequeuePos = m_DequeuePos.load(std::memory_order_relaxed);
+            const std::size_t enqueuePos = m_EnqueuePos.load(std::memory_order_relaxed);
+            return enqueuePos > dequeuePos ? enqueuePos - dequeuePos : 0;
+        }
+        bool Empty() const { return Size() == 0; }
+
+        bool TryPush(T value)
+        {
+            Cell* cell;
+            std::size_t pos = m_EnqueuePos.load(std::memory_order_relaxed);
+            while (true)
+            {
+                cell = &m_Cells[pos & m_Mask];
+                const std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+                const std::intptr_t diff = (std::intptr_t)sequence - (std::intptr_t)pos;
+                if (diff == 0)
+                {
+                    if (m_EnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (diff < 0)
+                {
+                    // Full, the cell still holds the value of the previous lap
+                    return false;
+                }
+                else
+                {
+                    pos = m_EnqueuePos.load(std::memory_order_relaxed);
+                }
+            }
+
+            cell->value = std::move(value);
+            cell->sequence.store(pos + 1, std::memory_order_release);
+            Notify(m_PushEpoch);
+            return true;
+        }
+
+        void Push(T value)
+        {
+            Await(m_PopEpoch, [&]{ return TryPush(value); });
+        }
+
+        bool TryPushFor(T value, std::chrono::steady_clock::duration timeout)
+        {
+            return TryPushUntil(std::move(value), std::chrono::steady_clock::now() + timeout);
+        }
+
+        bool TryPushUntil(T value, std::chrono::steady_clock::time_point timepoint)
+        {
+            return PollUntil(timepoint, [&]{ return TryPush(value); });
+        }
+
+        std::optional<T> TryPop()
+        {
+            Cell* cell;
+            std::size_t pos = m_DequeuePos.load(std::memory_order_relaxed);
+            while (true)
+            {
+                cell = &m_Cells[pos & m_Mask];
+                const std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+                const std::intptr_t diff = (std::intptr_t)sequence - (std::intptr_t)(pos + 1);
+                if (diff == 0)
+                {
+                    if (m_DequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (diff < 0)
+                {
+                    // Empty
+                    return std::nullopt;
+                }
+                else
+                {
+                    pos = m_DequeuePos.load(std::memory_order_relaxed);
+                }
+            }
+
+            std::optional<T> value(std::move(cell->value));
+            cell->sequence.store(pos + m_Mask + 1, std::memory_order_release);
+            Notify(m_PopEpoch);
+            return value;
+        }
+
+        T Pop()
+        {
+            std::optional<T> value;
+            Await(m_PushEpoch, [&]{ value = TryPop(); return value.has_value(); });
+            return std::move(*value);
+        }
+
+        std::optional<T> TryPopFor(std::chrono::steady_clock::duration timeout)
+        {
+            return TryPopUntil(std::chrono::steady_clock::now() + timeout);
+        }
+
+        std::optional<T> TryPopUntil(std::chrono::steady_clock::time_point timepoint)
+        {
+            std::optional<T> value;
+            PollUntil(timepoint, [&]{ value = TryPop(); return value.has_value(); });
+            return value;
+        }
+    };
+}
@@ -14,7 +14,7 @@ namespace Timo
     class MtQueue
     {
         Queue m_Queue;
-        std::mutex m_Mutex;
+        mutable std::mutex m_Mutex;
         std::condition_variable m_CV_empty;
         std::condition_variable m_CV_full;
         std::size_t m_Limit{};
@@ -55,7 +55,7 @@ namespace Timo
         bool TryPushFor(T value, std::chrono::steady_clock::duration timeout)
         {
             std::unique_lock lock(m_Mutex);
-            if (!m_CV_full.wait_for(lock, timeout, [this]{ m_Queue.size() < m_Limit; }) )
+            if (!m_CV_full.wait_for(lock, timeout, [this]{ return m_Queue.size() < m_Limit; }) )
                 return false;
             m_Queue.push_back(value);
             m_CV_empty.notify_one();
@@ -65,7 +65,7 @@ namespace Timo
         bool TryPushUntil(T value, std::chrono::steady_clock::time_point timepoint)
         {
             std::unique_lock lock(m_Mutex);
-            if (m_CV_full.wait_until(lock, timepoint, [this]{ m_Queue.size() < m_Limit; }) )
+            if (!m_CV_full.wait_until(lock, timepoint, [this]{ return m_Queue.size() < m_Limit; }) )
                 return false;
             m_Queue.push_back(value);
             m_CV_empty.notify_one();
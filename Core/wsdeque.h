@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Ref: Chase, Lev. Dynamic Circular Work-Stealing Deque. SPAA 2005
+// Le, Pop, Cohen, Zappa Nardelli. Correct and Efficient Work-Stealing for Weak Memory Models. PPoPP 2013
+
+namespace Timo
+{
+    /**
+     * Work-stealing deque. The owning thread pushes and pops at the bottom (LIFO), any other thread
+     * steals from the top (FIFO), so thieves take the oldest, usually largest, pieces of work.
+     * T must be trivially copyable and lock-free as std::atomic<T> (pointers, small integers).
+     * The ring grows when full; old rings stay alive until the deque is destroyed, since a thief
+     * may still be reading from one.
+     */
+    template <typename T>
+    class WsDeque
+    {
+        struct Ring
+        {
+            explicit Ring(int64_t capacity) : m_Capacity(capacity), m_Mask(capacity - 1), m_Slots(new std::atomic<T>[capacity]) { }
+
+            int64_t Capacity() const { return m_Capacity; }
+            T Get(int64_t index) const { return m_Slots[index & m_Mask].load(std::memory_order_relaxed); }
+            void Put(int64_t index, T value) { m_Slots[index & m_Mask].store(value, std::memory_order_relaxed); }
+
+            Ring* Grow(int64_t bottom, int64_t top) const
+            {
+                Ring* ring = new Ring(m_Capacity * 2);
+                for (int64_t i = top; i < bottom; ++i)
+                    ring->Put(i, Get(i));
+                return ring;
+            }
+
+        private:
+            int64_t m_Capacity;
+            int64_t m_Mask;
+            std::unique_ptr<std::atomic<T>[]> m_Slots;
+        };
+
+        alignas(64) std::atomic<int64_t> m_Top{ 0 };
+        alignas(64) std::atomic<int64_t> m_Bottom{ 0 };
+        alignas(64) std::atomic<Ring*> m_Ring;
+        std::vector<std::unique_ptr<Ring>> m_Rings;    // owner only
+
+    public:
+        constexpr static int64_t s_DefaultCapacity = 256;
+
+        // capacity must be a power of 2
+        explicit WsDeque(int64_t capacity = s_DefaultCapacity)
+        {
+            m_Rings.emplace_back(new Ring(capacity));
+            m_Ring.store(m_Rings.back().get(), std::memory_order_relaxed);
+        }
+
+        WsDeque(const WsDeque&) = delete;
+        WsDeque& operator=(const WsDeque&) = delete;
+
+        // Owner only
+        void Push(T value)
+        {
+            int64_t bottom = m_Bottom.load(std::memory_order_relaxed);
+            int64_t top = m_Top.load(std::memory_order_acquire);
+            Ring* ring = m_Ring.load(std::memory_order_relaxed);
+            if (bottom - top > ring->Capacity() - 1)
+            {
+                ring = ring->Grow(bottom, top);
+                m_Rings.emplace_back(ring);
+                m_Ring.store(ring, std::memory_order_release);
+            }
+            ring->Put(bottom, value);
+            m_Bottom.store(bottom + 1, std::memory_order_release);
+        }
+
+        // Owner only
+        bool Pop(T& value)
+        {
+            int64_t bottom = m_Bottom.load(std::memory_order_relaxed) - 1;
+            Ring* ring = m_Ring.load(std::memory_order_relaxed);
+            m_Bottom.store(bottom, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t top = m_Top.load(std::memory_order_relaxed);
+
+            if (top > bottom)
+            {
+                // Empty
+                m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+                return false;
+            }
+
+            value = ring->Get(bottom);
+            if (top == bottom)
+            {
+                // Last item, race the thieves for it
+                bool bWon = m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+                m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+                return bWon;
+            }
+            return true;
+        }
+
+        // Any thread. Fails when empty or when another thread took the item first.
+        bool Steal(T& value)
+        {
+            int64_t top = m_Top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t bottom = m_Bottom.load(std::memory_order_acquire);
+            if (top >= bottom)
+                return false;
+
+            Ring* ring = m_Ring.load(std::memory_order_acquire);
+            value = ring->Get(top);
+            return m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        }
+
+        // Snapshot, may be stale by the time it returns
+        bool Empty() const
+        {
+            return m_Bottom.load(std::memory_order_acquire) <= m_Top.load(std::memory_order_acquire);
+        }
+    };
+}
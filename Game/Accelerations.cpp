@@ -1,7 +1,15 @@
 ﻿#include "Accelerations.h"
-#include "Utility.h"
+#include "Task.h"
+#include "CpuProfiler.h"
+#include "Utilities/MappedFile.h"
 #include <fstream>
+#include <atomic>
+#include <bit>
 
+#ifdef RTRT_STANDALONE
+// The engine compiles stb_image in TextureManager.cpp
+#define STB_IMAGE_IMPLEMENTATION
+#endif
 #define STBI_NO_PSD
 #define STBI_NO_PIC
 #define STBI_NO_PNM
@@ -47,6 +55,61 @@ namespace rtrt
 		return false;
 	}
 
+	// Same tests as IntersectTriangle(), on 4 triangles at once. The nearest hit wins, ties go to the lowest lane,
+	// which matches testing the triangles one by one in lane order.
+	bool IntersectTriangleBlock(Ray& ray, Intersection& isect, const TriangleBlock& block, const uint instanceIndex)
+	{
+		const __m128 dx = _mm_set1_ps(ray.rd.x), dy = _mm_set1_ps(ray.rd.y), dz = _mm_set1_ps(ray.rd.z);
+		const __m128 e1x = _mm_load_ps(block.e1x), e1y = _mm_load_ps(block.e1y), e1z = _mm_load_ps(block.e1z);
+		const __m128 e2x = _mm_load_ps(block.e2x), e2y = _mm_load_ps(block.e2y), e2z = _mm_load_ps(block.e2z);
+
+		// h = cross(rd, edge2), a = dot(edge1, h)
+		const __m128 hx = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(e2y, dz));
+		const __m128 hy = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(e2z, dx));
+		const __m128 hz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(e2x, dy));
+		const __m128 a = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, hx), _mm_mul_ps(e1y, hy)), _mm_mul_ps(e1z, hz));
+		const __m128 absA = _mm_andnot_ps(_mm_set1_ps(-0.0f), a);
+		__m128 mask = _mm_cmpge_ps(absA, _mm_set1_ps(0.0001f));
+		if (_mm_movemask_ps(mask) == 0)
+			return false;
+
+		const __m128 f = _mm_div_ps(_mm_set1_ps(1.0f), a);
+		const __m128 sx = _mm_sub_ps(_mm_set1_ps(ray.ro.x), _mm_load_ps(block.v0x));
+		const __m128 sy = _mm_sub_ps(_mm_set1_ps(ray.ro.y), _mm_load_ps(block.v0y));
+		const __m128 sz = _mm_sub_ps(_mm_set1_ps(ray.ro.z), _mm_load_ps(block.v0z));
+		const __m128 u = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, hx), _mm_mul_ps(sy, hy)), _mm_mul_ps(sz, hz)));
+		mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(u, _mm_setzero_ps()), _mm_cmple_ps(u, _mm_set1_ps(1.0f))));
+		if (_mm_movemask_ps(mask) == 0)
+			return false;
+
+		// q = cross(s, edge1)
+		const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(e1y, sz));
+		const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(e1z, sx));
+		const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(e1x, sy));
+		const __m128 v = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)));
+		const __m128 t = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)));
+		mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(v, _mm_setzero_ps()), _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f))));
+		mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpgt_ps(t, _mm_set1_ps(0.0001f)), _mm_cmplt_ps(t, _mm_set1_ps(ray.tMax))));
+		const int hitMask = _mm_movemask_ps(mask);
+		if (hitMask == 0)
+			return false;
+
+		// Nearest of the accepted lanes
+		__m128 tHit = _mm_or_ps(_mm_and_ps(mask, t), _mm_andnot_ps(mask, _mm_set1_ps(g_Max)));
+		__m128 tMin = _mm_min_ps(tHit, _mm_shuffle_ps(tHit, tHit, _MM_SHUFFLE(2, 3, 0, 1)));
+		tMin = _mm_min_ps(tMin, _mm_shuffle_ps(tMin, tMin, _MM_SHUFFLE(1, 0, 3, 2)));
+		const int lane = std::countr_zero((uint)(_mm_movemask_ps(_mm_cmpeq_ps(tHit, tMin)) & hitMask));
+
+		alignas(16) float ts[4], us[4], vs[4];
+		_mm_store_ps(ts, t); _mm_store_ps(us, u); _mm_store_ps(vs, v);
+		ray.tMax = ts[lane];
+		isect.t = ts[lane];
+		isect.u = us[lane]; isect.v = vs[lane];
+		isect.inst_prim = (instanceIndex << 20) | block.primIndex[lane];
+
+		return true;
+	}
+
 	inline float IntersectAABB(const Ray &ray, const float3 &bmin, const float3 &bmax)
 	{
 		// "Slab test" ray/AABB intersection
@@ -68,17 +131,105 @@ namespace rtrt
 	float IntersectAABB_SSE(const Ray &ray, const __m128 &bmin4, const __m128 &bmax4)
 	{
 		static __m128 mask4 = _mm_cmpeq_ps(_mm_setzero_ps(), _mm_set_ps(1, 0, 0, 0));
-		__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_and_ps(bmin4, mask4), ray.o4), ray.rd4);
-		__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_and_ps(bmax4, mask4), ray.o4), ray.rd4);
-		__m128 vmax4 = _mm_max_ps(t0, t1), vmin4 = _mm_min_ps(t0, t1);
-		float tmax = std::min(vmax4.m128_f32[0], std::min(vmax4.m128_f32[1], vmax4.m128_f32[2]));
-		float tmin = std::max(vmin4.m128_f32[0], std::max(vmin4.m128_f32[1], vmin4.m128_f32[2]));
+		const __m128 o4 = ray.O4(), rd4 = ray.RcpD4();
+		__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_and_ps(bmin4, mask4), o4), rd4);
+		__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_and_ps(bmax4, mask4), o4), rd4);
+		alignas(16) float vmax[4], vmin[4];
+		_mm_store_ps(vmax, _mm_max_ps(t0, t1));
+		_mm_store_ps(vmin, _mm_min_ps(t0, t1));
+		float tmax = std::min(vmax[0], std::min(vmax[1], vmax[2]));
+		float tmin = std::max(vmin[0], std::max(vmin[1], vmin[2]));
 
 		bool bIntersect = tmax >= tmin && tmin < ray.tMax&& tmax > 0;
 		return bIntersect ? tmin : Ray::TMAX;
 	}
 
 
+	/// TraversalStats
+	void TraversalStats::Touch(const void* ptr, size_t size)
+	{
+		uintptr_t first = (uintptr_t)ptr >> 6, last = ((uintptr_t)ptr + size - 1) >> 6;
+		for (uintptr_t line = first; line <= last; ++line)
+		{
+			// Tags are stored +1, so that 0 marks an empty line
+			uintptr_t& tag = m_CacheTags[line % s_CacheLines];
+			if (tag != line + 1)
+			{
+				tag = line + 1;
+				++cacheMisses;
+			}
+		}
+	}
+
+	/// RayPacket
+	void RayPacket::Init(uint packetWidth, uint packetHeight)
+	{
+		width = packetWidth;
+		height = packetHeight;
+		size = std::min(packetWidth * packetHeight, s_MaxSize);
+		for (uint i = 0; i < size; ++i)
+			hits[i] = false;
+	}
+
+	void RayPacket::UpdateFrustum()
+	{
+		frustum.bValid = false;
+		if (width < 2 || height < 2 || width * height != size)
+			return;
+
+		// The corner rays only bound the packet if all rays start at the same point
+		const float3 origin = rays[0].ro;
+		for (uint i = 1; i < size; ++i)
+		{
+			if (rays[i].ro != origin)
+				return;
+		}
+
+		// Corners in winding order: top-left, top-right, bottom-right, bottom-left
+		const float3 corners[4] = { rays[0].rd, rays[width - 1].rd, rays[size - 1].rd, rays[size - width].rd };
+		const float3 center = corners[0] + corners[1] + corners[2] + corners[3];
+		for (int i = 0; i < 4; ++i)
+		{
+			float3 n = glm::cross(corners[i], corners[(i + 1) & 3]);
+			if (glm::dot(n, center) < 0.0f)
+				n = -n;
+			frustum.normals[i] = n;
+			frustum.dists[i] = glm::dot(n, origin);
+		}
+		frustum.bValid = true;
+	}
+
+	bool RayPacket::FrustumOverlaps(const float3& bmin, const float3& bmax) const
+	{
+		if (!frustum.bValid)
+			return true;
+
+		for (int i = 0; i < 4; ++i)
+		{
+			// Test the box corner furthest along the plane normal
+			const float3& n = frustum.normals[i];
+			const float3 p{ n.x > 0.0f ? bmax.x : bmin.x, n.y > 0.0f ? bmax.y : bmin.y, n.z > 0.0f ? bmax.z : bmin.z };
+			if (glm::dot(n, p) < frustum.dists[i])
+				return false;
+		}
+		return true;
+	}
+
+	// Index of the first ray in [first, size) that hits the box, size if none
+	static uint FindFirstHit(const RayPacket& packet, uint first, const float3& bmin, const float3& bmax)
+	{
+		if (!packet.FrustumOverlaps(bmin, bmax))
+			return packet.size;
+
+		for (; first < packet.size; ++first)
+		{
+			if (IntersectAABB(packet.rays[first], bmin, bmax) != Ray::TMAX)
+				break;
+		}
+		return first;
+	}
+
+
 	/// Surface
 	char g_Font[51][5][6];
 	bool g_bFontInited = false;
@@ -89,24 +240,17 @@ namespace rtrt
 	{
 		if (buffer == nullptr)
 		{
-			pixels = (uint*)_aligned_malloc(w * h * sizeof(uint), ALIGNMENT);
+			pixels = (uint*)AlignedAlloc(w * h * sizeof(uint), ALIGNMENT);
 			ownBuffer = true; // Needs to be deleted in destructor
 		}
 	}
 
 	Surface::Surface(const char* file) : pixels(nullptr), width(1), height(1)
 	{
-#if 1
-		FILE* f;
-		errno_t errorCode = fopen_s(&f, file, "rb");
-#else
-		// 'strcpy': This function or variable may be unsafe.Consider using strcpy_s instead.
-		// To disable deprecation, use _CRT_SECURE_NO_WARNINGS.
-		f = fopen(file, "rb");
-#endif
-		if (errorCode != 0)
+		FILE* f = OpenFile(file, "rb");
+		if (f == nullptr)
 		{
-			Utility::Printf("File not found: %s", file);
+			Printf("File not found: %s", file);
 			while (1) exit(0);
 		}
 		fclose(f);
@@ -119,7 +263,7 @@ namespace rtrt
 		uchar* data = stbi_load(file, &width, &height, &n, 0);
 		if (data)
 		{
-			pixels = (uint*)_aligned_malloc(width * height * sizeof(uint), ALIGNMENT);
+			pixels = (uint*)AlignedAlloc(width * height * sizeof(uint), ALIGNMENT);
 			ownBuffer = true;
 			const int s = width * height;
 			if (n == 1) // Greyscale
@@ -145,7 +289,7 @@ namespace rtrt
 	Surface::~Surface()
 	{
 		if (ownBuffer)
-			_aligned_free(pixels); // Free only if we allocated the buffer ourselves
+			AlignedFree(pixels); // Free only if we allocated the buffer ourselves
 	}
 
 	void Surface::Clear(uint c)
@@ -235,11 +379,10 @@ namespace rtrt
 
 	void Surface::SetChar(int c, const char* c1, const char* c2, const char* c3, const char* c4, const char* c5)
 	{
-		strcpy_s(g_Font[c][0], c1);
-		strcpy_s(g_Font[c][1], c2);
-		strcpy_s(g_Font[c][2], c3);
-		strcpy_s(g_Font[c][3], c4);
-		strcpy_s(g_Font[c][4], c5);
+		// Rows longer than 5 pixels are cut, every row stays terminated
+		const char* rows[] = { c1, c2, c3, c4, c5 };
+		for (int i = 0; i < 5; ++i)
+			std::snprintf(g_Font[c][i], sizeof(g_Font[c][i]), "%s", rows[i]);
 	}
 
 	void Surface::InitCharset()
@@ -316,12 +459,12 @@ namespace rtrt
 
 	void* BVHNode::operator new(size_t size)
 	{
-		return _aligned_malloc(size, ALIGNMENT);
+		return AlignedAlloc(size, ALIGNMENT);
 	}
 
 	void BVHNode::operator delete(void* ptr)
 	{
-		_aligned_free(ptr);
+		AlignedFree(ptr);
 	}
 
 
@@ -331,11 +474,10 @@ namespace rtrt
 		// Bare-bones obj file loader; only supports very basic meshes
 		m_Texture = std::make_unique<Surface>(texFile);
 
-		FILE* file = nullptr;
-		int ret = fopen_s(&file, objFile, "r");
-		if (ret != 0)
+		FILE* file = OpenFile(objFile, "r");
+		if (file == nullptr)
 		{
-			Utility::Printf("File %s not found!", objFile);
+			Printf("File %s not found!", objFile);
 			while (1) exit(-1);
 		}
 
@@ -352,15 +494,15 @@ namespace rtrt
 			char line[512] = { 0 };
 			fgets(line, 511, file);
 			if (line == strstr(line, "vt "))
-				sscanf_s(line + 3, "%f %f", &UV[UVs].x, &UV[UVs].y), UVs++;
+				sscanf(line + 3, "%f %f", &UV[UVs].x, &UV[UVs].y), UVs++;
 			else if (line == strstr(line, "vn "))
-				sscanf_s(line + 3, "%f %f %f", &m_Normals[Ns].x, &m_Normals[Ns].y, &m_Normals[Ns].z), Ns++;
+				sscanf(line + 3, "%f %f %f", &m_Normals[Ns].x, &m_Normals[Ns].y, &m_Normals[Ns].z), Ns++;
 			else if (line[0] == 'v')
-				sscanf_s(line + 2, "%f %f %f", &m_Positions[Ps].x, &m_Positions[Ps].y, &m_Positions[Ps].z), Ps++;
+				sscanf(line + 2, "%f %f %f", &m_Positions[Ps].x, &m_Positions[Ps].y, &m_Positions[Ps].z), Ps++;
 			if (line[0] != 'f')
 				continue;
 			else
-				sscanf_s(line + 2, "%i/%i/%i %i/%i/%i %i/%i/%i", &a, &b, &c, &d, &e, &f, &g, &h, &i);
+				sscanf(line + 2, "%i/%i/%i %i/%i/%i %i/%i/%i", &a, &b, &c, &d, &e, &f, &g, &h, &i);
 
 			auto& tri = m_Triangles[m_TriCount];
 			auto& triEx = m_TrianglesEx[m_TriCount];
@@ -373,6 +515,36 @@ namespace rtrt
 		fclose(file);
 	}
 
+	// Raw triangle soup (.tri), 9 floats per line, as used by the BVHAssets models
+	Mesh::Mesh(const char* triFile)
+	{
+		FILE* file = OpenFile(triFile, "r");
+		if (file == nullptr)
+		{
+			Printf("File %s not found!", triFile);
+			while (1) exit(-1);
+		}
+
+		std::vector<Triangle> triangles;
+		Triangle tri;
+		while (fscanf(file, "%f %f %f %f %f %f %f %f %f\n",
+			&tri.v0.x, &tri.v0.y, &tri.v0.z,
+			&tri.v1.x, &tri.v1.y, &tri.v1.z,
+			&tri.v2.x, &tri.v2.y, &tri.v2.z) == 9)
+		{
+			// The files end with a "999 999 ..." line
+			if (tri.v0.x == 999.0f)
+				break;
+			triangles.push_back(tri);
+		}
+		fclose(file);
+
+		m_TriCount = (int)triangles.size();
+		m_Triangles.reset(new Triangle[m_TriCount]);
+		m_TrianglesEx.reset(new TriangleEx[m_TriCount]);
+		std::copy(triangles.begin(), triangles.end(), m_Triangles.get());
+	}
+
 	// Basic constructor, for top-down TLAS construction
 	Mesh::Mesh(uint primCount)
 	{
@@ -381,9 +553,12 @@ namespace rtrt
 		m_TrianglesEx.reset(new TriangleEx[primCount]);
 	}
 
-	void Mesh::Init()
+	void Mesh::Init(BVHBuildMode buildMode, const char* cacheFile)
 	{
-		m_BVH.reset(new BVH(this));
+		if (cacheFile != nullptr)
+			m_BVH.reset(new BVH(this, cacheFile, buildMode));
+		else
+			m_BVH.reset(new BVH(this, buildMode));
 	}
 
 
@@ -393,22 +568,93 @@ namespace rtrt
 		int triCount = 0;
 	};
 	static constexpr int s_Bins = 8;
+	// Triangles per task when binning a large node on all workers
+	static constexpr uint s_BinGroupSize = 16384;
+
+	// Sweep the bins of one axis and keep the cheapest split plane
+	static void EvaluateBins(const Bin (&bins)[s_Bins], int a, float cmin, float scale, float& bestCost, int& axis, float& splitPos)
+	{
+		float areas0[s_Bins - 1], areas1[s_Bins - 1];
+		float triCount0[s_Bins - 1], triCount1[s_Bins - 1];
+		float n0 = 0, n1 = 0;
+		Bounds b0, b1;
+		for (int i = 0; i < s_Bins - 1; ++i)
+		{
+			const auto& bin0 = bins[i];
+			b0.Union(bin0.bounds);
+			n0 += bin0.triCount;
+			areas0[i] = b0.Area(); triCount0[i] = n0;
+
+			const auto& bin1 = bins[s_Bins - 1 - i];
+			b1.Union(bin1.bounds);
+			n1 += bin1.triCount;
+			areas1[s_Bins - 2 - i] = b1.Area(); triCount1[s_Bins - 2 - i] = n1;
+		}
+
+		scale = 1.0f / scale;
+		for (int i = 1; i < s_Bins - 1; ++i)
+		{
+			float cost = areas0[i] * triCount0[i] + areas1[i] * triCount1[i];
+			if (cost < bestCost)
+			{
+				axis = a;
+				splitPos = cmin + scale * (i + 1);
+				bestCost = cost;
+			}
+		}
+	}
 
 
 	/// BVH
-	BVH::BVH(Mesh* pMesh)
+	// Out of line, m_CacheFile holds an incomplete type in the header
+	BVH::BVH() = default;
+
+	BVH::BVH(Mesh* pMesh, BVHBuildMode buildMode)
 	{
 		m_Mesh = pMesh;
 
-		int triCount = pMesh->m_TriCount;
-		m_BVHNodes.reset(new BVHNode[triCount * 2]);
-		m_TriIndices.reset(new uint[triCount]);
+		Build(buildMode);
+	}
+
+	BVH::BVH(Mesh* pMesh, const char* cacheFile, BVHBuildMode buildMode)
+	{
+		m_Mesh = pMesh;
+
+		if (Load(cacheFile))
+			return;
+
+		Build(buildMode);
+		if (!Save(cacheFile))
+			Printf("BVH cache %s could not be written\n", cacheFile);
+	}
+
+	BVH::~BVH() = default;
+
+	void BVH::Reserve(uint refCapacity)
+	{
+		// Mapped arrays are sized for the cached tree only, a rebuild always moves to owned memory
+		if (refCapacity <= m_RefCapacity && m_CacheFile == nullptr)
+			return;
 
-		Build();
+		// A leaf holds at least one reference, and node 1 is never used
+		m_NodeStorage.reset(new BVHNode[refCapacity * 2]);
+		m_TriIndexStorage.reset(new uint[refCapacity]);
+		m_BVHNodes = m_NodeStorage.get();
+		m_TriIndices = m_TriIndexStorage.get();
+		m_LeafBlocks.reset(new uint[refCapacity]);
+		m_RefCapacity = refCapacity;
+		m_CacheFile.reset();
 	}
 
-	bool BVH::Intersect(Ray& ray, Intersection &isect, uint instanceIndex)
+	bool BVH::Intersect(Ray& ray, Intersection &isect, uint instanceIndex, TraversalStats* pStats)
 	{
+		if (m_Layout == BVHLayout::Wide4)
+			return m_MBVH4->Intersect(ray, isect, instanceIndex, pStats);
+		if (m_Layout == BVHLayout::Wide8)
+			return m_MBVH8->Intersect(ray, isect, instanceIndex, pStats);
+		if (m_Layout == BVHLayout::Quantized)
+			return m_QBVH->Intersect(ray, isect, instanceIndex, pStats);
+
 		BVHNode* node = &m_BVHNodes[0], * stack[128];
 		uint stackCount = 0;
 		bool bIntersect = false;
@@ -416,12 +662,7 @@ namespace rtrt
 		{
 			if (node->IsLeaf())
 			{
-				for (uint i = node->leftFirst, imax = node->leftFirst + node->triCount; i < imax; ++i)
-				{
-					uint index = m_TriIndices[i];
-					uint inst_prim = (instanceIndex << 20) | index;
-					bIntersect |= IntersectTriangle(ray, isect, m_Mesh->m_Triangles[index], inst_prim);
-				}
+				bIntersect |= IntersectLeaf(ray, isect, node->leftFirst, node->triCount, instanceIndex, pStats);
 				if (stackCount == 0)
 					break;
 				else
@@ -429,11 +670,12 @@ namespace rtrt
 			}
 			else
 			{
+				if (pStats) { ++pStats->nodeVisits; pStats->aabbTests += 2; pStats->Touch(&m_BVHNodes[node->leftFirst], 2 * sizeof(BVHNode)); }
 				BVHNode* pChild0 = &m_BVHNodes[node->leftFirst];
 				BVHNode* pChild1 = &m_BVHNodes[node->leftFirst + 1];
 #if 1
-				float d0 = IntersectAABB_SSE(ray, pChild0->bmin4, pChild0->bmax4);
-				float d1 = IntersectAABB_SSE(ray, pChild1->bmin4, pChild1->bmax4);
+				float d0 = IntersectAABB_SSE(ray, pChild0->Min4(), pChild0->Max4());
+				float d1 = IntersectAABB_SSE(ray, pChild1->Min4(), pChild1->Max4());
 #else
 				float d0 = IntersectAABB(ray, pChild0->bmin, pChild0->bmax);
 				float d1 = IntersectAABB(ray, pChild1->bmin, pChild1->bmax);
@@ -463,27 +705,452 @@ namespace rtrt
 		return bIntersect;
 	}
 
-	void BVH::Build()
+	void BVH::IntersectPacket(RayPacket& packet, uint instanceIndex, uint firstRay)
+	{
+		struct StackEntry { const BVHNode* node; uint first; };
+		StackEntry stack[128];
+		uint stackCount = 0;
+
+		const BVHNode* node = &m_BVHNodes[0];
+		uint first = FindFirstHit(packet, firstRay, node->bmin, node->bmax);
+		if (first == packet.size)
+			return;
+
+		while (true)
+		{
+			if (node->IsLeaf())
+			{
+				for (uint r = first; r < packet.size; ++r)
+					packet.hits[r] |= IntersectLeaf(packet.rays[r], packet.isects[r], node->leftFirst, node->triCount, instanceIndex, nullptr);
+				if (stackCount == 0)
+					break;
+				node = stack[--stackCount].node;
+				first = stack[stackCount].first;
+			}
+			else
+			{
+				const BVHNode* pChild0 = &m_BVHNodes[node->leftFirst];
+				const BVHNode* pChild1 = &m_BVHNodes[node->leftFirst + 1];
+				uint first0 = FindFirstHit(packet, first, pChild0->bmin, pChild0->bmax);
+				uint first1 = FindFirstHit(packet, first, pChild1->bmin, pChild1->bmax);
+
+				// Visit the child closer along the direction of the first active ray first
+				const float3 delta = (pChild1->bmin + pChild1->bmax) - (pChild0->bmin + pChild0->bmax);
+				if (glm::dot(delta, packet.rays[first].rd) < 0.0f)
+				{
+					std::swap(pChild0, pChild1);
+					std::swap(first0, first1);
+				}
+
+				if (first0 == packet.size && first1 == packet.size)
+				{
+					if (stackCount == 0)
+						break;
+					node = stack[--stackCount].node;
+					first = stack[stackCount].first;
+				}
+				else if (first0 == packet.size)
+				{
+					node = pChild1; first = first1;
+				}
+				else
+				{
+					node = pChild0; first = first0;
+					if (first1 != packet.size)
+						stack[stackCount++] = { pChild1, first1 };
+				}
+			}
+		}
+	}
+
+	// A triangle, or the part of it that falls into a node after spatial splits (SBVH)
+	struct BVH::Reference
+	{
+		Bounds bounds;
+		uint triIdx;
+	};
+
+	void BVH::Build(BVHBuildMode buildMode)
 	{
+		CPU_PROFILE_SCOPE("BVH::Build");
+
+		// Without workers the parallel build would never make progress
+		m_BuildMode = buildMode;
+		if (m_BuildMode == BVHBuildMode::Parallel && Timo::g_TaskContext.GetThreadCount() == 0)
+			m_BuildMode = BVHBuildMode::Serial;
+
 		// Reset node pool
 		m_NodesUsed = 2;
 		// Populate triangle index array
 		int triCount = m_Mesh->m_TriCount;
+		Reserve(m_BuildMode == BVHBuildMode::Spatial ? triCount + (uint)(triCount * m_SpatialSplitBudget) : triCount);
+		m_TriIndexCount = triCount;
+		if (m_Centroids == nullptr)
+			m_Centroids.reset(new float3[triCount]);
 		for (int i = 0; i < triCount; ++i)
 			m_TriIndices[i] = i;
 		// Calculate triangle centroids for partitioning
 		for (int i = 0; i < triCount; ++i)
 		{
-			auto& tri = m_Mesh->m_Triangles[i];
-			tri.c = (tri.v0 + tri.v1 + tri.v2) * 0.3333f;
+			const auto& tri = m_Mesh->m_Triangles[i];
+			m_Centroids[i] = (tri.v0 + tri.v1 + tri.v2) * 0.3333f;
 		}
 		// Assign all triangles to root node
 		constexpr int rootNodeIdx = 0;
 		BVHNode& root = m_BVHNodes[rootNodeIdx];
 		root.leftFirst = 0, root.triCount = triCount;
 		UpdateNodeBounds(rootNodeIdx);
-		// Subdivide recursively
-		Subdivide(rootNodeIdx);
+
+		if (m_BuildMode == BVHBuildMode::Serial)
+		{
+			// Subdivide recursively
+			Subdivide(rootNodeIdx);
+		}
+		else if (m_BuildMode == BVHBuildMode::Spatial)
+		{
+			// Leaves are written to m_TriIndices as they are created, m_TriIndexCount tracks the live references
+			std::vector<Reference> refs(triCount);
+			for (int i = 0; i < triCount; ++i)
+				refs[i] = { m_Mesh->m_Triangles[i].AABB(), (uint)i };
+
+			uint refOffset = 0;
+			SubdivideSpatial(rootNodeIdx, refs, 0, refOffset);
+			RTRT_ASSERT(refOffset == m_TriIndexCount);
+		}
+		else
+		{
+			/**
+			 * Parallel build: split the top of the tree on this thread (binning large nodes on all workers),
+			 * stop at nodes that are small enough, then finish each of those subtrees as an independent task.
+			 * Subtrees own disjoint ranges of m_TriIndices, only the node pool is shared.
+			 */
+			std::vector<uint> subtrees;
+			Subdivide(rootNodeIdx, &subtrees);
+
+			uint subtreeCount = (uint)subtrees.size();
+			Timo::TaskHandle handle = Timo::g_TaskContext.Dispatch([this, &subtrees](Timo::TaskParams params)
+				{
+					Subdivide(subtrees[params.groupId]);
+				}, subtreeCount, 1);
+			Timo::g_TaskContext.Wait(handle);
+		}
+
+		BuildTriangleBlocks();
+		if (m_Layout != BVHLayout::Binary)
+			SetLayout(m_Layout);
+	}
+
+	void BVH::SetLayout(BVHLayout layout)
+	{
+		m_Layout = layout;
+		if (layout == BVHLayout::Wide4)
+		{
+			if (m_MBVH4 == nullptr)
+				m_MBVH4.reset(new MBVH<4>(this));
+			m_MBVH4->Collapse();
+		}
+		else if (layout == BVHLayout::Wide8)
+		{
+			if (m_MBVH8 == nullptr)
+				m_MBVH8.reset(new MBVH<8>(this));
+			m_MBVH8->Collapse();
+		}
+		else if (layout == BVHLayout::Quantized)
+		{
+			if (m_QBVH == nullptr)
+				m_QBVH.reset(new QBVH(this));
+			m_QBVH->Compress();
+		}
+	}
+
+	void BVH::OptimizeLayout()
+	{
+		// Same capacity as the constructor, so that Build() can reuse the array
+		std::unique_ptr<BVHNode[]> nodes(new BVHNode[m_RefCapacity * 2]);
+		auto copyNode = [](BVHNode& dst, const BVHNode& src)
+		{
+			dst = src;
+		};
+
+		// Pre-order, the left subtree directly follows its sibling pair. Children still come after their parent,
+		// which Refit() relies on.
+		struct StackEntry { uint src, dst; };
+		StackEntry stack[128];
+		uint stackCount = 0, nodesUsed = 2;
+		copyNode(nodes[0], m_BVHNodes[0]);
+		stack[stackCount++] = { 0, 0 };
+		while (stackCount > 0)
+		{
+			const StackEntry entry = stack[--stackCount];
+			const BVHNode& src = m_BVHNodes[entry.src];
+			if (src.IsLeaf())
+				continue;
+
+			uint pair = nodesUsed;
+			nodesUsed += 2;
+			copyNode(nodes[pair], m_BVHNodes[src.leftFirst]);
+			copyNode(nodes[pair + 1], m_BVHNodes[src.leftFirst + 1]);
+			nodes[entry.dst].leftFirst = pair;
+
+			stack[stackCount++] = { src.leftFirst + 1, pair + 1 };
+			stack[stackCount++] = { src.leftFirst, pair };
+		}
+
+		m_NodeStorage = std::move(nodes);
+		m_BVHNodes = m_NodeStorage.get();
+		m_NodesUsed = nodesUsed;
+
+		// A loaded tree also leaves the mapping for its indices, so that nothing refers to the cache file anymore
+		if (m_CacheFile != nullptr)
+		{
+			m_TriIndexStorage.reset(new uint[m_RefCapacity]);
+			std::copy(m_TriIndices, m_TriIndices + m_TriIndexCount, m_TriIndexStorage.get());
+			m_TriIndices = m_TriIndexStorage.get();
+			m_CacheFile.reset();
+		}
+
+		if (m_Layout != BVHLayout::Binary)
+			SetLayout(m_Layout);
+	}
+
+	size_t BVH::GetNodeBytes() const
+	{
+		switch (m_Layout)
+		{
+		case BVHLayout::Wide4:		return m_MBVH4->m_NodesUsed * sizeof(MBVHNode<4>);
+		case BVHLayout::Wide8:		return m_MBVH8->m_NodesUsed * sizeof(MBVHNode<8>);
+		case BVHLayout::Quantized:	return m_QBVH->m_NodesUsed * sizeof(BVHNodeQ);
+		default:					return m_NodesUsed * sizeof(BVHNode);
+		}
+	}
+
+	// Cache file header, followed by the node and index arrays at 64-byte aligned offsets
+	struct BVHCacheHeader
+	{
+		uint magic;
+		uint version;
+		uint nodeSize;
+		uint buildMode;
+		uint64_t meshHash;
+		uint triCount;
+		uint nodesUsed;
+		uint triIndexCount;
+		uint64_t nodeOffset;
+		uint64_t triIndexOffset;
+	};
+	static constexpr uint s_CacheMagic = 0x48564252; // "RBVH"
+	static constexpr size_t s_CacheAlignment = 64;
+
+	static uint64_t HashMesh(const Mesh& mesh)
+	{
+		const Triangle* triangles = mesh.m_Triangles.get();
+		return HashRange((const uint32_t*)triangles, (const uint32_t*)(triangles + mesh.m_TriCount));
+	}
+
+	// A corrupted cache must not send traversal out of the arrays: walks the tree from the root, with every child
+	// pair and leaf range in bounds, and every triangle index below the triangle count
+	static bool ValidateCache(const BVHNode* nodes, uint nodesUsed, const uint* triIndices, uint triIndexCount, uint triCount)
+	{
+		for (uint i = 0; i < triIndexCount; ++i)
+		{
+			if (triIndices[i] >= triCount)
+				return false;
+		}
+
+		if (nodesUsed == 0)
+			return false;
+
+		uint stack[128];
+		uint stackPtr = 0, visited = 0;
+		stack[stackPtr++] = 0;
+		while (stackPtr > 0)
+		{
+			// A cycle visits more nodes than there are
+			if (++visited > nodesUsed)
+				return false;
+
+			const BVHNode& node = nodes[stack[--stackPtr]];
+			if (node.IsLeaf())
+			{
+				if ((uint64_t)node.leftFirst + node.triCount > triIndexCount)
+					return false;
+				continue;
+			}
+
+			// Children are a pair after the root, node 1 is never used
+			if (node.leftFirst < 2 || (uint64_t)node.leftFirst + 1 >= nodesUsed || stackPtr + 2 > 128)
+				return false;
+			stack[stackPtr++] = node.leftFirst;
+			stack[stackPtr++] = node.leftFirst + 1;
+		}
+
+		return true;
+	}
+
+	bool BVH::Load(const char* fileName)
+	{
+		auto file = std::make_unique<Utility::MappedFile>();
+		if (!file->Open(std::filesystem::path((const char8_t*)fileName)) || file->Size() < sizeof(BVHCacheHeader))
+			return false;
+
+		const BVHCacheHeader& header = *(const BVHCacheHeader*)file->Data();
+		if (header.magic != s_CacheMagic || header.version != s_CacheVersion || header.nodeSize != sizeof(BVHNode))
+			return false;
+		// Stale cache, the mesh changed since it was written
+		if (header.triCount != (uint)m_Mesh->m_TriCount || header.meshHash != HashMesh(*m_Mesh))
+			return false;
+		if (header.nodeOffset % s_CacheAlignment != 0 || header.triIndexOffset % s_CacheAlignment != 0 ||
+			header.nodeOffset + header.nodesUsed * sizeof(BVHNode) > file->Size() ||
+			header.triIndexOffset + header.triIndexCount * sizeof(uint) > file->Size())
+			return false;
+		if (!ValidateCache((const BVHNode*)(file->Data() + header.nodeOffset), header.nodesUsed,
+			(const uint*)(file->Data() + header.triIndexOffset), header.triIndexCount, header.triCount))
+			return false;
+
+		// Zero-copy, the arrays point into the mapping
+		m_NodeStorage.reset();
+		m_TriIndexStorage.reset();
+		m_BVHNodes = (BVHNode*)(file->Data() + header.nodeOffset);
+		m_TriIndices = (uint*)(file->Data() + header.triIndexOffset);
+		m_NodesUsed = header.nodesUsed;
+		m_TriIndexCount = header.triIndexCount;
+		m_BuildMode = (BVHBuildMode)header.buildMode;
+		m_RefCapacity = header.triIndexCount;
+		m_CacheFile = std::move(file);
+
+		// Derived data is cheap to rebuild, only the SAH build is skipped
+		m_LeafBlocks.reset(new uint[m_RefCapacity]);
+		BuildTriangleBlocks();
+		if (m_Layout != BVHLayout::Binary)
+			SetLayout(m_Layout);
+
+		return true;
+	}
+
+	bool BVH::Save(const char* fileName) const
+	{
+		// Written to a temporary file and renamed, an interrupted save never leaves a truncated cache behind
+		const std::filesystem::path filePath((const char8_t*)fileName);
+		std::filesystem::path tempPath = filePath;
+		tempPath += ".tmp";
+
+		std::ofstream file(tempPath, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+
+		BVHCacheHeader header{};
+		header.magic = s_CacheMagic;
+		header.version = s_CacheVersion;
+		header.nodeSize = sizeof(BVHNode);
+		header.buildMode = (uint)m_BuildMode;
+		header.meshHash = HashMesh(*m_Mesh);
+		header.triCount = m_Mesh->m_TriCount;
+		header.nodesUsed = m_NodesUsed;
+		header.triIndexCount = m_TriIndexCount;
+		header.nodeOffset = AlignUp(sizeof(BVHCacheHeader), s_CacheAlignment);
+		header.triIndexOffset = AlignUp(header.nodeOffset + m_NodesUsed * sizeof(BVHNode), s_CacheAlignment);
+
+		const char padding[s_CacheAlignment] = {};
+		auto writePadding = [&](uint64_t offset)
+		{
+			file.write(padding, offset - (uint64_t)file.tellp());
+		};
+		file.write((const char*)&header, sizeof(header));
+		writePadding(header.nodeOffset);
+		file.write((const char*)m_BVHNodes, m_NodesUsed * sizeof(BVHNode));
+		writePadding(header.triIndexOffset);
+		file.write((const char*)m_TriIndices, m_TriIndexCount * sizeof(uint));
+
+		std::error_code error;
+		if (!file.good())
+		{
+			file.close();
+			std::filesystem::remove(tempPath, error);
+			return false;
+		}
+		file.close();
+
+		std::filesystem::rename(tempPath, filePath, error);
+		if (error)
+		{
+			std::filesystem::remove(tempPath, error);
+			return false;
+		}
+		return true;
+	}
+
+	void BVH::BuildTriangleBlocks()
+	{
+		// Leaves are padded to whole blocks, so that a block never mixes triangles of 2 leaves
+		struct Leaf { uint first, triCount; };
+		std::vector<Leaf> leaves;
+		uint stack[128], stackCount = 0, blockCount = 0;
+		stack[stackCount++] = 0;
+		while (stackCount > 0)
+		{
+			const BVHNode& node = m_BVHNodes[stack[--stackCount]];
+			if (node.IsLeaf())
+			{
+				leaves.push_back({ node.leftFirst, node.triCount });
+				m_LeafBlocks[node.leftFirst] = blockCount;
+				blockCount += DivideByMultiple(node.triCount, 4u);
+				continue;
+			}
+			stack[stackCount++] = node.leftFirst;
+			stack[stackCount++] = node.leftFirst + 1;
+		}
+
+		if (blockCount != m_TriangleBlockCount)
+		{
+			m_TriangleBlocks.reset(new TriangleBlock[blockCount]);
+			m_TriangleBlockCount = blockCount;
+		}
+		std::memset(m_TriangleBlocks.get(), 0, blockCount * sizeof(TriangleBlock));
+
+		for (const Leaf& leaf : leaves)
+		{
+			TriangleBlock* pBlock = &m_TriangleBlocks[m_LeafBlocks[leaf.first]];
+			for (uint i = 0; i < leaf.triCount; ++i)
+			{
+				TriangleBlock& block = pBlock[i / 4];
+				const uint lane = i % 4;
+				const uint triIdx = m_TriIndices[leaf.first + i];
+				const Triangle& tri = m_Mesh->m_Triangles[triIdx];
+				const float3 e1 = tri.v1 - tri.v0, e2 = tri.v2 - tri.v0;
+				block.v0x[lane] = tri.v0.x, block.v0y[lane] = tri.v0.y, block.v0z[lane] = tri.v0.z;
+				block.e1x[lane] = e1.x, block.e1y[lane] = e1.y, block.e1z[lane] = e1.z;
+				block.e2x[lane] = e2.x, block.e2y[lane] = e2.y, block.e2z[lane] = e2.z;
+				block.primIndex[lane] = triIdx;
+			}
+		}
+	}
+
+	bool BVH::IntersectLeaf(Ray& ray, Intersection& isect, uint first, uint triCount, uint instanceIndex, TraversalStats* pStats) const
+	{
+		const TriangleBlock* pBlock = &m_TriangleBlocks[m_LeafBlocks[first]];
+		const uint blockCount = DivideByMultiple(triCount, 4u);
+		if (pStats)
+		{
+			pStats->triTests += triCount;
+			pStats->Touch(pBlock, blockCount * sizeof(TriangleBlock));
+		}
+
+		bool bIntersect = false;
+		for (uint i = 0; i < blockCount; ++i)
+			bIntersect |= IntersectTriangleBlock(ray, isect, pBlock[i], instanceIndex);
+
+		return bIntersect;
+	}
+
+	uint BVH::AllocateNodePair()
+	{
+		// Keep siblings adjacent, Intersect() relies on it
+		if (m_BuildMode == BVHBuildMode::Parallel)
+			return std::atomic_ref<uint>(m_NodesUsed).fetch_add(2);
+
+		uint index = m_NodesUsed;
+		m_NodesUsed += 2;
+		return index;
 	}
 
 	void BVH::UpdateNodeBounds(uint nodeIndex)
@@ -501,16 +1168,25 @@ namespace rtrt
 		}
 	}
 
-	void BVH::Subdivide(uint nodeIndex)
+	void BVH::Subdivide(uint nodeIndex, std::vector<uint>* pSubtrees)
 	{
 		auto& node = m_BVHNodes[nodeIndex];
 		if (node.triCount == 1)
 			return;
 
+		// Defer small nodes, they are built as independent subtrees
+		if (pSubtrees != nullptr && node.triCount <= s_SubtreeTriCount)
+		{
+			pSubtrees->push_back(nodeIndex);
+			return;
+		}
+
 		// Determine split axis using SAH
 		int axis = 0;
 		float splitPos;
-		float splitCost = FindBestSplitPlane(node, axis, splitPos);
+		float splitCost = (m_BuildMode == BVHBuildMode::Parallel && node.triCount >= s_ParallelBinTriCount) ?
+			FindBestSplitPlaneParallel(node, axis, splitPos) :
+			FindBestSplitPlane(node, axis, splitPos);
 		float noSplitCost = node.CalculateNodeCost();
 		// Checks if the best split cost is actually an improvement over not splitting
 		if (splitCost >= noSplitCost)
@@ -521,7 +1197,7 @@ namespace rtrt
 		int j = node.leftFirst + node.triCount - 1;
 		while (i <= j)
 		{
-			if (m_Mesh->m_Triangles[m_TriIndices[i]].c[axis] < splitPos)
+			if (m_Centroids[m_TriIndices[i]][axis] < splitPos)
 				++i;
 			else
 				std::swap(m_TriIndices[i], m_TriIndices[j--]);
@@ -535,8 +1211,8 @@ namespace rtrt
 			return;
 
 		// Creat child nodes
-		int lChildIdx = m_NodesUsed++;
-		int rChildIdx = m_NodesUsed++;
+		int lChildIdx = AllocateNodePair();
+		int rChildIdx = lChildIdx + 1;
 
 		auto& lChildNode = m_BVHNodes[lChildIdx];
 		lChildNode.leftFirst = node.leftFirst;
@@ -552,8 +1228,8 @@ namespace rtrt
 		node.leftFirst = lChildIdx;
 		node.triCount = 0;
 
-		Subdivide(lChildIdx);
-		Subdivide(rChildIdx);
+		Subdivide(lChildIdx, pSubtrees);
+		Subdivide(rChildIdx, pSubtrees);
 	}
 
 	float BVH::FindBestSplitPlane(BVHNode& node, int& axis, float& splitPos)
@@ -566,9 +1242,9 @@ namespace rtrt
 			float cmin = g_Max, cmax = g_Min;
 			for (int i = node.leftFirst, imax = node.leftFirst+node.triCount; i < imax; ++i)
 			{
-				auto& tri = m_Mesh->m_Triangles[m_TriIndices[i]];
-				cmin = std::min(cmin, tri.c[a]);
-				cmax = std::max(cmax, tri.c[a]);
+				const float c = m_Centroids[m_TriIndices[i]][a];
+				cmin = std::min(cmin, c);
+				cmax = std::max(cmax, c);
 			}
 
 			if (cmin == cmax)
@@ -579,55 +1255,376 @@ namespace rtrt
 			float scale = s_Bins / (cmax - cmin);
 			for (int i = node.leftFirst, imax = node.leftFirst + node.triCount; i < imax; ++i)
 			{
-				auto& tri = m_Mesh->m_Triangles[m_TriIndices[i]];
-				int binIdx = std::min((int)((tri.c[a] - cmin) * scale), s_Bins - 1);
+				uint triIdx = m_TriIndices[i];
+				auto& tri = m_Mesh->m_Triangles[triIdx];
+				int binIdx = std::min((int)((m_Centroids[triIdx][a] - cmin) * scale), s_Bins - 1);
 				Bin& bin = bins[binIdx];
 				++bin.triCount;
 				bin.bounds.Union(tri.v0); bin.bounds.Union(tri.v1); bin.bounds.Union(tri.v2);
 			}
 
-			float areas0[s_Bins - 1], areas1[s_Bins - 1];
-			float triCount0[s_Bins - 1], triCount1[s_Bins - 1];
-			float n0 = 0, n1 = 0;
-			Bounds b0, b1;
-			for (int i = 0; i < s_Bins - 1; ++i)
-			{
-				const auto& bin0 = bins[i];
-				b0.Union(bin0.bounds);
-				n0 += bin0.triCount;
-				areas0[i] = b0.Area(); triCount0[i] = n0;
-
-				const auto& bin1 = bins[s_Bins - 1 - i];
-				b1.Union(bin1.bounds);
-				n1 += bin1.triCount;
-				areas1[s_Bins - 2 - i] = b1.Area(); triCount1[s_Bins - 2 - i] = n1;
-			}
-
-			scale = 1.0f / scale;
-			for (int i = 1; i < s_Bins - 1; ++i)
-			{
-				float cost = areas0[i] * triCount0[i] + areas1[i] * triCount1[i];
-				if (cost < bestCost)
-				{
-					axis = a;
-					splitPos = cmin + scale * (i + 1);
-					bestCost = cost;
-				}
-			}
+			EvaluateBins(bins, a, cmin, scale, bestCost, axis, splitPos);
 		}
 
 		return bestCost;
 	}
 
-	void BVH::Refit()
+	// Same binning as FindBestSplitPlane(), but the triangle range is split into groups that are
+	// reduced on all workers. Bounds unions are order independent, so the chosen plane is identical.
+	float BVH::FindBestSplitPlaneParallel(BVHNode& node, int& axis, float& splitPos)
 	{
-		for (int i= m_NodesUsed-1; i >= 0; --i)
-		{
-			auto& node = m_BVHNodes[i];
-			if (!node.IsValid())
-				continue;
+		const uint first = node.leftFirst, triCount = node.triCount;
+		const uint groupCount = DivideByMultiple(triCount, s_BinGroupSize);
 
-			if (node.IsLeaf())
+		// Centroid bounds
+		const Bounds centroidBounds = Timo::g_TaskContext.ParallelReduce(triCount, s_BinGroupSize, Bounds(),
+			[&](Bounds& centroids, uint i) { centroids.Union(m_Centroids[m_TriIndices[first + i]]); },
+			[](Bounds a, const Bounds& b) { a.Union(b); return a; });
+
+		// Populate the bins, all 3 axes in one pass
+		const float3 cmin = centroidBounds.bmin, cmax = centroidBounds.bmax;
+		float3 scale;
+		for (int a = 0; a < 3; ++a)
+			scale[a] = cmin[a] == cmax[a] ? 0.0f : s_Bins / (cmax[a] - cmin[a]);
+
+		std::vector<Bin> groupBins(groupCount * 3 * s_Bins);
+		Timo::TaskHandle handle = Timo::g_TaskContext.Dispatch([&](Timo::TaskParams params)
+			{
+				Bin* bins = &groupBins[params.groupId * 3 * s_Bins];
+				uint i = first + params.groupId * params.groupSize;
+				uint imax = first + std::min((params.groupId + 1) * params.groupSize, triCount);
+				for (; i < imax; ++i)
+				{
+					uint triIdx = m_TriIndices[i];
+					auto& tri = m_Mesh->m_Triangles[triIdx];
+					const float3& c = m_Centroids[triIdx];
+					for (int a = 0; a < 3; ++a)
+					{
+						int binIdx = std::min((int)((c[a] - cmin[a]) * scale[a]), s_Bins - 1);
+						Bin& bin = bins[a * s_Bins + binIdx];
+						++bin.triCount;
+						bin.bounds.Union(tri.v0); bin.bounds.Union(tri.v1); bin.bounds.Union(tri.v2);
+					}
+				}
+			}, triCount, s_BinGroupSize);
+		Timo::g_TaskContext.Wait(handle);
+
+		float bestCost = g_Max;
+		for (int a = 0; a < 3; ++a)
+		{
+			if (cmin[a] == cmax[a])
+				continue;
+
+			Bin bins[s_Bins];
+			for (uint g = 0; g < groupCount; ++g)
+			{
+				for (int b = 0; b < s_Bins; ++b)
+				{
+					const Bin& groupBin = groupBins[(g * 3 + a) * s_Bins + b];
+					bins[b].triCount += groupBin.triCount;
+					bins[b].bounds.Union(groupBin.bounds);
+				}
+			}
+
+			EvaluateBins(bins, a, cmin[a], scale[a], bestCost, axis, splitPos);
+		}
+
+		return bestCost;
+	}
+
+	/// SBVH
+	struct SpatialBin
+	{
+		Bounds bounds;
+		uint enter = 0, exit = 0;
+	};
+	static constexpr int s_SpatialBins = 16;
+
+	static bool IsEmpty(const Bounds& bounds)
+	{
+		return bounds.bmin.x > bounds.bmax.x || bounds.bmin.y > bounds.bmax.y || bounds.bmin.z > bounds.bmax.z;
+	}
+
+	// Bounds of the part of a reference between 2 planes along an axis
+	static Bounds ClipReference(const Triangle& tri, const Bounds& refBounds, int axis, float lo, float hi)
+	{
+		lo = std::max(lo, refBounds.bmin[axis]);
+		hi = std::min(hi, refBounds.bmax[axis]);
+
+		Bounds bounds;
+		const float3* verts[3] = { &tri.v0, &tri.v1, &tri.v2 };
+		for (int i = 0; i < 3; ++i)
+		{
+			const float3& p0 = *verts[i], & p1 = *verts[(i + 1) % 3];
+			const float c0 = p0[axis], c1 = p1[axis];
+			if (c0 >= lo && c0 <= hi)
+				bounds.Union(p0);
+
+			// Edge crossings with either plane
+			for (float plane : { lo, hi })
+			{
+				if ((c0 < plane && plane < c1) || (c1 < plane && plane < c0))
+				{
+					float3 p = glm::mix(p0, p1, (plane - c0) / (c1 - c0));
+					p[axis] = plane;
+					bounds.Union(p);
+				}
+			}
+		}
+
+		// The reference may already have been clipped along the other axes
+		bounds.bmin = glm::max(bounds.bmin, refBounds.bmin);
+		bounds.bmax = glm::min(bounds.bmax, refBounds.bmax);
+		return bounds;
+	}
+
+	/**
+	 * Spatial split BVH (Stich et al. 2009). Each node first looks for the best object split, binned on the
+	 * reference centroids. If its children overlap, splitting space instead is also evaluated: triangles that
+	 * straddle the plane go to both sides, each with its clipped bounds. Duplicated references are limited by
+	 * the spatial split budget, reserved in m_TriIndices up front.
+	 */
+	void BVH::SubdivideSpatial(uint nodeIndex, std::vector<Reference>& refs, uint depth, uint& refOffset)
+	{
+		BVHNode& node = m_BVHNodes[nodeIndex];
+		const uint refCount = (uint)refs.size();
+		auto makeLeaf = [&]()
+		{
+			node.leftFirst = refOffset;
+			node.triCount = refCount;
+			for (const auto& ref : refs)
+				m_TriIndices[refOffset++] = ref.triIdx;
+		};
+
+		if (refCount == 1 || depth >= s_SpatialMaxDepth)
+		{
+			makeLeaf();
+			return;
+		}
+
+		const Bounds nodeBounds(node.bmin, node.bmax);
+		const float noSplitCost = nodeBounds.Area() * refCount;
+
+		// Object split
+		int objectAxis = -1;
+		float objectPos = 0.0f, objectCost = g_Max;
+		for (int a = 0; a < 3; ++a)
+		{
+			float cmin = g_Max, cmax = g_Min;
+			for (const auto& ref : refs)
+			{
+				const float c = ref.bounds.Center()[a];
+				cmin = std::min(cmin, c);
+				cmax = std::max(cmax, c);
+			}
+			if (cmin == cmax)
+				continue;
+
+			Bin bins[s_Bins];
+			float scale = s_Bins / (cmax - cmin);
+			for (const auto& ref : refs)
+			{
+				int binIdx = std::min((int)((ref.bounds.Center()[a] - cmin) * scale), s_Bins - 1);
+				++bins[binIdx].triCount;
+				bins[binIdx].bounds.Union(ref.bounds);
+			}
+			EvaluateBins(bins, a, cmin, scale, objectCost, objectAxis, objectPos);
+		}
+
+		std::vector<Reference> left, right;
+		Bounds leftBounds, rightBounds;
+		if (objectAxis >= 0)
+		{
+			for (const auto& ref : refs)
+			{
+				const bool bLeft = ref.bounds.Center()[objectAxis] < objectPos;
+				(bLeft ? left : right).push_back(ref);
+				(bLeft ? leftBounds : rightBounds).Union(ref.bounds);
+			}
+			if (left.empty() || right.empty())
+				objectCost = g_Max;
+		}
+
+		// Spatial split, only where the object split leaves overlapping children and the budget allows it
+		const float rootArea = Bounds(m_BVHNodes[0].bmin, m_BVHNodes[0].bmax).Area();
+		Bounds overlap;
+		overlap.bmin = glm::max(leftBounds.bmin, rightBounds.bmin);
+		overlap.bmax = glm::min(leftBounds.bmax, rightBounds.bmax);
+		const bool bTrySpatial = m_TriIndexCount < m_RefCapacity &&
+			(objectCost == g_Max || (!IsEmpty(overlap) && overlap.Area() > s_SpatialSplitOverlap * rootArea));
+
+		int spatialAxis = -1;
+		float spatialPos = 0.0f, spatialCost = g_Max;
+		if (bTrySpatial)
+		{
+			for (int a = 0; a < 3; ++a)
+			{
+				const float lo = nodeBounds.bmin[a], extent = nodeBounds.bmax[a] - lo;
+				if (extent <= 0.0f)
+					continue;
+
+				SpatialBin bins[s_SpatialBins];
+				const float scale = s_SpatialBins / extent, width = extent / s_SpatialBins;
+				for (const auto& ref : refs)
+				{
+					int first = std::clamp((int)((ref.bounds.bmin[a] - lo) * scale), 0, s_SpatialBins - 1);
+					int last = std::clamp((int)((ref.bounds.bmax[a] - lo) * scale), first, s_SpatialBins - 1);
+					++bins[first].enter;
+					++bins[last].exit;
+					if (first == last)
+					{
+						bins[first].bounds.Union(ref.bounds);
+						continue;
+					}
+
+					const Triangle& tri = m_Mesh->m_Triangles[ref.triIdx];
+					for (int b = first; b <= last; ++b)
+					{
+						Bounds part = ClipReference(tri, ref.bounds, a, lo + b * width, lo + (b + 1) * width);
+						if (!IsEmpty(part))
+							bins[b].bounds.Union(part);
+					}
+				}
+
+				// Sweep from the right, then evaluate each plane between 2 bins from the left
+				float rightAreas[s_SpatialBins];
+				uint rightCounts[s_SpatialBins];
+				Bounds b1;
+				uint n1 = 0;
+				for (int i = s_SpatialBins - 1; i > 0; --i)
+				{
+					b1.Union(bins[i].bounds);
+					n1 += bins[i].exit;
+					rightAreas[i] = b1.Area(); rightCounts[i] = n1;
+				}
+
+				Bounds b0;
+				uint n0 = 0;
+				for (int i = 1; i < s_SpatialBins; ++i)
+				{
+					b0.Union(bins[i - 1].bounds);
+					n0 += bins[i - 1].enter;
+					if (n0 == 0 || rightCounts[i] == 0)
+						continue;
+
+					float cost = b0.Area() * n0 + rightAreas[i] * rightCounts[i];
+					if (cost < spatialCost)
+					{
+						spatialAxis = a;
+						spatialPos = lo + i * width;
+						spatialCost = cost;
+					}
+				}
+			}
+		}
+
+		float splitCost = objectCost;
+		if (spatialAxis >= 0 && spatialCost < objectCost && spatialCost < noSplitCost)
+		{
+			std::vector<Reference> spatialLeft, spatialRight;
+			Bounds spatialLeftBounds, spatialRightBounds;
+			for (const auto& ref : refs)
+			{
+				if (ref.bounds.bmax[spatialAxis] <= spatialPos)
+				{
+					spatialLeft.push_back(ref);
+					spatialLeftBounds.Union(ref.bounds);
+				}
+				else if (ref.bounds.bmin[spatialAxis] >= spatialPos)
+				{
+					spatialRight.push_back(ref);
+					spatialRightBounds.Union(ref.bounds);
+				}
+				else
+				{
+					const Triangle& tri = m_Mesh->m_Triangles[ref.triIdx];
+					Bounds leftPart = ClipReference(tri, ref.bounds, spatialAxis, g_Min, spatialPos);
+					Bounds rightPart = ClipReference(tri, ref.bounds, spatialAxis, spatialPos, g_Max);
+					if (!IsEmpty(leftPart))
+					{
+						spatialLeft.push_back({ leftPart, ref.triIdx });
+						spatialLeftBounds.Union(leftPart);
+					}
+					if (!IsEmpty(rightPart))
+					{
+						spatialRight.push_back({ rightPart, ref.triIdx });
+						spatialRightBounds.Union(rightPart);
+					}
+				}
+			}
+
+			// Binning is approximate, check the actual reference growth against the budget
+			const uint growth = (uint)(spatialLeft.size() + spatialRight.size()) - refCount;
+			if (!spatialLeft.empty() && !spatialRight.empty() && m_TriIndexCount + growth <= m_RefCapacity)
+			{
+				m_TriIndexCount += growth;
+				left = std::move(spatialLeft), right = std::move(spatialRight);
+				leftBounds = spatialLeftBounds, rightBounds = spatialRightBounds;
+				splitCost = spatialCost;
+			}
+		}
+
+		if (splitCost >= noSplitCost)
+		{
+			makeLeaf();
+			return;
+		}
+
+		// Creat child nodes
+		uint lChildIdx = AllocateNodePair();
+		uint rChildIdx = lChildIdx + 1;
+		m_BVHNodes[lChildIdx].bmin = leftBounds.bmin, m_BVHNodes[lChildIdx].bmax = leftBounds.bmax;
+		m_BVHNodes[rChildIdx].bmin = rightBounds.bmin, m_BVHNodes[rChildIdx].bmax = rightBounds.bmax;
+		node.leftFirst = lChildIdx;
+		node.triCount = 0;
+
+		// The parent's references are no longer needed while the children are built
+		std::vector<Reference>().swap(refs);
+		SubdivideSpatial(lChildIdx, left, depth + 1, refOffset);
+		SubdivideSpatial(rChildIdx, right, depth + 1, refOffset);
+	}
+
+	float BVH::CalculateSAHCost() const
+	{
+		// Interior nodes cost one traversal step, leaves one intersection per triangle
+		constexpr float traversalCost = 1.0f, intersectionCost = 1.0f;
+		const float rootArea = Bounds(m_BVHNodes[0].bmin, m_BVHNodes[0].bmax).Area();
+		if (rootArea <= 0.0f)
+			return 0.0f;
+
+		float cost = 0.0f;
+		uint stack[128], stackCount = 0;
+		stack[stackCount++] = 0;
+		while (stackCount > 0)
+		{
+			const BVHNode& node = m_BVHNodes[stack[--stackCount]];
+			const float area = Bounds(node.bmin, node.bmax).Area();
+			if (node.IsLeaf())
+			{
+				cost += intersectionCost * area * node.triCount;
+			}
+			else
+			{
+				cost += traversalCost * area;
+				stack[stackCount++] = node.leftFirst;
+				stack[stackCount++] = node.leftFirst + 1;
+			}
+		}
+
+		return cost / rootArea;
+	}
+
+	void BVH::Refit()
+	{
+		CPU_PROFILE_SCOPE("BVH::Refit");
+
+		for (int i= m_NodesUsed-1; i >= 0; --i)
+		{
+			auto& node = m_BVHNodes[i];
+			if (!node.IsValid())
+				continue;
+
+			if (node.IsLeaf())
 			{
 				// Leaf node - adjust bounds to contained triangles
 				UpdateNodeBounds(i);
@@ -641,6 +1638,366 @@ namespace rtrt
 				node.bmax = glm::max(node0.bmax, node1.bmax);				
 			}
 		}
+
+		// Same topology, but the leaf blocks and the wide nodes carry their own copy of the triangles and child bounds
+		BuildTriangleBlocks();
+		if (m_Layout != BVHLayout::Binary)
+			SetLayout(m_Layout);
+	}
+
+
+	/// MBVH
+	// Ray origin and reciprocal direction broadcast once per ray
+	struct RaySSE
+	{
+		__m128 ox, oy, oz, rdx, rdy, rdz;
+
+		RaySSE(const Ray& ray)
+		{
+			ox = _mm_set1_ps(ray.ro.x), oy = _mm_set1_ps(ray.ro.y), oz = _mm_set1_ps(ray.ro.z);
+			rdx = _mm_set1_ps(ray.rcpD.x), rdy = _mm_set1_ps(ray.rcpD.y), rdz = _mm_set1_ps(ray.rcpD.z);
+		}
+	};
+
+	// Slab test against 4 SoA boxes, returns the hit mask and writes the entry distances
+	inline uint IntersectAABB4_SSE(const RaySSE& r, float tMax, const float* bminx, const float* bminy, const float* bminz,
+		const float* bmaxx, const float* bmaxy, const float* bmaxz, float* dist)
+	{
+		__m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(bminx), r.ox), r.rdx), tx2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(bmaxx), r.ox), r.rdx);
+		__m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(bminy), r.oy), r.rdy), ty2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(bmaxy), r.oy), r.rdy);
+		__m128 tz1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(bminz), r.oz), r.rdz), tz2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(bmaxz), r.oz), r.rdz);
+		__m128 tmin = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx1, tx2), _mm_min_ps(ty1, ty2)), _mm_min_ps(tz1, tz2));
+		__m128 tmax = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx1, tx2), _mm_max_ps(ty1, ty2)), _mm_max_ps(tz1, tz2));
+		__m128 hit = _mm_and_ps(_mm_cmpge_ps(tmax, tmin), _mm_cmplt_ps(tmin, _mm_set1_ps(tMax)));
+		hit = _mm_and_ps(hit, _mm_cmpgt_ps(tmax, _mm_setzero_ps()));
+		_mm_storeu_ps(dist, tmin);
+		return (uint)_mm_movemask_ps(hit);
+	}
+
+#ifdef __AVX__
+	struct RayAVX
+	{
+		__m256 ox, oy, oz, rdx, rdy, rdz;
+
+		RayAVX(const Ray& ray)
+		{
+			ox = _mm256_set1_ps(ray.ro.x), oy = _mm256_set1_ps(ray.ro.y), oz = _mm256_set1_ps(ray.ro.z);
+			rdx = _mm256_set1_ps(ray.rcpD.x), rdy = _mm256_set1_ps(ray.rcpD.y), rdz = _mm256_set1_ps(ray.rcpD.z);
+		}
+	};
+
+	inline uint IntersectAABB8_AVX(const RayAVX& r, float tMax, const float* bminx, const float* bminy, const float* bminz,
+		const float* bmaxx, const float* bmaxy, const float* bmaxz, float* dist)
+	{
+		__m256 tx1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(bminx), r.ox), r.rdx), tx2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(bmaxx), r.ox), r.rdx);
+		__m256 ty1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(bminy), r.oy), r.rdy), ty2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(bmaxy), r.oy), r.rdy);
+		__m256 tz1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(bminz), r.oz), r.rdz), tz2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(bmaxz), r.oz), r.rdz);
+		__m256 tmin = _mm256_max_ps(_mm256_max_ps(_mm256_min_ps(tx1, tx2), _mm256_min_ps(ty1, ty2)), _mm256_min_ps(tz1, tz2));
+		__m256 tmax = _mm256_min_ps(_mm256_min_ps(_mm256_max_ps(tx1, tx2), _mm256_max_ps(ty1, ty2)), _mm256_max_ps(tz1, tz2));
+		__m256 hit = _mm256_and_ps(_mm256_cmp_ps(tmax, tmin, _CMP_GE_OQ), _mm256_cmp_ps(tmin, _mm256_set1_ps(tMax), _CMP_LT_OQ));
+		hit = _mm256_and_ps(hit, _mm256_cmp_ps(tmax, _mm256_setzero_ps(), _CMP_GT_OQ));
+		_mm256_storeu_ps(dist, tmin);
+		return (uint)_mm256_movemask_ps(hit);
+	}
+#endif
+
+	template <uint Width>
+	MBVH<Width>::MBVH(const BVH* bvh)
+	{
+		m_BVH = bvh;
+	}
+
+	template <uint Width>
+	void MBVH<Width>::Collapse()
+	{
+		// Every wide node consumes at least one binary interior node
+		const uint maxNodes = std::max(m_BVH->m_NodesUsed / 2, 1u);
+		if (m_NodeCapacity < maxNodes)
+		{
+			m_Nodes.reset(new MBVHNode<Width>[maxNodes]);
+			m_NodeCapacity = maxNodes;
+		}
+
+		m_NodesUsed = 1;
+		CollapseNode(0, 0);
+	}
+
+	template <uint Width>
+	void MBVH<Width>::CollapseNode(uint bvhNodeIndex, uint nodeIndex)
+	{
+		const BVHNode* bvhNodes = m_BVH->m_BVHNodes;
+
+		// Gather up to Width binary descendants, always opening the interior child with the largest surface area
+		uint slots[Width], slotCount = 0;
+		const BVHNode& bvhNode = bvhNodes[bvhNodeIndex];
+		if (bvhNode.IsLeaf())
+		{
+			slots[slotCount++] = bvhNodeIndex;
+		}
+		else
+		{
+			slots[slotCount++] = bvhNode.leftFirst;
+			slots[slotCount++] = bvhNode.leftFirst + 1;
+		}
+		while (slotCount < Width)
+		{
+			int best = -1;
+			float bestArea = -1.0f;
+			for (uint i = 0; i < slotCount; ++i)
+			{
+				const BVHNode& child = bvhNodes[slots[i]];
+				if (child.IsLeaf())
+					continue;
+				float area = Bounds(child.bmin, child.bmax).Area();
+				if (area > bestArea)
+				{
+					best = i;
+					bestArea = area;
+				}
+			}
+			if (best < 0)
+				break;
+
+			uint first = bvhNodes[slots[best]].leftFirst;
+			slots[best] = first;
+			slots[slotCount++] = first + 1;
+		}
+
+		auto& node = m_Nodes[nodeIndex];
+		for (uint i = 0; i < Width; ++i)
+		{
+			if (i >= slotCount)
+			{
+				node.bminx[i] = node.bminy[i] = node.bminz[i] = g_Max;
+				node.bmaxx[i] = node.bmaxy[i] = node.bmaxz[i] = g_Max;
+				node.child[i] = 0;
+				node.triCount[i] = 0;
+				continue;
+			}
+
+			const BVHNode& child = bvhNodes[slots[i]];
+			node.bminx[i] = child.bmin.x; node.bminy[i] = child.bmin.y; node.bminz[i] = child.bmin.z;
+			node.bmaxx[i] = child.bmax.x; node.bmaxy[i] = child.bmax.y; node.bmaxz[i] = child.bmax.z;
+			if (child.IsLeaf())
+			{
+				node.child[i] = child.leftFirst;
+				node.triCount[i] = child.triCount;
+			}
+			else
+			{
+				node.child[i] = m_NodesUsed++;
+				node.triCount[i] = 0;
+			}
+		}
+
+		for (uint i = 0; i < slotCount; ++i)
+		{
+			if (node.triCount[i] == 0)
+				CollapseNode(slots[i], node.child[i]);
+		}
+	}
+
+	template <uint Width>
+	bool MBVH<Width>::Intersect(Ray& ray, Intersection& isect, uint instanceIndex, TraversalStats* pStats) const
+	{
+		struct StackEntry { uint child, triCount; float dist; };
+		StackEntry stack[256];
+		uint stackCount = 0;
+		stack[stackCount++] = { 0, 0, 0.0f };
+
+		const RaySSE raySSE(ray);
+#ifdef __AVX__
+		const RayAVX rayAVX(ray);
+#endif
+		bool bIntersect = false;
+		while (stackCount > 0)
+		{
+			const StackEntry entry = stack[--stackCount];
+			// The ray may have been shortened since this entry was pushed
+			if (entry.dist >= ray.tMax)
+				continue;
+
+			if (entry.triCount > 0)
+			{
+				bIntersect |= m_BVH->IntersectLeaf(ray, isect, entry.child, entry.triCount, instanceIndex, pStats);
+				continue;
+			}
+
+			const auto& node = m_Nodes[entry.child];
+			if (pStats) { ++pStats->nodeVisits; pStats->aabbTests += Width; pStats->Touch(&node, sizeof(node)); }
+
+			float dist[Width];
+			uint hitMask = 0;
+			if constexpr (Width == 4)
+			{
+				hitMask = IntersectAABB4_SSE(raySSE, ray.tMax, node.bminx, node.bminy, node.bminz, node.bmaxx, node.bmaxy, node.bmaxz, dist);
+			}
+			else
+			{
+#ifdef __AVX__
+				hitMask = IntersectAABB8_AVX(rayAVX, ray.tMax, node.bminx, node.bminy, node.bminz, node.bmaxx, node.bmaxy, node.bmaxz, dist);
+#else
+				hitMask = IntersectAABB4_SSE(raySSE, ray.tMax, node.bminx, node.bminy, node.bminz, node.bmaxx, node.bmaxy, node.bmaxz, dist);
+				hitMask |= IntersectAABB4_SSE(raySSE, ray.tMax, node.bminx + 4, node.bminy + 4, node.bminz + 4,
+					node.bmaxx + 4, node.bmaxy + 4, node.bmaxz + 4, dist + 4) << 4;
+#endif
+			}
+
+			// Sort the hit children far to near, so that the nearest one is popped first
+			uint order[Width], hitCount = 0;
+			while (hitMask != 0)
+			{
+				uint i = std::countr_zero(hitMask);
+				hitMask &= hitMask - 1;
+				uint j = hitCount++;
+				for (; j > 0 && dist[order[j - 1]] < dist[i]; --j)
+					order[j] = order[j - 1];
+				order[j] = i;
+			}
+			for (uint j = 0; j < hitCount; ++j)
+			{
+				uint i = order[j];
+				stack[stackCount++] = { node.child[i], node.triCount[i], dist[i] };
+			}
+		}
+
+		return bIntersect;
+	}
+
+	template class MBVH<4>;
+	template class MBVH<8>;
+
+
+	/// QBVH
+	QBVH::QBVH(const BVH* bvh)
+	{
+		m_BVH = bvh;
+	}
+
+	void QBVH::Decode(const float3& pmin, const float3& pmax, const BVHNodeQ& node, float3& bmin, float3& bmax)
+	{
+		const float3 scale = (pmax - pmin) * (1.0f / 255.0f);
+		for (int a = 0; a < 3; ++a)
+		{
+			// The end points decode exactly, so that rounding never shrinks a box
+			bmin[a] = node.qmin[a] == 0 ? pmin[a] : pmin[a] + node.qmin[a] * scale[a];
+			bmax[a] = node.qmax[a] == 255 ? pmax[a] : pmin[a] + node.qmax[a] * scale[a];
+		}
+	}
+
+	void QBVH::Compress()
+	{
+		const BVHNode* bvhNodes = m_BVH->m_BVHNodes;
+		m_NodesUsed = m_BVH->m_NodesUsed;
+		if (m_NodeCapacity < m_NodesUsed)
+		{
+			m_Nodes.reset(new BVHNodeQ[m_NodesUsed]);
+			m_NodeCapacity = m_NodesUsed;
+		}
+
+		// The root box is kept in full precision
+		m_RootBounds.bmin = bvhNodes[0].bmin;
+		m_RootBounds.bmax = bvhNodes[0].bmax;
+		BVHNodeQ& root = m_Nodes[0];
+		root.qmin[0] = root.qmin[1] = root.qmin[2] = 0;
+		root.qmax[0] = root.qmax[1] = root.qmax[2] = 255;
+		root.leftFirst = bvhNodes[0].leftFirst;
+		root.triCount = bvhNodes[0].triCount;
+
+		// Quantize top-down against the decoded parent box, so that the decoded boxes stay conservative
+		struct StackEntry { uint index; float3 bmin, bmax; };
+		StackEntry stack[128];
+		uint stackCount = 0;
+		stack[stackCount++] = { 0, m_RootBounds.bmin, m_RootBounds.bmax };
+		while (stackCount > 0)
+		{
+			const StackEntry entry = stack[--stackCount];
+			const BVHNode& bvhNode = bvhNodes[entry.index];
+			if (bvhNode.IsLeaf())
+				continue;
+
+			const float3 extent = entry.bmax - entry.bmin;
+			for (uint c = bvhNode.leftFirst; c < bvhNode.leftFirst + 2; ++c)
+			{
+				const BVHNode& child = bvhNodes[c];
+				BVHNodeQ& node = m_Nodes[c];
+				for (int a = 0; a < 3; ++a)
+				{
+					const float rcpScale = extent[a] > 0.0f ? 255.0f / extent[a] : 0.0f;
+					node.qmin[a] = (uchar)std::clamp((int)std::floor((child.bmin[a] - entry.bmin[a]) * rcpScale), 0, 255);
+					node.qmax[a] = (uchar)std::clamp((int)std::ceil((child.bmax[a] - entry.bmin[a]) * rcpScale), 0, 255);
+				}
+				node.padding = 0;
+				node.leftFirst = child.leftFirst;
+				node.triCount = child.triCount;
+
+				// Widen by one step wherever float rounding cut into the original box
+				float3 bmin, bmax;
+				Decode(entry.bmin, entry.bmax, node, bmin, bmax);
+				for (int a = 0; a < 3; ++a)
+				{
+					if (bmin[a] > child.bmin[a] && node.qmin[a] > 0) --node.qmin[a];
+					if (bmax[a] < child.bmax[a] && node.qmax[a] < 255) ++node.qmax[a];
+				}
+				Decode(entry.bmin, entry.bmax, node, bmin, bmax);
+
+				stack[stackCount++] = { c, bmin, bmax };
+			}
+		}
+	}
+
+	bool QBVH::Intersect(Ray& ray, Intersection& isect, uint instanceIndex, TraversalStats* pStats) const
+	{
+		struct StackEntry { uint index; float3 bmin, bmax; };
+		StackEntry stack[128];
+		uint stackCount = 0;
+
+		uint nodeIndex = 0;
+		float3 nodeMin = m_RootBounds.bmin, nodeMax = m_RootBounds.bmax;
+		bool bIntersect = false;
+		while (true)
+		{
+			const BVHNodeQ& node = m_Nodes[nodeIndex];
+			if (node.IsLeaf())
+			{
+				bIntersect |= m_BVH->IntersectLeaf(ray, isect, node.leftFirst, node.triCount, instanceIndex, pStats);
+				if (stackCount == 0)
+					break;
+				const StackEntry& entry = stack[--stackCount];
+				nodeIndex = entry.index, nodeMin = entry.bmin, nodeMax = entry.bmax;
+				continue;
+			}
+
+			if (pStats) { ++pStats->nodeVisits; pStats->aabbTests += 2; pStats->Touch(&m_Nodes[node.leftFirst], 2 * sizeof(BVHNodeQ)); }
+			uint child0 = node.leftFirst, child1 = node.leftFirst + 1;
+			float3 bmin0, bmax0, bmin1, bmax1;
+			Decode(nodeMin, nodeMax, m_Nodes[child0], bmin0, bmax0);
+			Decode(nodeMin, nodeMax, m_Nodes[child1], bmin1, bmax1);
+			float d0 = IntersectAABB(ray, bmin0, bmax0);
+			float d1 = IntersectAABB(ray, bmin1, bmax1);
+			if (d0 > d1)
+			{
+				std::swap(d0, d1);
+				std::swap(child0, child1);
+				std::swap(bmin0, bmin1);
+				std::swap(bmax0, bmax1);
+			}
+			if (d0 == Ray::TMAX)
+			{
+				if (stackCount == 0)
+					break;
+				const StackEntry& entry = stack[--stackCount];
+				nodeIndex = entry.index, nodeMin = entry.bmin, nodeMax = entry.bmax;
+			}
+			else
+			{
+				nodeIndex = child0, nodeMin = bmin0, nodeMax = bmax0;
+				if (d1 != Ray::TMAX)
+					stack[stackCount++] = { child1, bmin1, bmax1 };
+			}
+		}
+
+		return bIntersect;
 	}
 
 
@@ -661,6 +2018,7 @@ namespace rtrt
 	{
 		m_Transform = transform;
 		m_InvTransform = glm::inverse(transform);
+		m_bMoved = true;
 		// Calculate world-space bounds using the new matrix
 		float3 bmin = m_BVH->AABB().bmin, bmax = m_BVH->AABB().bmax;
 		m_Bounds.Reset();
@@ -691,6 +2049,36 @@ namespace rtrt
 		return bIntersect;
 	}
 
+	void BVHInstance::IntersectPacket(RayPacket& packet, uint firstRay)
+	{
+		// Backup rays and frustum, transform to object space
+		float3 origins[RayPacket::s_MaxSize], directions[RayPacket::s_MaxSize];
+		const RayPacket::Frustum frustum = packet.frustum;
+		for (uint i = firstRay; i < packet.size; ++i)
+		{
+			Ray& ray = packet.rays[i];
+			origins[i] = ray.ro, directions[i] = ray.rd;
+			ray.ro = float3(m_InvTransform * float4(ray.ro, 1.0f));
+			ray.rd = float3(m_InvTransform * float4(ray.rd, 0.0f));
+			ray.rcpD = 1.0f / ray.rd;
+		}
+		if (firstRay == 0)
+			packet.UpdateFrustum();
+		else
+			packet.frustum.bValid = false;
+
+		m_BVH->IntersectPacket(packet, m_Index, firstRay);
+
+		// Restore ray origins and directions, keep tMax
+		for (uint i = firstRay; i < packet.size; ++i)
+		{
+			Ray& ray = packet.rays[i];
+			ray.ro = origins[i], ray.rd = directions[i];
+			ray.rcpD = 1.0f / ray.rd;
+		}
+		packet.frustum = frustum;
+	}
+
 	/// TLAS
 	TLAS::TLAS(BVHInstance* bvhList, int N)
 	{
@@ -699,11 +2087,16 @@ namespace rtrt
 		// Allocate TLAS nodes
 		m_TLASNodes.reset(new TLASNode[2 * N]);
 		m_NodeIndices.reset(new uint[N]);
+		m_Parents.reset(new uint[2 * N]);
+		// Zeroed, a TLAS that was never built has no leaf at node 0 to update
+		m_LeafNodes.reset(new uint[N]());
 		m_NodesUsed = 2;
 	}
 
 	void TLAS::Build()
 	{
+		CPU_PROFILE_SCOPE("TLAS::Build");
+
 		// Assign a TLASLeaf node to each BLAS
 		m_NodesUsed = 1;
 		for (uint i = 0; i < m_BLASCount; ++i)
@@ -712,7 +2105,7 @@ namespace rtrt
 			auto& tlasNode = m_TLASNodes[m_NodesUsed];
 			tlasNode.bmin = m_BLAS[i].m_Bounds.bmin;
 			tlasNode.bmax = m_BLAS[i].m_Bounds.bmax;
-			tlasNode.leftRight = 0;
+			tlasNode.left = 0;
 			tlasNode.BLASIndex = i;
 			++m_NodesUsed;
 		}
@@ -736,7 +2129,8 @@ namespace rtrt
 				TLASNode& newNode = m_TLASNodes[m_NodesUsed];
 				newNode.bmin = glm::min(nodeA.bmin, nodeB.bmin);
 				newNode.bmax = glm::max(nodeA.bmax, nodeB.bmax);
-				newNode.leftRight = (nodeIdxA | (nodeIdxB << 16));
+				newNode.left = nodeIdxA;
+				newNode.right = nodeIdxB;
 
 				m_NodeIndices[A] = m_NodesUsed++;
 				m_NodeIndices[B] = m_NodeIndices[nodeCount - 1];
@@ -757,15 +2151,22 @@ namespace rtrt
 #endif
 		// Copy last remaining node to the root node
 		m_TLASNodes[0] = m_TLASNodes[m_NodeIndices[A]];
-
+		LinkNodes();
 	}
 
 	bool TLAS::Intersect(Ray& ray, Intersection& isect)
 	{
 		// Calculate reciprocal ray directions for fast AABB intersection
 		ray.rcpD = float3(1.0f / ray.rd.x, 1.0f / ray.rd.y, 1.0f / ray.rd.z);
-		// Use a local stack instead of a recursive function
-		TLASNode* node = &m_TLASNodes[0], * stack[64];
+		// Use a local stack instead of a recursive function, every interior node on the path pushes at most one child
+		TLASNode* node = &m_TLASNodes[0], * localStack[64];
+		std::vector<TLASNode*> deepStack;
+		TLASNode** stack = localStack;
+		if (m_Depth > std::size(localStack))
+		{
+			deepStack.resize(m_Depth);
+			stack = deepStack.data();
+		}
 		uint stackCount = 0;
 		bool bIntersect = false;
 		while (true)
@@ -783,8 +2184,8 @@ namespace rtrt
 			else
 			{
 				// Current node is a interior node, visit child nodes, ordered
-				TLASNode* pChild0 = &m_TLASNodes[(node->leftRight & 0xFFFF)];
-				TLASNode* pChild1 = &m_TLASNodes[(node->leftRight >> 16)];
+				TLASNode* pChild0 = &m_TLASNodes[node->left];
+				TLASNode* pChild1 = &m_TLASNodes[node->right];
 				float d0 = IntersectAABB(ray, pChild0->bmin, pChild0->bmax);
 				float d1 = IntersectAABB(ray, pChild1->bmin, pChild1->bmax);
 				if (d0 > d1)
@@ -813,6 +2214,73 @@ namespace rtrt
 		return bIntersect;
 	}
 
+	void TLAS::IntersectPacket(RayPacket& packet)
+	{
+		for (uint i = 0; i < packet.size; ++i)
+			packet.rays[i].rcpD = 1.0f / packet.rays[i].rd;
+		packet.UpdateFrustum();
+
+		struct StackEntry { const TLASNode* node; uint first; };
+		StackEntry localStack[64];
+		std::vector<StackEntry> deepStack;
+		StackEntry* stack = localStack;
+		if (m_Depth > std::size(localStack))
+		{
+			deepStack.resize(m_Depth);
+			stack = deepStack.data();
+		}
+		uint stackCount = 0;
+
+		const TLASNode* node = &m_TLASNodes[0];
+		uint first = FindFirstHit(packet, 0, node->bmin, node->bmax);
+		if (first == packet.size)
+			return;
+
+		while (true)
+		{
+			if (node->IsLeaf())
+			{
+				m_BLAS[node->BLASIndex].IntersectPacket(packet, first);
+				if (stackCount == 0)
+					break;
+				node = stack[--stackCount].node;
+				first = stack[stackCount].first;
+			}
+			else
+			{
+				const TLASNode* pChild0 = &m_TLASNodes[node->left];
+				const TLASNode* pChild1 = &m_TLASNodes[node->right];
+				uint first0 = FindFirstHit(packet, first, pChild0->bmin, pChild0->bmax);
+				uint first1 = FindFirstHit(packet, first, pChild1->bmin, pChild1->bmax);
+
+				const float3 delta = (pChild1->bmin + pChild1->bmax) - (pChild0->bmin + pChild0->bmax);
+				if (glm::dot(delta, packet.rays[first].rd) < 0.0f)
+				{
+					std::swap(pChild0, pChild1);
+					std::swap(first0, first1);
+				}
+
+				if (first0 == packet.size && first1 == packet.size)
+				{
+					if (stackCount == 0)
+						break;
+					node = stack[--stackCount].node;
+					first = stack[stackCount].first;
+				}
+				else if (first0 == packet.size)
+				{
+					node = pChild1; first = first1;
+				}
+				else
+				{
+					node = pChild0; first = first0;
+					if (first1 != packet.size)
+						stack[stackCount++] = { pChild1, first1 };
+				}
+			}
+		}
+	}
+
 	int TLAS::FindBestMatch(int N, int A)
 	{
 		// Find BLAS that, when joined with A, forms the smallest AABB
@@ -837,10 +2305,286 @@ namespace rtrt
 		return bestB;
 	}
 
+	// Spreads the lower 10 bits of v to every third bit
+	static uint ExpandBits(uint v)
+	{
+		v = (v * 0x00010001u) & 0xFF0000FFu;
+		v = (v * 0x00000101u) & 0x0F00F00Fu;
+		v = (v * 0x00000011u) & 0xC30C30C3u;
+		v = (v * 0x00000005u) & 0x49249249u;
+		return v;
+	}
+
+	static float UnionArea(const TLASNode& a, const TLASNode& b)
+	{
+		const float3 e = glm::max(a.bmax, b.bmax) - glm::min(a.bmin, b.bmin);
+		return (e.x * e.y + e.y * e.z + e.z * e.x) * 2.0f;
+	}
+
+	static float NodeArea(const TLASNode& node)
+	{
+		return Bounds(node.bmin, node.bmax).Area();
+	}
+
+	void TLAS::BuildParallel()
+	{
+		CPU_PROFILE_SCOPE("TLAS::BuildParallel");
+
+		const uint N = m_BLASCount;
+		if (N == 0)
+			return;
+
+		// Leaves at 1..N, interior nodes follow. The root ends up at node 0.
+		Timo::g_TaskContext.ParallelFor(N, s_PLOCGroupSize, [&](uint i)
+			{
+				TLASNode& leaf = m_TLASNodes[i + 1];
+				leaf.bmin = m_BLAS[i].m_Bounds.bmin;
+				leaf.bmax = m_BLAS[i].m_Bounds.bmax;
+				leaf.left = 0;
+				leaf.BLASIndex = i;
+			});
+		m_NodesUsed = N + 1;
+		if (N == 1)
+		{
+			m_TLASNodes[0] = m_TLASNodes[1];
+			LinkNodes();
+			return;
+		}
+
+		// Sort the leaves along a 30-bit Morton curve over the centroid bounds
+		Bounds centroidBounds;
+		for (uint i = 0; i < N; ++i)
+			centroidBounds.Union(m_BLAS[i].m_Bounds.Center());
+		const float3 cmin = centroidBounds.bmin;
+		const float3 extent = centroidBounds.bmax - centroidBounds.bmin;
+		const float3 scale = glm::mix(float3(0.0f), 1023.0f / extent, glm::greaterThan(extent, float3(0.0f)));
+
+		std::vector<uint64_t> keys(N);
+		Timo::g_TaskContext.ParallelFor(N, s_PLOCGroupSize, [&](uint i)
+			{
+				const float3 p = (m_BLAS[i].m_Bounds.Center() - cmin) * scale;
+				const uint code = (ExpandBits((uint)p.x) << 2) | (ExpandBits((uint)p.y) << 1) | ExpandBits((uint)p.z);
+				keys[i] = ((uint64_t)code << 32) | i;
+			});
+		std::sort(keys.begin(), keys.end());
+
+		std::vector<uint> clusters(N), nearest, merged;
+		for (uint i = 0; i < N; ++i)
+			clusters[i] = (uint)keys[i] + 1;
+
+		while (clusters.size() > 1)
+		{
+			// Nearest neighbour of each cluster within the search window. Ties are broken on the pair indices,
+			// so that the globally best pair is always mutual and every pass merges at least once.
+			const uint n = (uint)clusters.size();
+			nearest.resize(n);
+			Timo::g_TaskContext.ParallelFor(n, s_PLOCGroupSize, [&](uint i)
+				{
+					const TLASNode& node = m_TLASNodes[clusters[i]];
+					float bestArea = g_Max;
+					uint64_t bestPair = ~0ull;
+					uint best = i;
+					for (uint j = i > s_PLOCRadius ? i - s_PLOCRadius : 0, jmax = std::min(i + s_PLOCRadius + 1, n); j < jmax; ++j)
+					{
+						if (j == i)
+							continue;
+						const float area = UnionArea(node, m_TLASNodes[clusters[j]]);
+						const uint64_t pair = ((uint64_t)std::min(i, j) << 32) | std::max(i, j);
+						if (area < bestArea || (area == bestArea && pair < bestPair))
+						{
+							bestArea = area, bestPair = pair;
+							best = j;
+						}
+					}
+					nearest[i] = best;
+				});
+
+			// Mutual nearest neighbours merge, the new cluster takes the place of the first one to keep the order
+			merged.clear();
+			for (uint i = 0; i < n; ++i)
+			{
+				const uint j = nearest[i];
+				if (nearest[j] != i)
+				{
+					merged.push_back(clusters[i]);
+				}
+				else if (i < j)
+				{
+					const uint nodeIdx = m_NodesUsed++;
+					TLASNode& node = m_TLASNodes[nodeIdx];
+					const TLASNode& nodeA = m_TLASNodes[clusters[i]], & nodeB = m_TLASNodes[clusters[j]];
+					node.bmin = glm::min(nodeA.bmin, nodeB.bmin);
+					node.bmax = glm::max(nodeA.bmax, nodeB.bmax);
+					node.left = clusters[i];
+					node.right = clusters[j];
+					merged.push_back(nodeIdx);
+				}
+			}
+			clusters.swap(merged);
+		}
+
+		// Copy the last remaining cluster to the root node
+		m_TLASNodes[0] = m_TLASNodes[clusters[0]];
+		LinkNodes();
+	}
+
+	void TLAS::Update()
+	{
+		std::vector<uint> moved;
+		for (uint i = 0; i < m_BLASCount; ++i)
+		{
+			if (m_BLAS[i].m_bMoved)
+				moved.push_back(i);
+		}
+		if (moved.empty())
+			return;
+
+		// Reinsertion degrades the tree a little every time, past a point a full build is as cheap and better
+		m_ReinsertCount += (uint)moved.size();
+		if (m_BLASCount < 2 || moved.size() * 4 > m_BLASCount || m_ReinsertCount > m_BLASCount || m_LeafNodes[moved[0]] == 0)
+		{
+			BuildParallel();
+			return;
+		}
+
+		for (uint i : moved)
+		{
+			const uint leaf = m_LeafNodes[i];
+			m_TLASNodes[leaf].bmin = m_BLAS[i].m_Bounds.bmin;
+			m_TLASNodes[leaf].bmax = m_BLAS[i].m_Bounds.bmax;
+			InsertLeaf(leaf, RemoveLeaf(leaf));
+			m_BLAS[i].m_bMoved = false;
+		}
+	}
+
+	void TLAS::LinkNodes()
+	{
+		// Agglomerative builds can be deep, no fixed-size stack here
+		struct StackEntry { uint node, depth; };
+		std::vector<StackEntry> stack{ { 0, 0 } };
+		m_Parents[0] = 0;
+		m_ReinsertCount = 0;
+		m_Depth = 0;
+		while (!stack.empty())
+		{
+			const StackEntry entry = stack.back();
+			stack.pop_back();
+			const TLASNode& node = m_TLASNodes[entry.node];
+			if (node.IsLeaf())
+			{
+				m_LeafNodes[node.BLASIndex] = entry.node;
+				m_BLAS[node.BLASIndex].m_bMoved = false;
+				m_Depth = std::max(m_Depth, entry.depth);
+				continue;
+			}
+			m_Parents[node.left] = m_Parents[node.right] = entry.node;
+			stack.push_back({ node.left, entry.depth + 1 });
+			stack.push_back({ node.right, entry.depth + 1 });
+		}
+	}
+
+	// Detaches a leaf from the tree, returns the node slot it frees
+	uint TLAS::RemoveLeaf(uint leaf)
+	{
+		const uint parent = m_Parents[leaf];
+		const TLASNode& parentNode = m_TLASNodes[parent];
+		const uint sibling = parentNode.left == leaf ? parentNode.right : parentNode.left;
+		if (parent == 0)
+		{
+			// The sibling becomes the root, which has to stay at node 0
+			MoveNode(sibling, 0);
+			return sibling;
+		}
+
+		const uint grandParent = m_Parents[parent];
+		TLASNode& grandParentNode = m_TLASNodes[grandParent];
+		(grandParentNode.left == parent ? grandParentNode.left : grandParentNode.right) = sibling;
+		m_Parents[sibling] = grandParent;
+		RefitUpwards(grandParent);
+		return parent;
+	}
+
+	// Pairs the leaf with the sibling found by a greedy SAH descent, under a new parent in freeNode
+	void TLAS::InsertLeaf(uint leaf, uint freeNode)
+	{
+		const TLASNode& leafNode = m_TLASNodes[leaf];
+		uint sibling = 0;
+		while (!m_TLASNodes[sibling].IsLeaf())
+		{
+			// Pairing here costs the new parent, every step down adds the growth of this node
+			const TLASNode& node = m_TLASNodes[sibling];
+			const float combinedArea = UnionArea(node, leafNode);
+			const float cost = 2.0f * combinedArea;
+			const float inheritedCost = 2.0f * (combinedArea - NodeArea(node));
+			auto descendCost = [&](uint child)
+			{
+				const TLASNode& childNode = m_TLASNodes[child];
+				float childCost = UnionArea(childNode, leafNode) + inheritedCost;
+				if (!childNode.IsLeaf())
+					childCost -= NodeArea(childNode);
+				return childCost;
+			};
+			const float cost0 = descendCost(node.left), cost1 = descendCost(node.right);
+			if (cost < cost0 && cost < cost1)
+				break;
+			sibling = cost0 < cost1 ? node.left : node.right;
+		}
+
+		uint parent = freeNode;
+		if (sibling == 0)
+		{
+			// The root moves down, the new parent becomes the root
+			MoveNode(0, freeNode);
+			sibling = freeNode;
+			parent = 0;
+		}
+		else
+		{
+			const uint grandParent = m_Parents[sibling];
+			TLASNode& grandParentNode = m_TLASNodes[grandParent];
+			(grandParentNode.left == sibling ? grandParentNode.left : grandParentNode.right) = parent;
+			m_Parents[parent] = grandParent;
+		}
+
+		TLASNode& parentNode = m_TLASNodes[parent];
+		parentNode.left = sibling;
+		parentNode.right = leaf;
+		m_Parents[sibling] = m_Parents[leaf] = parent;
+		RefitUpwards(parent);
+		// The subtree of the sibling moved one level down, it may have held the deepest leaf
+		++m_Depth;
+	}
+
+	// Copies a node to another slot and points its children, or its instance, at the copy
+	void TLAS::MoveNode(uint src, uint dst)
+	{
+		TLASNode& node = m_TLASNodes[dst];
+		node = m_TLASNodes[src];
+		if (node.IsLeaf())
+			m_LeafNodes[node.BLASIndex] = dst;
+		else
+			m_Parents[node.left] = m_Parents[node.right] = dst;
+	}
+
+	void TLAS::RefitUpwards(uint nodeIndex)
+	{
+		while (true)
+		{
+			TLASNode& node = m_TLASNodes[nodeIndex];
+			node.bmin = glm::min(m_TLASNodes[node.left].bmin, m_TLASNodes[node.right].bmin);
+			node.bmax = glm::max(m_TLASNodes[node.left].bmax, m_TLASNodes[node.right].bmax);
+			if (nodeIndex == 0)
+				break;
+			nodeIndex = m_Parents[nodeIndex];
+		}
+	}
+
 	static KdTree* s_KdTree = nullptr;
 	static Mesh* s_Mesh = nullptr;
 	void TLAS::BuildQuick()
 	{
+		CPU_PROFILE_SCOPE("TLAS::BuildQuick");
+
 #if 0
 		// Single-threaded code, for reference
 		// Assign a TLASLeaf node to each BLAS
@@ -850,7 +2594,7 @@ namespace rtrt
 			auto& tlasNode = m_TLASNodes[m_NodesUsed];
 			tlasNode.bmin = m_BLAS[i].m_Bounds.bmin;
 			tlasNode.bmax = m_BLAS[i].m_Bounds.bmax;
-			tlasNode.leftRight = 0;
+			tlasNode.left = 0;
 			tlasNode.BLASIndex = i; // makes it a leaf
 			++m_NodesUsed;
 		}
@@ -873,7 +2617,8 @@ namespace rtrt
 				TLASNode& newNode = m_TLASNodes[m_NodesUsed];
 				newNode.bmin = glm::min(m_TLASNodes[A].bmin, m_TLASNodes[B].bmin);
 				newNode.bmax = glm::max(m_TLASNodes[A].bmax, m_TLASNodes[B].bmax);
-				newNode.leftRight = (A | (B << 16));
+				newNode.left = A;
+				newNode.right = B;
 				if (workLeft-- == 2)
 					break;
 				s_KdTree->RemoveLeaf(A);
@@ -893,8 +2638,11 @@ namespace rtrt
 
 #else
 		// 2. building the TLAS top-down
-		if (s_Mesh == nullptr)
+		if (s_Mesh == nullptr || s_Mesh->m_TriCount != (int)m_BLASCount)
+		{
+			delete s_Mesh;
 			s_Mesh = new Mesh(m_BLASCount);
+		}
 		for (uint i = 0; i < m_BLASCount; ++i)
 		{
 			s_Mesh->m_Triangles[i].v0 = m_BLAS[i].m_Bounds.bmin;
@@ -910,29 +2658,93 @@ namespace rtrt
 		{
 			const auto& bvhNode = s_Mesh->m_BVH->m_BVHNodes[i];
 			auto& tlasNode = m_TLASNodes[i];
+			tlasNode.bmin = bvhNode.bmin;
+			tlasNode.bmax = bvhNode.bmax;
 			if (bvhNode.IsLeaf())
 			{
 				tlasNode.BLASIndex = s_Mesh->m_BVH->m_TriIndices[bvhNode.leftFirst];
-				tlasNode.leftRight = 0; // mark as leaf
+				tlasNode.left = 0; // mark as leaf
 			}
 			else
 			{
-				tlasNode.leftRight = bvhNode.leftFirst | ((bvhNode.leftFirst + 1) << 16);
+				tlasNode.left = bvhNode.leftFirst;
+				tlasNode.right = bvhNode.leftFirst + 1;
 			}
 		}
+		m_NodesUsed = s_Mesh->m_BVH->m_NodesUsed;
+		LinkNodes();
 
 #endif
 
 	}
 
 
+	/// RaySorter
+	void RaySorter::Init(const Bounds& sceneBounds)
+	{
+		constexpr float cells = (float)(1u << s_CellBits);
+		m_Origin = sceneBounds.bmin;
+		m_Scale = cells / glm::max(sceneBounds.Extent(), float3(1e-6f));
+	}
+
+	uint RaySorter::Key(const Ray& ray) const
+	{
+		constexpr int maxCell = (1 << s_CellBits) - 1;
+		const uint octant = (ray.rd.x < 0.0f ? 1 : 0) | (ray.rd.y < 0.0f ? 2 : 0) | (ray.rd.z < 0.0f ? 4 : 0);
+		// Origins outside the scene bounds land in the border cells
+		const float3 cell = glm::clamp((ray.ro - m_Origin) * m_Scale, float3(0.0f), float3((float)maxCell));
+		const uint morton = (ExpandBits((uint)cell.x) << 2) | (ExpandBits((uint)cell.y) << 1) | ExpandBits((uint)cell.z);
+		return (octant << (3 * s_CellBits)) | morton;
+	}
+
+	void RaySorter::Sort(const Ray* rays, uint count, std::vector<uint>& order, size_t stride)
+	{
+		order.resize(count);
+		if (count == 0)
+			return;
+
+		const uint groupCount = DivideByMultiple(count, s_GroupSize);
+		m_Keys.resize(count);
+		m_Offsets.assign((size_t)groupCount * s_KeyCount, 0);
+
+		// Keys and per group histograms
+		Timo::g_TaskContext.ParallelFor(groupCount, 1, [&](uint group)
+			{
+				uint* histogram = &m_Offsets[(size_t)group * s_KeyCount];
+				for (uint i = group * s_GroupSize, imax = std::min(i + s_GroupSize, count); i < imax; ++i)
+				{
+					m_Keys[i] = Key(*(const Ray*)((const uchar*)rays + i * stride));
+					++histogram[m_Keys[i]];
+				}
+			});
+
+		// Exclusive scan, key major, so that groups keep their order within a key
+		uint offset = 0;
+		for (uint key = 0; key < s_KeyCount; ++key)
+		{
+			for (uint group = 0; group < groupCount; ++group)
+			{
+				uint& slot = m_Offsets[(size_t)group * s_KeyCount + key];
+				const uint keyCount = slot;
+				slot = offset;
+				offset += keyCount;
+			}
+		}
+
+		Timo::g_TaskContext.ParallelFor(groupCount, 1, [&](uint group)
+			{
+				uint* offsets = &m_Offsets[(size_t)group * s_KeyCount];
+				for (uint i = group * s_GroupSize, imax = std::min(i + s_GroupSize, count); i < imax; ++i)
+					order[offsets[m_Keys[i]]++] = i;
+			});
+	}
+
 #pragma region KdTree
 	KdTree::KdNode::KdNode()
 	{
 		left = right = parax = 0; splitPos = 0;
-		bmin4 = _mm_setzero_ps();
-		bmax4 = _mm_setzero_ps();
-		minSize4 = _mm_setzero_ps();
+		bmin = bmax = minSize = float3(0.0f);
+		w0 = w1 = w2 = 0.0f;
 	}
 
 	KdTree::KdNode& KdTree::KdNode::operator=(const KdNode& other)
@@ -940,20 +2752,20 @@ namespace rtrt
 		left = other.left; right = other.right;
 		parax = other.parax; splitPos = other.splitPos;
 
-		bmin4 = other.bmin4;
-		bmax4 = other.bmax4;
-		minSize4 = other.minSize4;
+		bmin = other.bmin; w0 = other.w0;
+		bmax = other.bmax; w1 = other.w1;
+		minSize = other.minSize; w2 = other.w2;
 
 		return *this;
 	}
 
 	void* KdTree::KdNode::operator new(size_t size)
 	{
-		return _aligned_malloc(size, ALIGNMENT);
+		return AlignedAlloc(size, ALIGNMENT);
 	}
 	void KdTree::KdNode::operator delete(void* ptr)
 	{
-		_aligned_free(ptr);
+		AlignedFree(ptr);
 	}
 
 	/// KdTree
@@ -1,7 +1,11 @@
 ﻿#pragma once
 
-#include "pch.h"
-#include "Math/GLMath.h"
+#include "rtrtPlatform.h"
+
+namespace Utility
+{
+	class MappedFile;
+}
 
 namespace rtrt
 {
@@ -19,6 +23,7 @@ namespace rtrt
 
 	struct Triangle;
 	class Mesh;
+	class BVH;
 
 	// 32-bit surface container
 	class Surface
@@ -53,39 +58,36 @@ namespace rtrt
 		static constexpr float TMAX = 1e5f;
 		static constexpr float TMIN = 1e-3f;
 
-		Ray()
-		{
-			o4 = d4 = rd4 = _mm_set1_ps(1);
-		}
+		Ray() : ro(1.0f), dummy0(1.0f), rd(1.0f), dummy1(1.0f), rcpD(1.0f), dummy2(1.0f) {  }
 		Ray(float3 o, float3 d) : ro(o), rd(d), rcpD(1.0f / d) {  }
-		Ray(const Ray &other) : o4(other.o4), d4(other.d4), rd4(other.rd4) {  }
+		Ray(const Ray &other) { CopyFrom(other); }
 
 		Ray& operator=(const Ray &other)
 		{
-			o4	= other.o4;
-			d4	= other.d4;
-			rd4 = other.rd4;
+			CopyFrom(other);
 
 			return *this;
 		}
 
-		// float3 ro, rd, rcpD;
-		union
-		{
-			struct { float3 ro; float dummy; };
-			__m128 o4;
-		};
-		union 
-		{
-			struct { float3 rd; float dummy; };
-			__m128 d4;
-		};
-		union 
-		{
-			struct { float3 rcpD; float dummy; };
-			__m128 rd4;
-		};
+		// SSE views of the padded vectors
+		__m128 O4() const { return _mm_load_ps(&ro.x); }
+		__m128 D4() const { return _mm_load_ps(&rd.x); }
+		__m128 RcpD4() const { return _mm_load_ps(&rcpD.x); }
+
+		// Each vector is padded to 16 bytes, so that it can be loaded as __m128
+		alignas(16) float3 ro; float dummy0 = 0.0f;
+		float3 rd; float dummy1 = 0.0f;
+		float3 rcpD; float dummy2 = 0.0f;
 		float tMin = TMIN, tMax = TMAX;
+
+	private:
+		// Only the ray itself is copied, tMin/tMax keep their defaults
+		void CopyFrom(const Ray& other)
+		{
+			_mm_store_ps(&ro.x, other.O4());
+			_mm_store_ps(&rd.x, other.D4());
+			_mm_store_ps(&rcpD.x, other.RcpD4());
+		}
 	};
 
 	struct Bounds
@@ -149,7 +151,6 @@ namespace rtrt
 	struct Triangle
 	{
 		float3 v0, v1, v2;
-		float3 c; // centroid
 
 		Bounds AABB() const
 		{
@@ -164,6 +165,15 @@ namespace rtrt
 		float2 uv0, uv1, uv2;
 		float3 n0, n1, n2;
 	};
+	// 4 triangles of a leaf in SoA form, vertex 0 and the 2 edges precomputed for Moeller-Trumbore.
+	// Unused lanes have zero edges and never hit.
+	struct alignas(16) TriangleBlock
+	{
+		float v0x[4], v0y[4], v0z[4];
+		float e1x[4], e1y[4], e1z[4];
+		float e2x[4], e2y[4], e2z[4];
+		uint primIndex[4];
+	};
 
 	// Intersection record, carefully tuned to be 16 bytes in size
 	struct Intersection
@@ -185,16 +195,12 @@ namespace rtrt
 		void* operator new (size_t size);
 		void operator delete(void* ptr);
 
-		union 
-		{
-			struct { float3 bmin; uint leftFirst; };
-			__m128 bmin4;
-		};
-		union 
-		{
-			struct { float3 bmax; uint triCount; };
-			__m128 bmax4;
-		};
+		__m128 Min4() const { return _mm_load_ps(&bmin.x); }
+		__m128 Max4() const { return _mm_load_ps(&bmax.x); }
+
+		alignas(16) float3 bmin; uint leftFirst;
+		float3 bmax; uint triCount;
+
 		bool IsLeaf() const { return triCount > 0; }
 		bool IsValid() const { return bmin.x < bmax.x && bmin.y < bmax.y && bmin.z < bmax.z; }
 		float CalculateNodeCost() const
@@ -204,16 +210,205 @@ namespace rtrt
 		}
 	};
 
+	/**
+	 * Coherent bundle of rays (e.g. an 8x8 screen tile) traversed together, so that the rays share
+	 * node fetches. Traversal is ranged: a node is entered with the index of the first ray that hits it,
+	 * rays before that index are known to miss. When all rays share an origin (primary rays), the frustum
+	 * spanned by the corner rays rejects boxes for the whole packet in one test.
+	 */
+	struct RayPacket
+	{
+		static constexpr uint s_MaxSize = 64;
+
+		struct Frustum
+		{
+			float3 normals[4];
+			float dists[4];
+			bool bValid = false;
+		};
+
+		// Rays are laid out row by row, width x height
+		void Init(uint packetWidth, uint packetHeight);
+		// Rebuilds the frustum from the corner rays, call after the rays change
+		void UpdateFrustum();
+		// False if the whole box is outside the frustum
+		bool FrustumOverlaps(const float3& bmin, const float3& bmax) const;
+
+		Ray rays[s_MaxSize];
+		Intersection isects[s_MaxSize];
+		bool hits[s_MaxSize];
+		uint width = 0, height = 0, size = 0;
+		Frustum frustum;
+	};
+
+	/**
+	 * Reorders a batch of incoherent (secondary) rays before traversal, so that neighbouring rays visit
+	 * the same nodes. The key is the direction octant, then the cell of the origin on an 8x8x8 grid over
+	 * the scene bounds in Morton order. Counting sort on the task system, stable within a key.
+	 */
+	class RaySorter
+	{
+	public:
+		static constexpr uint s_CellBits = 3;	// per axis
+		static constexpr uint s_KeyCount = 8u << (3 * s_CellBits);
+		static constexpr uint s_GroupSize = 65536;
+
+		void Init(const Bounds& sceneBounds);
+		uint Key(const Ray& ray) const;
+
+		// Fills order with the indices of the count rays sorted by Key(). The rays may be members of
+		// larger records, stride is the distance between two of them in bytes.
+		void Sort(const Ray* rays, uint count, std::vector<uint>& order, size_t stride = sizeof(Ray));
+
+	private:
+		float3 m_Origin{ 0.0f }, m_Scale{ 0.0f };
+		std::vector<uint> m_Keys;
+		std::vector<uint> m_Offsets;	// one histogram per group of s_GroupSize rays
+	};
+
+	// Traversal counters, filled in when a stats pointer is passed to Intersect()
+	struct TraversalStats
+	{
+		// Simulated 256KB direct-mapped cache with 64-byte lines, stands in for L2 miss counters
+		static constexpr uint s_CacheLines = 4096;
+
+		uint64_t nodeVisits = 0;	// interior nodes fetched (traversal steps)
+		uint64_t aabbTests = 0;		// child boxes tested
+		uint64_t triTests = 0;		// ray/triangle tests
+		uint64_t cacheMisses = 0;	// lines of node/triangle data missing from the simulated cache
+
+		// Records a read of [ptr, ptr + size)
+		void Touch(const void* ptr, size_t size);
+
+	private:
+		std::vector<uintptr_t> m_CacheTags = std::vector<uintptr_t>(s_CacheLines, 0);
+	};
+
+	/**
+	 * Wide BVH node, Width children with their bounds stored SoA, so that all child boxes
+	 * can be tested in one SSE (4-wide) or AVX (8-wide) step.
+	 * Unused slots hold a degenerate box at infinity which never intersects.
+	 */
+	template <uint Width>
+	struct alignas(64) MBVHNode
+	{
+		float bminx[Width], bminy[Width], bminz[Width];
+		float bmaxx[Width], bmaxy[Width], bmaxz[Width];
+		uint child[Width];		// interior: MBVH node index, leaf: first entry in BVH::m_TriIndices
+		uint triCount[Width];	// 0 for interior children
+	};
+
+	// MBVH4/MBVH8, collapsed from a binary BVH. Leaves reference the triangle indices of the source BVH.
+	template <uint Width>
+	class MBVH
+	{
+	public:
+		static_assert(Width == 4 || Width == 8, "MBVH supports 4 or 8 children per node");
+
+		MBVH() = default;
+		MBVH(const BVH* bvh);
+
+		void Collapse();
+		bool Intersect(Ray& ray, Intersection& isect, uint instanceIndex, TraversalStats* pStats = nullptr) const;
+
+		std::unique_ptr<MBVHNode<Width>[]> m_Nodes;
+		uint m_NodesUsed = 0;
+
+	private:
+		void CollapseNode(uint bvhNodeIndex, uint nodeIndex);
+
+		const BVH* m_BVH = nullptr;
+		uint m_NodeCapacity = 0;
+	};
+
+	// 16-byte compressed node, its bounds are stored as 8-bit offsets within the (decoded) parent box
+	struct BVHNodeQ
+	{
+		uchar qmin[3], qmax[3];
+		ushort padding;
+		uint leftFirst, triCount;
+
+		bool IsLeaf() const { return triCount > 0; }
+	};
+
+	// Quantized BVH, same topology and node indices as the source BVH, half the node bytes
+	class QBVH
+	{
+	public:
+		QBVH() = default;
+		QBVH(const BVH* bvh);
+
+		void Compress();
+		bool Intersect(Ray& ray, Intersection& isect, uint instanceIndex, TraversalStats* pStats = nullptr) const;
+
+		// Conservative child box within its parent box
+		static void Decode(const float3& pmin, const float3& pmax, const BVHNodeQ& node, float3& bmin, float3& bmax);
+
+		std::unique_ptr<BVHNodeQ[]> m_Nodes;
+		uint m_NodesUsed = 0;
+		Bounds m_RootBounds;
+
+	private:
+		const BVH* m_BVH = nullptr;
+		uint m_NodeCapacity = 0;
+	};
+
+	enum class BVHLayout
+	{
+		Binary,
+		Wide4,		// MBVH4, SSE child tests
+		Wide8,		// MBVH8, AVX child tests (2x SSE without __AVX__)
+		Quantized,	// QBVH, 8-bit child bounds
+	};
+
+	enum class BVHBuildMode
+	{
+		Serial,		// single-threaded binned SAH
+		Parallel,	// subtrees and large-node binning are fanned out onto Timo::g_TaskContext
+		Spatial,	// single-threaded SBVH, object splits plus spatial splits that clip straddling triangles
+	};
+
 	// Bounding volume hierarchy, to be used as BLAS
 	class BVH
 	{
 	public:
-		BVH() = default;
-		BVH(Mesh* pMesh);
-
-		void Build();
+		// Nodes with fewer triangles are built as independent subtrees (parallel mode)
+		static constexpr uint s_SubtreeTriCount = 4096;
+		// Nodes with more triangles are binned on all workers (parallel mode)
+		static constexpr uint s_ParallelBinTriCount = 65536;
+		// Spatial splits are only tried where the best object split leaves this much overlap (relative to the root area)
+		static constexpr float s_SpatialSplitOverlap = 1e-5f;
+		// Spatial mode gives up on splitting below this depth, traversal stacks are 128 entries deep
+		static constexpr uint s_SpatialMaxDepth = 64;
+
+		// Bump whenever the cache file layout or BVHNode changes
+		static constexpr uint s_CacheVersion = 2;
+
+		BVH();
+		BVH(Mesh* pMesh, BVHBuildMode buildMode = BVHBuildMode::Serial);
+		// Loads the BVH from a cache file if it matches the mesh, otherwise builds it and writes the cache
+		BVH(Mesh* pMesh, const char* cacheFile, BVHBuildMode buildMode = BVHBuildMode::Serial);
+		~BVH();
+
+		void Build(BVHBuildMode buildMode = BVHBuildMode::Serial);
 		void Refit();
-		bool Intersect(Ray& ray, Intersection &isect, uint instanceIndex);
+		// Cache files are keyed by a hash of the mesh triangles. Load() maps the file and uses its node and
+		// index arrays in place, Build() and OptimizeLayout() move them back into owned memory.
+		bool Load(const char* fileName);
+		bool Save(const char* fileName) const;
+		// Extra triangle references the spatial mode may create, as a fraction of the triangle count
+		void SetSpatialSplitBudget(float budget) { m_SpatialSplitBudget = std::max(budget, 0.0f); }
+		bool Intersect(Ray& ray, Intersection &isect, uint instanceIndex, TraversalStats* pStats = nullptr);
+		// Ranged packet traversal over the binary nodes, records hits in packet.hits
+		void IntersectPacket(RayPacket& packet, uint instanceIndex, uint firstRay = 0);
+		// Collapses the binary tree into a wide layout used by Intersect(), kept in sync by Build() and Refit()
+		void SetLayout(BVHLayout layout);
+		// Post-build: reorders the nodes depth-first with siblings adjacent, so that a subtree is contiguous in memory
+		void OptimizeLayout();
+		// Bytes of the node array used by the current layout
+		size_t GetNodeBytes() const;
+		BVHLayout GetLayout() const { return m_Layout; }
+		Mesh* GetMesh() const { return m_Mesh; }
 		Bounds AABB() const
 		{
 			Bounds bounds;
@@ -225,18 +420,51 @@ namespace rtrt
 
 			return bounds;
 		}
+		// SAH cost of the whole tree, normalized by the root surface area
+		float CalculateSAHCost() const;
 
 	private:
-		void Subdivide(uint nodeIndex);
+		struct Reference;
+
+		void Subdivide(uint nodeIndex, std::vector<uint>* pSubtrees = nullptr);
+		void SubdivideSpatial(uint nodeIndex, std::vector<Reference>& refs, uint depth, uint& refOffset);
+		void Reserve(uint refCapacity);
 		void UpdateNodeBounds(uint nodeIndex);
 		float FindBestSplitPlane(BVHNode& node, int& axis, float& splitPos);
+		float FindBestSplitPlaneParallel(BVHNode& node, int& axis, float& splitPos);
+		uint AllocateNodePair();
+		// Packs the triangles of every leaf into TriangleBlocks, in m_TriIndices order
+		void BuildTriangleBlocks();
+		bool IntersectLeaf(Ray& ray, Intersection& isect, uint first, uint triCount, uint instanceIndex, TraversalStats* pStats) const;
+
+		template <uint Width> friend class MBVH;
+		friend class QBVH;
 
 		Mesh* m_Mesh = nullptr;
+		BVHBuildMode m_BuildMode = BVHBuildMode::Serial;
+		BVHLayout m_Layout = BVHLayout::Binary;
+		float m_SpatialSplitBudget = 0.3f;
+		uint m_RefCapacity = 0;
+		// Backing memory of m_BVHNodes and m_TriIndices, either owned or a mapped cache file
+		std::unique_ptr<BVHNode[]> m_NodeStorage;
+		std::unique_ptr<uint[]> m_TriIndexStorage;
+		std::unique_ptr<Utility::MappedFile> m_CacheFile;
 
 	public:
-		std::unique_ptr<BVHNode[]> m_BVHNodes;
+		BVHNode* m_BVHNodes = nullptr;
 		uint m_NodesUsed = 0;
-		std::unique_ptr<uint[]> m_TriIndices;
+		uint* m_TriIndices = nullptr;
+		// Used entries of m_TriIndices, more than the triangle count when spatial splits duplicated references
+		uint m_TriIndexCount = 0;
+		// Build-only, kept out of the triangle data that traversal reads
+		std::unique_ptr<float3[]> m_Centroids;
+		// Leaf triangles for the SIMD leaf test. m_LeafBlocks is indexed by a leaf's first triangle (leftFirst).
+		std::unique_ptr<TriangleBlock[]> m_TriangleBlocks;
+		std::unique_ptr<uint[]> m_LeafBlocks;
+		uint m_TriangleBlockCount = 0;
+		std::unique_ptr<MBVH<4>> m_MBVH4;
+		std::unique_ptr<MBVH<8>> m_MBVH8;
+		std::unique_ptr<QBVH> m_QBVH;
 
 	};
 
@@ -249,9 +477,10 @@ namespace rtrt
 
 		Mesh() = default;
 		Mesh(const char* objFile, const char* texFile);
+		Mesh(const char* triFile);
 		Mesh(uint primCount);
 
-		void Init();
+		void Init(BVHBuildMode buildMode = BVHBuildMode::Serial, const char* cacheFile = nullptr);
 
 		std::unique_ptr<Triangle[]> m_Triangles;	// triangle data for intersection
 		std::unique_ptr<TriangleEx[]> m_TrianglesEx;// triangle data for shading
@@ -274,34 +503,40 @@ namespace rtrt
 		const glm::mat4& GetTransform() const { return m_Transform; }
 
 		bool Intersect(Ray& ray, Intersection &isect);
+		void IntersectPacket(RayPacket& packet, uint firstRay = 0);
 
 		Bounds m_Bounds; // in world space
 
 	private:
+		friend class TLAS;
+
 		glm::mat4 m_Transform;
 		glm::mat4 m_InvTransform;
 
 		BVH* m_BVH = nullptr;
 		uint m_Index = 0;
+		// Set by SetTransform(), cleared once a TLAS has reinserted the instance
+		bool m_bMoved = true;
 	};
 
 	struct alignas(32) TLASNode
 	{
 		TLASNode()
 		{
-			bmin = float3(g_Max); leftRight = 0;
+			bmin = float3(g_Max); left = 0;
 			bmax = float3(g_Min); BLASIndex = 0;
 		}
 
 		float3 bmin;
-		union 
+		uint left;				// 0 for a leaf, the root is never a child
+		float3 bmax;
+		union
 		{
-			uint leftRight;
-			struct { ushort left, right; };
+			uint BLASIndex;		// leaf
+			uint right;			// interior node
 		};
-		float3 bmax; uint BLASIndex;
 
-		bool IsLeaf() const { return leftRight == 0; }
+		bool IsLeaf() const { return left == 0; }
 	};
 
 	// Top-level BVH class
@@ -309,17 +544,43 @@ namespace rtrt
 	class TLAS
 	{
 	public:
+		// Neighbours on each side of a cluster searched by the PLOC build
+		static constexpr uint s_PLOCRadius = 16;
+		// Clusters per task in the PLOC build
+		static constexpr uint s_PLOCGroupSize = 1024;
+
 		TLAS() = default;
 		TLAS(BVHInstance* bvhList, int N);
 		void Build();
+		// Parallel locally-ordered clustering (PLOC), clusters are sorted along a Morton curve and each one
+		// merges with its best neighbour within s_PLOCRadius, all searches running on Timo::g_TaskContext
+		void BuildParallel();
+		// Reinserts the instances moved by BVHInstance::SetTransform() since the last build or update and refits
+		// their ancestors, the rest of the tree is left as is. Falls back to BuildParallel() when many moved.
+		void Update();
 		bool Intersect(Ray& ray, Intersection& isect);
+		void IntersectPacket(RayPacket& packet);
 
 	private:
 		int FindBestMatch(int N, int A);
+		// Parent links and instance leaves, recomputed after every full build
+		void LinkNodes();
+		uint RemoveLeaf(uint leaf);
+		void InsertLeaf(uint leaf, uint freeNode);
+		void MoveNode(uint src, uint dst);
+		void RefitUpwards(uint nodeIndex);
+
+		// Instances reinserted since the last full build
+		uint m_ReinsertCount = 0;
+		// Edges from the root to the deepest leaf, bounds the traversal stacks. Measured by LinkNodes(), reinsertions
+		// may overestimate it
+		uint m_Depth = 0;
 
 	public:
 		std::unique_ptr<TLASNode[]> m_TLASNodes;
 		std::unique_ptr<uint[]> m_NodeIndices;
+		std::unique_ptr<uint[]> m_Parents;
+		std::unique_ptr<uint[]> m_LeafNodes;
 		BVHInstance* m_BLAS = nullptr;
 		uint m_NodesUsed = 0, m_BLASCount = 0;
 
@@ -327,6 +588,7 @@ namespace rtrt
 	};
 
 	extern bool IntersectTriangle(Ray& ray, Intersection& isect, const Triangle& tri, const uint inst_prim);
+	extern bool IntersectTriangleBlock(Ray& ray, Intersection& isect, const TriangleBlock& block, const uint instanceIndex);
 
 #pragma region KdTree
 	// Custom Kd-Tree, used for quick TLAS construction
@@ -344,21 +606,9 @@ namespace rtrt
 				struct { uint first, count, dummy0, dummy1; };	// for a leaf node, 16 bytes
 			};
 
-			union 
-			{
-				struct { float3 bmin; float w0; };
-				__m128 bmin4;
-			};
-			union 
-			{
-				struct { float3 bmax; float w1; };
-				__m128 bmax4;
-			};
-			union 
-			{
-				struct { float3 minSize; float w2; };
-				__m128 minSize4;
-			};
+			alignas(16) float3 bmin; float w0;
+			float3 bmax; float w1;
+			float3 minSize; float w2;
 
 			void* operator new(size_t size);
 			void operator delete(void* ptr);
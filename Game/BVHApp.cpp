@@ -3,9 +3,16 @@
 #include "Graphics.h"
 #include "Math/Random.h"
 #include "Core/Utility.h"
+#include "Task.h"
+#include <chrono>
 
 #include <ppl.h>
 #define PARALLEL_IMPL 1
+// Trace the primary rays of a tile as 8x8 packets
+#define PACKET_TRAVERSAL 1
+// Trace the frame bounce by bounce with sorted ray queues instead of pixel by pixel, replaces the packet
+// traversal above when on
+#define WAVEFRONT_TRACING 0
 
 // #define STB_IMAGE_IMPLEMENTATION
 #define STBI_NO_PSD
@@ -840,8 +847,10 @@ void Surface::InitCharset()
 constexpr char *s_unityMesh		= "Models/BVHAssets/unity.tri";
 constexpr char *s_ArmadilloMesh	= "Models/BVHAssets/armadillo.tri";
 constexpr char *s_TeapotMesh	= "Models/BVHAssets/teapot.obj";
+constexpr char *s_TeapotBVH		= "Models/BVHAssets/teapot.bvh";
 constexpr char *s_BrickTexture	= "Models/BVHAssets/bricks.png";
 constexpr char *s_SkyTexture	= "Models/BVHAssets/sky_19.hdr";
+constexpr char *s_BigbenMesh	= "Models/BVHAssets/bigben.tri";
 BVHApp::BVHApp(HINSTANCE hInstance, const wchar_t* title, UINT width, UINT height)
 	: IGameApp(hInstance, title, width, height)
 {
@@ -851,6 +860,14 @@ BVHApp::BVHApp(HINSTANCE hInstance, const wchar_t* title, UINT width, UINT heigh
 
 void BVHApp::InitCustom()
 {
+	Timo::g_TaskContext.Init(std::thread::hardware_concurrency());
+
+#if BVH_BENCHMARK
+	BenchmarkBVHBuild();
+	BenchmarkBVHTraversal();
+	BenchmarkTLASBuild();
+#endif
+
 	// Pipeline
 	{
 		m_DebugPass.Init();
@@ -970,7 +987,7 @@ void BVHApp::InitCustom()
 
 #if AS_FLAG == 2
 		m_Mesh = std::make_shared<rtrt::Mesh>(s_TeapotMesh, s_BrickTexture);
-		m_Mesh->Init();
+		m_Mesh->Init(rtrt::BVHBuildMode::Parallel, s_TeapotBVH);
 
 		m_BVHInstance.reset(new rtrt::BVHInstance[s_Instances]);
 		for (int i = 0; i < s_Instances; ++i)
@@ -1071,7 +1088,9 @@ void BVHApp::Update(float deltaTime)
 
 		const int W = m_Surface->width, H = m_Surface->height;
 		const float invW = 1.0f / W, invH = 1.0f / H;
-#if PARALLEL_IMPL
+#if AS_FLAG == 2 && WAVEFRONT_TRACING
+		TraceWavefront(ro, lowerLeftCorner, horizontal, vertical);
+#elif PARALLEL_IMPL
 		const int tileSize = 16;
 		const int nXTiles = (W + tileSize - 1) / tileSize;
 		const int nYTiles = (H + tileSize - 1) / tileSize;
@@ -1086,6 +1105,41 @@ void BVHApp::Update(float deltaTime)
 				int x1 = std::min(x0 + tileSize, W);
 				int y1 = std::min(y0 + tileSize, H);
 				bool bIntersect = false;
+#if AS_FLAG == 2 && PACKET_TRAVERSAL
+				// Primary rays of a tile share their origin and are coherent, so they share node fetches as a packet
+				constexpr int packetSize = 8;
+				rtrt::RayPacket packet;
+				for (int py = y0; py < y1; py += packetSize)
+				{
+					for (int px = x0; px < x1; px += packetSize)
+					{
+						const int pw = std::min(packetSize, x1 - px), ph = std::min(packetSize, y1 - py);
+						packet.Init(pw, ph);
+						for (int j = 0; j < ph; ++j)
+						{
+							float v = (py + j + 0.5f) / H;
+							for (int i = 0; i < pw; ++i)
+							{
+								float u = (px + i + 0.5f) / W;
+								rtrt::Ray& ray = packet.rays[j * pw + i];
+								ray = rtrt::Ray{ ro, glm::normalize(lowerLeftCorner + u * horizontal + v * vertical) };
+								ray.tMax = rtrt::Ray::TMAX;
+							}
+						}
+						packet.UpdateFrustum();
+						m_BVHInstance[0].IntersectPacket(packet);
+
+						for (int j = 0; j < ph; ++j)
+						{
+							for (int i = 0; i < pw; ++i)
+							{
+								const int k = j * pw + i;
+								m_Accumulator[(py + j) * m_Width + (px + i)] = Shade(packet.rays[k], packet.isects[k], packet.hits[k]);
+							}
+						}
+					}
+				}
+#else
 				for (int y = y0; y < y1; ++y)
 				{
 					float v = (y + 0.5f) / H;
@@ -1139,6 +1193,7 @@ void BVHApp::Update(float deltaTime)
 #endif
 					}
 				}
+#endif
 			});
 #else
 		/**
@@ -1505,30 +1560,42 @@ rtrt::float3 g_LightPos{ 3.0f, 10.0f, 2.0f };
 rtrt::float3 g_LightColor{ 40.0f, 20.0f, 10.0f };
 rtrt::float3 g_Ambient{ 0.2f, 0.2f, 0.2f };
 
+// Single-ray path, incoherent (secondary) rays go through here rather than through packets
 rtrt::float3 BVHApp::Trace(rtrt::Ray& ray, rtrt::Intersection &isect, int rayDepth)
 {
 	bool bIntersect = m_BVHInstance[0].Intersect(ray, isect);
+	return Shade(ray, isect, bIntersect);
+}
+
+void BVHApp::GetSurface(const rtrt::Ray& ray, const rtrt::Intersection& isect, rtrt::float3& albedo, rtrt::float3& N) const
+{
+	// Calculate texture uv based on barycentrics
+	uint triIdx = isect.inst_prim & 0xFFFFF, instIdx = isect.inst_prim >> 20;
+	const rtrt::TriangleEx& triEx = m_Mesh->m_TrianglesEx[triIdx];
+	const rtrt::Surface* pTex = m_Mesh->m_Texture.get();
+
+	float oneMinusUV = 1.0f - isect.u - isect.v;
+	rtrt::float2 uv = isect.u * triEx.uv1 + isect.v * triEx.uv2 + oneMinusUV * triEx.uv0;
+	int iu = (int)(uv.x * pTex->width ) % pTex->width;
+	int iv = (int)(uv.y * pTex->height) % pTex->height;
+	uint texel = pTex->pixels[iu + iv * pTex->width];
+	albedo = ColorRGB(texel);
+
+	// Calculate the Normal for the intersection
+	N = isect.u * triEx.n1 + isect.v * triEx.n2 + oneMinusUV * triEx.n0;
+	N = glm::normalize( rtrt::float3(m_BVHInstance[instIdx].GetTransform() * rtrt::float4(N, 0.0f)) );
+	// For debug
+	// N = 0.5f * N + 0.5f;
+}
+
+rtrt::float3 BVHApp::Shade(const rtrt::Ray& ray, const rtrt::Intersection& isect, bool bIntersect)
+{
 	if (bIntersect)
 	{
 		const rtrt::float3 p = ray.ro + ray.rd * isect.t;
 
-		// Calculate texture uv based on barycentrics
-		uint triIdx = isect.inst_prim & 0xFFFFF, instIdx = isect.inst_prim >> 20;
-		const rtrt::TriangleEx& triEx = m_Mesh->m_TrianglesEx[triIdx];
-		const rtrt::Surface* pTex = m_Mesh->m_Texture.get();
-
-		float oneMinusUV = 1.0f - isect.u - isect.v;
-		rtrt::float2 uv = isect.u * triEx.uv1 + isect.v * triEx.uv2 + oneMinusUV * triEx.uv0;
-		int iu = (int)(uv.x * pTex->width ) % pTex->width;
-		int iv = (int)(uv.y * pTex->height) % pTex->height;
-		uint texel = pTex->pixels[iu + iv * pTex->width];
-		glm::vec3 albedo = ColorRGB(texel);
-
-		// Calculate the Normal for the intersection
-		rtrt::float3 N = isect.u * triEx.n1 + isect.v * triEx.n2 + oneMinusUV * triEx.n0;
-		N = glm::normalize( rtrt::float3(m_BVHInstance[instIdx].GetTransform() * rtrt::float4(N, 0.0f)) );
-		// For debug
-		// N = 0.5f * N + 0.5f;
+		rtrt::float3 albedo, N;
+		GetSurface(ray, isect, albedo, N);
 
 		// Calculate the diffuse reflection in the intersection point
 		rtrt::float3 L = g_LightPos - p;
@@ -1546,6 +1613,404 @@ rtrt::float3 BVHApp::Trace(rtrt::Ray& ray, rtrt::Intersection &isect, int rayDep
 	}
 }
 
+#if AS_FLAG == 2
+static uint WangHash(uint s)
+{
+	s = (s ^ 61) ^ (s >> 16);
+	s *= 9;
+	s = s ^ (s >> 4);
+	s *= 0x27d4eb2d;
+	s = s ^ (s >> 15);
+	return s;
+}
+
+static float RandomFloat(uint& seed)
+{
+	// Xorshift32
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return (seed & 0xFFFFFF) * (1.0f / 16777216.0f);
+}
+
+void BVHApp::TraceWavefront(const rtrt::float3& eye, const rtrt::float3& lowerLeftCorner, const rtrt::float3& horizontal, const rtrt::float3& vertical)
+{
+	constexpr uint kTileSize = 8, kGroupSize = 1024;
+	// The surface size sizes, indexes and bounds every per-pixel buffer
+	const uint W = m_Surface->width, H = m_Surface->height;
+	const uint pixelCount = W * H;
+
+	if (m_Paths.size() != pixelCount)
+	{
+		m_Paths.resize(pixelCount);
+		m_NextPaths.resize(pixelCount);
+		m_ShadowRays.resize(pixelCount);
+		m_Radiance.resize(pixelCount);
+		m_AccumulatedFrames = 0;
+	}
+
+	// Restart the average when the camera moves
+	const rtrt::float3 forward = glm::normalize(lowerLeftCorner + 0.5f * horizontal + 0.5f * vertical);
+	if (eye != m_LastEye || forward != m_LastForward)
+	{
+		m_LastEye = eye;
+		m_LastForward = forward;
+		m_AccumulatedFrames = 0;
+	}
+	++m_FrameIndex;
+	m_RaySorter.Init(m_BVHInstance[0].m_Bounds);
+
+	// Primary rays in 8x8 tile order, they are coherent without sorting
+	const uint tileRows = (H + kTileSize - 1) / kTileSize;
+	Timo::g_TaskContext.ParallelFor(tileRows, 1, [&](uint tileRow)
+		{
+			const uint y0 = tileRow * kTileSize, y1 = std::min(y0 + kTileSize, H);
+			uint pathIndex = y0 * W;
+			for (uint x0 = 0; x0 < W; x0 += kTileSize)
+			{
+				const uint x1 = std::min(x0 + kTileSize, W);
+				for (uint y = y0; y < y1; ++y)
+				{
+					for (uint x = x0; x < x1; ++x)
+					{
+						const float u = (x + 0.5f) / W, v = (y + 0.5f) / H;
+						PathState& path = m_Paths[pathIndex++];
+						path.ray = rtrt::Ray{ eye, glm::normalize(lowerLeftCorner + u * horizontal + v * vertical) };
+						path.throughput = rtrt::float3(1.0f);
+						path.pixel = y * W + x;
+						m_Radiance[path.pixel] = rtrt::float3(0.0f);
+					}
+				}
+			}
+		});
+
+	uint pathCount = pixelCount;
+	for (int bounce = 0; bounce < s_MaxBounces && pathCount > 0; ++bounce)
+	{
+		// Sort
+		if (bounce > 0)
+		{
+			m_RaySorter.Sort(&m_Paths[0].ray, pathCount, m_SortOrder, sizeof(PathState));
+			Timo::g_TaskContext.ParallelFor(pathCount, kGroupSize, [&](uint i)
+				{
+					m_NextPaths[i] = m_Paths[m_SortOrder[i]];
+				});
+			std::swap(m_Paths, m_NextPaths);
+		}
+
+		// Extend
+		Timo::g_TaskContext.ParallelFor(pathCount, kGroupSize, [&](uint i)
+			{
+				PathState& path = m_Paths[i];
+				path.ray.tMax = rtrt::Ray::TMAX; // Ray copies leave tMax alone
+				path.bHit = m_BVHInstance[0].Intersect(path.ray, path.isect);
+			});
+
+		// Shade, queues the shadow ray and the extension ray of every hit. Each pixel has one path, so
+		// the radiance writes don't overlap.
+		m_ShadowRayCount = 0;
+		m_NextPathCount = 0;
+		const bool bLastBounce = bounce + 1 == s_MaxBounces;
+		const uint bounceSeed = WangHash(m_FrameIndex * s_MaxBounces + bounce);
+		Timo::g_TaskContext.ParallelFor(pathCount, kGroupSize, [&](uint i)
+			{
+				const PathState& path = m_Paths[i];
+				if (!path.bHit)
+				{
+					m_Radiance[path.pixel] += path.throughput * SampleSky(path.ray.rd);
+					return;
+				}
+
+				rtrt::float3 albedo, N;
+				GetSurface(path.ray, path.isect, albedo, N);
+				if (glm::dot(N, path.ray.rd) > 0.0f)
+					N = -N;
+				const rtrt::float3 p = path.ray.ro + path.ray.rd * path.isect.t + N * 1e-4f;
+
+				// Direct light, visibility is resolved in the shadow stage
+				rtrt::float3 L = g_LightPos - p;
+				const float dist = glm::length(L);
+				L /= dist;
+				const float NdotL = glm::dot(N, L);
+				if (NdotL > 0.0f)
+				{
+					ShadowRay& shadowRay = m_ShadowRays[m_ShadowRayCount++];
+					shadowRay.ray = rtrt::Ray{ p, L };
+					shadowRay.distance = dist;
+					shadowRay.pixel = path.pixel;
+					shadowRay.contribution = path.throughput * albedo * g_LightColor * (NdotL / (dist * dist));
+				}
+
+				if (bLastBounce)
+					return;
+
+				// Cosine weighted diffuse bounce, the pdf cancels the cosine, the throughput only picks up the albedo
+				uint seed = WangHash(path.pixel ^ bounceSeed) | 1;
+				const float r0 = RandomFloat(seed), r1 = RandomFloat(seed);
+				const float r = std::sqrt(r0), phi = Math::TwoPi * r1;
+				const rtrt::float3 T = glm::normalize(glm::cross(N, std::abs(N.x) > 0.9f ? rtrt::float3(0.0f, 1.0f, 0.0f) : rtrt::float3(1.0f, 0.0f, 0.0f)));
+				const rtrt::float3 B = glm::cross(N, T);
+				const rtrt::float3 D = T * (r * std::cos(phi)) + B * (r * std::sin(phi)) + N * std::sqrt(std::max(0.0f, 1.0f - r0));
+
+				PathState& next = m_NextPaths[m_NextPathCount++];
+				next.ray = rtrt::Ray{ p, glm::normalize(D) };
+				next.throughput = path.throughput * albedo;
+				next.pixel = path.pixel;
+			});
+
+		// Shadow rays, traced in sorted order through an index
+		const uint shadowRayCount = m_ShadowRayCount;
+		if (bounce > 0)
+			m_RaySorter.Sort(&m_ShadowRays[0].ray, shadowRayCount, m_SortOrder, sizeof(ShadowRay));
+		Timo::g_TaskContext.ParallelFor(shadowRayCount, kGroupSize, [&](uint i)
+			{
+				ShadowRay& shadowRay = m_ShadowRays[bounce > 0 ? m_SortOrder[i] : i];
+				shadowRay.ray.tMax = shadowRay.distance;
+				rtrt::Intersection isect;
+				if (!m_BVHInstance[0].Intersect(shadowRay.ray, isect))
+					m_Radiance[shadowRay.pixel] += shadowRay.contribution;
+			});
+
+		std::swap(m_Paths, m_NextPaths);
+		pathCount = m_NextPathCount;
+	}
+
+	// Running average of the frames since the camera last moved
+	const float weight = 1.0f / ++m_AccumulatedFrames;
+	Timo::g_TaskContext.ParallelFor(pixelCount, kGroupSize * 4, [&](uint i)
+		{
+			m_Accumulator[i] += (m_Radiance[i] - m_Accumulator[i]) * weight;
+		});
+}
+#endif
+
+#endif
+
+#if BVH_BENCHMARK
+void BVHApp::BenchmarkBVHBuild()
+{
+	using Clock = std::chrono::high_resolution_clock;
+	constexpr int kRuns = 5;
+
+	const char* meshes[] = { s_unityMesh, s_ArmadilloMesh, s_BigbenMesh };
+	const uint maxThreads = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+
+	// Best-of-N build time in milliseconds
+	auto timeBuild = [&](rtrt::BVH& bvh, rtrt::BVHBuildMode buildMode)
+	{
+		double best = DBL_MAX;
+		for (int run = 0; run < kRuns; ++run)
+		{
+			auto start = Clock::now();
+			bvh.Build(buildMode);
+			best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+		}
+		return best;
+	};
+
+	for (const char* meshFile : meshes)
+	{
+		rtrt::Mesh mesh(meshFile);
+		mesh.Init();
+		rtrt::BVH& bvh = *mesh.m_BVH;
+
+		double serialMs = timeBuild(bvh, rtrt::BVHBuildMode::Serial);
+		float serialCost = bvh.CalculateSAHCost();
+		Utility::Printf("BVH build %s: %d tris, serial %.2f ms, %u nodes, SAH %.3f\n",
+			meshFile, mesh.m_TriCount, serialMs, bvh.m_NodesUsed, serialCost);
+
+		for (uint threads = 1; ; threads = std::min(threads * 2, maxThreads))
+		{
+			Timo::g_TaskContext.Init(threads);
+			double parallelMs = timeBuild(bvh, rtrt::BVHBuildMode::Parallel);
+			float parallelCost = bvh.CalculateSAHCost();
+			float costError = std::abs(parallelCost - serialCost) / std::max(serialCost, 1e-6f);
+			Utility::Printf("    %2u threads: %.2f ms (x%.2f), SAH %.3f%s\n",
+				threads, parallelMs, serialMs / parallelMs, parallelCost, costError > 1e-3f ? " MISMATCH" : "");
+			if (threads == maxThreads)
+				break;
+		}
+
+		// Spatial splits trade build time and duplicated references for less overlap
+		double spatialMs = timeBuild(bvh, rtrt::BVHBuildMode::Spatial);
+		Utility::Printf("    spatial: %.2f ms, %u nodes, %u refs (+%.1f%%), SAH %.3f (%+.1f%%)\n",
+			spatialMs, bvh.m_NodesUsed, bvh.m_TriIndexCount, 100.0 * ((double)bvh.m_TriIndexCount / mesh.m_TriCount - 1.0),
+			bvh.CalculateSAHCost(), 100.0 * (bvh.CalculateSAHCost() / serialCost - 1.0));
+	}
+
+	Timo::g_TaskContext.Init(std::thread::hardware_concurrency());
+}
+
+// Primary rays from outside the mesh towards a grid spanning its bounds
+static void GenerateBenchmarkRays(const rtrt::Bounds& bounds, int gridSize, std::vector<rtrt::Ray>& rays)
+{
+	const rtrt::float3 extent = bounds.Extent();
+	const rtrt::float3 eye = bounds.Center() - rtrt::float3(0.0f, 0.0f, 2.0f * glm::length(extent));
+	rays.clear();
+	rays.reserve(gridSize * gridSize);
+	for (int y = 0; y < gridSize; ++y)
+	{
+		for (int x = 0; x < gridSize; ++x)
+		{
+			rtrt::float3 target{
+				bounds.bmin.x + (x + 0.5f) / gridSize * extent.x,
+				bounds.bmin.y + (y + 0.5f) / gridSize * extent.y,
+				bounds.Center().z };
+			rays.emplace_back(eye, glm::normalize(target - eye));
+		}
+	}
+}
+
+void BVHApp::BenchmarkBVHTraversal()
+{
+	using Clock = std::chrono::high_resolution_clock;
+	constexpr int kGridSize = 512;
+
+	const char* meshes[] = { s_unityMesh, s_ArmadilloMesh, s_BigbenMesh };
+	// Construction order first, every later layout is derived from the depth-first reordered tree.
+	// The spatial split entries rebuild the tree, to compare against the object split ones above them.
+	const struct { rtrt::BVHLayout layout; bool bOptimize; bool bSpatial; const char* name; } layouts[] =
+	{
+		{ rtrt::BVHLayout::Binary, false, false, "BVH2" },
+		{ rtrt::BVHLayout::Binary, true, false, "BVH2 DFS" },
+		{ rtrt::BVHLayout::Wide4, true, false, "MBVH4" },
+		{ rtrt::BVHLayout::Wide8, true, false, "MBVH8" },
+		{ rtrt::BVHLayout::Quantized, true, false, "QBVH" },
+		{ rtrt::BVHLayout::Binary, true, true, "SBVH2" },
+		{ rtrt::BVHLayout::Wide4, true, true, "SBVH4" },
+	};
+
+	std::vector<rtrt::Ray> rays;
+	for (const char* meshFile : meshes)
+	{
+		rtrt::Mesh mesh(meshFile);
+		mesh.Init(rtrt::BVHBuildMode::Parallel);
+		rtrt::BVH& bvh = *mesh.m_BVH;
+		GenerateBenchmarkRays(bvh.AABB(), kGridSize, rays);
+
+		Utility::Printf("BVH traversal %s: %d tris, %zu rays, SAH %.3f\n", meshFile, mesh.m_TriCount, rays.size(), bvh.CalculateSAHCost());
+		bool bOptimized = false, bSpatial = false;
+		for (const auto& entry : layouts)
+		{
+			bvh.SetLayout(rtrt::BVHLayout::Binary);
+			if (entry.bSpatial && !bSpatial)
+			{
+				bvh.Build(rtrt::BVHBuildMode::Spatial);
+				bSpatial = true;
+				bOptimized = false;
+				Utility::Printf("    spatial splits: SAH %.3f, %u refs\n", bvh.CalculateSAHCost(), bvh.m_TriIndexCount);
+			}
+			if (entry.bOptimize && !bOptimized)
+			{
+				bvh.OptimizeLayout();
+				bOptimized = true;
+			}
+			bvh.SetLayout(entry.layout);
+
+			// Counters first, then an uninstrumented timed pass
+			rtrt::TraversalStats stats;
+			uint hits = 0;
+			for (const auto& r : rays)
+			{
+				rtrt::Ray ray = r;
+				rtrt::Intersection isect;
+				hits += bvh.Intersect(ray, isect, 0, &stats) ? 1 : 0;
+			}
+
+			auto start = Clock::now();
+			for (const auto& r : rays)
+			{
+				rtrt::Ray ray = r;
+				rtrt::Intersection isect;
+				bvh.Intersect(ray, isect, 0);
+			}
+			double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+			const double rayCount = (double)rays.size();
+			Utility::Printf("    %-8s %6.2f Mrays/s, %6.2f steps/ray, %6.2f boxes/ray, %6.2f tris/ray, %u hits\n",
+				entry.name, rayCount / seconds * 1e-6, stats.nodeVisits / rayCount, stats.aabbTests / rayCount,
+				stats.triTests / rayCount, hits);
+			Utility::Printf("             %6.2f node bytes/tri, %6.2f cache misses/ray\n",
+				(double)bvh.GetNodeBytes() / mesh.m_TriCount, stats.cacheMisses / rayCount);
+		}
+		bvh.SetLayout(rtrt::BVHLayout::Binary);
+	}
+}
+
+void BVHApp::BenchmarkTLASBuild()
+{
+	using Clock = std::chrono::high_resolution_clock;
+	constexpr int kGridSize = 256;
+	// The last count is past the 65536 nodes the old 16-bit child links could address
+	const uint instanceCounts[] = { 1024, 16384, 131072 };
+
+	rtrt::Mesh mesh(s_ArmadilloMesh);
+	mesh.Init(rtrt::BVHBuildMode::Parallel);
+	Math::RandomNumberGenerator rng;
+	rng.SetSeed(1);
+
+	std::vector<rtrt::Ray> rays;
+	for (uint instanceCount : instanceCounts)
+	{
+		// Instances scattered in a cube that grows with their count, to keep the density constant
+		const float extent = 4.0f * std::cbrt((float)instanceCount);
+		std::vector<rtrt::BVHInstance> instances(instanceCount);
+		auto randomTransform = [&]()
+		{
+			return glm::translate(glm::mat4(1.0f), rtrt::float3(rng.NextFloat(), rng.NextFloat(), rng.NextFloat()) * extent);
+		};
+		for (uint i = 0; i < instanceCount; ++i)
+			instances[i].Init(mesh.m_BVH.get(), i, randomTransform());
+
+		rtrt::TLAS tlas(instances.data(), instanceCount);
+		auto timeMs = [](auto&& func)
+		{
+			auto start = Clock::now();
+			func();
+			return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		};
+		auto traceMrays = [&]()
+		{
+			auto start = Clock::now();
+			for (const auto& r : rays)
+			{
+				rtrt::Ray ray = r;
+				rtrt::Intersection isect;
+				tlas.Intersect(ray, isect);
+			}
+			return rays.size() / std::chrono::duration<double>(Clock::now() - start).count() * 1e-6;
+		};
+
+		Utility::Printf("TLAS %u instances\n", instanceCount);
+		if (instanceCount <= 16384)
+		{
+			double ms = timeMs([&]() { tlas.Build(); });
+			GenerateBenchmarkRays(rtrt::Bounds(tlas.m_TLASNodes[0].bmin, tlas.m_TLASNodes[0].bmax), kGridSize, rays);
+			Utility::Printf("    agglomerative %8.2f ms, %6.2f Mrays/s\n", ms, traceMrays());
+		}
+		{
+			double ms = timeMs([&]() { tlas.BuildQuick(); });
+			GenerateBenchmarkRays(rtrt::Bounds(tlas.m_TLASNodes[0].bmin, tlas.m_TLASNodes[0].bmax), kGridSize, rays);
+			Utility::Printf("    top-down      %8.2f ms, %6.2f Mrays/s\n", ms, traceMrays());
+		}
+		{
+			double ms = timeMs([&]() { tlas.BuildParallel(); });
+			Utility::Printf("    PLOC          %8.2f ms, %6.2f Mrays/s\n", ms, traceMrays());
+		}
+
+		// Move 1% of the instances per frame
+		const uint movedCount = std::max(instanceCount / 100, 1u);
+		constexpr int kFrames = 10;
+		double updateMs = 0.0;
+		for (int frame = 0; frame < kFrames; ++frame)
+		{
+			for (uint i = 0; i < movedCount; ++i)
+				instances[rng.NextInt(instanceCount - 1)].SetTransform(randomTransform());
+			updateMs += timeMs([&]() { tlas.Update(); });
+		}
+		Utility::Printf("    update (%u moved) %6.2f ms/frame, %6.2f Mrays/s\n", movedCount, updateMs / kFrames, traceMrays());
+	}
+}
 #endif
 
 rtrt::float3 BVHApp::SampleSky(const rtrt::float3& direction)
@@ -5,6 +5,7 @@
 #include "ColorBuffer.h"
 #include "Math/GLMath.h"
 #include "Scenes/DebugPass.h"
+#include <atomic>
 
 // How to build BVH
 // twitter: @j_bikker
@@ -17,6 +18,11 @@
 #define AS_FLAG 2
 #endif
 
+// Time BLAS builds and binary vs. wide BVH traversal of the BVHAssets models at startup
+#ifndef BVH_BENCHMARK
+#define BVH_BENCHMARK 0
+#endif
+
 #include "Accelerations.h"
 
 namespace MyDirectX
@@ -28,7 +34,9 @@ namespace MyDirectX
 #define FREE64(x) _aligned_free(x)
 
 #else
-	// TODO
+#define ALIGN(x) __attribute__((aligned(x)))
+#define MALLOC64(x) ((x) == 0 ? 0 : rtrt::AlignedAlloc((x), 64))
+#define FREE64(x) rtrt::AlignedFree(x)
 #endif
 
 	// Basic types
@@ -271,9 +279,20 @@ namespace MyDirectX
 
 #if AS_FLAG >= 2
 		rtrt::float3 Trace(rtrt::Ray& ray, rtrt::Intersection &isect, int rayDepth = 0);
+		rtrt::float3 Shade(const rtrt::Ray& ray, const rtrt::Intersection& isect, bool bIntersect);
+		// Albedo and world space normal at a hit
+		void GetSurface(const rtrt::Ray& ray, const rtrt::Intersection& isect, rtrt::float3& albedo, rtrt::float3& N) const;
+		// Traces the whole frame bounce by bounce, see PathState
+		void TraceWavefront(const rtrt::float3& eye, const rtrt::float3& lowerLeftCorner, const rtrt::float3& horizontal, const rtrt::float3& vertical);
 #endif
 		rtrt::float3 SampleSky(const rtrt::float3& direction);
 
+#if BVH_BENCHMARK
+		void BenchmarkBVHBuild();
+		void BenchmarkBVHTraversal();
+		void BenchmarkTLASBuild();
+#endif
+
 		/// Pipeline
 		DebugPass m_DebugPass;
 
@@ -309,6 +328,43 @@ namespace MyDirectX
 		glm::vec3 m_Translations[4];
 #endif
 
+#if AS_FLAG == 2
+		/**
+		 * Wavefront path tracing: every bounce keeps its paths in a queue, which is sorted by origin cell
+		 * and direction octant (rtrt::RaySorter), then extended, shaded and shadow tested as separate stages,
+		 * each one spread over all cores. Secondary rays of neighbouring pixels point everywhere, the sort
+		 * brings rays that traverse the same nodes back together.
+		 */
+		static constexpr int s_MaxBounces = 3;	// path vertices, the first one is the primary hit
+
+		struct PathState
+		{
+			rtrt::Ray ray;
+			rtrt::Intersection isect;
+			rtrt::float3 throughput;
+			uint pixel;
+			bool bHit;
+		};
+		struct ShadowRay
+		{
+			rtrt::Ray ray;
+			rtrt::float3 contribution;
+			float distance;
+			uint pixel;
+		};
+
+		std::vector<PathState> m_Paths, m_NextPaths;
+		std::vector<ShadowRay> m_ShadowRays;
+		std::vector<uint> m_SortOrder;
+		std::vector<rtrt::float3> m_Radiance;
+		std::atomic<uint> m_NextPathCount{ 0 }, m_ShadowRayCount{ 0 };
+		rtrt::RaySorter m_RaySorter;
+
+		// Frames are averaged while the camera stands still
+		rtrt::float3 m_LastEye{ 0.0f }, m_LastForward{ 0.0f };
+		uint m_FrameIndex = 0, m_AccumulatedFrames = 0;
+#endif
+
 		std::unique_ptr<rtrt::float3[]> m_Accumulator;
 		float* m_SkyPixels = nullptr;
 		int m_SkyWidth = 1, m_SkyHeight = 1, m_SkyBpp = 3;
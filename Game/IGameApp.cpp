@@ -10,6 +10,9 @@
 #include "GameTimer.h"
 #include "GameInput.h"
 #include "Model.h"
+#include "CpuProfiler.h"
+#include "Task.h"
+#include "Telemetry.h"
 #include <sstream>
 #include <windowsX.h>
 
@@ -115,6 +118,10 @@ void IGameApp::Cleanup()
 	m_Input->Shutdown();
 
 	m_Gfx->Shutdown();	
+
+	// Workers record markers until they are stopped
+	Timo::g_TaskContext.Destroy();
+	Timo::g_CpuProfiler.Shutdown();
 }
 
 int IGameApp::Run()
@@ -123,6 +130,8 @@ int IGameApp::Run()
 
 	m_Timer->Reset();
 
+	Timo::g_CpuProfiler.SetThreadName("Main");
+
 	MSG msg = {};
 	while (msg.message != WM_QUIT)
 	{
@@ -135,17 +144,30 @@ int IGameApp::Run()
 		{
 			m_Timer->Tick();
 			CalculateFrameStats();
+			Timo::g_CpuProfiler.MarkFrame();
+			Telemetry::EndFrame();
 			
 			float deltaTime = m_Timer->DeltaTime();
-			Update(deltaTime);
-
-			Render();
-			
-			PostProcess();
-
-			RenderUI();
-
-			m_Gfx->Present();
+			{
+				CPU_PROFILE_SCOPE("Update");
+				Update(deltaTime);
+			}
+			{
+				CPU_PROFILE_SCOPE("Render");
+				Render();
+			}
+			{
+				CPU_PROFILE_SCOPE("PostProcess");
+				PostProcess();
+			}
+			{
+				CPU_PROFILE_SCOPE("RenderUI");
+				RenderUI();
+			}
+			{
+				CPU_PROFILE_SCOPE("Present");
+				m_Gfx->Present();
+			}
 		}
 	}
 
@@ -6,13 +6,23 @@
 #include <stack>
 #include <deque>
 #include <algorithm>
+#include <atomic>
 
 #include "Graphics.h"
 #include "Utilities/FileUtility.h"
+#include "CpuProfiler.h"
+#include "Task.h"
+#include "VertexConversion.h"
 #include "TextureManager.h"
 
 #define MATRIX_SIZE 16
 
+// .glb, little endian: a 12-byte header (magic, version, length), then chunks (length, type, data) padded to 4 bytes,
+// the JSON chunk first and the optional BIN chunk second
+#define GLB_MAGIC 0x46546C67		// "glTF"
+#define GLB_CHUNK_JSON 0x4E4F534A	// "JSON"
+#define GLB_CHUNK_BIN 0x004E4942	// "BIN\0"
+
 namespace glTF
 {
 	using namespace rapidjson;
@@ -65,6 +75,42 @@ namespace glTF
 		}
 	}
 
+	static bool GetVertexFormat(const glAccessor& accessor, MyDirectX::VertexFormat& format)
+	{
+		using MyDirectX::VertexComponent;
+
+		switch (accessor.componentType)
+		{
+		case glDataType::BYTE:
+			format.component = VertexComponent::Int8;
+			break;
+		case glDataType::UNSIGNED_BYTE:
+			format.component = VertexComponent::UInt8;
+			break;
+		case glDataType::SHORT:
+			format.component = VertexComponent::Int16;
+			break;
+		case glDataType::UNSIGNED_SHORT:
+			format.component = VertexComponent::UInt16;
+			break;
+		case glDataType::UNSIGNED_INT:
+			format.component = VertexComponent::UInt32;
+			break;
+		case glDataType::FLOAT:
+			format.component = VertexComponent::Float;
+			break;
+		default:
+			return false;
+		}
+
+		int numComponents = GetNumComponentsInType(accessor.type);
+		if (numComponents < 1 || numComponents > 4)
+			return false;
+		format.count = numComponents;
+		format.normalized = accessor.normalized;
+		return true;
+	}
+
 #if defined(GLMath)
 	static void Mat2TRS(const Matrix4x4& mat, Vector3& translate, Quaternion& rotation, Vector3& scale)
 	{
@@ -225,33 +271,36 @@ namespace glTF
 
 	bool glTFImporter::Load(const std::string & glTFFilePath)
 	{
+		CPU_PROFILE_SCOPE("glTFImporter::Load");
+
 		m_FileDir = GetBaseDir(glTFFilePath);
 		m_FileName = GetFileNameWithNoExtensions(glTFFilePath);
 
 		std::regex reg(".gltf$", std::regex_constants::icase);
-		bool bValid = std::regex_search(glTFFilePath, reg);	// regex_match - ȫƥ	regex_search - ƥ
+		bool bBinary = std::regex_search(glTFFilePath, std::regex(".glb$", std::regex_constants::icase));
+		bool bValid = bBinary || std::regex_search(glTFFilePath, reg);	// regex_match - ȫƥ	regex_search - ƥ
 		if (!bValid)
 		{
-			std::cout << "File format is not gltf" << std::endl;
+			std::cout << "File format is not gltf or glb" << std::endl;
 			return false;
 		}
 
-		std::ifstream ifs(glTFFilePath);
-		if (!ifs.is_open())
+		const rapidjson::Document* dom = nullptr;
+		if (bBinary)
+			dom = ParseGlb(glTFFilePath);
+		else
 		{
-			std::cout << "Failed to open file " << glTFFilePath << std::endl;
-			return false;
+			dom = m_JsonParser.ParseFile(glTFFilePath);
+			if (dom == nullptr)
+				std::cout << m_JsonParser.GetError() << std::endl;
 		}
-
-		m_glTFJson = std::string((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
-		rapidjson::Document dom;
-		if (dom.Parse(m_glTFJson.c_str()).HasParseError())
-		{
-			std::cout << "Parse glTF file error" << dom.GetParseError() << std::endl;
+		if (dom == nullptr)
 			return false;
-		}
 
-		Parse(dom);
+		Parse(*dom);
+
+		// Parse() copied what it needs, the pool stays for the next model
+		m_JsonParser.Release();
 
 		return true;
 	}
@@ -268,7 +317,7 @@ namespace glTF
 			m_VertexData.reset();
 			m_IndexData.reset();
 
-			m_BinData.clear();
+			ReleaseBuffers();
 		}
 		else
 		{
@@ -280,7 +329,7 @@ namespace glTF
 
 	void glTFImporter::Clear()
 	{
-		m_BinData.clear();
+		ReleaseBuffers();
 
 		m_VertexData.reset();
 		m_IndexData.reset();
@@ -303,6 +352,73 @@ namespace glTF
 		}		
 	}
 
+	const rapidjson::Document* glTFImporter::ParseGlb(const std::string& glbFilePath)
+	{
+		// mapped, not read. the BIN chunk is used where it is, as buffer 0
+		auto glbFile = std::make_unique<Utility::MappedFile>();
+		if (!glbFile->Open(glbFilePath))
+		{
+			std::cout << "Failed to open file " << glbFilePath << std::endl;
+			return nullptr;
+		}
+
+		unsigned char* data = glbFile->Data();
+		auto readUint = [data](size_t offset)
+		{
+			uint32_t value;
+			memcpy(&value, data + offset, sizeof(uint32_t));
+			return value;
+		};
+
+		const size_t fileSize = glbFile->Size();
+		if (fileSize < 20 || readUint(0) != GLB_MAGIC || readUint(4) != 2 || readUint(8) > fileSize
+			|| readUint(16) != GLB_CHUNK_JSON || 20 + (size_t)readUint(12) > readUint(8))
+		{
+			std::cout << "Invalid glb file " << glbFilePath << std::endl;
+			return nullptr;
+		}
+		const size_t fileLength = readUint(8);
+		const size_t jsonLength = readUint(12);
+
+		const size_t binChunk = 20 + jsonLength;
+		m_GlbBinData = nullptr;
+		m_GlbBinLength = 0;
+		if (binChunk + 8 <= fileLength && readUint(binChunk + 4) == GLB_CHUNK_BIN)
+		{
+			const size_t binLength = readUint(binChunk);
+			if (binChunk + 8 + binLength > fileLength)
+			{
+				std::cout << "Invalid glb file " << glbFilePath << std::endl;
+				return nullptr;
+			}
+			m_GlbBinData = data + binChunk + 8;
+			m_GlbBinLength = binLength;
+		}
+
+		// the JSON chunk is parsed in situ. the byte after it (the BIN chunk length, read above) becomes the terminator,
+		// the mapping is copy-on-write
+		char* json = (char*)data + 20;
+		const rapidjson::Document* dom = nullptr;
+		if (binChunk < fileSize)
+		{
+			json[jsonLength] = '\0';
+			dom = m_JsonParser.ParseInsitu(json, jsonLength);
+		}
+		else
+			dom = m_JsonParser.ParseText(json, jsonLength);
+
+		if (dom == nullptr)
+		{
+			std::cout << m_JsonParser.GetError() << std::endl;
+			m_GlbBinData = nullptr;
+			m_GlbBinLength = 0;
+			return nullptr;
+		}
+
+		m_GlbFile = std::move(glbFile);
+		return dom;
+	}
+
 	void glTFImporter::Parse(const rapidjson::Document& dom)
 	{
 		// scenes
@@ -889,8 +1005,9 @@ namespace glTF
 		}
 	}
 
-	void glTFImporter::ReadBuffers()
+	bool glTFImporter::ReadBuffers()
 	{
+		m_BinData.assign(m_Buffers.size(), nullptr);
 		for (size_t i = 0, imax = m_Buffers.size(); i < imax; ++i)
 		{
 			const auto& curBuffer = m_Buffers[i];
@@ -904,44 +1021,52 @@ namespace glTF
 				}
 
 				fileName = m_FileDir + fileName;
-				ReadFromFile(fileName, curBuffer.byteLength);
+				m_BinData[i] = ReadFromFile(fileName, curBuffer.byteLength);
+			}
+			else if (i == 0 && m_GlbBinData != nullptr && m_GlbBinLength >= (size_t)curBuffer.byteLength)
+			{
+				// a .glb buffer without uri is its BIN chunk
+				m_BinData[i] = m_GlbBinData;
+			}
+
+			if (m_BinData[i] == nullptr)
+			{
+				std::cout << "Failed to read glTF buffer " << i << std::endl;
+				return false;
 			}
 		}
+		return true;
 	}
 
-	bool glTFImporter::ReadFromFile(const std::string& fileName, uint32_t bufferLength)
+	unsigned char* glTFImporter::ReadFromFile(const std::string& fileName, uint32_t bufferLength)
 	{
-		std::ifstream ifs(fileName, std::ifstream::in | std::ifstream::binary);
-		if (!ifs.is_open())
+		// mapped instead of copied, accessors read straight from the file
+		auto file = std::make_unique<Utility::MappedFile>();
+		if (!file->Open(fileName))
 		{
-			std::cout << "Failed to load glTF model: " << ifs.failbit << std::endl;
-			return false;
+			std::cout << "Failed to load glTF buffer: " << fileName << std::endl;
+			return nullptr;
 		}
 
-		size_t byteLength = 0;
-
-		ifs.seekg(0, ifs.end);
-		byteLength = static_cast<size_t>(ifs.tellg());	// tellg - returns the input position indicator
+		size_t byteLength = file->Size();
 		if (bufferLength > 0 && bufferLength != byteLength)
 		{
 			std::cout << "Load byte length: " << byteLength << " is not equal to the given length: " << bufferLength << std::endl;
-			ifs.close();
-			return false;
+			return nullptr;
 		}
 
-		ifs.seekg(0, ifs.beg);
-
-		unsigned char* newBytes = new unsigned char[byteLength];
-		ifs.read(reinterpret_cast<char*>(newBytes), byteLength);
-
-		m_BinData.emplace_back(std::unique_ptr<unsigned char[]>(newBytes));
-
-		ifs.close();
+		unsigned char* data = file->Data();
+		m_MappedFiles.emplace_back(std::move(file));
+		return data;
+	}
 
-		// 
-		// 
-		// Utility::ReadFileSync();
-		return true;
+	void glTFImporter::ReleaseBuffers()
+	{
+		m_BinData.clear();
+		m_MappedFiles.clear();
+		m_GlbFile.reset();
+		m_GlbBinData = nullptr;
+		m_GlbBinLength = 0;
 	}
 
 	void glTFImporter::BuildNodeTree()
@@ -1017,7 +1142,8 @@ namespace glTF
 		BuildNodeTree();
 		CacheTransform();
 
-		ReadBuffers();
+		if (!ReadBuffers())
+			return false;
 
 		InitVAttribFormats();
 
@@ -1026,6 +1152,8 @@ namespace glTF
 
 	bool glTFImporter::BuildMeshes()
 	{
+		CPU_PROFILE_SCOPE("glTFImporter::BuildMeshes");
+
 		m_ActiveNodes.clear();
 		m_ActiveMeshes.clear();
 		m_ActiveMaterials.clear();
@@ -1077,7 +1205,6 @@ namespace glTF
 					auto& curPrimitive = primitives[i];
 
 					uint32_t curMeshVertexCount = 0;
-					uint32_t curMeshVertexByteOffset = 0;
 					uint32_t enabledAttribs = 0;
 
 					// attributes 
@@ -1090,7 +1217,6 @@ namespace glTF
 						curAttrib.byteLen = cachedAttrib.byteLen;
 						curAttrib.format = cachedAttrib.format;
 
-						int attribByteSize = 0;
 						if (curAttrib.accessor >= 0)
 						{
 							enabledAttribs |= (1 << j);
@@ -1108,7 +1234,7 @@ namespace glTF
 							ASSERT(componentSize > 0);
 							int numComponents = GetNumComponentsInType(curAccessor.type);
 							ASSERT(numComponents > 0);
-							attribByteSize = componentSize * numComponents;
+							int attribByteSize = componentSize * numComponents;
 
 							// ԴϢ
 							int bufferViewIdx = curAccessor.bufferViewIdx;
@@ -1128,12 +1254,8 @@ namespace glTF
 								newMesh.boundingBox.max = Vector3(maxs[0], maxs[1], maxs[2]);
 							}
 						}
-						else
-							attribByteSize = m_VertexAttributes[j].byteLen;
 
 						ASSERT(curMeshVertexCount > 0);	// ӦѾʼˣ뺬POSITION
-						int totalByteLegnth = curMeshVertexCount * attribByteSize;	// curMeshVertexCount
-						curMeshVertexByteOffset += totalByteLegnth;
 
 						newMesh.attribs[j] = curAttrib;
 					}
@@ -1141,7 +1263,8 @@ namespace glTF
 					newMesh.vertexCount = curMeshVertexCount;
 					newMesh.vertexStride = m_VertexStride;
 
-					curVertexByteLength += curMeshVertexByteOffset;
+					// pass 2 writes whole vertices of the layout, whatever the size of the source attributes
+					curVertexByteLength += curMeshVertexCount * m_VertexStride;
 
 					// index 
 					int indexAccessor = curPrimitive.indexAccessor;
@@ -1186,7 +1309,8 @@ namespace glTF
 		}
 
 		/// pass 2
-		bool bValid = true;
+		// every mesh converts its accessors into its own range of the blobs, sized in pass 1
+		std::atomic<bool> bValid = true;
 		{
 			if (curVertexByteLength > 0)	// >0
 			{
@@ -1199,11 +1323,26 @@ namespace glTF
 				m_IndexByteLength = curIndexByteLength;
 			}
 
-			for (size_t i = 0, imax = m_oMeshes.size(); i < imax; ++i)
+			// the vertex layout keeps the formats of the accessors it was taken from, or floats by default
+			MyDirectX::VertexFormat attribFormats[Attrib::maxAttrib];
+			for (size_t j = 0; j < Attrib::maxAttrib; ++j)
+			{
+				const auto& cachedAttrib = m_VertexAttributes[j];
+				if (cachedAttrib.accessor >= 0)
+					GetVertexFormat(m_Accessors[cachedAttrib.accessor], attribFormats[j]);
+				else
+					attribFormats[j].count = cachedAttrib.byteLen / (uint32_t)sizeof(float);
+			}
+			const MyDirectX::VertexFormat indexFormat{ MyDirectX::VertexComponent::UInt16, 1 };
+
+			// messages of each mesh, printed in mesh order once all are done
+			std::vector<std::string> meshLogs(m_oMeshes.size());
+			Timo::g_TaskContext.ParallelFor((uint32_t)m_oMeshes.size(), 1, [&](uint32_t i)
 			{
 				const auto& curMesh = m_oMeshes[i];
+				std::string& log = meshLogs[i];
 
-				// vertices
+				// vertices, one kernel per accessor
 				{
 					uint32_t curVertexCount = curMesh.vertexCount;
 					uint32_t curVertexByteOffset = curMesh.vertexDataByteOffset;
@@ -1217,20 +1356,26 @@ namespace glTF
 						if (bEnabled && curMesh.attribs[j].accessor >= 0)
 						{
 							const auto& curAttrib = curMesh.attribs[j];
-							uint32_t curAttribLen = curAttrib.byteLen;
 							unsigned char* dstAttriPos = dstPos + curAttrib.alignedByteOffset;
+							unsigned char* srcPos = m_BinData[curAttrib.bufferIdx] + curAttrib.bufferOffset;
 
-							uint32_t bufferIdx = curAttrib.bufferIdx;
-							uint32_t bufferOffset = curAttrib.bufferOffset;
-							uint32_t srcStride = curAttrib.bufferByteStride;
-							unsigned char* srcPos = m_BinData[bufferIdx].get() + bufferOffset;
-							for (size_t k = 0; k < curVertexCount; ++k)
+							MyDirectX::VertexFormat srcFormat;
+							MyDirectX::VertexConverter convert = nullptr;
+							if (GetVertexFormat(m_Accessors[curAttrib.accessor], srcFormat))
+								convert = MyDirectX::GetVertexConverter(srcFormat, attribFormats[j]);
+							if (convert == nullptr)
+							{
+								// no kernel, e.g. integer attributes of another width than the layout's, the bytes are copied as they are
+								log += "No conversion of vertex attribute format, accessor " + std::to_string(curAttrib.accessor) + " copied as raw bytes\n";
+								convert = MyDirectX::GetVertexCopier(std::min((uint32_t)curAttrib.byteLen, attribFormats[j].GetSize()));
+							}
+							if (convert == nullptr)
 							{
-								memcpy_s(dstAttriPos, curAttribLen, srcPos, curAttribLen);
-								// memcpy(dstAttriPos, srcPos, curAttribLen);
-								dstAttriPos += curVertexStride;
-								srcPos += srcStride;
+								log += "Unsupported vertex attribute format, accessor " + std::to_string(curAttrib.accessor) + "\n";
+								bValid = false;
+								return;
 							}
+							convert(srcPos, curAttrib.bufferByteStride, dstAttriPos, curVertexStride, curVertexCount);
 						}
 					}
 				}
@@ -1241,8 +1386,15 @@ namespace glTF
 					int indexAccessor = curMesh.indexAccessor;
 					if (indexAccessor >= 0)
 					{
+						// the index buffer is 16-bit for all meshes, larger ones would wrap around
+						if (curMesh.vertexCount > 65536)
+						{
+							log += "Mesh of " + std::to_string(curMesh.vertexCount) + " vertices exceeds 16-bit indices, accessor " + std::to_string(indexAccessor) + "\n";
+							bValid = false;
+							return;
+						}
+
 						uint32_t curIndexCount = curMesh.indexCount;
-						uint32_t curIndexByteLength = curIndexCount * sizeof(unsigned short);
 						uint32_t curIndexByteOffset = curMesh.indexDataByteOffset;
 						unsigned char* dstPos = m_IndexData.get() + curIndexByteOffset;
 
@@ -1250,66 +1402,33 @@ namespace glTF
 						const auto& bufferView = m_BufferViews[accessor.bufferViewIdx];
 						uint32_t bufferIdx = bufferView.bufferIdx;
 						uint32_t bufferOffset = bufferView.byteOffset + accessor.byteOffset;
-						uint32_t bufferStride = bufferView.byteStride;
-						unsigned char* srcPos = m_BinData[bufferIdx].get() + bufferOffset;
+						unsigned char* srcPos = m_BinData[bufferIdx] + bufferOffset;
 
-						if (bufferStride == 0)	// indices are packed tightly
+						MyDirectX::VertexFormat srcFormat;
+						MyDirectX::VertexConverter convert = nullptr;
+						if (GetVertexFormat(accessor, srcFormat))
+							convert = MyDirectX::GetVertexConverter(srcFormat, indexFormat);
+						if (convert == nullptr)
 						{
-							if (accessor.componentType == glDataType::UNSIGNED_SHORT)	// ʽƥ
-								memcpy_s(dstPos, curIndexByteLength, srcPos, curIndexByteLength);
-							else
-							{
-								int componentSize = GetComponentSizeInBytes(accessor.componentType);
-								if (componentSize < 0)
-									return false;
-								int numComponents = GetNumComponentsInType(accessor.type);
-								if (numComponents < 0)
-									return false;
-
-								bufferStride = componentSize * numComponents;
-							}
+							log += "Unsupported index format, accessor " + std::to_string(indexAccessor) + "\n";
+							bValid = false;
+							return;
 						}
 
-						if (bufferStride > 0)
-						{
-							unsigned short* shDstPos = (unsigned short*)(dstPos);
-
-							if (accessor.componentType == glDataType::UNSIGNED_SHORT)
-							{
-								unsigned short* shSrcPos = (unsigned short*)srcPos;
-								for (size_t j = 0; j < curIndexCount; ++j)
-								{
-									*(shDstPos++) = *shSrcPos;
-									shSrcPos = (unsigned short*)((unsigned char*)shSrcPos + bufferStride);
-								}
-							}
-							// ܶ඼UNSIGNED_INTʽ
-							else if (accessor.componentType == glDataType::UNSIGNED_INT)
-							{
-								unsigned int* uiSrcPos = (unsigned int*)srcPos;
-								for (size_t j = 0; j < curIndexCount; ++j)
-								{
-									*(shDstPos++) = *uiSrcPos;
-									uiSrcPos = (unsigned int*)((unsigned char*)uiSrcPos + bufferStride);
-								}
-							}
-						}
-
-						// debug
-						//unsigned short* psh = (unsigned short*)dstPos;
-						//for (int k = 0; k < curIndexCount && k < 100; ++k)
-						//{
-						//	std::cout << *(psh++) << (((k + 1) % 12 > 0) ? " " : "\n");
-						//}
-						//std::cout << "Mesh " << i << std::endl;
+						// indices are packed tightly unless the buffer view has a stride
+						uint32_t bufferStride = bufferView.byteStride > 0 ? bufferView.byteStride : srcFormat.GetSize();
+						convert(srcPos, bufferStride, dstPos, sizeof(unsigned short), curIndexCount);
 					}
 				}
-			}
+			});
+
+			for (const std::string& log : meshLogs)
+				std::cout << log;
 		}
 
 		ComputeBoundingBox();
 
-		return true;
+		return bValid;
 	}
 
 	bool glTFImporter::BuildMaterials()
@@ -1419,77 +1538,43 @@ namespace glTF
 		{
 			m_SRVs.reset(new D3D12_CPU_DESCRIPTOR_HANDLE[activeMatCount * Material::TextureNum]);
 
-			const ManagedTexture* matTextures[Material::TextureNum] = {};
-
+			// base color, metallic roughness, normal, occlusion, emissive
+			const Texture* fallbacks[Material::TextureNum] =
+			{
+				&TextureManager::GetWhiteTex2D(), &TextureManager::GetWhiteTex2D(), &TextureManager::GetWhiteTex2D(),
+				&TextureManager::GetWhiteTex2D(), &TextureManager::GetBlackTex2D()
+			};
+
+			// Start every load first, the file reads queue up on the I/O thread while the textures already read
+			// are created on the workers
+			std::vector<Timo::Async<const ManagedTexture*>> loads;
+			std::vector<uint32_t> loadSlots;
 			for (size_t i = 0; i < activeMatCount; ++i)
 			{
 				const auto& curMat = m_oMaterials[i];
-				// base color
-				bool bValid = !curMat.texBaseColorPath.empty();
-				if (bValid)
-				{
-					matTextures[0] = Graphics::s_TextureManager.LoadFromFile(pDevice, curMat.texBaseColorPath);
-					bValid = matTextures[0]->IsValid();
-				}
-				if (!bValid)
-				{
-					matTextures[0] = dynamic_cast<const ManagedTexture*>(&TextureManager::GetWhiteTex2D());
-				}
-
-				// metallic roughness
-				bValid = !curMat.texMetallicRoughnessPath.empty();
-				if (bValid)
-				{
-					matTextures[1] = Graphics::s_TextureManager.LoadFromFile(pDevice, curMat.texMetallicRoughnessPath);
-					bValid = matTextures[1]->IsValid();
-				}
-				if (!bValid)
-				{
-					matTextures[1] = dynamic_cast<const ManagedTexture*>(&TextureManager::GetWhiteTex2D());
-				}
-
-				// normal
-				bValid = !curMat.texNormalPath.empty();
-				if (bValid)
-				{
-					matTextures[2] = Graphics::s_TextureManager.LoadFromFile(pDevice, curMat.texNormalPath);
-					bValid = matTextures[2]->IsValid();
-				}
-				if (!bValid)
-				{
-					matTextures[2] = dynamic_cast<const ManagedTexture*>(&TextureManager::GetWhiteTex2D());
-				}
-
-				// occlusion
-				bValid = !curMat.texOcclusionPath.empty();
-				if (bValid)
+				const std::string* paths[Material::TextureNum] =
 				{
-					matTextures[3] = Graphics::s_TextureManager.LoadFromFile(pDevice, curMat.texOcclusionPath);
-					bValid = matTextures[3]->IsValid();
-				}
-				if (!bValid)
-				{
-					matTextures[3] = dynamic_cast<const ManagedTexture*>(&TextureManager::GetWhiteTex2D());
-				}
+					&curMat.texBaseColorPath, &curMat.texMetallicRoughnessPath, &curMat.texNormalPath,
+					&curMat.texOcclusionPath, &curMat.texEmissivePath
+				};
 
-				// emissive
-				bValid = !curMat.texEmissivePath.empty();
-				if (bValid)
-				{
-					matTextures[4] = Graphics::s_TextureManager.LoadFromFile(pDevice, curMat.texEmissivePath);
-					bValid = matTextures[4]->IsValid();
-				}
-				if (!bValid)
+				uint32_t ind = (uint32_t)i * Material::TextureNum;
+				for (uint32_t t = 0; t < Material::TextureNum; ++t)
 				{
-					matTextures[4] = dynamic_cast<const ManagedTexture*>(&TextureManager::GetBlackTex2D());
+					m_SRVs[ind + t] = fallbacks[t]->GetSRV();
+					if (!paths[t]->empty())
+					{
+						loads.push_back(Graphics::s_TextureManager.LoadFromFileAsync(pDevice, *paths[t]));
+						loadSlots.push_back(ind + t);
+					}
 				}
+			}
 
-				uint32_t ind = (uint32_t)i * Material::TextureNum;
-				m_SRVs[ind + 0] = matTextures[0]->GetSRV();
-				m_SRVs[ind + 1] = matTextures[1]->GetSRV();
-				m_SRVs[ind + 2] = matTextures[2]->GetSRV();
-				m_SRVs[ind + 3] = matTextures[3]->GetSRV();
-				m_SRVs[ind + 4] = matTextures[4]->GetSRV();
+			auto textures = Timo::SyncWait(Timo::g_TaskContext, Timo::WhenAll(std::move(loads)));
+			for (size_t i = 0, imax = textures.size(); i < imax; ++i)
+			{
+				if (textures[i]->IsValid())
+					m_SRVs[loadSlots[i]] = textures[i]->GetSRV();
 			}
 		}
 	}
@@ -13,6 +13,8 @@
 
 #include "glTFCommon.h"
 #include "GpuBuffer.h"
+#include "Utilities/MappedFile.h"
+#include "glTFJsonParser.h"
 
 // OpenGL glTF, TinyGLTF,...
 namespace glTF
@@ -50,13 +52,15 @@ namespace glTF
 		//
 	private:
 		void Parse(const rapidjson::Document &dom);
+		const rapidjson::Document* ParseGlb(const std::string &glbFilePath);
 
 		bool BuildScenes();
 		bool BuildMeshes();
 		bool BuildMaterials();
 
-		void ReadBuffers();
-		bool ReadFromFile(const std::string &filePath, uint32_t bufferLength = 0);
+		bool ReadBuffers();
+		unsigned char* ReadFromFile(const std::string &filePath, uint32_t bufferLength = 0);
+		void ReleaseBuffers();
 
 		void BuildNodeTree();
 		void CacheTransform();
@@ -71,7 +75,6 @@ namespace glTF
 		void InitTextures();
 
 	public:
-		std::string m_glTFJson;
 		std::string m_FileDir;
 		std::string m_FileName;
 		
@@ -108,7 +111,15 @@ namespace glTF
 		std::vector<glImage> m_Images;
 		std::vector<glSampler> m_Samplers;
 
-		std::vector<std::unique_ptr<unsigned char[]>> m_BinData;
+		// the JSON text and document of the model being loaded, the pool is kept between models
+		glTFJsonParser m_JsonParser;
+
+		// one per buffer, into the mapped .bin files or the BIN chunk of the .glb
+		std::vector<unsigned char*> m_BinData;
+		std::vector<std::unique_ptr<Utility::MappedFile>> m_MappedFiles;
+		std::unique_ptr<Utility::MappedFile> m_GlbFile;
+		unsigned char* m_GlbBinData = nullptr;
+		size_t m_GlbBinLength = 0;
 		Matrix4x4 m_DefaultTransorm;
 
 	public:
@@ -0,0 +1,90 @@
+#include "glTFJsonParser.h"
+#include <rapidjson/error/en.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace glTF
+{
+	// in situ the pool holds the values and members only, about as large as the text for glTF
+	static constexpr size_t kMinPoolSize = 64 * 1024;
+
+	const rapidjson::Document* glTFJsonParser::ParseFile(const std::string& filePath)
+	{
+		std::ifstream ifs(filePath, std::ifstream::in | std::ifstream::binary | std::ifstream::ate);
+		if (!ifs.is_open())
+		{
+			m_Error = "Failed to open file " + filePath;
+			return nullptr;
+		}
+
+		const size_t length = static_cast<size_t>(ifs.tellg());
+		ifs.seekg(0, ifs.beg);
+
+		m_Text.resize(length + 1);
+		if (!ifs.read(m_Text.data(), length))
+		{
+			m_Error = "Failed to read file " + filePath;
+			return nullptr;
+		}
+		m_Text[length] = '\0';
+
+		return Parse(m_Text.data(), length);
+	}
+
+	const rapidjson::Document* glTFJsonParser::ParseInsitu(char* text, size_t length)
+	{
+		return Parse(text, length);
+	}
+
+	const rapidjson::Document* glTFJsonParser::ParseText(const char* text, size_t length)
+	{
+		m_Text.resize(length + 1);
+		memcpy(m_Text.data(), text, length);
+		m_Text[length] = '\0';
+
+		return Parse(m_Text.data(), length);
+	}
+
+	void glTFJsonParser::Release()
+	{
+		m_Document.reset();
+		m_Allocator.reset();
+		m_Text.clear();
+		m_Text.shrink_to_fit();
+	}
+
+	size_t glTFJsonParser::GetMemoryUsage() const
+	{
+		// the allocator's capacity includes the pool and the chunks it had to add
+		return m_Text.capacity() + (m_Allocator ? m_Allocator->Capacity() : m_PoolSize);
+	}
+
+	const rapidjson::Document* glTFJsonParser::Parse(char* text, size_t length)
+	{
+		m_Document.reset();
+		m_Allocator.reset();
+
+		// the pool only grows, to what the largest parse needed
+		const size_t poolSize = std::max({ m_PoolUsed, length + length / 8, kMinPoolSize });
+		if (m_PoolSize < poolSize)
+		{
+			m_Pool.reset(new char[poolSize]);
+			m_PoolSize = poolSize;
+		}
+
+		m_Allocator = std::make_unique<rapidjson::MemoryPoolAllocator<>>(m_Pool.get(), m_PoolSize);
+		m_Document = std::make_unique<rapidjson::Document>(m_Allocator.get());
+		m_Document->ParseInsitu(text);
+		m_PoolUsed = std::max(m_PoolUsed, m_Allocator->Size());
+
+		if (m_Document->HasParseError())
+		{
+			m_Error = std::string("Parse glTF file error: ") + rapidjson::GetParseError_En(m_Document->GetParseError())
+				+ " at " + std::to_string(m_Document->GetErrorOffset());
+			m_Document.reset();
+			return nullptr;
+		}
+		return m_Document.get();
+	}
+}
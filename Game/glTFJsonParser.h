@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef RAPIDJSON_NOMEMBERITERATORCLASS
+#define RAPIDJSON_NOMEMBERITERATORCLASS
+#endif
+#include <rapidjson/document.h>
+
+namespace glTF
+{
+	/**
+		Parses the JSON of a glTF file in situ, without the copies of a DOM parse: the text is read once into a buffer
+	the document's strings then point into, and the values come from a memory pool that is kept between loads, so that
+	loading the next model of the same size allocates nothing. The pool grows to what the largest parse used.
+		The document is valid until the next parse or Release(). Only the standard library and rapidjson, so that the
+	standalone rtrt build can benchmark it.
+	*/
+	class glTFJsonParser
+	{
+	public:
+		glTFJsonParser() = default;
+
+		glTFJsonParser(const glTFJsonParser&) = delete;
+		glTFJsonParser& operator=(const glTFJsonParser&) = delete;
+
+		// nullptr if the file can't be read or parsed
+		const rapidjson::Document* ParseFile(const std::string& filePath);
+		// text must be terminated, it is modified and must outlive the document, e.g. the mapped JSON chunk of a .glb
+		const rapidjson::Document* ParseInsitu(char* text, size_t length);
+		// copies text into the parser's buffer first
+		const rapidjson::Document* ParseText(const char* text, size_t length);
+
+		// frees the text and the document, keeps the pool
+		void Release();
+
+		const std::string& GetError() const { return m_Error; }
+		// text and pool, in bytes
+		size_t GetMemoryUsage() const;
+
+	private:
+		const rapidjson::Document* Parse(char* text, size_t length);
+
+		std::vector<char> m_Text;
+		std::unique_ptr<char[]> m_Pool;
+		size_t m_PoolSize = 0;
+		size_t m_PoolUsed = 0;	// by the last parse, the next one starts with a pool this large
+		std::unique_ptr<rapidjson::MemoryPoolAllocator<>> m_Allocator;
+		std::unique_ptr<rapidjson::Document> m_Document;
+		std::string m_Error;
+	};
+}
@@ -3,6 +3,8 @@
 #include "GfxCommon.h"
 #include "CommandContext.h"
 #include "TextureManager.h"
+#include "Task.h"
+#include <thread>
 
 // compiled shade bytecode
 #include "glTFCommonVS.h"
@@ -101,6 +103,9 @@ void glTFViewer::InitAssets()
 
 	// ģ
 	Graphics::s_TextureManager.Init(L"Textures/");
+	// meshes are converted in parallel
+	if (Timo::g_TaskContext.GetThreadCount() == 0)
+		Timo::g_TaskContext.Init(std::thread::hardware_concurrency());
 	ASSERT(m_Importer.Create(Graphics::s_Device));
 
 	// root signature & pso
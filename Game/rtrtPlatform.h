@@ -0,0 +1,104 @@
+#pragma once
+
+/**
+ * Platform layer of the rtrt ray tracing core (Accelerations.h/.cpp).
+ * Inside the engine it builds on pch.h, the standalone library (rtrt/CMakeLists.txt) defines RTRT_STANDALONE
+ * and only needs the C++ standard library, SSE intrinsics and glm, so that it also builds with GCC and Clang.
+ */
+
+#ifndef RTRT_STANDALONE
+#include "pch.h"
+#endif
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdarg>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <string>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+// Same configuration as Math/GLMath.h
+#define GLM_FORCE_CTOR_INIT
+#define GLM_FORCE_XYZW_ONLY
+#ifndef GLM_ENABLE_EXPERIMENTAL
+#define GLM_ENABLE_EXPERIMENTAL
+#endif
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+
+#ifdef RTRT_STANDALONE
+#define RTRT_ASSERT(x) assert(x)
+#else
+#define RTRT_ASSERT(x) ASSERT(x)
+#endif
+
+namespace rtrt
+{
+#ifdef RTRT_STANDALONE
+	inline void Printf(const char* format, ...)
+	{
+		va_list args;
+		va_start(args, format);
+		std::vprintf(format, args);
+		va_end(args);
+	}
+#else
+	using Utility::Printf;
+#endif
+
+	inline void* AlignedAlloc(size_t size, size_t alignment)
+	{
+#ifdef _MSC_VER
+		return _aligned_malloc(size, alignment);
+#else
+		// std::aligned_alloc() wants a multiple of the alignment
+		return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+#endif
+	}
+
+	inline void AlignedFree(void* ptr)
+	{
+#ifdef _MSC_VER
+		_aligned_free(ptr);
+#else
+		std::free(ptr);
+#endif
+	}
+
+	inline FILE* OpenFile(const char* fileName, const char* mode)
+	{
+#ifdef _MSC_VER
+		FILE* file = nullptr;
+		return fopen_s(&file, fileName, mode) == 0 ? file : nullptr;
+#else
+		return std::fopen(fileName, mode);
+#endif
+	}
+
+	template <typename T> inline T DivideByMultiple(T value, size_t alignment)
+	{
+		return (T)((value + alignment - 1) / alignment);
+	}
+
+	template <typename T> inline T AlignUp(T value, size_t alignment)
+	{
+		return (T)((value + alignment - 1) / alignment * alignment);
+	}
+
+	// 64-bit FNV-1a over 32-bit words, identical on every platform
+	inline uint64_t HashRange(const uint32_t* begin, const uint32_t* end, uint64_t hash = 14695981039346656037ull)
+	{
+		for (const uint32_t* iter = begin; iter < end; ++iter)
+			hash = (hash ^ *iter) * 1099511628211ull;
+		return hash;
+	}
+}
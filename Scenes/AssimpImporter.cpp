@@ -1,8 +1,12 @@
 #include "AssimpImporter.h"
+#include "BakedScene.h"
 #include "Graphics.h"
 #include "TextureManager.h"
+#include "CpuProfiler.h"
+#include "VertexConversion.h"
 #include <fstream>
 #include <functional>
+#include <assimp/DefaultIOSystem.h>
 
 #ifdef _DEBUG
 #pragma comment(lib, "assimp-vc143-mtd.lib")
@@ -16,6 +20,24 @@ const std::string AssimpImporter::s_DefaultDiffusePath	= "default";
 const std::string AssimpImporter::s_DefaultSpecularPath	= "default_specular";
 const std::string AssimpImporter::s_DefaultNormalPath	= "default_normal";
 
+// Records the files Assimp opens, a baked scene is stale once any of them changes
+class RecordingIOSystem : public Assimp::DefaultIOSystem
+{
+public:
+	explicit RecordingIOSystem(std::vector<std::string>& openedFiles) : m_OpenedFiles(openedFiles) {}
+
+	Assimp::IOStream* Open(const char* pFile, const char* pMode = "rb") override
+	{
+		Assimp::IOStream* pStream = DefaultIOSystem::Open(pFile, pMode);
+		if (pStream != nullptr && std::find(m_OpenedFiles.begin(), m_OpenedFiles.end(), pFile) == m_OpenedFiles.end())
+			m_OpenedFiles.push_back(pFile);
+		return pStream;
+	}
+
+private:
+	std::vector<std::string>& m_OpenedFiles;
+};
+
 static AlphaMode Str2AlphaMode(const std::string& strAlphaMode, const std::string& errorInfo = "")
 {
 	if (strAlphaMode == "OPAQUE")
@@ -321,9 +343,13 @@ void AssimpImporter::ProcessMaterials(const aiScene* scene, ImporterData& import
 
 bool AssimpImporter::Load(ID3D12Device* pDevice, const std::string& filePath, const InstanceMatrices& instances, uint32_t indexStride)
 {
+	CPU_PROFILE_SCOPE("AssimpImporter::Load");
+
 	Clear();
 
 	Assimp::Importer importer;
+	// the importer owns the handler
+	importer.SetIOHandler(new RecordingIOSystem(m_SourceFiles));
 
 	// and have it read the given file with some example postprocessing
 	// usually - if speed is not the most important aspect for you - you'll
@@ -399,6 +425,84 @@ bool AssimpImporter::AddToScene(ID3D12Device* pDevice, Scene* pScene)
 	return true;
 }
 
+bool AssimpImporter::Bake(const std::string& bakedPath, const Scene* pScene, uint64_t key) const
+{
+	CPU_PROFILE_SCOPE("AssimpImporter::Bake");
+
+	// only a scene of this import alone, with static meshes
+	if (m_SceneMeshOffset != 0 || m_SceneMaterialOffset != 0 || pScene->m_MeshDescs.size() != m_Meshes.size()
+		|| std::any_of(m_Meshes.begin(), m_Meshes.end(), [](const MeshSpec& mesh) { return mesh.hasDynamicData; }))
+		return false;
+
+	uint64_t sourceSize = 0;
+	int64_t sourceTime = 0;
+	if (!BakedScene::GetSourceStamp(m_FilePath, sourceSize, sourceTime))
+		return false;
+
+	BakedScene::Writer writer(sourceSize, sourceTime, key);
+	writer.SetName(pScene->m_Name);
+	for (const std::string& sourceFile : m_SourceFiles)
+	{
+		if (sourceFile != m_FilePath && !writer.AddSource(sourceFile))
+			return false;
+	}
+
+	std::vector<BakedNode> nodes(pScene->m_SceneGraph.size());
+	for (size_t i = 0, imax = nodes.size(); i < imax; ++i)
+	{
+		const Node& node = pScene->m_SceneGraph[i];
+		nodes[i].transform = node.transform;
+		nodes[i].localToBindSpace = node.localToBindSpace;
+		nodes[i].parentIndex = node.parentIndex;
+		nodes[i].name = writer.AddString(node.name);
+	}
+
+	// texture paths are those LoadTextures() loaded, relative to the texture library
+	std::vector<BakedMaterial> materials(pScene->m_Materials.size());
+	for (size_t i = 0, imax = materials.size(); i < imax; ++i)
+	{
+		const Material& material = *pScene->m_Materials[i];
+		materials[i].data = material.GetMaterialData();
+		materials[i].name = writer.AddString(material.GetName());
+		for (uint32_t t = 0; t < Material::TextureNum; ++t)
+			materials[i].texturePaths[t] = writer.AddString(material.GetTexturePath((TextureType)t));
+		materials[i].alphaMode = (int32_t)material.eAlphaMode;
+		materials[i].doubleSided = material.doubleSided ? 1 : 0;
+		materials[i].unlit = material.unlit ? 1 : 0;
+	}
+
+	// AddToScene() gives the scene the camera of the source, a baked load has to do the same
+	std::vector<BakedCamera> cameras;
+	if (HasCamera())
+	{
+		const Math::Vector3 position = m_Camera->GetPosition(), forward = m_Camera->GetForwardVec(), up = m_Camera->GetUpVec();
+		BakedCamera& camera = cameras.emplace_back();
+		camera.position = Vector3(position.GetX(), position.GetY(), position.GetZ());
+		camera.forward = Vector3(forward.GetX(), forward.GetY(), forward.GetZ());
+		camera.up = Vector3(up.GetX(), up.GetY(), up.GetZ());
+		camera.verticalFov = m_Camera->GetFOV();
+		camera.aspectHeightOverWidth = m_Camera->GetAspect();
+		camera.nearClip = m_Camera->GetNearClip();
+		camera.farClip = m_Camera->GetFarClip();
+	}
+
+	writer.AddSection(BakedScene::Section::VertexData, m_BuffersData.staticData);
+	writer.AddSection(BakedScene::Section::IndexData, m_BuffersData.indices.data(), m_IndexStride, (uint32_t)m_BuffersData.indices.size() / m_IndexStride);
+	writer.AddSection(BakedScene::Section::Meshes, pScene->m_MeshDescs);
+	writer.AddSection(BakedScene::Section::MeshInstances, pScene->m_MeshInstanceData);
+	writer.AddSection(BakedScene::Section::MeshBounds, pScene->m_MeshBBs);
+	writer.AddSection(BakedScene::Section::Nodes, nodes);
+	writer.AddSection(BakedScene::Section::Materials, materials);
+	writer.AddSection(BakedScene::Section::Camera, cameras);
+
+	if (!writer.Save(bakedPath))
+	{
+		Utility::Printf("Can't write baked scene %s\n", bakedPath.c_str());
+		return false;
+	}
+	return true;
+}
+
 void AssimpImporter::Clear() 
 {
 	m_Dirty = true;
@@ -414,6 +518,7 @@ void AssimpImporter::Clear()
 	m_MaterialToId.clear();
 
 	m_BuffersData.Clear();
+	m_SourceFiles.clear();
 }
 
 Scene::SharedPtr AssimpImporter::GetScene(ID3D12Device* pDevice)
@@ -485,21 +590,36 @@ size_t AssimpImporter::AddMesh(const Mesh& mesh)
 		spec.hasDynamicData = true;
 	}
 
-	for (uint32_t v = 0; v < mesh.vertexCount; ++v)
+	// one conversion kernel per stream, missing streams stay 0
+	static_assert(sizeof(Vector3) == 3 * sizeof(float), "Mesh streams are packed float3");
+	using MyDirectX::VertexComponent;
+	const MyDirectX::VertexFormat float3Format{ VertexComponent::Float, 3 };
+	const MyDirectX::VertexFormat float2Format{ VertexComponent::Float, 2 };
+	const MyDirectX::VertexConverter copyFloat3 = MyDirectX::GetVertexConverter(float3Format, float3Format);
+	const MyDirectX::VertexConverter float3ToFloat2 = MyDirectX::GetVertexConverter(float3Format, float2Format);
+
+	const size_t staticOffset = m_BuffersData.staticData.size();
+	m_BuffersData.staticData.resize(staticOffset + mesh.vertexCount);
+	uint8_t* pStaticData = (uint8_t*)&m_BuffersData.staticData[staticOffset];
+	auto convertStream = [&](const Vector3* pStream, MyDirectX::VertexConverter convert, size_t dstOffset)
+	{
+		if (pStream)
+			convert((const uint8_t*)pStream, sizeof(Vector3), pStaticData + dstOffset, sizeof(StaticVertexData), mesh.vertexCount);
+	};
+	convertStream(mesh.pPositions, copyFloat3, offsetof(StaticVertexData, position));
+	convertStream(mesh.pNormals, copyFloat3, offsetof(StaticVertexData, normal));
+	convertStream(mesh.pTangents, copyFloat3, offsetof(StaticVertexData, tangent));
+	convertStream(mesh.pBitangents, copyFloat3, offsetof(StaticVertexData, bitangent));
+	convertStream(mesh.pUVs, float3ToFloat2, offsetof(StaticVertexData, uv));
+
+	if (mesh.pBoneWeights)
 	{
-		StaticVertexData& sVertex = m_BuffersData.staticData.emplace_back();
-		sVertex.position = float3((float*)&mesh.pPositions[v]);
-		sVertex.normal = mesh.pNormals ? float3((float*)&mesh.pNormals[v]) : float3(0, 0, 0);
-		sVertex.tangent = mesh.pTangents ? float3((float*)&mesh.pTangents[v]) : float3(0, 0, 0);
-		sVertex.bitangent = mesh.pBitangents ? float3((float*)&mesh.pBitangents[v]) : float3(0, 0, 0);
-		sVertex.uv = mesh.pUVs ? float2((float*)&mesh.pUVs[v]) : float2(0, 0);
-
-		if (mesh.pBoneWeights)
+		for (uint32_t v = 0; v < mesh.vertexCount; ++v)
 		{
 			DynamicVertexData &dVertex = m_BuffersData.dynamicData.emplace_back();
 			dVertex.boneIDs = uint4((uint32_t*)&mesh.pBoneIDs[v]);
 			dVertex.boneWeights = float4((float*)&mesh.pBoneWeights[v]);
-			dVertex.staticIndex = (uint32_t)m_BuffersData.staticData.size() - 1;
+			dVertex.staticIndex = (uint32_t)(staticOffset + v);
 		}
 	}
 
@@ -631,19 +751,8 @@ bool AssimpImporter::CreateMeshes(ImporterData& data)
 		newMesh.pNormals = (Vector3*)curMesh->mNormals;
 		newMesh.pTangents = (Vector3*)curMesh->mTangents;
 		newMesh.pBitangents = (Vector3*)curMesh->mBitangents;
-		// texCoords is destroyed!
-	#if 0
-		if (curMesh->HasTextureCoords(0))
-		{
-			const auto& texCoords = CreateTexCoordList(curMesh->mTextureCoords[0], newMesh.vertexCount);
-			newMesh.pUVs = texCoords.data();
-		}
-		else
-	#endif
-			newMesh.pUVs = nullptr;
-		const auto& texCoords = curMesh->HasTextureCoords(0) ?
-			CreateTexCoordList(curMesh->mTextureCoords[0], newMesh.vertexCount) : std::vector<Vector2>();
-		newMesh.pUVs = !texCoords.empty() ? texCoords.data() : nullptr;
+		// Assimp keeps 3 components, AddMesh() takes xy
+		newMesh.pUVs = curMesh->HasTextureCoords(0) ? (Vector3*)curMesh->mTextureCoords[0] : nullptr;
 
 		// bones
 		std::vector<UVector4> boneIds;		// can't be in 'if()', note lifetime
@@ -691,16 +800,6 @@ std::unique_ptr<uint8_t[]> AssimpImporter::CreateIndexList(const aiMesh* curMesh
 	return std::unique_ptr<uint8_t[]>(indices);
 }
 
-std::vector<Vector2> AssimpImporter::CreateTexCoordList(const aiVector3D* curTexCoord, uint32_t count)
-{
-	std::vector<Vector2> uv2(count);
-	for (uint32_t i = 0; i < count; ++i)
-	{
-		uv2[i] = Vector2(curTexCoord[i].x, curTexCoord[i].y);
-	}
-	return uv2;
-}
-
 void AssimpImporter::LoadBones(const aiMesh* curMesh, const ImporterData& data, 
 	std::vector<UVector4> ids, std::vector<Vector4>& weights)
 {
@@ -872,6 +971,10 @@ bool AssimpImporter::CreatePointLight(ImporterData& data, const aiLight* pAiLigh
 void AssimpImporter::LoadTextures(aiMaterial* curMat, Material* dstMat)
 {
 	const auto& textureMappings = kDefaultTextureMapping;
+
+	// Load the material's textures together, their reads and decodes overlap
+	std::vector<Timo::Async<const MyDirectX::ManagedTexture*>> loads;
+	std::vector<TextureType> loadTypes;
 	for (const auto& tex : textureMappings)
 	{
 		std::string path(dstMat->GetTexturePath(tex.dstType));
@@ -885,12 +988,18 @@ void AssimpImporter::LoadTextures(aiMaterial* curMat, Material* dstMat)
 				dstMat->GetTexturePath(tex.dstType) = texName;
 			}
 
-			auto pManagedTex = Graphics::s_TextureManager.LoadFromFile(m_Device, texName,
-				IsSrgbRequired(tex.dstType, dstMat->GetShadingModel()));
-			if (pManagedTex->IsValid())
-				SetTexture(tex.dstType, dstMat, pManagedTex->GetSRV());
+			loads.push_back(Graphics::s_TextureManager.LoadFromFileAsync(m_Device, texName,
+				IsSrgbRequired(tex.dstType, dstMat->GetShadingModel())));
+			loadTypes.push_back(tex.dstType);
 		}
 	}
+
+	auto managedTextures = Timo::SyncWait(Timo::g_TaskContext, Timo::WhenAll(std::move(loads)));
+	for (size_t i = 0; i < managedTextures.size(); ++i)
+	{
+		if (managedTextures[i]->IsValid())
+			SetTexture(loadTypes[i], dstMat, managedTextures[i]->GetSRV());
+	}
 }
 
 uint32_t AssimpImporter::AddMaterial(const Material::SharedPtr& pMat, bool removeDuplicate)
@@ -208,7 +208,7 @@ namespace MFalcor
 			const Vector3* pNormals = nullptr;		// array of vertex normals.	count = `vertexCount`
 			const Vector3* pTangents = nullptr;		// array of vertex tangent .	count = `vertexCount`	Assimp tangent-float3, mostly float4
 			const Vector3* pBitangents = nullptr;	// array of vertex bitangent	count = `vertexCount`
-			const Vector2* pUVs = nullptr;			// array of vertex uv.			count = `vertexCount`
+			const Vector3* pUVs = nullptr;			// array of vertex uv (xy).		count = `vertexCount`
 			const Vector3* pLightMapUVs = nullptr;	// array of light-map UVs.		count = `vertexCount`
 			const UVector4* pBoneIDs = nullptr;		// array of bone IDs
 			const Vector4* pBoneWeights = nullptr;	// array of bone weights.
@@ -226,6 +226,8 @@ namespace MFalcor
 		// import a scene/model file
 		bool Load(ID3D12Device* pDevice, const std::string& fileName, const InstanceMatrices& instances = {}, uint32_t indexStride = 2);
 		bool AddToScene(ID3D12Device* pDevice, Scene* pScene);
+		// write what AddToScene() added to the scene into a baked scene file, key identifies the import settings
+		bool Bake(const std::string& bakedPath, const Scene* pScene, uint64_t key) const;
 
 		void Clear();
 
@@ -278,7 +280,6 @@ namespace MFalcor
 		bool CreateMeshes(ImporterData& data);
 		template <typename T>
 		std::unique_ptr<uint8_t[]> CreateIndexList(const aiMesh* curMesh);
-		std::vector<Vector2> CreateTexCoordList(const aiVector3D* curTexCoord, uint32_t count);
 		void LoadBones(const aiMesh* curMesh, const ImporterData& data,
 			std::vector<UVector4> ids, std::vector<Vector4>& weights);
 
@@ -298,6 +299,8 @@ namespace MFalcor
 
 		std::string m_FilePath;
 		std::string m_FileName;
+		// every file the last Load() read, the source included
+		std::vector<std::string> m_SourceFiles;
 		
 		ImportMode m_ImportMode = ImportMode::Default;
 		
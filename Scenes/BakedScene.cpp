@@ -0,0 +1,182 @@
+#include "BakedScene.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace MFalcor
+{
+	namespace BakedScene
+	{
+		static uint64_t AlignUp(uint64_t value)
+		{
+			return (value + kSectionAlignment - 1) & ~(kSectionAlignment - 1);
+		}
+
+		bool GetSourceStamp(const std::string& sourcePath, uint64_t& size, int64_t& time)
+		{
+			std::error_code error;
+			const auto fileSize = std::filesystem::file_size(sourcePath, error);
+			if (error)
+				return false;
+			const auto writeTime = std::filesystem::last_write_time(sourcePath, error);
+			if (error)
+				return false;
+
+			size = (uint64_t)fileSize;
+			time = (int64_t)writeTime.time_since_epoch().count();
+			return true;
+		}
+
+		Writer::Writer(uint64_t sourceSize, int64_t sourceTime, uint64_t key)
+		{
+			m_Header.sourceSize = sourceSize;
+			m_Header.sourceTime = sourceTime;
+			m_Header.key = key;
+
+			// offset 0 is the empty string
+			m_Strings.push_back('\0');
+		}
+
+		uint32_t Writer::AddString(const std::string& str)
+		{
+			if (str.empty())
+				return 0;
+
+			const uint32_t offset = (uint32_t)m_Strings.size();
+			m_Strings.insert(m_Strings.end(), str.begin(), str.end());
+			m_Strings.push_back('\0');
+			return offset;
+		}
+
+		bool Writer::AddSource(const std::string& filePath)
+		{
+			SourceFile source;
+			if (!GetSourceStamp(filePath, source.size, source.time))
+				return false;
+
+			source.path = AddString(filePath);
+			m_Sources.push_back(source);
+			return true;
+		}
+
+		void Writer::AddSection(Section section, const void* data, uint32_t elementSize, uint32_t count)
+		{
+			SectionDesc& desc = m_Header.sections[(uint32_t)section];
+			desc.elementSize = elementSize;
+			desc.count = count;
+			desc.size = (uint64_t)elementSize * count;
+			m_Data[(uint32_t)section] = data;
+		}
+
+		bool Writer::Save(const std::string& filePath)
+		{
+			AddSection(Section::Sources, m_Sources);
+			AddSection(Section::Strings, m_Strings.data(), 1, (uint32_t)m_Strings.size());
+
+			uint64_t offset = AlignUp(sizeof(Header));
+			for (SectionDesc& desc : m_Header.sections)
+			{
+				desc.offset = offset;
+				offset = AlignUp(offset + desc.size);
+			}
+			m_Header.fileSize = m_Header.sections[(uint32_t)Section::Count - 1].offset + m_Header.sections[(uint32_t)Section::Count - 1].size;
+
+			const std::string tempPath = filePath + ".tmp";
+			{
+				std::ofstream ofs(tempPath, std::ios::binary | std::ios::trunc);
+				if (!ofs.is_open())
+					return false;
+
+				static const char s_Padding[kSectionAlignment] = {};
+				ofs.write((const char*)&m_Header, sizeof(Header));
+				uint64_t written = sizeof(Header);
+				for (uint32_t i = 0; i < (uint32_t)Section::Count; ++i)
+				{
+					const SectionDesc& desc = m_Header.sections[i];
+					ofs.write(s_Padding, (std::streamsize)(desc.offset - written));
+					if (desc.size != 0)
+						ofs.write((const char*)m_Data[i], (std::streamsize)desc.size);
+					written = desc.offset + desc.size;
+				}
+				if (!ofs)
+				{
+					ofs.close();
+					std::filesystem::remove(tempPath);
+					return false;
+				}
+			}
+
+			std::error_code error;
+			std::filesystem::rename(tempPath, filePath, error);
+			if (error)
+			{
+				std::filesystem::remove(tempPath, error);
+				return false;
+			}
+			return true;
+		}
+
+		bool Reader::Open(const std::string& filePath)
+		{
+			Close();
+
+			if (!m_File.Open(filePath) || m_File.Size() < sizeof(Header))
+			{
+				m_File.Close();
+				return false;
+			}
+
+			const Header* header = reinterpret_cast<const Header*>(m_File.Data());
+			bool bValid = header->magic == kMagic && header->version == kVersion && header->headerSize == sizeof(Header)
+				&& header->fileSize == m_File.Size();
+			for (uint32_t i = 0; bValid && i < (uint32_t)Section::Count; ++i)
+			{
+				const SectionDesc& desc = header->sections[i];
+				bValid = desc.offset % kSectionAlignment == 0 && desc.offset >= sizeof(Header)
+					&& desc.size == (uint64_t)desc.elementSize * desc.count && desc.offset + desc.size <= header->fileSize;
+			}
+
+			// every string ends before the table does
+			const SectionDesc& strings = header->sections[(uint32_t)Section::Strings];
+			bValid = bValid && strings.elementSize == 1 && strings.size != 0 && m_File.Data()[strings.offset + strings.size - 1] == '\0';
+			if (!bValid)
+			{
+				m_File.Close();
+				return false;
+			}
+
+			m_Header = header;
+			return true;
+		}
+
+		void Reader::Close()
+		{
+			m_Header = nullptr;
+			m_File.Close();
+		}
+
+		bool Reader::IsCurrent(uint64_t sourceSize, int64_t sourceTime, uint64_t key) const
+		{
+			if (m_Header == nullptr || m_Header->sourceSize != sourceSize || m_Header->sourceTime != sourceTime || m_Header->key != key)
+				return false;
+
+			const SourceFile* pSources = GetArray<SourceFile>(Section::Sources);
+			if (pSources == nullptr)
+				return false;
+			for (uint32_t i = 0, imax = GetCount(Section::Sources); i < imax; ++i)
+			{
+				uint64_t size = 0;
+				int64_t time = 0;
+				if (!GetSourceStamp(GetString(pSources[i].path), size, time) || size != pSources[i].size || time != pSources[i].time)
+					return false;
+			}
+			return true;
+		}
+
+		const char* Reader::GetString(uint32_t offset) const
+		{
+			const SectionDesc& strings = m_Header->sections[(uint32_t)Section::Strings];
+			return offset < strings.size ? (const char*)m_File.Data() + strings.offset + offset : "";
+		}
+	}
+}
@@ -0,0 +1,139 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Utilities/MappedFile.h"
+
+namespace MFalcor
+{
+	/**
+		Engine-native scene file, the importer's final output written once and mapped on later launches.
+		A header, then one section per array, each at a multiple of kSectionAlignment so that the arrays are used in
+	place from the mapping: vertex and index blobs go straight to the upload, records are copied as a whole. The header
+	carries the size and time of the source file and a key of the import settings, the Sources section those of every
+	other file the import read (buffers, material libraries). A baked file that doesn't match them all is stale and the
+	source is imported again.
+		The container only knows sections of fixed-size records and a string table, the records are defined by the
+	scene. Bump kVersion when any of them changes. Only depends on the standard library, so that the standalone rtrt
+	build can benchmark it.
+	*/
+	namespace BakedScene
+	{
+		constexpr uint32_t kMagic = 0x4E43534D;	// "MSCN"
+		constexpr uint32_t kVersion = 3;
+		constexpr uint64_t kSectionAlignment = 64;
+
+		enum class Section : uint32_t
+		{
+			VertexData,
+			IndexData,
+			Meshes,
+			MeshInstances,
+			MeshBounds,
+			Nodes,
+			Materials,
+			Camera,			// none, or the camera of the source
+			Sources,		// SourceFile of each file the import read besides the source
+			Strings,
+
+			Count
+		};
+
+		struct SectionDesc
+		{
+			uint64_t offset = 0;
+			uint64_t size = 0;
+			uint32_t elementSize = 0;
+			uint32_t count = 0;
+		};
+
+		struct Header
+		{
+			uint32_t magic = kMagic;
+			uint32_t version = kVersion;
+			uint32_t headerSize = sizeof(Header);
+			uint32_t name = 0;				// string offset
+			uint64_t fileSize = 0;
+			uint64_t sourceSize = 0;
+			int64_t sourceTime = 0;
+			uint64_t key = 0;				// import settings
+			SectionDesc sections[(uint32_t)Section::Count];
+		};
+
+		struct SourceFile
+		{
+			uint32_t path = 0;				// string offset
+			uint32_t padding = 0;
+			uint64_t size = 0;
+			int64_t time = 0;
+		};
+
+		// size and last write time of the source, false if it doesn't exist
+		bool GetSourceStamp(const std::string& sourcePath, uint64_t& size, int64_t& time);
+
+		class Writer
+		{
+		public:
+			Writer(uint64_t sourceSize, int64_t sourceTime, uint64_t key);
+
+			// offset into the string table
+			uint32_t AddString(const std::string& str);
+
+			// the data is copied at Save()
+			void AddSection(Section section, const void* data, uint32_t elementSize, uint32_t count);
+
+			template <typename T>
+			void AddSection(Section section, const std::vector<T>& data)
+			{
+				AddSection(section, data.data(), (uint32_t)sizeof(T), (uint32_t)data.size());
+			}
+
+			void SetName(const std::string& name) { m_Header.name = AddString(name); }
+
+			// another file the baked data depends on, false if it doesn't exist
+			bool AddSource(const std::string& filePath);
+
+			// written to a temporary file first, a failed cook leaves no file behind
+			bool Save(const std::string& filePath);
+
+		private:
+			Header m_Header;
+			const void* m_Data[(uint32_t)Section::Count] = {};
+			std::vector<SourceFile> m_Sources;
+			std::vector<char> m_Strings;
+		};
+
+		class Reader
+		{
+		public:
+			// false if the file is missing, truncated or of another version
+			bool Open(const std::string& filePath);
+			void Close();
+
+			bool IsOpen() const { return m_Header != nullptr; }
+			// the source, the other files the import read and the import settings are still those the file was baked from
+			bool IsCurrent(uint64_t sourceSize, int64_t sourceTime, uint64_t key) const;
+
+			const Header& GetHeader() const { return *m_Header; }
+			uint32_t GetCount(Section section) const { return m_Header->sections[(uint32_t)section].count; }
+			const uint8_t* GetData(Section section) const { return m_File.Data() + m_Header->sections[(uint32_t)section].offset; }
+			uint64_t GetSize(Section section) const { return m_Header->sections[(uint32_t)section].size; }
+
+			// nullptr if the records of the section are not T
+			template <typename T>
+			const T* GetArray(Section section) const
+			{
+				const SectionDesc& desc = m_Header->sections[(uint32_t)section];
+				return desc.elementSize == sizeof(T) ? reinterpret_cast<const T*>(m_File.Data() + desc.offset) : nullptr;
+			}
+
+			const char* GetString(uint32_t offset) const;
+
+		private:
+			Utility::MappedFile m_File;
+			const Header* m_Header = nullptr;
+		};
+	}
+}
@@ -1,5 +1,6 @@
 #include "Scene.h"
 #include "AssimpImporter.h"
+#include "BakedScene.h"
 #include "GameInput.h"
 #include "SceneViewer.h"
 #include "Graphics.h"
@@ -11,6 +12,9 @@
 #include "ClusteredLighting.h"
 #include "MSAAFilter.h"
 #include "Utilities/ShadowUtility.h"
+#include "CpuProfiler.h"
+#include "TextureManager.h"
+#include "Hash.h"
 
 // compiled shader bytecode
 #include "WireframeVS.h"
@@ -172,14 +176,8 @@ namespace MFalcor
 
 	Scene::SharedPtr Scene::Create(ID3D12Device* pDevice, const std::string& filePath, SceneViewer *sceneViewer, const InstanceMatrices& instances)
 	{
-		auto pAssimpImporter = AssimpImporter::Create(pDevice, filePath, instances);
-		auto pScene = pAssimpImporter ? pAssimpImporter->GetScene(pDevice) : nullptr;
-		pScene->m_Graphics = sceneViewer->GetGraphics();
-		pScene->InitCamera(sceneViewer->GetInput());
-		pScene->InitPipelines(pDevice);
-		pScene->InitResources(pDevice);
-		pScene->InitDescriptors(pDevice);
-		return pScene;
+		auto pScene = Create();
+		return pScene->Init(pDevice, filePath, sceneViewer, instances) ? pScene : nullptr;
 	}
 
 	Scene::SharedPtr Scene::Create()
@@ -192,10 +190,20 @@ namespace MFalcor
 
 	bool Scene::Init(ID3D12Device* pDevice, const std::string& filePath, SceneViewer *sceneViewer, const InstanceMatrices& instances)
 	{
-		bool ret = false;
-		auto pAssimpImporter = AssimpImporter::Create();
-		if (pAssimpImporter && pAssimpImporter->Load(pDevice, filePath, instances))
-			ret = pAssimpImporter->AddToScene(pDevice, this);
+		// the baked copy is used while the source and the instances are those it was baked from
+		const std::string bakedPath = GetBakedPath(filePath);
+		const uint32_t indexStride = sizeof(uint16_t);
+		const uint64_t key = Utility::HashRange((const uint32_t*)instances.data(), (const uint32_t*)(instances.data() + instances.size()), indexStride);
+
+		bool ret = LoadBaked(pDevice, bakedPath, filePath, key);
+		if (!ret)
+		{
+			auto pAssimpImporter = AssimpImporter::Create();
+			if (pAssimpImporter && pAssimpImporter->Load(pDevice, filePath, instances, indexStride))
+				ret = pAssimpImporter->AddToScene(pDevice, this);
+			if (ret)
+				pAssimpImporter->Bake(bakedPath, this, key);
+		}
 
 		if (!ret) return false;
 
@@ -579,6 +587,8 @@ namespace MFalcor
 
 	Scene::UpdateFlags Scene::Update(float deltaTime)
 	{
+		CPU_PROFILE_SCOPE("Scene::Update");
+
 		m_CameraController->Update(deltaTime);
 
 		// m_CommonLights.sunOrientation += 0.002f * Math::Pi * deltaTime;
@@ -1701,6 +1711,142 @@ namespace MFalcor
 		SaveNewViewport();
 	}
 
+	bool Scene::LoadBaked(ID3D12Device* pDevice, const std::string& bakedPath, const std::string& sourcePath, uint64_t key)
+	{
+		CPU_PROFILE_SCOPE("Scene::LoadBaked");
+
+		using BakedScene::Section;
+
+		uint64_t sourceSize = 0;
+		int64_t sourceTime = 0;
+		BakedScene::Reader reader;
+		if (!BakedScene::GetSourceStamp(sourcePath, sourceSize, sourceTime) || !reader.Open(bakedPath)
+			|| !reader.IsCurrent(sourceSize, sourceTime, key))
+			return false;
+
+		const uint32_t meshCount = reader.GetCount(Section::Meshes);
+		const uint32_t indexStride = reader.GetHeader().sections[(uint32_t)Section::IndexData].elementSize;
+		const auto* pVertices = reader.GetArray<StaticVertexData>(Section::VertexData);
+		const auto* pMeshes = reader.GetArray<MeshDesc>(Section::Meshes);
+		const auto* pInstances = reader.GetArray<MeshInstanceData>(Section::MeshInstances);
+		const auto* pMeshBBs = reader.GetArray<BoundingBox>(Section::MeshBounds);
+		const auto* pNodes = reader.GetArray<BakedNode>(Section::Nodes);
+		const auto* pMaterials = reader.GetArray<BakedMaterial>(Section::Materials);
+		const auto* pCamera = reader.GetArray<BakedCamera>(Section::Camera);
+		const uint32_t cameraCount = reader.GetCount(Section::Camera);
+		if (pVertices == nullptr || pMeshes == nullptr || pInstances == nullptr || pMeshBBs == nullptr || pNodes == nullptr || pMaterials == nullptr
+			|| cameraCount > 1 || (cameraCount != 0 && pCamera == nullptr)
+			|| (indexStride != sizeof(uint16_t) && indexStride != sizeof(uint32_t)) || meshCount == 0
+			|| reader.GetCount(Section::MeshBounds) != meshCount || reader.GetCount(Section::MeshInstances) == 0)
+		{
+			Utility::Printf("Baked scene %s doesn't match this build\n", bakedPath.c_str());
+			return false;
+		}
+
+		// indices between the records, a parent comes before its children as UpdateMatrices() expects
+		const uint32_t instanceCount = reader.GetCount(Section::MeshInstances);
+		const uint32_t nodeCount = reader.GetCount(Section::Nodes);
+		const uint32_t materialCount = reader.GetCount(Section::Materials);
+		bool bValid = true;
+		for (uint32_t i = 0; bValid && i < meshCount; ++i)
+			bValid = pMeshes[i].materialID < materialCount;
+		for (uint32_t i = 0; bValid && i < instanceCount; ++i)
+		{
+			const MeshInstanceData& instance = pInstances[i];
+			bValid = instance.meshID < meshCount && instance.materialID < materialCount && instance.globalMatrixID < nodeCount;
+		}
+		for (uint32_t i = 0; bValid && i < nodeCount; ++i)
+			bValid = pNodes[i].parentIndex == kInvalidNode || pNodes[i].parentIndex < i;
+		if (!bValid)
+		{
+			Utility::Printf("Baked scene %s is corrupt\n", bakedPath.c_str());
+			return false;
+		}
+
+		m_Name = reader.GetString(reader.GetHeader().name);
+		std::wstring bufferName = std::wstring(m_Name.begin(), m_Name.end());
+
+		// geometry, uploaded from the mapping
+		m_VertexBuffer = std::make_shared<StructuredBuffer>();
+		m_VertexBuffer->Create(pDevice, bufferName + L"_VertexBuffer", reader.GetCount(Section::VertexData), sizeof(StaticVertexData), pVertices);
+
+		VertexBufferLayout::SharedPtr pLayout = VertexBufferLayout::Create();
+		pLayout->AddElement("POSITION",	DXGI_FORMAT_R32G32B32_FLOAT);
+		pLayout->AddElement("NORMAL",	DXGI_FORMAT_R32G32B32_FLOAT);
+		pLayout->AddElement("TANGENT",	DXGI_FORMAT_R32G32B32_FLOAT);
+		pLayout->AddElement("BITANGENT",DXGI_FORMAT_R32G32B32_FLOAT);
+		pLayout->AddElement("TEXCOORD", DXGI_FORMAT_R32G32_FLOAT);
+		m_VertexLayout = pLayout;
+
+		m_IndexBuffer = std::make_shared<ByteAddressBuffer>();
+		m_IndexBuffer->Create(pDevice, bufferName + L"_IndexBuffer", reader.GetCount(Section::IndexData), indexStride, reader.GetData(Section::IndexData));
+
+		m_MeshDescs.assign(pMeshes, pMeshes + meshCount);
+		m_MeshInstanceData.assign(pInstances, pInstances + instanceCount);
+		m_MeshBBs.assign(pMeshBBs, pMeshBBs + meshCount);
+		m_MeshHasDynamicData.assign(meshCount, false);
+
+		m_SceneGraph.resize(nodeCount);
+		for (uint32_t i = 0, imax = (uint32_t)m_SceneGraph.size(); i < imax; ++i)
+		{
+			Node& node = m_SceneGraph[i];
+			node.name = reader.GetString(pNodes[i].name);
+			node.parentIndex = pNodes[i].parentIndex;
+			node.transform = pNodes[i].transform;
+			node.localToBindSpace = pNodes[i].localToBindSpace;
+		}
+
+		// camera of the source, as AddToScene() sets it
+		if (cameraCount != 0 && m_Camera == nullptr)
+		{
+			const BakedCamera& bakedCam = *pCamera;
+			const Math::Vector3 position(bakedCam.position.x, bakedCam.position.y, bakedCam.position.z);
+			const Math::Vector3 forward(bakedCam.forward.x, bakedCam.forward.y, bakedCam.forward.z);
+			m_Camera = std::make_shared<Math::Camera>();
+			m_Camera->SetEyeAtUp(position, position + forward, Math::Vector3(bakedCam.up.x, bakedCam.up.y, bakedCam.up.z));
+			m_Camera->SetPerspectiveMatrix(bakedCam.verticalFov, bakedCam.aspectHeightOverWidth, bakedCam.nearClip, bakedCam.farClip);
+			m_Camera->Update();
+		}
+
+		// materials, the textures of all of them load together
+		Graphics::s_TextureManager.Init(L"Textures/");
+
+		std::vector<Timo::Async<const ManagedTexture*>> loads;
+		std::vector<std::pair<Material*, TextureType>> loadTargets;
+		m_Materials.reserve(reader.GetCount(Section::Materials));
+		for (uint32_t i = 0, imax = reader.GetCount(Section::Materials); i < imax; ++i)
+		{
+			const BakedMaterial& bakedMat = pMaterials[i];
+			Material::SharedPtr pMat = Material::Create(reader.GetString(bakedMat.name));
+			for (uint32_t t = 0; t < Material::TextureNum; ++t)
+				pMat->SetTexturePath((TextureType)t, reader.GetString(bakedMat.texturePaths[t]));
+			pMat->GetMaterialData() = bakedMat.data;
+			pMat->eAlphaMode = (AlphaMode)bakedMat.alphaMode;
+			pMat->doubleSided = bakedMat.doubleSided != 0;
+			pMat->unlit = bakedMat.unlit != 0;
+
+			for (uint32_t t = 0; t < Material::TextureNum; ++t)
+			{
+				const std::string& path = pMat->GetTexturePath((TextureType)t);
+				if (path.empty())
+					continue;
+				loads.push_back(Graphics::s_TextureManager.LoadFromFileAsync(pDevice, path, IsSrgbRequired((TextureType)t, pMat->GetShadingModel())));
+				loadTargets.emplace_back(pMat.get(), (TextureType)t);
+			}
+			m_Materials.push_back(pMat);
+		}
+
+		auto managedTextures = Timo::SyncWait(Timo::g_TaskContext, Timo::WhenAll(std::move(loads)));
+		for (size_t i = 0; i < managedTextures.size(); ++i)
+		{
+			if (managedTextures[i]->IsValid())
+				SetTexture(loadTargets[i].second, loadTargets[i].first, managedTextures[i]->GetSRV());
+		}
+
+		Finalize(pDevice);
+		return true;
+	}
+
 	void Scene::SortMeshInstances()
 	{
 		// instance data sort by AlphaMode
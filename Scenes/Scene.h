@@ -161,6 +161,36 @@ namespace MFalcor
 		uint32_t flags = 0;		// MeshInstanceFlags
 	};
 
+	// records of the baked scene file (Scenes/BakedScene.h), strings are offsets into its string table
+	struct BakedNode
+	{
+		Matrix4x4 transform;
+		Matrix4x4 localToBindSpace;
+		uint32_t parentIndex = -1;
+		uint32_t name = 0;
+	};
+
+	struct BakedMaterial
+	{
+		MaterialData data;
+		uint32_t name = 0;
+		uint32_t texturePaths[Material::TextureNum] = {};	// TextureType
+		int32_t alphaMode = 0;
+		uint32_t doubleSided = 0;
+		uint32_t unlit = 0;
+	};
+
+	struct BakedCamera
+	{
+		Vector3 position;
+		Vector3 forward;
+		Vector3 up;
+		float verticalFov = 0.0f;
+		float aspectHeightOverWidth = 0.0f;
+		float nearClip = 0.0f;
+		float farClip = 0.0f;
+	};
+
 	struct alignas(16) ViewUniformParameters
 	{
 		Matrix4x4 viewProjMat;
@@ -217,6 +247,9 @@ namespace MFalcor
 
 		bool Init(ID3D12Device* pDevice, const std::string& filePath, SceneViewer* sceneViewer = nullptr, const InstanceMatrices& instances = InstanceMatrices());
 
+		// the baked copy of a scene file, next to it
+		static std::string GetBakedPath(const std::string& filePath) { return filePath + ".mscene"; }
+
 		// Do any additional initialization required after scene data is set and draw lists are determined
 		void Finalize(ID3D12Device* pDevice);
 
@@ -415,6 +448,9 @@ namespace MFalcor
 		void InitPipelines(ID3D12Device* pDevice);
 		void InitCamera(GameInput* pInput);
 
+		// Fill the scene from a baked file instead of importing the source. False if the file is missing or stale
+		bool LoadBaked(ID3D12Device* pDevice, const std::string& bakedPath, const std::string& sourcePath, uint64_t key);
+
 		// Uploads scene data to parameter block
 		void UploadResources() { }
 
@@ -5,7 +5,6 @@
 
 namespace Utility
 {
-	using namespace concurrency;
 	using namespace std;
 
 	using byte = ::byte;
@@ -119,9 +118,10 @@ namespace Utility
 		return ReadFileHelperEx(make_shared<wstring>(fileName));
 	}
 
-	concurrency::task<ByteArray> ReadFileAsync(const std::wstring& fileName)
+	Timo::Async<ByteArray> ReadFileAsync(std::wstring fileName)
 	{
-		shared_ptr<wstring> sharedPtr = make_shared<wstring>(fileName);
-		return create_task([=] {return ReadFileHelperEx(sharedPtr); });
+		// Taken by value, the coroutine outlives the caller's string
+		shared_ptr<wstring> sharedPtr = make_shared<wstring>(std::move(fileName));
+		co_return co_await Timo::RunIO(Timo::g_TaskContext, [sharedPtr] { return ReadFileHelperEx(sharedPtr); });
 	}
 }
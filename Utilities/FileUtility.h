@@ -1,6 +1,6 @@
 #pragma once
 #include "pch.h"
-#include <ppltasks.h>
+#include "AsyncTask.h"
 
 namespace Utility
 {
@@ -12,6 +12,7 @@ namespace Utility
 	// this operation blocks until the entire file is read
 	ByteArray ReadFileSync(const std::wstring& fileName);
 
-	// same as previous except that it does not block but instead returns a task
-	concurrency::task<ByteArray> ReadFileAsync(const std::wstring& fileName);
+	// same as previous except that it does not block but instead returns a coroutine, the read runs on
+	// Timo::g_IOService and the coroutine resumes on a worker of Timo::g_TaskContext
+	Timo::Async<ByteArray> ReadFileAsync(std::wstring fileName);
 }
@@ -0,0 +1,106 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Utility
+{
+#ifdef _WIN32
+	bool MappedFile::Open(const std::filesystem::path& fileName)
+	{
+		Close();
+
+		HANDLE file = CreateFileW(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		m_File = file;
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+		{
+			Close();
+			return false;
+		}
+
+		m_Mapping = CreateFileMappingW(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+		if (m_Mapping == nullptr)
+		{
+			Close();
+			return false;
+		}
+
+		m_Data = (uint8_t*)MapViewOfFile(m_Mapping, FILE_MAP_COPY, 0, 0, 0);
+		if (m_Data == nullptr)
+		{
+			Close();
+			return false;
+		}
+		m_Size = (size_t)fileSize.QuadPart;
+
+		return true;
+	}
+
+	void MappedFile::Close()
+	{
+		if (m_Data != nullptr)
+			UnmapViewOfFile(m_Data);
+		if (m_Mapping != nullptr)
+			CloseHandle(m_Mapping);
+		if (m_File != nullptr)
+			CloseHandle(m_File);
+
+		m_File = nullptr;
+		m_Mapping = nullptr;
+		m_Data = nullptr;
+		m_Size = 0;
+	}
+#else
+	bool MappedFile::Open(const std::filesystem::path& fileName)
+	{
+		Close();
+
+		int file = open(fileName.c_str(), O_RDONLY);
+		if (file < 0)
+			return false;
+
+		struct stat fileStat;
+		if (fstat(file, &fileStat) != 0 || fileStat.st_size == 0)
+		{
+			close(file);
+			return false;
+		}
+
+		// MAP_PRIVATE gives the same copy-on-write behaviour as FILE_MAP_COPY, the mapping outlives the descriptor
+		void* data = mmap(nullptr, (size_t)fileStat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+		close(file);
+		if (data == MAP_FAILED)
+			return false;
+
+		m_Data = (uint8_t*)data;
+		m_Size = (size_t)fileStat.st_size;
+
+		return true;
+	}
+
+	void MappedFile::Close()
+	{
+		if (m_Data != nullptr)
+			munmap(m_Data, m_Size);
+
+		m_Data = nullptr;
+		m_Size = 0;
+	}
+#endif
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+namespace Utility
+{
+	// read-only view of an entire file, mapped into the address space instead of being read.
+	// pages are copy-on-write, so the contents can be patched in place without touching the file.
+	// only depends on the OS, so that it can also be used by the standalone rtrt library
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		~MappedFile() { Close(); }
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		bool Open(const std::filesystem::path& fileName);
+		void Close();
+
+		bool IsOpen() const { return m_Data != nullptr; }
+		uint8_t* Data() const { return m_Data; }
+		size_t Size() const { return m_Size; }
+
+	private:
+#ifdef _WIN32
+		void* m_File = nullptr;		// HANDLE
+		void* m_Mapping = nullptr;	// HANDLE
+#endif
+		uint8_t* m_Data = nullptr;
+		size_t m_Size = 0;
+	};
+}
@@ -0,0 +1,276 @@
+// Baked scene file (Scenes/BakedScene.h), cooked from a synthetic scene with the record sizes of Scene: 56-byte static
+// vertices, uint16 indices, mesh descs, instances, bounds, nodes and materials. A load is what Scene::LoadBaked does
+// with the file: map and validate it, copy the records into vectors, read the vertex and index blobs once as the upload
+// would. It is compared with reading the same bytes into memory, the I/O a load can't avoid. The loaded scene must
+// match the cooked one.
+//
+//	scene_bench [--meshes N] [--vertices N] [--repeat N]
+
+#include "Scenes/BakedScene.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+	using Clock = std::chrono::high_resolution_clock;
+	using namespace MFalcor;
+	using BakedScene::Section;
+
+	struct Options
+	{
+		uint32_t meshes = 400;
+		uint32_t vertices = 2000;	// per mesh
+		uint32_t repeat = 10;
+	};
+
+	// the layouts of StaticVertexData, MeshDesc, MeshInstanceData, BoundingBox, BakedNode and BakedMaterial
+	struct Vertex { float position[3], normal[3], tangent[3], bitangent[3], uv[2]; };
+	struct Mesh { uint32_t vertexOffset, vertexByteSize, vertexStrideSize, vertexCount, indexByteOffset, indexByteSize, indexStrideSize, indexCount, materialID; };
+	struct Instance { uint32_t globalMatrixID, materialID, meshID, flags; };
+	struct Bounds { float vMin[3], vMax[3]; };
+	struct Node { float transform[16], localToBindSpace[16]; uint32_t parentIndex, name; };
+	struct alignas(16) Material { float data[20]; uint32_t name, texturePaths[5]; int32_t alphaMode; uint32_t doubleSided, unlit; };
+
+	struct SceneData
+	{
+		std::string name;
+		std::vector<Vertex> vertices;
+		std::vector<uint16_t> indices;
+		std::vector<Mesh> meshes;
+		std::vector<Instance> instances;
+		std::vector<Bounds> bounds;
+		std::vector<Node> nodes;
+		std::vector<Material> materials;
+		std::vector<std::string> strings;	// node names, material names and texture paths, in record order
+		uint64_t blobSum = 0;
+	};
+
+	template <typename T>
+	bool Equal(const std::vector<T>& a, const std::vector<T>& b)
+	{
+		return a.size() == b.size() && (a.empty() || std::memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+	}
+
+	uint64_t Sum(const uint8_t* data, size_t size)
+	{
+		uint64_t sum = 0;
+		for (size_t i = 0; i + 8 <= size; i += 8)
+		{
+			uint64_t value;
+			std::memcpy(&value, data + i, 8);
+			sum += value;
+		}
+		return sum;
+	}
+
+	SceneData CreateScene(const Options& options)
+	{
+		uint32_t random = 0x9E3779B9u;
+		auto nextFloat = [&random]
+		{
+			random ^= random << 13;
+			random ^= random >> 17;
+			random ^= random << 5;
+			return (float)(random & 0xFFFF) / 256.0f;
+		};
+
+		SceneData scene;
+		scene.name = "scene_bench";
+		const uint32_t numMaterials = std::max(options.meshes / 8, 1u);
+		for (uint32_t m = 0; m < options.meshes; ++m)
+		{
+			Mesh mesh = {};
+			mesh.vertexOffset = (uint32_t)scene.vertices.size();
+			mesh.vertexCount = options.vertices;
+			mesh.vertexStrideSize = sizeof(Vertex);
+			mesh.vertexByteSize = options.vertices * (uint32_t)sizeof(Vertex);
+			mesh.indexByteOffset = (uint32_t)(scene.indices.size() * sizeof(uint16_t));
+			mesh.indexCount = (options.vertices - 2) * 3;
+			mesh.indexStrideSize = sizeof(uint16_t);
+			mesh.indexByteSize = mesh.indexCount * (uint32_t)sizeof(uint16_t);
+			mesh.materialID = m % numMaterials;
+			scene.meshes.push_back(mesh);
+
+			Bounds bounds = { { 1e30f, 1e30f, 1e30f }, { -1e30f, -1e30f, -1e30f } };
+			for (uint32_t v = 0; v < options.vertices; ++v)
+			{
+				Vertex vertex;
+				for (float& value : vertex.position)
+					value = nextFloat();
+				for (float* values : { vertex.normal, vertex.tangent, vertex.bitangent })
+					for (uint32_t c = 0; c < 3; ++c)
+						values[c] = nextFloat();
+				vertex.uv[0] = nextFloat();
+				vertex.uv[1] = nextFloat();
+				for (uint32_t c = 0; c < 3; ++c)
+				{
+					bounds.vMin[c] = std::min(bounds.vMin[c], vertex.position[c]);
+					bounds.vMax[c] = std::max(bounds.vMax[c], vertex.position[c]);
+				}
+				scene.vertices.push_back(vertex);
+			}
+			for (uint32_t t = 0; t + 2 < options.vertices; ++t)
+			{
+				scene.indices.push_back((uint16_t)t);
+				scene.indices.push_back((uint16_t)(t + 1));
+				scene.indices.push_back((uint16_t)(t + 2));
+			}
+			scene.bounds.push_back(bounds);
+
+			Node node = {};
+			for (float& value : node.transform)
+				value = nextFloat();
+			node.parentIndex = m == 0 ? (uint32_t)-1 : 0;
+			scene.nodes.push_back(node);
+			scene.strings.push_back("Node" + std::to_string(m));
+
+			scene.instances.push_back({ m, mesh.materialID, m, 0 });
+		}
+
+		for (uint32_t m = 0; m < numMaterials; ++m)
+		{
+			Material material = {};
+			for (float& value : material.data)
+				value = nextFloat();
+			material.alphaMode = (int32_t)(m % 3);
+			scene.materials.push_back(material);
+			scene.strings.push_back("Material" + std::to_string(m));
+			for (const char* texture : { "BaseColor", "MetalRough", "Normal", "Emissive", "Occlusion" })
+				scene.strings.push_back("scene_bench/" + std::string(texture) + std::to_string(m));
+		}
+		return scene;
+	}
+
+	bool Cook(SceneData& scene, const std::string& path)
+	{
+		BakedScene::Writer writer(1, 2, 3);
+		writer.SetName(scene.name);
+
+		size_t s = 0;
+		for (Node& node : scene.nodes)
+			node.name = writer.AddString(scene.strings[s++]);
+		for (Material& material : scene.materials)
+		{
+			material.name = writer.AddString(scene.strings[s++]);
+			for (uint32_t& texture : material.texturePaths)
+				texture = writer.AddString(scene.strings[s++]);
+		}
+
+		writer.AddSection(Section::VertexData, scene.vertices);
+		writer.AddSection(Section::IndexData, scene.indices);
+		writer.AddSection(Section::Meshes, scene.meshes);
+		writer.AddSection(Section::MeshInstances, scene.instances);
+		writer.AddSection(Section::MeshBounds, scene.bounds);
+		writer.AddSection(Section::Nodes, scene.nodes);
+		writer.AddSection(Section::Materials, scene.materials);
+		return writer.Save(path);
+	}
+
+	template <typename T>
+	void Assign(std::vector<T>& dst, const BakedScene::Reader& reader, Section section)
+	{
+		const T* data = reader.GetArray<T>(section);
+		dst.assign(data, data + (data != nullptr ? reader.GetCount(section) : 0));
+	}
+
+	// Scene::LoadBaked without the device: blobs are read once in place of the upload
+	bool Load(const std::string& path, SceneData& scene)
+	{
+		BakedScene::Reader reader;
+		if (!reader.Open(path) || !reader.IsCurrent(1, 2, 3))
+			return false;
+
+		scene.name = reader.GetString(reader.GetHeader().name);
+		scene.blobSum = Sum(reader.GetData(Section::VertexData), reader.GetSize(Section::VertexData))
+			+ Sum(reader.GetData(Section::IndexData), reader.GetSize(Section::IndexData));
+		Assign(scene.meshes, reader, Section::Meshes);
+		Assign(scene.instances, reader, Section::MeshInstances);
+		Assign(scene.bounds, reader, Section::MeshBounds);
+		Assign(scene.nodes, reader, Section::Nodes);
+		Assign(scene.materials, reader, Section::Materials);
+
+		scene.strings.clear();
+		for (const Node& node : scene.nodes)
+			scene.strings.push_back(reader.GetString(node.name));
+		for (const Material& material : scene.materials)
+		{
+			scene.strings.push_back(reader.GetString(material.name));
+			for (uint32_t texture : material.texturePaths)
+				scene.strings.push_back(reader.GetString(texture));
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		const std::string arg = argv[i];
+		const uint32_t value = (uint32_t)std::max(std::atoi(argv[i + 1]), 1);
+		if (arg == "--meshes")
+			options.meshes = value;
+		else if (arg == "--vertices")
+			options.vertices = std::clamp(value, 3u, 65536u);
+		else if (arg == "--repeat")
+			options.repeat = value;
+	}
+
+	const std::string path = (std::filesystem::temp_directory_path() / "scene_bench.mscene").string();
+	SceneData scene = CreateScene(options);
+
+	auto start = Clock::now();
+	if (!Cook(scene, path))
+	{
+		std::printf("scene_bench: can't write %s\n", path.c_str());
+		return 1;
+	}
+	const double cookMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	const uint64_t fileSize = std::filesystem::file_size(path);
+	scene.blobSum = Sum((const uint8_t*)scene.vertices.data(), scene.vertices.size() * sizeof(Vertex))
+		+ Sum((const uint8_t*)scene.indices.data(), scene.indices.size() * sizeof(uint16_t));
+
+	// the I/O floor: the whole file read into memory
+	std::vector<char> bytes(fileSize);
+	start = Clock::now();
+	for (uint32_t r = 0; r < options.repeat; ++r)
+	{
+		std::ifstream ifs(path, std::ios::binary);
+		ifs.read(bytes.data(), (std::streamsize)fileSize);
+	}
+	const double readMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / options.repeat;
+
+	SceneData loaded;
+	bool bLoaded = true;
+	start = Clock::now();
+	for (uint32_t r = 0; r < options.repeat; ++r)
+		bLoaded = Load(path, loaded) && bLoaded;
+	const double loadMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / options.repeat;
+
+	const bool match = bLoaded && loaded.name == scene.name && loaded.blobSum == scene.blobSum && Equal(loaded.meshes, scene.meshes)
+		&& Equal(loaded.instances, scene.instances) && Equal(loaded.bounds, scene.bounds) && Equal(loaded.nodes, scene.nodes)
+		&& Equal(loaded.materials, scene.materials) && loaded.strings == scene.strings;
+	std::filesystem::remove(path);
+
+	std::printf("scene_bench: %u meshes, %zu vertices, %zu indices, %.1f MB file, %u runs, cooked in %.1f ms\n", options.meshes,
+		scene.vertices.size(), scene.indices.size(), fileSize / (1024.0 * 1024.0), options.repeat, cookMs);
+	std::printf("%10s %12s %12s\n", "", "ms", "GB/s");
+	std::printf("%10s %12.3f %12.2f\n", "read", readMs, fileSize / (readMs * 1e6));
+	std::printf("%10s %12.3f %12.2f\n", "load", loadMs, fileSize / (loadMs * 1e6));
+	std::printf("load is %.2fx the read of the file\n", loadMs / std::max(readMs, 1e-6));
+
+	if (!match)
+	{
+		std::printf("scene_bench: the loaded scene differs from the cooked one\n");
+		return 1;
+	}
+	return 0;
+}
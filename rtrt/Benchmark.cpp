@@ -0,0 +1,556 @@
+// Headless benchmark of the rtrt ray tracing core.
+// Builds a BVH over each BVHAssets model with every build mode and reports build time, memory,
+// and primary / shadow / diffuse ray throughput on one core and on all cores. Diffuse rays are traced
+// once in generation (pixel) order and once reordered by RaySorter, as the wavefront renderer does.
+// The serial tree is then traced in every node layout (BVH2, depth-first BVH2, MBVH4, MBVH8, QBVH), with the
+// traversal steps per ray and the node bytes per triangle of each; a layout whose hits differ from BVH2 fails.
+// Finally all models are instanced into one TLAS, built once in order on the main thread and once as a
+// task graph, where every BLAS build is a task and the TLAS build is their continuation.
+// --trace writes the CPU markers as a chrome://tracing file, one frame per model and one for the scene.
+// --tile N adds a mesh of N armadillo copies side by side, large enough for the parallel mode to bin its top
+// nodes on all workers (BVH::s_ParallelBinTriCount), none of the assets is.
+// The default asset directory is resolved against the repository (RTRT_ASSET_ROOT).
+//
+//	rtrt_bench [asset directory] [--threads N] [--grid N] [--runs N] [--tile N] [--json file] [--trace file]
+
+#include "Accelerations.h"
+#include "Task.h"
+#include "CpuProfiler.h"
+#include <chrono>
+#include <thread>
+
+#ifndef RTRT_ASSET_ROOT
+#define RTRT_ASSET_ROOT "."
+#endif
+
+using namespace rtrt;
+
+namespace
+{
+	using Clock = std::chrono::high_resolution_clock;
+
+	struct Options
+	{
+		std::string assetDir = RTRT_ASSET_ROOT "/Models/BVHAssets";
+		std::string jsonFile;
+		std::string traceFile;
+		uint threads = 0;	// 0 - all hardware threads
+		int gridSize = 512;
+		int runs = 3;
+		uint tileCount = 8;	// 0 - no tiled mesh
+	};
+
+	struct RayStats
+	{
+		double singleMrays = 0.0, parallelMrays = 0.0;
+		uint hits = 0;
+	};
+
+	struct BuildResult
+	{
+		const char* mode = "";
+		double buildMs = 0.0;
+		uint nodesUsed = 0, triIndexCount = 0;
+		size_t nodeBytes = 0, indexBytes = 0, blockBytes = 0;
+		float sahCost = 0.0f;
+		RayStats primary, shadow, diffuse, diffuseSorted;
+		double sortMs = 0.0;
+	};
+
+	struct LayoutResult
+	{
+		const char* name = "";
+		size_t nodeBytes = 0;
+		double nodeBytesPerTri = 0.0;
+		RayStats primary, diffuse;
+		double primarySteps = 0.0, diffuseSteps = 0.0;	// interior nodes visited per ray
+	};
+
+	struct SceneResult
+	{
+		double sequentialMs = 0.0, graphMs = 0.0;
+		uint tlasNodes = 0;
+	};
+
+	struct MeshResult
+	{
+		std::string name;
+		int triCount = 0;
+		size_t rayCount = 0;
+		std::vector<BuildResult> builds;
+		std::vector<LayoutResult> layouts;
+	};
+
+	// Deterministic per-ray random numbers, so that runs are comparable
+	inline uint WangHash(uint s)
+	{
+		s = (s ^ 61) ^ (s >> 16);
+		s *= 9; s = s ^ (s >> 4);
+		s *= 0x27d4eb2d;
+		s = s ^ (s >> 15);
+		return s;
+	}
+
+	inline float RandomFloat(uint& seed)
+	{
+		seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+		return (seed & 0xFFFFFF) * (1.0f / 16777216.0f);
+	}
+
+	// Rays through a grid covering the model, from a viewpoint in front of it (same setup as BVHApp)
+	void GeneratePrimaryRays(const Bounds& bounds, int gridSize, std::vector<Ray>& rays)
+	{
+		const float3 extent = bounds.Extent();
+		const float3 eye = bounds.Center() - float3(0.0f, 0.0f, 2.0f * glm::length(extent));
+		rays.clear();
+		rays.reserve((size_t)gridSize * gridSize);
+		for (int y = 0; y < gridSize; ++y)
+		{
+			for (int x = 0; x < gridSize; ++x)
+			{
+				float3 target{
+					bounds.bmin.x + (x + 0.5f) / gridSize * extent.x,
+					bounds.bmin.y + (y + 0.5f) / gridSize * extent.y,
+					bounds.Center().z };
+				rays.emplace_back(eye, glm::normalize(target - eye));
+			}
+		}
+	}
+
+	// Shadow rays towards a point light above the model, diffuse rays cosine distributed around the
+	// geometric normal. Both start at the primary hits, misses are dropped.
+	void GenerateSecondaryRays(const Mesh& mesh, BVH& bvh, const std::vector<Ray>& primaryRays,
+		std::vector<Ray>& shadowRays, std::vector<float>& shadowDistances, std::vector<Ray>& diffuseRays)
+	{
+		const Bounds bounds = bvh.AABB();
+		const float3 lightPos = bounds.Center() + float3(0.0f, bounds.Extent().y * 2.0f, -bounds.Extent().z);
+		const float epsilon = glm::length(bounds.Extent()) * 1e-5f;
+
+		shadowRays.clear(); shadowDistances.clear(); diffuseRays.clear();
+		for (size_t i = 0; i < primaryRays.size(); ++i)
+		{
+			Ray ray = primaryRays[i];
+			Intersection isect;
+			if (!bvh.Intersect(ray, isect, 0))
+				continue;
+
+			const Triangle& tri = mesh.m_Triangles[isect.inst_prim & 0xFFFFF];
+			float3 N = glm::normalize(glm::cross(tri.v1 - tri.v0, tri.v2 - tri.v0));
+			if (glm::dot(N, ray.rd) > 0.0f)
+				N = -N;
+			const float3 P = ray.ro + ray.rd * isect.t + N * epsilon;
+
+			const float3 L = lightPos - P;
+			const float distance = glm::length(L);
+			shadowRays.emplace_back(P, L / distance);
+			shadowDistances.push_back(distance);
+
+			uint seed = WangHash((uint)i + 1);
+			const float r0 = RandomFloat(seed), r1 = RandomFloat(seed);
+			const float r = std::sqrt(r0), phi = 2.0f * 3.14159265f * r1;
+			const float3 T = glm::normalize(std::abs(N.x) > 0.9f ? glm::cross(N, float3(0, 1, 0)) : glm::cross(N, float3(1, 0, 0)));
+			const float3 B = glm::cross(N, T);
+			const float3 D = T * (r * std::cos(phi)) + B * (r * std::sin(phi)) + N * std::sqrt(std::max(0.0f, 1.0f - r0));
+			diffuseRays.emplace_back(P, glm::normalize(D));
+		}
+	}
+
+	// Best-of-N throughput of one ray set, first on the calling thread, then spread over the task context
+	RayStats TraceRays(BVH& bvh, const std::vector<Ray>& rays, const std::vector<float>* pDistances, int runs)
+	{
+		RayStats stats;
+		if (rays.empty())
+			return stats;
+
+		auto traceRange = [&](uint begin, uint end)
+		{
+			uint hits = 0;
+			for (uint i = begin; i < end; ++i)
+			{
+				Ray ray = rays[i];
+				if (pDistances)
+					ray.tMax = (*pDistances)[i];
+				Intersection isect;
+				hits += bvh.Intersect(ray, isect, 0) ? 1 : 0;
+			}
+			return hits;
+		};
+
+		const uint rayCount = (uint)rays.size();
+		double best = 1e30;
+		for (int run = 0; run < runs; ++run)
+		{
+			auto start = Clock::now();
+			stats.hits = traceRange(0, rayCount);
+			best = std::min(best, std::chrono::duration<double>(Clock::now() - start).count());
+		}
+		stats.singleMrays = rayCount / best * 1e-6;
+
+		constexpr uint kGroupSize = 1024;
+		best = 1e30;
+		for (int run = 0; run < runs; ++run)
+		{
+			auto start = Clock::now();
+			if (Timo::g_TaskContext.GetThreadCount() == 0)
+			{
+				traceRange(0, rayCount);
+			}
+			else
+			{
+				Timo::TaskHandle handle = Timo::g_TaskContext.Dispatch([&](Timo::TaskParams params)
+				{
+					const uint begin = params.groupId * params.groupSize;
+					traceRange(begin, std::min(begin + params.groupSize, rayCount));
+				}, rayCount, kGroupSize);
+				Timo::g_TaskContext.Wait(handle);
+			}
+			best = std::min(best, std::chrono::duration<double>(Clock::now() - start).count());
+		}
+		stats.parallelMrays = rayCount / best * 1e-6;
+
+		return stats;
+	}
+
+	// Interior nodes visited per ray, counted on the calling thread
+	double CountStepsPerRay(BVH& bvh, const std::vector<Ray>& rays, uint& hits)
+	{
+		TraversalStats stats;
+		hits = 0;
+		for (const Ray& r : rays)
+		{
+			Ray ray = r;
+			Intersection isect;
+			hits += bvh.Intersect(ray, isect, 0, &stats) ? 1 : 0;
+		}
+		return rays.empty() ? 0.0 : (double)stats.nodeVisits / rays.size();
+	}
+
+	// Copies of a mesh in a grid of 4 columns, 10% apart
+	Mesh* CreateTiledMesh(const Mesh& src, uint tileCount)
+	{
+		Bounds bounds;
+		for (int i = 0; i < src.m_TriCount; ++i)
+			bounds.Union(src.m_Triangles[i].AABB());
+		const float3 spacing = bounds.Extent() * 1.1f;
+
+		Mesh* mesh = new Mesh(src.m_TriCount * tileCount);
+		for (uint tile = 0; tile < tileCount; ++tile)
+		{
+			const float3 offset(spacing.x * (tile % 4), spacing.y * (tile / 4), 0.0f);
+			Triangle* triangles = mesh->m_Triangles.get() + (size_t)tile * src.m_TriCount;
+			for (int i = 0; i < src.m_TriCount; ++i)
+			{
+				const Triangle& tri = src.m_Triangles[i];
+				triangles[i] = { tri.v0 + offset, tri.v1 + offset, tri.v2 + offset };
+			}
+			std::copy_n(src.m_TrianglesEx.get(), src.m_TriCount, mesh->m_TrianglesEx.get() + (size_t)tile * src.m_TriCount);
+		}
+		return mesh;
+	}
+
+	bool ParseOptions(int argc, char** argv, Options& options)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string arg = argv[i];
+			const bool bHasValue = i + 1 < argc;
+			if (arg == "--threads" && bHasValue)
+				options.threads = (uint)std::atoi(argv[++i]);
+			else if (arg == "--grid" && bHasValue)
+				options.gridSize = std::max(std::atoi(argv[++i]), 1);
+			else if (arg == "--runs" && bHasValue)
+				options.runs = std::max(std::atoi(argv[++i]), 1);
+			else if (arg == "--tile" && bHasValue)
+				options.tileCount = (uint)std::max(std::atoi(argv[++i]), 0);
+			else if (arg == "--json" && bHasValue)
+				options.jsonFile = argv[++i];
+			else if (arg == "--trace" && bHasValue)
+				options.traceFile = argv[++i];
+			else if (arg.rfind("--", 0) != 0)
+				options.assetDir = arg;
+			else
+				return false;
+		}
+		return true;
+	}
+
+	// One instance of each mesh side by side in a TLAS. The instance bounds depend on the BLAS, so they are
+	// updated once it is rebuilt, as part of the TLAS build.
+	SceneResult BenchmarkSceneBuild(const std::vector<std::unique_ptr<Mesh>>& meshes, int runs)
+	{
+		const uint meshCount = (uint)meshes.size();
+		std::vector<BVHInstance> instances(meshCount);
+		std::vector<glm::mat4> transforms(meshCount);
+		float offset = 0.0f;
+		for (uint i = 0; i < meshCount; ++i)
+		{
+			const Bounds& bounds = meshes[i]->m_BVH->AABB();
+			transforms[i] = glm::translate(float3(offset - bounds.bmin.x, 0.0f, 0.0f));
+			offset += bounds.Extent().x * 1.1f;
+			instances[i].Init(meshes[i]->m_BVH.get(), i, transforms[i]);
+		}
+
+		auto buildTLAS = [&](TLAS& tlas)
+		{
+			for (uint i = 0; i < meshCount; ++i)
+				instances[i].SetTransform(transforms[i]);
+			tlas.Build();
+		};
+
+		SceneResult result;
+		result.sequentialMs = result.graphMs = 1e30;
+		for (int run = 0; run < runs; ++run)
+		{
+			TLAS tlas(instances.data(), (int)meshCount);
+			auto start = Clock::now();
+			for (const auto& mesh : meshes)
+				mesh->m_BVH->Build(BVHBuildMode::Serial);
+			buildTLAS(tlas);
+			result.sequentialMs = std::min(result.sequentialMs, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+			result.tlasNodes = tlas.m_NodesUsed;
+		}
+		for (int run = 0; run < runs; ++run)
+		{
+			TLAS tlas(instances.data(), (int)meshCount);
+			auto start = Clock::now();
+			std::vector<Timo::TaskHandle> blasBuilds;
+			for (const auto& mesh : meshes)
+			{
+				BVH* bvh = mesh->m_BVH.get();
+				blasBuilds.push_back(Timo::g_TaskContext.Execute([bvh](Timo::TaskParams) { bvh->Build(BVHBuildMode::Serial); }));
+			}
+			Timo::TaskHandle tlasBuild = Timo::g_TaskContext.Execute([&](Timo::TaskParams) { buildTLAS(tlas); }, blasBuilds);
+			Timo::g_TaskContext.Wait(tlasBuild);
+			result.graphMs = std::min(result.graphMs, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+		}
+		return result;
+	}
+
+	void WriteJson(const char* fileName, const Options& options, uint threadCount, const std::vector<MeshResult>& results, const SceneResult& scene)
+	{
+		FILE* file = OpenFile(fileName, "w");
+		if (file == nullptr)
+		{
+			Printf("Could not write %s\n", fileName);
+			return;
+		}
+
+		auto writeRays = [file](const char* name, const RayStats& stats, bool bLast)
+		{
+			std::fprintf(file, "          \"%s\": { \"mrays_1t\": %.3f, \"mrays_mt\": %.3f, \"hits\": %u }%s\n",
+				name, stats.singleMrays, stats.parallelMrays, stats.hits, bLast ? "" : ",");
+		};
+
+		std::fprintf(file, "{\n  \"threads\": %u,\n  \"grid\": %d,\n  \"meshes\": [\n", threadCount, options.gridSize);
+		for (size_t m = 0; m < results.size(); ++m)
+		{
+			const MeshResult& mesh = results[m];
+			std::fprintf(file, "    {\n      \"name\": \"%s\",\n      \"triangles\": %d,\n      \"primary_rays\": %zu,\n      \"builds\": [\n",
+				mesh.name.c_str(), mesh.triCount, mesh.rayCount);
+			for (size_t b = 0; b < mesh.builds.size(); ++b)
+			{
+				const BuildResult& build = mesh.builds[b];
+				std::fprintf(file, "        {\n          \"mode\": \"%s\",\n          \"build_ms\": %.3f,\n          \"nodes\": %u,\n"
+					"          \"tri_indices\": %u,\n          \"node_bytes\": %zu,\n          \"index_bytes\": %zu,\n"
+					"          \"block_bytes\": %zu,\n          \"sah\": %.4f,\n",
+					build.mode, build.buildMs, build.nodesUsed, build.triIndexCount,
+					build.nodeBytes, build.indexBytes, build.blockBytes, build.sahCost);
+				writeRays("primary", build.primary, false);
+				writeRays("shadow", build.shadow, false);
+				writeRays("diffuse", build.diffuse, false);
+				writeRays("diffuse_sorted", build.diffuseSorted, false);
+				std::fprintf(file, "          \"sort_ms\": %.3f\n", build.sortMs);
+				std::fprintf(file, "        }%s\n", b + 1 < mesh.builds.size() ? "," : "");
+			}
+			std::fprintf(file, "      ],\n      \"layouts\": [\n");
+			for (size_t l = 0; l < mesh.layouts.size(); ++l)
+			{
+				const LayoutResult& layout = mesh.layouts[l];
+				std::fprintf(file, "        {\n          \"layout\": \"%s\",\n          \"node_bytes\": %zu,\n"
+					"          \"node_bytes_per_tri\": %.3f,\n          \"primary_steps\": %.3f,\n          \"diffuse_steps\": %.3f,\n",
+					layout.name, layout.nodeBytes, layout.nodeBytesPerTri, layout.primarySteps, layout.diffuseSteps);
+				writeRays("primary", layout.primary, false);
+				writeRays("diffuse", layout.diffuse, true);
+				std::fprintf(file, "        }%s\n", l + 1 < mesh.layouts.size() ? "," : "");
+			}
+			std::fprintf(file, "      ]\n    }%s\n", m + 1 < results.size() ? "," : "");
+		}
+		std::fprintf(file, "  ],\n  \"scene\": { \"sequential_ms\": %.3f, \"graph_ms\": %.3f, \"tlas_nodes\": %u }\n}\n",
+			scene.sequentialMs, scene.graphMs, scene.tlasNodes);
+		std::fclose(file);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		Printf("Usage: %s [asset directory] [--threads N] [--grid N] [--runs N] [--tile N] [--json file] [--trace file]\n", argv[0]);
+		return 1;
+	}
+
+	// Workers besides the main thread, Init() clamps to the hardware
+	const uint hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	const uint threads = options.threads == 0 ? hardwareThreads : options.threads;
+	if (threads > 1)
+		Timo::g_TaskContext.Init(threads - 1);
+	const uint threadCount = Timo::g_TaskContext.GetThreadCount() + 1;
+
+	std::vector<std::string> meshes = { "unity.tri", "armadillo.tri", "bigben.tri" };
+	const std::string tiledMesh = "armadillo.tri x" + std::to_string(options.tileCount);
+	if (options.tileCount > 0)
+		meshes.push_back(tiledMesh);
+	const struct { BVHBuildMode mode; const char* name; } buildModes[] =
+	{
+		{ BVHBuildMode::Serial, "serial" },
+		{ BVHBuildMode::Parallel, "parallel" },
+		{ BVHBuildMode::Spatial, "spatial" },
+	};
+	// Construction order first, every later layout is derived from the depth-first reordered tree
+	const struct { BVHLayout layout; bool bOptimize; const char* name; } layouts[] =
+	{
+		{ BVHLayout::Binary, false, "BVH2" },
+		{ BVHLayout::Binary, true, "BVH2 DFS" },
+		{ BVHLayout::Wide4, true, "MBVH4" },
+		{ BVHLayout::Wide8, true, "MBVH8" },
+		{ BVHLayout::Quantized, true, "QBVH" },
+	};
+
+	Printf("rtrt benchmark: %u threads, %dx%d primary rays, best of %d runs\n", threadCount, options.gridSize, options.gridSize, options.runs);
+
+	std::vector<MeshResult> results;
+	std::vector<Ray> primaryRays, shadowRays, diffuseRays, sortedRays;
+	std::vector<float> shadowDistances;
+	std::vector<uint> sortOrder;
+	RaySorter sorter;
+	bool bLayoutMismatch = false;
+	std::vector<std::unique_ptr<Mesh>> sceneMeshes;
+	Timo::g_CpuProfiler.SetThreadName("Main");
+	for (const std::string& meshName : meshes)
+	{
+		Timo::g_CpuProfiler.MarkFrame();
+
+		// the tiled mesh copies the armadillo loaded before it
+		Mesh* pMesh = meshName == tiledMesh ? CreateTiledMesh(*sceneMeshes[1], options.tileCount) :
+			new Mesh((options.assetDir + "/" + meshName).c_str());
+		Mesh& mesh = *sceneMeshes.emplace_back(pMesh);
+		mesh.Init();
+		BVH& bvh = *mesh.m_BVH;
+
+		MeshResult& meshResult = results.emplace_back();
+		meshResult.name = meshName;
+		meshResult.triCount = mesh.m_TriCount;
+		Printf("%s: %d tris\n", meshName.c_str(), mesh.m_TriCount);
+
+		for (const auto& buildMode : buildModes)
+		{
+			BuildResult& result = meshResult.builds.emplace_back();
+			result.mode = buildMode.name;
+
+			result.buildMs = 1e30;
+			for (int run = 0; run < options.runs; ++run)
+			{
+				auto start = Clock::now();
+				bvh.Build(buildMode.mode);
+				result.buildMs = std::min(result.buildMs, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+			}
+			result.nodesUsed = bvh.m_NodesUsed;
+			result.triIndexCount = bvh.m_TriIndexCount;
+			result.nodeBytes = bvh.GetNodeBytes();
+			result.indexBytes = (size_t)bvh.m_TriIndexCount * sizeof(uint);
+			result.blockBytes = (size_t)bvh.m_TriangleBlockCount * sizeof(TriangleBlock);
+			result.sahCost = bvh.CalculateSAHCost();
+
+			// The ray sets depend on the hits, so they are regenerated from the tree they are traced against
+			GeneratePrimaryRays(bvh.AABB(), options.gridSize, primaryRays);
+			GenerateSecondaryRays(mesh, bvh, primaryRays, shadowRays, shadowDistances, diffuseRays);
+			meshResult.rayCount = primaryRays.size();
+
+			result.primary = TraceRays(bvh, primaryRays, nullptr, options.runs);
+			result.shadow = TraceRays(bvh, shadowRays, &shadowDistances, options.runs);
+			result.diffuse = TraceRays(bvh, diffuseRays, nullptr, options.runs);
+
+			result.sortMs = 1e30;
+			for (int run = 0; run < options.runs; ++run)
+			{
+				auto start = Clock::now();
+				sorter.Init(bvh.AABB());
+				sorter.Sort(diffuseRays.data(), (uint)diffuseRays.size(), sortOrder);
+				result.sortMs = std::min(result.sortMs, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+			}
+			sortedRays.resize(diffuseRays.size());
+			for (size_t i = 0; i < sortedRays.size(); ++i)
+				sortedRays[i] = diffuseRays[sortOrder[i]];
+			result.diffuseSorted = TraceRays(bvh, sortedRays, nullptr, options.runs);
+
+			const double memoryMB = (result.nodeBytes + result.indexBytes + result.blockBytes) / (1024.0 * 1024.0);
+			Printf("    %-8s build %8.2f ms, %7u nodes, %7u refs, %6.2f MB, SAH %.3f\n",
+				result.mode, result.buildMs, result.nodesUsed, result.triIndexCount, memoryMB, result.sahCost);
+			Printf("             primary %7.2f / %7.2f Mrays/s, shadow %7.2f / %7.2f Mrays/s, diffuse %7.2f / %7.2f Mrays/s (1 / %u threads)\n",
+				result.primary.singleMrays, result.primary.parallelMrays, result.shadow.singleMrays, result.shadow.parallelMrays,
+				result.diffuse.singleMrays, result.diffuse.parallelMrays, threadCount);
+			Printf("             sorted diffuse %7.2f / %7.2f Mrays/s, sort %.2f ms\n",
+				result.diffuseSorted.singleMrays, result.diffuseSorted.parallelMrays, result.sortMs);
+		}
+
+		bvh.Build(BVHBuildMode::Serial);
+		GeneratePrimaryRays(bvh.AABB(), options.gridSize, primaryRays);
+		GenerateSecondaryRays(mesh, bvh, primaryRays, shadowRays, shadowDistances, diffuseRays);
+		Printf("    layouts of the serial tree (1 / %u threads)\n", threadCount);
+		uint binaryPrimaryHits = 0, binaryDiffuseHits = 0;
+		bool bOptimized = false;
+		for (const auto& layout : layouts)
+		{
+			bvh.SetLayout(BVHLayout::Binary);
+			if (layout.bOptimize && !bOptimized)
+			{
+				bvh.OptimizeLayout();
+				bOptimized = true;
+			}
+			bvh.SetLayout(layout.layout);
+
+			LayoutResult& result = meshResult.layouts.emplace_back();
+			result.name = layout.name;
+			result.nodeBytes = bvh.GetNodeBytes();
+			result.nodeBytesPerTri = (double)result.nodeBytes / mesh.m_TriCount;
+			uint primaryHits = 0, diffuseHits = 0;
+			result.primarySteps = CountStepsPerRay(bvh, primaryRays, primaryHits);
+			result.diffuseSteps = CountStepsPerRay(bvh, diffuseRays, diffuseHits);
+			result.primary = TraceRays(bvh, primaryRays, nullptr, options.runs);
+			result.diffuse = TraceRays(bvh, diffuseRays, nullptr, options.runs);
+
+			if (meshResult.layouts.size() == 1)
+			{
+				binaryPrimaryHits = primaryHits;
+				binaryDiffuseHits = diffuseHits;
+			}
+			const bool bMismatch = primaryHits != binaryPrimaryHits || diffuseHits != binaryDiffuseHits;
+			bLayoutMismatch |= bMismatch;
+			Printf("    %-8s primary %7.2f / %7.2f Mrays/s, %6.2f steps/ray, diffuse %7.2f / %7.2f Mrays/s, %6.2f steps/ray, %6.2f node bytes/tri%s\n",
+				result.name, result.primary.singleMrays, result.primary.parallelMrays, result.primarySteps,
+				result.diffuse.singleMrays, result.diffuse.parallelMrays, result.diffuseSteps, result.nodeBytesPerTri,
+				bMismatch ? " HIT MISMATCH" : "");
+		}
+		// Build() keeps a wide layout in sync, the scene build below should time the binary tree only
+		bvh.SetLayout(BVHLayout::Binary);
+	}
+
+	Timo::g_CpuProfiler.MarkFrame();
+	const SceneResult scene = BenchmarkSceneBuild(sceneMeshes, options.runs);
+	Printf("scene: %zu instances, %u TLAS nodes, build %.2f ms in order, %.2f ms as task graph\n",
+		sceneMeshes.size(), scene.tlasNodes, scene.sequentialMs, scene.graphMs);
+
+	if (!options.jsonFile.empty())
+		WriteJson(options.jsonFile.c_str(), options, threadCount, results, scene);
+	if (!options.traceFile.empty() && !Timo::g_CpuProfiler.ExportChromeTrace(options.traceFile))
+		Printf("Couldn't write %s\n", options.traceFile.c_str());
+
+	Timo::g_TaskContext.Destroy();
+	if (bLayoutMismatch)
+	{
+		Printf("Layout hits differ from BVH2\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,196 @@
+// Texture streaming against the descriptor free list (Core/DescriptorFreeList.h), on fake CPU heaps without a device.
+// Every frame loads a few textures, an SRV each and now and then a table of UAVs, and unloads random old ones
+// once the working set is full. Freed descriptors are fenced with the frame, the fence completes a few frames later.
+// Descriptors carry their owner and the fence they were freed with, so overlapping ranges and ranges reused before
+// their fence are caught. Heap counts are compared with the previous bump allocator, which never gave anything back.
+//
+//	descriptor_bench [--frames N] [--loads N] [--textures N] [--latency frames] [--seed N]
+
+#include "DescriptorFreeList.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+	using Clock = std::chrono::high_resolution_clock;
+	using namespace MyDirectX;
+
+	constexpr uint32_t kDescriptorsPerHeap = 256;	// DescriptorAllocator::s_NumDescriptorsPerHeap
+
+	struct Options
+	{
+		uint32_t frames = 4000;
+		uint32_t loads = 8;			// textures loaded per frame
+		uint32_t textures = 4096;	// working set
+		uint32_t latency = 3;		// frames until a fence completes
+		uint32_t seed = 1;
+	};
+
+	// what a descriptor of the fake heap holds
+	struct FakeDescriptor
+	{
+		uint32_t owner;
+		uint32_t freedFence;
+		uint8_t padding[24];
+	};
+
+	class FakeHeapSource : public DescriptorHeapSource
+	{
+	public:
+		size_t CreateHeap(uint32_t numDescriptors) override
+		{
+			m_Heaps.emplace_back(new FakeDescriptor[numDescriptors]());
+			return (size_t)m_Heaps.back().get();
+		}
+		uint32_t GetDescriptorSize() override { return (uint32_t)sizeof(FakeDescriptor); }
+		bool IsFenceComplete(uint64_t fenceValue) override { return fenceValue <= m_CompletedFence; }
+
+		void SetCompletedFence(uint64_t fenceValue) { m_CompletedFence = fenceValue; }
+		uint64_t GetCompletedFence() const { return m_CompletedFence; }
+
+	private:
+		std::vector<std::unique_ptr<FakeDescriptor[]>> m_Heaps;
+		uint64_t m_CompletedFence = 0;
+	};
+
+	// DescriptorAllocator before the free list: bump through 256-entry heaps, the tail of a heap is lost
+	class BumpAllocator
+	{
+	public:
+		void Allocate(uint32_t count)
+		{
+			if (m_Heaps == 0 || m_Remaining < count)
+			{
+				++m_Heaps;
+				m_Remaining = std::max(count, kDescriptorsPerHeap);
+			}
+			m_Remaining -= count;
+		}
+		uint32_t GetHeaps() const { return m_Heaps; }
+
+	private:
+		uint32_t m_Heaps = 0;
+		uint32_t m_Remaining = 0;
+	};
+
+	struct Texture
+	{
+		FakeDescriptor* descriptors;
+		uint32_t count;
+		uint32_t owner;
+	};
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		const std::string arg = argv[i];
+		if (arg == "--frames")
+			options.frames = (uint32_t)std::max(std::atoi(argv[i + 1]), 1);
+		else if (arg == "--loads")
+			options.loads = (uint32_t)std::max(std::atoi(argv[i + 1]), 1);
+		else if (arg == "--textures")
+			options.textures = (uint32_t)std::max(std::atoi(argv[i + 1]), 1);
+		else if (arg == "--latency")
+			options.latency = (uint32_t)std::max(std::atoi(argv[i + 1]), 0);
+		else if (arg == "--seed")
+			options.seed = (uint32_t)std::max(std::atoi(argv[i + 1]), 1);
+	}
+
+	FakeHeapSource source;
+	DescriptorFreeList freeList(source, "DescriptorBench.", kDescriptorsPerHeap);
+	BumpAllocator bump;
+
+	std::vector<Texture> textures;
+	uint32_t random = options.seed * 0x9E3779B9u;
+	auto nextRandom = [&random]
+	{
+		random ^= random << 13;
+		random ^= random >> 17;
+		random ^= random << 5;
+		return random;
+	};
+
+	uint64_t errors = 0, allocations = 0, frees = 0;
+	Clock::duration allocateTime{}, freeTime{};
+	uint32_t nextOwner = 1;
+
+	std::printf("descriptor_bench: %u frames, %u loads per frame, %u textures resident, fence latency %u frames\n",
+		options.frames, options.loads, options.textures, options.latency);
+	std::printf("%8s %12s %12s %12s %14s\n", "frame", "bump heaps", "heaps", "pending", "fragmentation");
+
+	for (uint32_t frame = 1; frame <= options.frames; ++frame)
+	{
+		source.SetCompletedFence(frame > options.latency ? frame - options.latency : 0);
+
+		for (uint32_t load = 0; load < options.loads; ++load)
+		{
+			// an SRV, one texture in 8 also gets a table of UAVs, one per mip
+			const uint32_t count = (nextRandom() & 7) == 0 ? 2 + nextRandom() % 11 : 1;
+
+			auto start = Clock::now();
+			FakeDescriptor* descriptors = (FakeDescriptor*)freeList.Allocate(count);
+			allocateTime += Clock::now() - start;
+			bump.Allocate(count);
+			++allocations;
+
+			const uint32_t owner = nextOwner++;
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				if (descriptors[i].owner != 0 || !source.IsFenceComplete(descriptors[i].freedFence))
+					++errors;
+				descriptors[i].owner = owner;
+			}
+			textures.push_back({ descriptors, count, owner });
+		}
+
+		while (textures.size() > options.textures)
+		{
+			const size_t index = nextRandom() % textures.size();
+			const Texture texture = textures[index];
+			textures[index] = textures.back();
+			textures.pop_back();
+
+			for (uint32_t i = 0; i < texture.count; ++i)
+			{
+				if (texture.descriptors[i].owner != texture.owner)
+					++errors;
+				texture.descriptors[i].owner = 0;
+				texture.descriptors[i].freedFence = frame;
+			}
+
+			auto start = Clock::now();
+			freeList.Free((size_t)texture.descriptors, frame);
+			freeTime += Clock::now() - start;
+			++frees;
+		}
+
+		if (frame % (options.frames / 8 > 0 ? options.frames / 8 : 1) == 0 || frame == options.frames)
+		{
+			const DescriptorFragmentationReport report = freeList.GetReport();
+			std::printf("%8u %12u %12u %12llu %14.3f\n", frame, bump.GetHeaps(), report.heaps,
+				(unsigned long long)report.pendingDescriptors, report.GetFragmentation());
+		}
+	}
+
+	std::printf("\n");
+	freeList.GetReport().Write(std::cout);
+	std::printf("%.1f ns per Allocate, %.1f ns per Free\n",
+		std::chrono::duration<double, std::nano>(allocateTime).count() / (double)std::max<uint64_t>(allocations, 1),
+		std::chrono::duration<double, std::nano>(freeTime).count() / (double)std::max<uint64_t>(frees, 1));
+
+	if (errors != 0)
+	{
+		std::printf("descriptor_bench: %llu descriptors overlapped or were reused before their fence\n", (unsigned long long)errors);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,308 @@
+// Descriptor table dedup of the dynamic descriptor heap (Core/DescriptorTableHashCache.h), without a device.
+// A frame is one command list drawing objects with random materials, sorted by material or not. Every draw stages
+// its material table of textures, a pass table of shared inputs is staged again every few draws, as the renderer
+// does. Stale tables are copied to a 1024-descriptor shader-visible heap, a full heap is retired and every bound
+// table goes stale, as in DynamicDescriptorHeap. Descriptors copied per frame are compared with and without the
+// cache, the fake GPU heap is checked against the tables bound from it.
+//
+//	table_cache_bench [--frames N] [--draws N] [--materials N] [--pass-interval draws] [--unsorted] [--seed N]
+
+#include "DescriptorTableHashCache.h"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace
+{
+	using Clock = std::chrono::high_resolution_clock;
+	using namespace MyDirectX;
+
+	constexpr uint32_t kNumDescriptorsPerHeap = 1024;	// DynamicDescriptorHeap::kNumDescriptorsPerHeap
+	constexpr uint32_t kMaxTableSize = 32;
+	constexpr size_t kDescriptorSize = 32;
+	constexpr size_t kCpuHeapStart = 0x10000;
+
+	struct Options
+	{
+		uint32_t frames = 200;
+		uint32_t draws = 3000;
+		uint32_t materials = 400;
+		uint32_t passInterval = 500;	// draws between pass table changes
+		bool sorted = true;
+		uint32_t seed = 1;
+	};
+
+	// DynamicDescriptorHeap::DescriptorTableCache
+	struct Table
+	{
+		size_t handles[kMaxTableSize] = {};
+		uint32_t assignedBitMap = 0;
+		bool stale = false;
+		uint64_t gpuPtr = 0;	// where it is bound
+		size_t hash = 0;
+		bool hashStale = true;
+		uint64_t boundGeneration = 0;	// of the cache when the handles were bound at gpuPtr, 0 - never
+
+		// DescriptorHandleCache::StageDescriptorHandles, the whole table at once
+		void Stage(const size_t* newHandles, uint32_t newBitMap)
+		{
+			bool changed = assignedBitMap != newBitMap;
+			for (uint64_t slots = newBitMap; slots != 0; slots &= slots - 1)
+			{
+				const int slot = std::countr_zero(slots);
+				changed |= handles[slot] != newHandles[slot];
+				handles[slot] = newHandles[slot];
+			}
+			assignedBitMap = newBitMap;
+			if (changed)
+			{
+				hashStale = true;
+				boundGeneration = 0;
+			}
+			stale = true;
+		}
+
+		size_t GetHash()
+		{
+			if (hashStale)
+			{
+				hash = DescriptorTableHashCache::HashTable(handles, assignedBitMap);
+				hashStale = false;
+			}
+			return hash;
+		}
+	};
+
+	// shader-visible heaps, a descriptor holds the CPU handle it was copied from
+	class FakeDynamicHeap
+	{
+	public:
+		explicit FakeDynamicHeap(bool useCache) : m_UseCache(useCache) {}
+
+		// DynamicDescriptorHeap::CopyAndBindStagedTables
+		void Commit(Table* tables, uint32_t numTables)
+		{
+			if (m_UseCache && m_Cache.GetSize() != 0)
+			{
+				for (uint32_t i = 0; i < numTables; ++i)
+				{
+					Table& table = tables[i];
+					if (!table.stale)
+						continue;
+
+					// restaged with the handles it is bound with, no lookup
+					const uint64_t gpuPtr = table.boundGeneration == m_Cache.GetGeneration() ? table.gpuPtr :
+						m_Cache.Find(table.GetHash(), table.handles, table.assignedBitMap);
+					if (gpuPtr == 0)
+						continue;
+
+					table.gpuPtr = gpuPtr;
+					table.boundGeneration = m_Cache.GetGeneration();
+					table.stale = false;
+					++m_Hits;
+					m_ReusedDescriptors += std::bit_width(table.assignedBitMap);
+				}
+			}
+
+			uint32_t neededSize = 0;
+			for (uint32_t i = 0; i < numTables; ++i)
+				neededSize += tables[i].stale ? std::bit_width(tables[i].assignedBitMap) : 0;
+			if (neededSize == 0)
+				return;
+
+			if (m_Offset + neededSize > kNumDescriptorsPerHeap)
+			{
+				// RetireCurrentHeap, UnbindAllValid
+				m_Heap.assign(kNumDescriptorsPerHeap, 0);
+				m_Offset = 0;
+				m_Cache.Clear();
+				++m_Heaps;
+
+				neededSize = 0;
+				for (uint32_t i = 0; i < numTables; ++i)
+				{
+					tables[i].stale = tables[i].assignedBitMap != 0;
+					neededSize += std::bit_width(tables[i].assignedBitMap);
+				}
+			}
+
+			for (uint32_t i = 0; i < numTables; ++i)
+			{
+				Table& table = tables[i];
+				if (!table.stale)
+					continue;
+
+				table.gpuPtr = GetGpuPtr(m_Offset);
+				if (m_UseCache)
+				{
+					m_Cache.Insert(table.GetHash(), table.handles, table.assignedBitMap, table.gpuPtr);
+					table.boundGeneration = m_Cache.GetGeneration();
+				}
+
+				for (uint64_t slots = table.assignedBitMap; slots != 0; slots &= slots - 1)
+				{
+					const int slot = std::countr_zero(slots);
+					m_Heap[m_Offset + slot] = table.handles[slot];
+				}
+				m_Offset += std::bit_width(table.assignedBitMap);
+				m_CopiedDescriptors += std::bit_width(table.assignedBitMap);
+				table.stale = false;
+			}
+		}
+
+		// what a draw would read through its bound tables
+		bool Validate(const Table* tables, uint32_t numTables) const
+		{
+			for (uint32_t i = 0; i < numTables; ++i)
+			{
+				const Table& table = tables[i];
+				const size_t offset = (size_t)(table.gpuPtr - GetGpuPtr(0)) / kDescriptorSize;
+				for (uint64_t slots = table.assignedBitMap; slots != 0; slots &= slots - 1)
+				{
+					const int slot = std::countr_zero(slots);
+					if (offset + slot >= m_Offset || m_Heap[offset + slot] != table.handles[slot])
+						return false;
+				}
+			}
+			return true;
+		}
+
+		// CleanupUsedHeaps, at the end of the command list
+		void EndFrame()
+		{
+			m_Offset = kNumDescriptorsPerHeap;
+			m_Cache.Clear();
+		}
+
+		uint64_t GetCopiedDescriptors() const { return m_CopiedDescriptors; }
+		uint64_t GetReusedDescriptors() const { return m_ReusedDescriptors; }
+		uint64_t GetHits() const { return m_Hits; }
+		uint64_t GetHeaps() const { return m_Heaps; }
+
+	private:
+		uint64_t GetGpuPtr(uint32_t offset) const { return ((uint64_t)m_Heaps << 32) + (uint64_t)offset * kDescriptorSize; }
+
+		const bool m_UseCache;
+		DescriptorTableHashCache m_Cache;
+		std::vector<size_t> m_Heap;
+		uint32_t m_Offset = kNumDescriptorsPerHeap;
+		uint64_t m_CopiedDescriptors = 0, m_ReusedDescriptors = 0, m_Hits = 0, m_Heaps = 0;
+	};
+
+	size_t GetCpuHandle(uint32_t texture) { return kCpuHeapStart + (size_t)texture * kDescriptorSize; }
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string arg = argv[i];
+		if (arg == "--unsorted")
+			options.sorted = false;
+		else if (i + 1 < argc)
+		{
+			const uint32_t value = (uint32_t)std::max(std::atoi(argv[++i]), 1);
+			if (arg == "--frames")
+				options.frames = value;
+			else if (arg == "--draws")
+				options.draws = value;
+			else if (arg == "--materials")
+				options.materials = value;
+			else if (arg == "--pass-interval")
+				options.passInterval = value;
+			else if (arg == "--seed")
+				options.seed = value;
+		}
+	}
+
+	uint32_t random = options.seed * 0x9E3779B9u;
+	auto nextRandom = [&random]
+	{
+		random ^= random << 13;
+		random ^= random >> 17;
+		random ^= random << 5;
+		return random;
+	};
+
+	// 3 to 6 textures, a few materials leave a slot empty, textures are shared now and then
+	const uint32_t numTextures = options.materials * 4;
+	std::vector<Table> materials(options.materials);
+	for (Table& material : materials)
+	{
+		const uint32_t count = 3 + nextRandom() % 4;
+		material.assignedBitMap = (1u << count) - 1;
+		if ((nextRandom() & 7) == 0)
+			material.assignedBitMap &= ~2u;
+		for (uint32_t slot = 0; slot < count; ++slot)
+			material.handles[slot] = GetCpuHandle(nextRandom() % numTextures);
+	}
+
+	FakeDynamicHeap plainHeap(false), cachedHeap(true);
+	FakeDynamicHeap* heaps[] = { &plainHeap, &cachedHeap };
+	Clock::duration commitTime[2] = {};
+	uint64_t errors = 0;
+
+	std::printf("table_cache_bench: %u frames, %u draws, %u materials, pass table every %u draws, %s\n",
+		options.frames, options.draws, options.materials, options.passInterval, options.sorted ? "sorted by material" : "unsorted");
+
+	std::vector<uint32_t> drawMaterials(options.draws);
+	for (uint32_t frame = 0; frame < options.frames; ++frame)
+	{
+		for (uint32_t& material : drawMaterials)
+			material = nextRandom() % options.materials;
+		if (options.sorted)
+			std::sort(drawMaterials.begin(), drawMaterials.end());
+
+		for (uint32_t h = 0; h < 2; ++h)
+		{
+			// root parameters: 0 - pass inputs (shadow map, SSAO, environment), 1 - material
+			Table tables[2];
+			auto start = Clock::now();
+			for (uint32_t draw = 0; draw < options.draws; ++draw)
+			{
+				if (draw % options.passInterval == 0)
+				{
+					const uint32_t pass = draw / options.passInterval;
+					size_t handles[3];
+					for (uint32_t slot = 0; slot < 3; ++slot)
+						handles[slot] = GetCpuHandle(numTextures + pass * 3 + slot);
+					tables[0].Stage(handles, 7);
+				}
+
+				// SetDynamicDescriptors stages the table and marks it stale, even when nothing changed
+				const Table& material = materials[drawMaterials[draw]];
+				tables[1].Stage(material.handles, material.assignedBitMap);
+
+				heaps[h]->Commit(tables, 2);
+				if (!heaps[h]->Validate(tables, 2))
+					++errors;
+			}
+			heaps[h]->EndFrame();
+			commitTime[h] += Clock::now() - start;
+		}
+	}
+
+	const double frames = (double)options.frames;
+	std::printf("%10s %22s %22s %14s %12s\n", "", "copied per frame", "reused per frame", "heaps/frame", "ms/frame");
+	for (uint32_t h = 0; h < 2; ++h)
+	{
+		std::printf("%10s %22.1f %22.1f %14.2f %12.3f\n", h == 0 ? "no cache" : "cache",
+			(double)heaps[h]->GetCopiedDescriptors() / frames, (double)heaps[h]->GetReusedDescriptors() / frames,
+			(double)heaps[h]->GetHeaps() / frames, std::chrono::duration<double, std::milli>(commitTime[h]).count() / frames);
+	}
+	std::printf("%.1f tables per frame bound from the cache, %.1f%% fewer descriptors copied\n",
+		(double)cachedHeap.GetHits() / frames,
+		100.0 * (1.0 - (double)cachedHeap.GetCopiedDescriptors() / (double)std::max<uint64_t>(plainHeap.GetCopiedDescriptors(), 1)));
+
+	if (errors != 0)
+	{
+		std::printf("table_cache_bench: %llu draws read descriptors that differ from their tables\n", (unsigned long long)errors);
+		return 1;
+	}
+	return 0;
+}
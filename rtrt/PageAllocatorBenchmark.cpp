@@ -0,0 +1,264 @@
+// Multithreaded stress test of the LinearAllocator page pool (Core/LinearAllocatorPagePool.h), with CPU memory
+// pages and a simulated fence: a "GPU" thread completes the signaled fences after a fixed latency.
+// Every thread runs its own linear allocator the way a command context does, retiring its pages with a new fence
+// at the end of each frame. Pages are checked to never be handed out while in use or before their fence completed.
+// Runs the pool with every call going through the lock (as before the thread caches) and with the thread caches.
+//
+//	page_bench [--allocs N] [--frame N] [--latency us] [--threads N] [--runs N]
+
+#include "LinearAllocatorPagePool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	using Clock = std::chrono::high_resolution_clock;
+	using namespace MyDirectX;
+
+	constexpr size_t kPageSize = 0x10000;	// kGpuAllocatorPageSize
+	constexpr size_t kAlignment = 256;		// DEFAULT_ALIGN
+
+	struct Options
+	{
+		uint32_t allocs = 1u << 18;	// per thread
+		uint32_t frame = 256;		// allocations between fences
+		uint32_t latency = 200;		// us from signal to completion
+		uint32_t threads = 0;		// 0 - max(hardware threads, 2)
+		int runs = 3;
+	};
+
+	struct CpuPage
+	{
+		explicit CpuPage(size_t size) : data(new uint8_t[size]), size(size) {  }
+
+		std::unique_ptr<uint8_t[]> data;
+		size_t size;
+		std::atomic_bool inUse{ false };
+		uint64_t retireFence = 0;
+	};
+
+	class SimulatedFence
+	{
+	public:
+		explicit SimulatedFence(uint32_t latencyUs)
+			: m_Gpu([this, latencyUs]
+				{
+					while (!m_Stop.load(std::memory_order_relaxed))
+					{
+						const uint64_t signaled = m_Signaled.load(std::memory_order_acquire);
+						std::this_thread::sleep_for(std::chrono::microseconds(latencyUs));
+						m_Completed.store(signaled, std::memory_order_release);
+					}
+				})
+		{
+		}
+		~SimulatedFence()
+		{
+			m_Stop.store(true, std::memory_order_relaxed);
+			m_Gpu.join();
+		}
+
+		uint64_t Signal() { return m_Signaled.fetch_add(1, std::memory_order_acq_rel) + 1; }
+		bool IsComplete(uint64_t fenceValue) const { return fenceValue <= m_Completed.load(std::memory_order_acquire); }
+
+	private:
+		std::atomic_uint64_t m_Signaled{ 0 };
+		std::atomic_uint64_t m_Completed{ 0 };
+		std::atomic_bool m_Stop{ false };
+		std::thread m_Gpu;
+	};
+
+	class CpuPageSource : public LinearPageSource<CpuPage>
+	{
+	public:
+		explicit CpuPageSource(const SimulatedFence& fence) : m_Fence(fence) {  }
+
+		CpuPage* CreateNewPage(size_t pageSize) override
+		{
+			m_CreatedPages.fetch_add(1, std::memory_order_relaxed);
+			return new CpuPage(pageSize == 0 ? kPageSize : pageSize);
+		}
+		size_t GetPageSize(CpuPage& page) override { return page.size; }
+		bool IsFenceComplete(uint64_t fenceValue) override { return m_Fence.IsComplete(fenceValue); }
+
+		uint64_t GetCreatedPages() const { return m_CreatedPages.load(std::memory_order_relaxed); }
+
+	private:
+		const SimulatedFence& m_Fence;
+		std::atomic_uint64_t m_CreatedPages{ 0 };
+	};
+
+	// LinearAllocator::Allocate / CleanupUsedPages on CPU pages
+	class CpuLinearAllocator
+	{
+	public:
+		CpuLinearAllocator(LinearPagePool<CpuPage>& pool, CpuPageSource& source, std::atomic_uint64_t& errors)
+			: m_Pool(pool), m_Source(source), m_Errors(errors)
+		{
+		}
+
+		uint8_t* Allocate(size_t sizeInBytes)
+		{
+			const size_t alignedSize = (sizeInBytes + kAlignment - 1) & ~(kAlignment - 1);
+
+			if (alignedSize > kPageSize)
+			{
+				CpuPage* oneOff = m_Pool.CreateLargePage(alignedSize);
+				m_LargePageList.push_back(oneOff);
+				return oneOff->data.get();
+			}
+
+			if (m_CurPage != nullptr && m_CurOffset + alignedSize > kPageSize)
+			{
+				m_RetiredPages.push_back(m_CurPage);
+				m_CurPage = nullptr;
+			}
+
+			if (m_CurPage == nullptr)
+			{
+				m_CurPage = m_Pool.RequestPage();
+				m_CurOffset = 0;
+
+				if (m_CurPage->inUse.exchange(true, std::memory_order_relaxed) || !m_Source.IsFenceComplete(m_CurPage->retireFence))
+					m_Errors.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			uint8_t* ret = m_CurPage->data.get() + m_CurOffset;
+			m_CurOffset += alignedSize;
+			return ret;
+		}
+
+		void CleanupUsedPages(uint64_t fenceID)
+		{
+			if (m_CurPage != nullptr)
+			{
+				m_RetiredPages.push_back(m_CurPage);
+				m_CurPage = nullptr;
+
+				for (CpuPage* page : m_RetiredPages)
+				{
+					page->retireFence = fenceID;
+					page->inUse.store(false, std::memory_order_relaxed);
+				}
+				m_Pool.DiscardPages(fenceID, m_RetiredPages);
+				m_RetiredPages.clear();
+			}
+
+			if (!m_LargePageList.empty())
+			{
+				m_Pool.FreeLargePages(fenceID, m_LargePageList);
+				m_LargePageList.clear();
+			}
+		}
+
+	private:
+		LinearPagePool<CpuPage>& m_Pool;
+		CpuPageSource& m_Source;
+		std::atomic_uint64_t& m_Errors;
+		CpuPage* m_CurPage = nullptr;
+		size_t m_CurOffset = 0;
+		std::vector<CpuPage*> m_RetiredPages;
+		std::vector<CpuPage*> m_LargePageList;
+	};
+
+	struct Result
+	{
+		double mallocsPerSecond = 0.0;	// millions, best of the runs
+		uint64_t pages = 0;				// pooled pages created, last run
+		double cacheHitRate = 0.0;		// page requests served without the lock, last run
+	};
+
+	Result Measure(const Options& options, uint32_t threads, size_t threadCachePages)
+	{
+		Result result;
+		double best = 1e30;
+		for (int run = 0; run < options.runs; ++run)
+		{
+			SimulatedFence fence(options.latency);
+			CpuPageSource source(fence);
+			LinearPagePool<CpuPage> pool(source, "PageBench.", threadCachePages);
+			std::atomic_uint64_t errors{ 0 };
+
+			auto start = Clock::now();
+			std::vector<std::thread> workers;
+			for (uint32_t t = 0; t < threads; ++t)
+			{
+				workers.emplace_back([&, t]
+					{
+						CpuLinearAllocator allocator(pool, source, errors);
+						uint32_t random = 0x9E3779B9u * (t + 1);
+						for (uint32_t i = 0; i < options.allocs; ++i)
+						{
+							random ^= random << 13;
+							random ^= random >> 17;
+							random ^= random << 5;
+
+							// mostly constants and small uploads, one in 4096 is larger than a page
+							const size_t size = (random & 0xFFF) == 0 ? kPageSize + 1 : 16 + (random >> 20);
+							*allocator.Allocate(size) = (uint8_t)i;
+
+							if ((i + 1) % options.frame == 0)
+								allocator.CleanupUsedPages(fence.Signal());
+						}
+						allocator.CleanupUsedPages(fence.Signal());
+						pool.FlushThreadCache();
+					});
+			}
+			for (auto& worker : workers)
+				worker.join();
+			best = std::min(best, std::chrono::duration<double>(Clock::now() - start).count());
+
+			if (errors.load() != 0)
+			{
+				std::printf("page_bench: %llu pages handed out while in use or in flight (%u threads)\n", (unsigned long long)errors.load(), threads);
+				std::exit(1);
+			}
+
+			const int64_t requests = Telemetry::Find("PageBench.PageRequests")->GetTotal();
+			const int64_t hits = Telemetry::Find("PageBench.ThreadCacheHits")->GetTotal();
+			result.pages = (uint64_t)Telemetry::Find("PageBench.Pages")->GetValue();
+			result.cacheHitRate = requests > 0 ? (double)hits / (double)requests : 0.0;
+		}
+		result.mallocsPerSecond = (double)options.allocs * threads / best * 1e-6;
+		return result;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		const std::string arg = argv[i];
+		if (arg == "--allocs")
+			options.allocs = (uint32_t)std::max(std::atoi(argv[i + 1]), 1);
+		else if (arg == "--frame")
+			options.frame = (uint32_t)std::max(std::atoi(argv[i + 1]), 1);
+		else if (arg == "--latency")
+			options.latency = (uint32_t)std::max(std::atoi(argv[i + 1]), 0);
+		else if (arg == "--threads")
+			options.threads = (uint32_t)std::max(std::atoi(argv[i + 1]), 1);
+		else if (arg == "--runs")
+			options.runs = std::max(std::atoi(argv[i + 1]), 1);
+	}
+
+	const uint32_t maxThreads = options.threads != 0 ? options.threads : std::max(std::thread::hardware_concurrency(), 2u);
+
+	std::printf("page_bench: %u allocations per thread, fence every %u, %u us fence latency, best of %d runs\n",
+		options.allocs, options.frame, options.latency, options.runs);
+	std::printf("%8s | %12s %8s | %12s %8s %10s\n", "threads", "locked M/s", "pages", "cached M/s", "pages", "lock-free");
+	for (uint32_t threads = 1; threads <= maxThreads; threads *= 2)
+	{
+		const Result locked = Measure(options, threads, 0);
+		const Result cached = Measure(options, threads, LinearPagePool<CpuPage>::kDefaultThreadCachePages);
+		std::printf("%8u | %12.2f %8llu | %12.2f %8llu %9.1f%%\n", threads,
+			locked.mallocsPerSecond, (unsigned long long)locked.pages,
+			cached.mallocsPerSecond, (unsigned long long)cached.pages, cached.cacheHitRate * 100.0);
+	}
+	return 0;
+}
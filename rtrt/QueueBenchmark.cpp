@@ -0,0 +1,116 @@
+// Throughput of the MPMC queues: Timo::MtQueue (mutex + condition variables) against Timo::MpmcQueue
+// (lock-free ring), both bounded to the same capacity, for 1..N producers times 1..N consumers.
+// Producers push their share of the items with the blocking Push(), consumers Pop() until they get
+// a stop value, the sum of everything popped is checked against the sum pushed.
+//
+//	queue_bench [--items N] [--capacity N] [--threads N] [--runs N]
+
+#include "mpmcqueue.h"
+#include "mtqueue.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	using Clock = std::chrono::high_resolution_clock;
+	using namespace Timo;
+
+	constexpr uint32_t kStop = ~0u;
+
+	struct Options
+	{
+		uint32_t items = 1u << 20;
+		uint32_t capacity = 1024;
+		uint32_t threads = 0;	// 0 - max(hardware threads, 2)
+		int runs = 3;
+	};
+
+	// Millions of items per second through the queue, best of the runs
+	template <typename TQueue>
+	double Measure(const Options& options, uint32_t producers, uint32_t consumers)
+	{
+		double best = 1e30;
+		for (int run = 0; run < options.runs; ++run)
+		{
+			TQueue queue(options.capacity);
+			std::vector<uint64_t> sums(consumers, 0);
+
+			auto start = Clock::now();
+			std::vector<std::thread> consumerThreads;
+			for (uint32_t c = 0; c < consumers; ++c)
+			{
+				consumerThreads.emplace_back([&queue, &sums, c]
+					{
+						uint64_t sum = 0;
+						for (uint32_t value = queue.Pop(); value != kStop; value = queue.Pop())
+							sum += value;
+						sums[c] = sum;
+					});
+			}
+
+			std::vector<std::thread> producerThreads;
+			for (uint32_t p = 0; p < producers; ++p)
+			{
+				producerThreads.emplace_back([&queue, &options, p, producers]
+					{
+						for (uint32_t i = p; i < options.items; i += producers)
+							queue.Push(i);
+					});
+			}
+			for (auto& thread : producerThreads)
+				thread.join();
+			for (uint32_t c = 0; c < consumers; ++c)
+				queue.Push(kStop);
+			for (auto& thread : consumerThreads)
+				thread.join();
+			best = std::min(best, std::chrono::duration<double>(Clock::now() - start).count());
+
+			uint64_t sum = 0;
+			for (uint64_t consumerSum : sums)
+				sum += consumerSum;
+			if (sum != (uint64_t)options.items * (options.items - 1) / 2)
+			{
+				std::printf("queue_bench: lost or duplicated items (%u producers, %u consumers)\n", producers, consumers);
+				std::exit(1);
+			}
+		}
+		return options.items / best * 1e-6;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		const std::string arg = argv[i];
+		if (arg == "--items")
+			options.items = (uint32_t)std::max(std::atoi(argv[i + 1]), 1);
+		else if (arg == "--capacity")
+			options.capacity = (uint32_t)std::max(std::atoi(argv[i + 1]), 2);
+		else if (arg == "--threads")
+			options.threads = (uint32_t)std::max(std::atoi(argv[i + 1]), 1);
+		else if (arg == "--runs")
+			options.runs = std::max(std::atoi(argv[i + 1]), 1);
+	}
+
+	const uint32_t maxThreads = options.threads != 0 ? options.threads : std::max(std::thread::hardware_concurrency(), 2u);
+
+	std::printf("queue_bench: %u items, capacity %u, best of %d runs, Mitems/s\n", options.items, options.capacity, options.runs);
+	std::printf("%10s %10s %12s %12s\n", "producers", "consumers", "MtQueue", "MpmcQueue");
+	for (uint32_t producers = 1; producers <= maxThreads; producers *= 2)
+	{
+		for (uint32_t consumers = 1; consumers <= maxThreads; consumers *= 2)
+		{
+			const double locked = Measure<MtQueue<uint32_t>>(options, producers, consumers);
+			const double lockFree = Measure<MpmcQueue<uint32_t>>(options, producers, consumers);
+			std::printf("%10u %10u %12.2f %12.2f\n", producers, consumers, locked, lockFree);
+		}
+	}
+	return 0;
+}
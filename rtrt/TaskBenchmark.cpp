@@ -0,0 +1,245 @@
+// Contention microbenchmark of Timo::Context.
+// Compares the work-stealing context against the previous design, kept here as LegacyContext: one
+// mutex/condvar MtQueue of std::function tasks, and a second queue of responses drained by Wait().
+// Global operator new is replaced by a counting one, allocations per task are measured on the last run,
+// after the queues have grown to their working size.
+//
+//	task_bench [--tasks N] [--work N] [--runs N]
+
+#include "Task.h"
+#include "mtqueue.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+static std::atomic_uint64_t g_AllocationCount{ 0 };
+
+// new[] and delete[] forward to these, over-aligned allocations are not counted
+void* operator new(std::size_t size)
+{
+	g_AllocationCount.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = std::malloc(size != 0 ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+	std::free(p);
+}
+
+namespace
+{
+	using Clock = std::chrono::high_resolution_clock;
+	using namespace Timo;
+
+	class LegacyContext
+	{
+	public:
+		~LegacyContext() { Destroy(); }
+
+		void Init(uint32_t numThreads)
+		{
+			for (uint32_t i = 0; i < numThreads; i++)
+				m_Threads.emplace_back(&LegacyContext::WorkerEntry, this);
+		}
+
+		void Destroy()
+		{
+			for (size_t i = 0; i < m_Threads.size(); i++)
+				m_TaskQueue.Push({ .params = { .id = Context::kInvalidTaskId }, .func = {} });
+			Wait();
+			m_Threads.clear();
+		}
+
+		void Execute(const std::function<void(TaskParams)>& taskImpl)
+		{
+			uint32_t taskId = m_Counter.fetch_add(1);
+			m_TaskQueue.Push({ .params = { .id = taskId }, .func = taskImpl });
+		}
+
+		void Dispatch(const std::function<void(TaskParams)>& taskImpl, uint32_t dispatchSize, uint32_t groupSize = Context::kDefaultGroupSize)
+		{
+			uint32_t groupCount = (dispatchSize + groupSize - 1) / groupSize;
+			uint32_t taskId = m_Counter.fetch_add(groupCount);
+			for (uint32_t groupId = 0; groupId < groupCount; ++groupId)
+				m_TaskQueue.Push({ .params = { .id = taskId, .groupId = groupId, .groupSize = groupSize }, .func = taskImpl });
+		}
+
+		void Wait()
+		{
+			while (m_Counter > 0)
+			{
+				if (m_ResponseQueue.TryPop())
+					--m_Counter;
+				std::this_thread::yield();
+			}
+		}
+
+	private:
+		struct Task
+		{
+			TaskParams params;
+			std::function<void(TaskParams)> func;
+		};
+		struct TaskResult {};
+
+		void WorkerEntry()
+		{
+			while (true)
+			{
+				auto task = m_TaskQueue.Pop();
+				if (task.params.id == Context::kInvalidTaskId)
+					break;
+				task.func(task.params);
+				m_ResponseQueue.Push(TaskResult{});
+			}
+		}
+
+		MtQueue<Task> m_TaskQueue;
+		MtQueue<TaskResult> m_ResponseQueue;
+		std::vector<std::jthread> m_Threads;
+		std::atomic_uint32_t m_Counter{ 0 };
+	};
+
+	struct Options
+	{
+		uint32_t tasks = 1u << 16;
+		uint32_t work = 64;		// inner loop iterations per task
+		int runs = 3;
+	};
+
+	// A few dependent multiply-adds, small enough that the scheduler overhead dominates
+	inline float Work(uint32_t seed, uint32_t iterations)
+	{
+		float x = (float)seed;
+		for (uint32_t i = 0; i < iterations; ++i)
+			x = x * 0.999f + 1.0f;
+		return x;
+	}
+
+	struct Result
+	{
+		double mtasks = 0.0;
+		double allocations = 0.0;	// per task
+	};
+
+	// Millions of tasks per second, best of the runs, and the allocations of the last run
+	template <typename TContext, typename Func>
+	Result BestOf(TContext& context, int runs, uint32_t taskCount, const Func& func)
+	{
+		double best = 1e30;
+		uint64_t allocations = 0;
+		for (int run = 0; run < runs; ++run)
+		{
+			const uint64_t firstAllocation = g_AllocationCount.load();
+			auto start = Clock::now();
+			func(context);
+			context.Wait();
+			best = std::min(best, std::chrono::duration<double>(Clock::now() - start).count());
+			allocations = g_AllocationCount.load() - firstAllocation;
+		}
+		return { taskCount / best * 1e-6, (double)allocations / taskCount };
+	}
+
+	// The four submission patterns, ParallelFor() only exists on the work-stealing context
+	template <typename TContext>
+	void Measure(TContext& context, const Options& options, std::vector<float>& results, Result (&measured)[4])
+	{
+		const uint32_t taskCount = options.tasks, work = options.work;
+		auto task = [&](TaskParams params)
+		{
+			const uint32_t i = params.groupId * params.groupSize;
+			for (uint32_t j = i, jmax = std::min(i + params.groupSize, taskCount); j < jmax; ++j)
+				results[j] = Work(j, work);
+		};
+
+		// One dispatch of single element groups
+		measured[0] = BestOf(context, options.runs, taskCount, [&](TContext& c) { c.Dispatch(task, taskCount, 1); });
+
+		// Many small dispatches of 64 groups
+		constexpr uint32_t kBatch = 64;
+		measured[1] = BestOf(context, options.runs, taskCount, [&](TContext& c)
+			{
+				for (uint32_t i = 0; i < taskCount; i += kBatch)
+					c.Dispatch(task, kBatch, 1);
+			});
+
+		// Independent Execute() calls
+		measured[2] = BestOf(context, options.runs, taskCount, [&](TContext& c)
+			{
+				for (uint32_t i = 0; i < taskCount; ++i)
+					c.Execute([&results, i, work](TaskParams) { results[i] = Work(i, work); });
+			});
+
+		// The same loops of 64 elements as ParallelFor(), which doesn't allocate
+		if constexpr (requires { context.ParallelFor(0u, 1u, [](uint32_t) {}); })
+		{
+			measured[3] = BestOf(context, options.runs, taskCount, [&](TContext& c)
+				{
+					for (uint32_t i = 0; i < taskCount; i += kBatch)
+						c.ParallelFor(kBatch, 1, [&results, i, work](uint32_t j) { results[i + j] = Work(i + j, work); });
+				});
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		const std::string arg = argv[i];
+		if (arg == "--tasks")
+			options.tasks = (uint32_t)std::max(std::atoi(argv[i + 1]), 1);
+		else if (arg == "--work")
+			options.work = (uint32_t)std::max(std::atoi(argv[i + 1]), 0);
+		else if (arg == "--runs")
+			options.runs = std::max(std::atoi(argv[i + 1]), 1);
+	}
+
+	const uint32_t maxWorkers = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+	std::vector<float> results(options.tasks);
+
+	std::printf("task_bench: %u tasks, %u iterations per task, best of %d runs, Mtasks/s (allocations per task)\n", options.tasks, options.work, options.runs);
+	std::printf("%8s  %-16s %18s %18s %18s %18s\n", "workers", "context", "dispatch", "batches", "execute", "parallel for");
+	auto print = [](const Result& result)
+	{
+		if (result.mtasks > 0.0)
+			std::printf(" %9.2f (%6.3f)", result.mtasks, result.allocations);
+		else
+			std::printf(" %18s", "-");
+	};
+	for (uint32_t workers = 1; ; workers = std::min(workers * 2, maxWorkers))
+	{
+		Result legacy[4], stealing[4];
+		{
+			LegacyContext context;
+			context.Init(workers);
+			Measure(context, options, results, legacy);
+		}
+		{
+			Context context;
+			context.Init(workers);
+			Measure(context, options, results, stealing);
+		}
+		std::printf("%8u  %-16s", workers, "mutex queue");
+		for (const Result& result : legacy)
+			print(result);
+		std::printf("\n%8s  %-16s", "", "work stealing");
+		for (const Result& result : stealing)
+			print(result);
+		std::printf("\n");
+
+		if (workers == maxWorkers)
+			break;
+	}
+	return 0;
+}
@@ -0,0 +1,160 @@
+// Vertex stream conversion kernels (Core/VertexConversion.h) against a converter that switches on the component type
+// and normalization for every element, as the importers did. Each case converts a packed source stream into one
+// attribute of interleaved 48-byte vertices, the results of both paths must match bit for bit.
+//
+//	vertex_bench [--vertices N] [--repeat N]
+
+#include "VertexConversion.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace
+{
+	using Clock = std::chrono::high_resolution_clock;
+	using namespace MyDirectX;
+
+	constexpr size_t kVertexStride = 48;
+
+	struct Options
+	{
+		uint32_t vertices = 1 << 20;
+		uint32_t repeat = 10;
+	};
+
+	struct Case
+	{
+		const char* name;
+		VertexFormat src;
+		VertexFormat dst;
+	};
+
+	float ReadComponent(const uint8_t* src, VertexComponent component, bool normalized)
+	{
+		switch (component)
+		{
+		case VertexComponent::Int8: { int8_t v; std::memcpy(&v, src, 1); return normalized ? std::max(v * (1.0f / 127.0f), -1.0f) : (float)v; }
+		case VertexComponent::UInt8: { uint8_t v; std::memcpy(&v, src, 1); return normalized ? v * (1.0f / 255.0f) : (float)v; }
+		case VertexComponent::Int16: { int16_t v; std::memcpy(&v, src, 2); return normalized ? std::max(v * (1.0f / 32767.0f), -1.0f) : (float)v; }
+		case VertexComponent::UInt16: { uint16_t v; std::memcpy(&v, src, 2); return normalized ? v * (1.0f / 65535.0f) : (float)v; }
+		case VertexComponent::UInt32: { uint32_t v; std::memcpy(&v, src, 4); return (float)v; }
+		default: { float v; std::memcpy(&v, src, 4); return v; }
+		}
+	}
+
+	// the per-element path: a switch for every component
+	void ConvertPerElement(const Case& c, const uint8_t* src, size_t srcStride, uint8_t* dst, size_t dstStride, size_t count)
+	{
+		const uint32_t componentSize = c.src.GetSize() / c.src.count;
+		for (size_t i = 0; i < count; ++i, src += srcStride, dst += dstStride)
+		{
+			for (uint32_t k = 0; k < c.dst.count; ++k)
+			{
+				const float value = k < c.src.count ? ReadComponent(src + k * componentSize, c.src.component, c.src.normalized) : 0.0f;
+				if (c.dst.component == VertexComponent::Float)
+					std::memcpy(dst + k * 4, &value, 4);
+				else if (c.dst.component == VertexComponent::UInt16)
+				{
+					uint32_t index;
+					std::memcpy(&index, src, 4);
+					const uint16_t index16 = (uint16_t)(componentSize == 4 ? index : (componentSize == 2 ? (index & 0xFFFF) : (index & 0xFF)));
+					std::memcpy(dst, &index16, 2);
+				}
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		const std::string arg = argv[i];
+		if (arg == "--vertices")
+			options.vertices = (uint32_t)std::max(std::atoi(argv[i + 1]), 1);
+		else if (arg == "--repeat")
+			options.repeat = (uint32_t)std::max(std::atoi(argv[i + 1]), 1);
+	}
+
+	const Case cases[] =
+	{
+		{ "float3 -> float3", { VertexComponent::Float, 3 }, { VertexComponent::Float, 3 } },
+		{ "float4 -> float4", { VertexComponent::Float, 4 }, { VertexComponent::Float, 4 } },
+		{ "float3 -> float2", { VertexComponent::Float, 3 }, { VertexComponent::Float, 2 } },
+		{ "unorm8x4 -> float4", { VertexComponent::UInt8, 4, true }, { VertexComponent::Float, 4 } },
+		{ "unorm16x2 -> float2", { VertexComponent::UInt16, 2, true }, { VertexComponent::Float, 2 } },
+		{ "snorm8x3 -> float3", { VertexComponent::Int8, 3, true }, { VertexComponent::Float, 3 } },
+		{ "uint32 -> uint16", { VertexComponent::UInt32, 1 }, { VertexComponent::UInt16, 1 } },
+	};
+
+	// random bytes, float components get values that round trip
+	const size_t count = options.vertices;
+	std::vector<uint8_t> source(count * 16 + 16);
+	uint32_t random = 0x9E3779B9u;
+	for (size_t i = 0; i < source.size(); i += 4)
+	{
+		random ^= random << 13;
+		random ^= random >> 17;
+		random ^= random << 5;
+		const float value = (float)(random & 0xFFFF) / 256.0f;
+		std::memcpy(&source[i], &value, 4);
+	}
+
+	std::vector<uint8_t> expected(count * kVertexStride), actual(count * kVertexStride);
+	uint32_t errors = 0;
+
+	std::printf("vertex_bench: %u vertices, %u runs, into %zu-byte vertices\n", options.vertices, options.repeat, kVertexStride);
+	std::printf("%22s %16s %16s %10s\n", "", "per element ms", "kernel ms", "speedup");
+	for (const Case& c : cases)
+	{
+		const size_t srcStride = c.src.GetSize();
+		const VertexConverter convert = GetVertexConverter(c.src, c.dst);
+		if (convert == nullptr)
+		{
+			std::printf("%22s no kernel\n", c.name);
+			++errors;
+			continue;
+		}
+
+		// uint32 indices only in range of uint16
+		if (c.src.component == VertexComponent::UInt32)
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				const uint32_t index = (uint32_t)(i * 7919 % 65536);
+				std::memcpy(&source[i * 4], &index, 4);
+			}
+		}
+
+		std::fill(expected.begin(), expected.end(), uint8_t(0xCD));
+		std::fill(actual.begin(), actual.end(), uint8_t(0xCD));
+
+		auto start = Clock::now();
+		for (uint32_t r = 0; r < options.repeat; ++r)
+			ConvertPerElement(c, source.data(), srcStride, expected.data() + 4, kVertexStride, count);
+		const double perElementMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / options.repeat;
+
+		start = Clock::now();
+		for (uint32_t r = 0; r < options.repeat; ++r)
+			convert(source.data(), srcStride, actual.data() + 4, kVertexStride, count);
+		const double kernelMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / options.repeat;
+
+		// the bytes around the attribute must stay untouched as well
+		const bool match = expected == actual;
+		if (!match)
+			++errors;
+		std::printf("%22s %16.3f %16.3f %9.2fx%s\n", c.name, perElementMs, kernelMs, perElementMs / std::max(kernelMs, 1e-6),
+			match ? "" : "  MISMATCH");
+	}
+
+	if (errors != 0)
+	{
+		std::printf("vertex_bench: %u cases failed\n", errors);
+		return 1;
+	}
+	return 0;
+}
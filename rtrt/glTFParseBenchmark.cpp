@@ -0,0 +1,105 @@
+// JSON parse of a glTF file, the in-situ parser of the importer (Game/glTFJsonParser.h) against the DOM parse it
+// replaced: the file read into a string with stream iterators, then Document::Parse() copying every string into a new
+// document. The in-situ parser keeps its buffers and pool between runs, as between the loads of the importer. Memory
+// is the text and allocator capacity after a parse, both documents must compare equal.
+//
+// The default file is resolved against the repository (RTRT_ASSET_ROOT), so that it runs from the build directory.
+//
+//	gltf_bench [file.gltf] [--repeat N]
+
+#include "glTFJsonParser.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#ifndef RTRT_ASSET_ROOT
+#define RTRT_ASSET_ROOT "."
+#endif
+
+namespace
+{
+	using Clock = std::chrono::high_resolution_clock;
+
+	struct Options
+	{
+		std::string path = RTRT_ASSET_ROOT "/Models/buster_drone.gltf";
+		uint32_t repeat = 50;
+	};
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string arg = argv[i];
+		if (arg == "--repeat" && i + 1 < argc)
+			options.repeat = (uint32_t)std::max(std::atoi(argv[++i]), 1);
+		else
+			options.path = arg;
+	}
+
+	// the DOM path, as glTFImporter::Load read .gltf files
+	size_t domMemory = 0;
+	rapidjson::Document reference;
+	auto start = Clock::now();
+	for (uint32_t r = 0; r < options.repeat; ++r)
+	{
+		std::ifstream ifs(options.path);
+		if (!ifs.is_open())
+		{
+			std::printf("gltf_bench: can't open %s\n", options.path.c_str());
+			return 1;
+		}
+		const std::string json((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+
+		rapidjson::Document dom;
+		if (dom.Parse(json.c_str()).HasParseError())
+		{
+			std::printf("gltf_bench: parse error %d at %zu\n", (int)dom.GetParseError(), dom.GetErrorOffset());
+			return 1;
+		}
+		domMemory = json.capacity() + dom.GetAllocator().Capacity();
+		if (r + 1 == options.repeat)
+			reference.Swap(dom);
+	}
+	const double domMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / options.repeat;
+
+	glTF::glTFJsonParser parser;
+	size_t firstMemory = 0;
+	bool match = true;
+	start = Clock::now();
+	for (uint32_t r = 0; r < options.repeat; ++r)
+	{
+		const rapidjson::Document* dom = parser.ParseFile(options.path);
+		if (dom == nullptr)
+		{
+			std::printf("gltf_bench: %s\n", parser.GetError().c_str());
+			return 1;
+		}
+		if (r == 0)
+			firstMemory = parser.GetMemoryUsage();
+		if (r + 1 == options.repeat)
+			match = *dom == reference;
+	}
+	const double insituMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / options.repeat;
+	const size_t insituMemory = parser.GetMemoryUsage();
+
+	std::printf("gltf_bench: %s, %u runs\n", options.path.c_str(), options.repeat);
+	std::printf("%10s %12s %14s\n", "", "ms/parse", "memory KB");
+	std::printf("%10s %12.3f %14.1f\n", "DOM", domMs, domMemory / 1024.0);
+	std::printf("%10s %12.3f %14.1f\n", "in situ", insituMs, insituMemory / 1024.0);
+	std::printf("%.2fx faster, %.1f%% less memory, first parse %.1f KB\n", domMs / std::max(insituMs, 1e-6),
+		100.0 * (1.0 - (double)insituMemory / (double)std::max<size_t>(domMemory, 1)), firstMemory / 1024.0);
+
+	if (!match)
+	{
+		std::printf("gltf_bench: the in-situ document differs from the DOM\n");
+		return 1;
+	}
+	return 0;
+}